@@ -6,70 +6,77 @@
 #include "esp_sleep.h"
 
 #include "W25N01GV.h"
+#include "W25N01GV_log.h"
+#include "W25N01GV_stage.h"
 
 #define N_SAMPLES 10// Amount of real input samples
+#define READ_EVERY_COMMITS 4 // The log is read back once every few commits
 
 constexpr static uint8_t sleep_seconds = 2;
 
 static const char *TAG = "w25_memory";
 
-RTC_DATA_ATTR static bool write; //This variable persists the deep_sleep
+RTC_DATA_ATTR static uint32_t commits; //Commits since the first boot, this variable persists the deep_sleep
+RTC_DATA_ATTR static w25_log_state_t log_state; //Write position of the log, no flash scan is needed after a deep sleep
+RTC_DATA_ATTR static w25_rtc_stage_t stage; //Samples waiting for the next commit
 
 extern "C" void app_main(){
 
-	esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
+	if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER){
+		commits = 0; //The very first time the esp32 is powered on, the stage is dropped by w25_StageInit as well
+	}
 
-	if (wakeup_reason == ESP_SLEEP_WAKEUP_TIMER){
+	//Commits when the next wake up couldn't stage its samples anymore, so a commit programs a whole page.
+	//The 5 minutes deadline only bounds the samples lost on a power loss, the page fills up in about 100s
+	w25_StageInit(&stage, sizeof(float), (W25_PAGE_SIZE/sizeof(float)) - N_SAMPLES, 300U);
 
-		//MEMORY STARTING ROUTINE - START%%%%%%%%%%%%%%%%%%%
-    	winbond_t *flash_memory = init_w25_struct(sizeof(float)*N_SAMPLES+4); //This +4 is just a workaround for a current bug
-    
-    	ESP_ERROR_CHECK(vspi_w25_alloc_bus(flash_memory)); //Allocates the vspi bus
-    
-    	w25_Initialize(flash_memory); //Initializes the handler
-    	//MEMORY STARTING ROUTINE - END%%%%%%%%%%%%%%%%%%%%
+	//Every wake up stages its samples in RTC memory, the flash stays asleep until a page worth of them is staged
+	float payload[N_SAMPLES] = {1.4,4.7,6.0,26.6597,17.12,97,0.23,7.8,12.85,0}; //Samples that will be written into the memory
+	for (int i = 0; i < N_SAMPLES; i++){
+		ESP_ERROR_CHECK(w25_StagePush(&stage, &payload[i]));
+	}
+	ESP_LOGI(TAG, "%u samples staged", (unsigned int)w25_StageCount(&stage));
 
-		if (write){ //Routine that writes the values into the memory
+	if (w25_StageCommitDue(&stage)){
 
-			ESP_LOGE(TAG, "WRITE!");
+		//MEMORY STARTING ROUTINE - START%%%%%%%%%%%%%%%%%%%
+		winbond_t *flash_memory = init_w25_struct(W25_PAGE_SIZE + 4);
 
-			float payload[N_SAMPLES] = {1.4,4.7,6.0,26.6597,17.12,97,0.23,7.8,12.85,0}; //Array that will be written into the memory
-			uint8_t *payloadUINT8_T = (uint8_t *)&payload[0]; //Since the memory accepts uint8_t converts it without changing the values
-			//if the payload was a uint8_t, the conversion wouldn't be necessary
+		ESP_ERROR_CHECK(vspi_w25_alloc_bus(flash_memory)); //Allocates the vspi bus
 
-    		ESP_ERROR_CHECK(w25_BlockErase(flash_memory, 0x0000, 20U)); //The memory's block needs to be erased before writing in the address
-    		ESP_ERROR_CHECK(w25_WriteMemory(flash_memory, 0x0000, 0x0000, payloadUINT8_T, sizeof(float)*N_SAMPLES)); 
-    		//Since the float has 4x the size of an uint8_t, the samples' number has to be multiplied by sizeof(float)
+		w25_Initialize(flash_memory); //Initializes the handler
 
-			write = false; //when the esp32 wakes from the deep sleep, it'll enter the Read path
+		//Each sample is a record of the circular log kept on blocks 0 to 7, the oldest samples are dropped once it's full
+		const w25_log_config_t log_config = {0, 8, sizeof(float), 1};
+		w25_log_t *samples_log = NULL;
+		ESP_ERROR_CHECK(w25_LogOpen(flash_memory, &log_config, &log_state, &samples_log));
+		//MEMORY STARTING ROUTINE - END%%%%%%%%%%%%%%%%%%%%
 
-		}else{
-			
-			ESP_LOGE(TAG, "READ!");
+		ESP_LOGE(TAG, "COMMIT %u SAMPLES!", (unsigned int)w25_StageCount(&stage));
+		ESP_ERROR_CHECK(w25_StageCommit(&stage, samples_log)); //The log finds the address and erases the blocks ahead by itself
+		commits++;
 
-    		//Since the float has 4x the size of an uint8_t, the samples' number has to be multiplied by sizeof(float)
-			uint8_t payloadUINT8_T[sizeof(float)*N_SAMPLES]{0}; 
+		if ((commits % READ_EVERY_COMMITS) == 0){ //The memory is up anyway, the samples committed so far are read back
 
-			w25_ReadMemory(flash_memory, 0x0000, 0x0000, &payloadUINT8_T[0], sizeof(float)*N_SAMPLES);
+			ESP_LOGE(TAG, "READ!");
 
-			float *payload = (float *)&payloadUINT8_T[0]; //Converts back to float without changing the values
+			w25_log_reader_t reader;
+			float sample = 0;
+			w25_LogReaderInit(samples_log, &reader); //Every sample written so far, from the oldest one
 
-			for (int i = 0; i < N_SAMPLES; i++) //Now, payload has N_SAMPLES values again
+			while (w25_LogRead(samples_log, &reader, &sample) == ESP_OK)
 			{		
-				ESP_LOGW(TAG,"%f\n", payload[i]);
+				ESP_LOGW(TAG,"%f\n", sample);
 			}
-
-			write = true; //when the esp32 wakes from the deep sleep, it'll enter the Write path
 		}
-		//DEINIT MEMORY - START%%%%%%%%%%%%%%%%%%%%%%%%%%%
-    	ESP_LOGW("tag","FREE BUS: %s",esp_err_to_name(vspi_w25_free_bus(flash_memory)));
-    	ESP_LOGW("tag","FREE STRUCT: %s",esp_err_to_name(deinit_w25_struct(flash_memory)));
-    	//DEINIT MEMORY - END%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-	}else{
-		write = true; //Initializes the variable the very first time the esp32 is powered on
+		//DEINIT MEMORY - START%%%%%%%%%%%%%%%%%%%%%%%%%%%
+		ESP_ERROR_CHECK(w25_LogClose(samples_log));
+		ESP_LOGW("tag","FREE BUS: %s",esp_err_to_name(vspi_w25_free_bus(flash_memory)));
+		ESP_LOGW("tag","FREE STRUCT: %s",esp_err_to_name(deinit_w25_struct(flash_memory)));
+		//DEINIT MEMORY - END%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 	}
 
 	esp_deep_sleep(sleep_seconds*1000000); //Sleeps for 2 seconds
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "W25N01GV.h"
+#include "W25N01GV_series.h"
+#include "host_shim.h"
+#include "w25_emulator.h"
+
+//Throughput and latency of the driver against the emulated memory, in virtual time: what the same calls
+//would take on an ESP32 with the configured clock and bus mode, give or take the setup overhead per transaction.
+//w25_bench [--mode single|dual|quad] [--clock hz] [--blocks n] [--overhead us] [--smoke]
+
+namespace{
+    struct options{
+        w25_bus_mode mode = W25_BUS_SINGLE;
+        uint32_t clock_hz = 40000000;
+        uint32_t blocks = 16;
+        uint32_t overhead_us = 8;
+    };
+
+    constexpr uint16_t FIRST_BLOCK = 100;
+    constexpr size_t CONTINUOUS_CHUNK = 8U*W25_PAGE_SIZE;
+    constexpr size_t BATCH_PAGES = 8;
+
+    //One pattern: every call timed on its own
+    struct run{
+        const char *name;
+        std::vector<int64_t> latencies;
+        uint64_t bytes = 0;
+        int64_t total_us = 0;
+        esp_err_t err = ESP_OK;
+
+        explicit run(const char *p_name) : name{p_name}{}
+
+        template <typename Operation>
+        void time(size_t size, Operation operation){
+            const int64_t start = host_now_us();
+            const esp_err_t result = operation();
+            const int64_t elapsed = host_now_us() - start;
+            latencies.push_back(elapsed);
+            total_us += elapsed;
+            bytes += size;
+            if ((result != ESP_OK) && (err == ESP_OK)){
+                err = result;
+            }
+        }
+
+        static int64_t percentile(const std::vector<int64_t> &sorted, double fraction){
+            const size_t index = static_cast<size_t>(fraction*static_cast<double>(sorted.size() - 1U));
+            return sorted[index];
+        }
+
+        void report(void) const{
+            std::vector<int64_t> sorted = latencies;
+            std::sort(sorted.begin(), sorted.end());
+            char mb_s[16] = "-"; //MB of 10^6 bytes, nothing for the erases
+            if ((bytes > 0U) && (total_us > 0)){
+                (void)snprintf(mb_s, sizeof(mb_s), "%.3f", static_cast<double>(bytes)/static_cast<double>(total_us));
+            }
+            printf("%-22s %6zu %9s %9.1f %8lld %8lld %8lld%s\n", name, sorted.size(), mb_s,
+                static_cast<double>(total_us)/static_cast<double>(sorted.size()),
+                static_cast<long long>(percentile(sorted, 0.5)), static_cast<long long>(percentile(sorted, 0.99)),
+                static_cast<long long>(sorted.back()), (err == ESP_OK) ? "" : "  FAILED");
+        }
+    };
+
+    bool parse(int argc, char **argv, options *opts){
+        bool valid = true;
+        for (int i = 1; (i < argc) && valid; i++){
+            const bool has_value = ((i + 1) < argc);
+            if (strcmp(argv[i], "--smoke") == 0){ //Quick pass for ctest
+                opts->blocks = 2;
+            }else if ((strcmp(argv[i], "--mode") == 0) && has_value){
+                i++;
+                if (strcmp(argv[i], "single") == 0){
+                    opts->mode = W25_BUS_SINGLE;
+                }else if (strcmp(argv[i], "dual") == 0){
+                    opts->mode = W25_BUS_DUAL;
+                }else if (strcmp(argv[i], "quad") == 0){
+                    opts->mode = W25_BUS_QUAD;
+                }else{
+                    valid = false;
+                }
+            }else if ((strcmp(argv[i], "--clock") == 0) && has_value){
+                opts->clock_hz = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+            }else if ((strcmp(argv[i], "--blocks") == 0) && has_value){
+                opts->blocks = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+            }else if ((strcmp(argv[i], "--overhead") == 0) && has_value){
+                opts->overhead_us = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+            }else{
+                valid = false;
+            }
+        }
+        return valid && (opts->clock_hz > 0U) && (opts->blocks > 0U) && ((FIRST_BLOCK + (2U*opts->blocks) + 1U) < 1000U);
+    }
+}
+
+int main(int argc, char **argv){
+    options opts;
+    if (!parse(argc, argv, &opts)){
+        fprintf(stderr, "usage: %s [--mode single|dual|quad] [--clock hz] [--blocks n] [--overhead us] [--smoke]\n", argv[0]);
+        return 2;
+    }
+    host_spi_set_overhead_us(opts.overhead_us);
+
+    w25_config_t config = W25_CONFIG_DEFAULT();
+    config.clock_speed_hz = opts.clock_hz;
+    config.bus_mode = opts.mode;
+    winbond_t *w25 = w25_Create(&config);
+    if ((vspi_w25_alloc_bus(w25) != ESP_OK) || (w25_Initialize(w25) != ESP_OK)){
+        fprintf(stderr, "the emulated memory didn't initialize\n");
+        return 1;
+    }
+
+    const uint16_t first_page = static_cast<uint16_t>(FIRST_BLOCK*W25_PAGES_PER_BLOCK);
+    const uint32_t pages = opts.blocks*W25_PAGES_PER_BLOCK;
+    std::vector<uint8_t> payload(size_t{pages}*W25_PAGE_SIZE);
+    for (size_t i = 0; i < payload.size(); i++){
+        payload[i] = static_cast<uint8_t>((i*31U) ^ (i >> 11U));
+    }
+    std::vector<uint8_t> receiver(payload.size(), 0);
+
+    run erase("block erase");
+    run program("sequential program");
+    run read("sequential read");
+    run random("random read");
+    run continuous("continuous read");
+    run batch("batched read (8 pages)");
+
+    for (uint32_t block = 0; block < opts.blocks; block++){
+        erase.time(0, [&](){ return w25_BlockErase(w25, static_cast<uint16_t>(first_page + (block*W25_PAGES_PER_BLOCK)), 20U); });
+    }
+    for (uint32_t page = 0; page < pages; page++){
+        program.time(W25_PAGE_SIZE, [&](){
+            return w25_WriteMemory(w25, 0, static_cast<uint16_t>(first_page + page), &payload[page*W25_PAGE_SIZE], W25_PAGE_SIZE);
+        });
+    }
+    for (uint32_t page = 0; page < pages; page++){
+        read.time(W25_PAGE_SIZE, [&](){
+            return w25_ReadMemory(w25, 0, static_cast<uint16_t>(first_page + page), &receiver[page*W25_PAGE_SIZE], W25_PAGE_SIZE);
+        });
+    }
+    bool intact = (receiver == payload);
+
+    uint32_t seed = 12345U;
+    std::vector<uint8_t> page_buffer(W25_PAGE_SIZE);
+    for (uint32_t i = 0; i < pages; i++){
+        seed = (seed*1103515245U) + 12345U;
+        const uint32_t page = (seed >> 8U) % pages;
+        random.time(W25_PAGE_SIZE, [&](){
+            return w25_ReadMemory(w25, 0, static_cast<uint16_t>(first_page + page), page_buffer.data(), page_buffer.size());
+        });
+        intact = intact && (memcmp(page_buffer.data(), &payload[page*W25_PAGE_SIZE], W25_PAGE_SIZE) == 0);
+    }
+
+    std::fill(receiver.begin(), receiver.end(), 0);
+    for (size_t done = 0; done < payload.size(); done += CONTINUOUS_CHUNK){
+        const size_t chunk = std::min(CONTINUOUS_CHUNK, payload.size() - done);
+        continuous.time(chunk, [&](){
+            return w25_ReadContinuous(w25, 0, static_cast<uint16_t>(first_page + (done/W25_PAGE_SIZE)), &receiver[done], chunk);
+        });
+    }
+    intact = intact && (receiver == payload);
+
+    std::fill(receiver.begin(), receiver.end(), 0);
+    for (uint32_t page = 0; page < pages; page += BATCH_PAGES){
+        const size_t count = std::min<size_t>(BATCH_PAGES, pages - page);
+        batch.time(count*W25_PAGE_SIZE, [&](){
+            return w25_ReadRange(w25, 0, static_cast<uint16_t>(first_page + page), &receiver[page*W25_PAGE_SIZE], count*W25_PAGE_SIZE);
+        });
+    }
+    intact = intact && (receiver == payload);
+
+    //Slow sensor readings through the compressed series, on the blocks after the ones above
+    std::vector<float> readings(pages*(W25_PAGE_SIZE/sizeof(float)));
+    for (size_t i = 0; i < readings.size(); i++){
+        readings[i] = 21.0F + (static_cast<float>(static_cast<int>((i / 7U) % 300U) - 150)*0.01F);
+    }
+    const w25_series_config_t series_config = {static_cast<uint16_t>(FIRST_BLOCK + opts.blocks), static_cast<uint16_t>(opts.blocks + 1U)};
+    w25_series_t *series = nullptr;
+    w25_series_stats_t series_stats = {};
+    run compressed("compressed append");
+    if (w25_SeriesOpen(w25, &series_config, &series) == ESP_OK){
+        constexpr size_t CHUNK = W25_PAGE_SIZE/sizeof(float);
+        for (size_t done = 0; done < readings.size(); done += CHUNK){
+            compressed.time(CHUNK*sizeof(float), [&](){ return w25_SeriesAppend(series, &readings[done], CHUNK); });
+        }
+        w25_SeriesGetStats(series, &series_stats);
+        (void)w25_SeriesClose(series);
+    }else{
+        compressed.time(0, [](){ return ESP_FAIL; });
+    }
+
+    const char *mode_names[] = {"single", "dual", "quad"};
+    printf("W25N01GV host benchmark: %s bus at %.1f MHz, %u us per transaction, %u blocks\n",
+        mode_names[opts.mode], static_cast<double>(opts.clock_hz)/1e6, opts.overhead_us, opts.blocks);
+    printf("%-22s %6s %9s %9s %8s %8s %8s\n", "pattern", "ops", "MB/s", "avg us", "p50 us", "p99 us", "max us");
+    const run *runs[] = {&erase, &program, &read, &random, &continuous, &batch, &compressed};
+    bool ok = intact;
+    for (const run *pattern : runs){
+        pattern->report();
+        ok = ok && (pattern->err == ESP_OK);
+    }
+    const w25_emu::counters &stats = w25_emu::attached(config.host, config.cs)->stats;
+    printf("frames %llu, page reads %llu, programs %llu, erases %llu, data %s\n",
+        static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.page_reads),
+        static_cast<unsigned long long>(stats.programs), static_cast<unsigned long long>(stats.erases),
+        intact ? "intact" : "CORRUPTED");
+
+    if (series_stats.encoded_bytes > 0U){
+        printf("series: %u samples in %u frames, %.2f:1\n", static_cast<unsigned int>(series_stats.samples),
+            static_cast<unsigned int>(series_stats.frames), static_cast<double>(series_stats.raw_bytes)/static_cast<double>(series_stats.encoded_bytes));
+    }
+
+    (void)vspi_w25_free_bus(w25);
+    (void)deinit_w25_struct(w25);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,401 @@
+#include <string.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include "host_shim.h"
+#include "w25_emulator.h"
+
+namespace w25_emu{
+
+namespace{
+    enum opcode : uint8_t{
+        DEVICE_RESET = 0xFF, JEDEC_ID = 0x9F, READ_STATUS = 0x05, READ_STATUS_ALT = 0x0F,
+        WRITE_STATUS = 0x01, WRITE_STATUS_ALT = 0x1F, WRITE_ENABLE = 0x06, WRITE_DISABLE = 0x04,
+        BB_SWAP = 0xA1, READ_LUT = 0xA5, LAST_ECC_FAIL = 0xA9, BLOCK_ERASE = 0xD8,
+        LOAD = 0x02, RANDOM_LOAD = 0x84, QUAD_LOAD = 0x32, RANDOM_QUAD_LOAD = 0x34,
+        PROGRAM_EXECUTE = 0x10, PAGE_DATA_READ = 0x13,
+        READ = 0x03, FAST_READ = 0x0B, FAST_READ_DUAL = 0x3B, FAST_READ_QUAD = 0x6B,
+        FAST_READ_DUAL_IO = 0xBB, FAST_READ_QUAD_IO = 0xEB
+    };
+
+    constexpr uint8_t PROTECTION_REG = 0xA0;
+    constexpr uint8_t CONFIG_REG = 0xB0;
+    constexpr uint8_t STATUS_REG = 0xC0;
+
+    constexpr uint8_t BP_BITS = 0x78;      //Any of them protects the whole array in the model
+    constexpr uint8_t CONFIG_WRITABLE = 0x58; //OTP-E, ECC-E and BUF, the lock bits are OTP
+    constexpr uint8_t ECC_E = 0x10;
+    constexpr uint8_t BUF = 0x08;
+    constexpr uint8_t LUT_F = 0x40;
+    constexpr uint8_t ECC_1 = 0x20;
+    constexpr uint8_t ECC_0 = 0x10;
+    constexpr uint8_t P_FAIL = 0x08;
+    constexpr uint8_t E_FAIL = 0x04;
+    constexpr uint8_t WEL = 0x02;
+    constexpr uint8_t BUSY = 0x01;
+
+    constexpr uint8_t PROTECTION_DEFAULT = 0x7C; //Whole array protected at power up
+    constexpr uint8_t CONFIG_DEFAULT = 0x18;     //ECC on, buffer mode on the IG parts
+    constexpr uint16_t LUT_ENABLE = 0x8000U;
+    constexpr uint16_t BLOCK_MASK = 0x03FFU;
+    constexpr uint16_t COLUMN_MASK = 0x0FFFU;
+    constexpr uint8_t JEDEC[3] = {0xEF, 0xAA, 0x21};
+
+    bool is_load(uint8_t code){
+        return (code == LOAD) || (code == RANDOM_LOAD) || (code == QUAD_LOAD) || (code == RANDOM_QUAD_LOAD);
+    }
+
+    bool is_read(uint8_t code){
+        return (code == READ) || (code == FAST_READ) || (code == FAST_READ_DUAL) || (code == FAST_READ_QUAD) ||
+               (code == FAST_READ_DUAL_IO) || (code == FAST_READ_QUAD_IO);
+    }
+}
+
+chip::chip() : opcode{0}, position{0}, header_length{0}, ignored{false}, streaming{false}, stream_page{0},
+    stream_column{0}, lut{}, lut_used{0}, protection{PROTECTION_DEFAULT}, configuration{CONFIG_DEFAULT}, status{0},
+    busy_until{0}, last_read_page{0}, last_ecc_failure{0}{
+    buffer.fill(0xFF);
+}
+
+void chip::select(void){
+    opcode = 0;
+    position = 0;
+    header.clear();
+    header_length = 0;
+    ignored = false;
+    streaming = false;
+}
+
+//Address and dummy bytes following each instruction, as the driver sends them
+size_t chip::header_for(uint8_t code) const{
+    size_t length = 0;
+    const bool buffer_mode = ((configuration & BUF) != 0U);
+    switch (code){
+        case JEDEC_ID: case READ_STATUS: case READ_STATUS_ALT: case WRITE_STATUS: case WRITE_STATUS_ALT:
+        case READ_LUT: case LAST_ECC_FAIL:
+            length = 1;
+            break;
+        case LOAD: case RANDOM_LOAD: case QUAD_LOAD: case RANDOM_QUAD_LOAD:
+            length = 2;
+            break;
+        case BLOCK_ERASE: case PROGRAM_EXECUTE: case PAGE_DATA_READ: case READ: case FAST_READ_DUAL_IO:
+            length = 3; //Dummy and page, column and dummy, or 3 dummy bytes for Read Data in continuous mode
+            break;
+        case FAST_READ: case FAST_READ_DUAL: case FAST_READ_QUAD:
+            length = buffer_mode ? 3U : 4U;
+            break;
+        case BB_SWAP: case FAST_READ_QUAD_IO:
+            length = 4;
+            break;
+        default:
+            break;
+    }
+    return length;
+}
+
+bool chip::allowed_while_busy(uint8_t code) const{
+    return (code == READ_STATUS) || (code == READ_STATUS_ALT) || (code == JEDEC_ID) || (code == DEVICE_RESET);
+}
+
+uint16_t chip::header_word(size_t index) const{
+    return static_cast<uint16_t>((uint16_t{header[index]} << 8U) | header[index + 1U]);
+}
+
+bool chip::busy(void) const{
+    return host_now_us() < busy_until;
+}
+
+bool chip::garbles(uint32_t clock_hz, int input_delay_ns) const{
+    return (clock_hz > wiring.max_clock_hz) || ((clock_hz > wiring.late_above_hz) && (input_delay_ns < wiring.miso_delay_ns));
+}
+
+void chip::start_busy(uint32_t us){
+    busy_until = host_now_us() + us;
+}
+
+uint8_t chip::register_value(uint8_t address) const{
+    uint8_t value = 0;
+    if (address == PROTECTION_REG){
+        value = protection;
+    }else if (address == CONFIG_REG){
+        value = configuration;
+    }else if (address == STATUS_REG){
+        value = status | (busy() ? BUSY : 0U) | ((lut_used == LUT_ENTRIES) ? LUT_F : 0U);
+    }
+    return value;
+}
+
+//The Bad Block Management LUT redirects whole blocks
+uint32_t chip::physical_page(uint32_t page) const{
+    const uint16_t block = static_cast<uint16_t>(page / PAGES_PER_BLOCK);
+    uint32_t physical = page;
+    for (size_t i = 0; i < lut_used; i++){
+        if ((lut[i*2U] & LUT_ENABLE) && ((lut[i*2U] & BLOCK_MASK) == block)){
+            physical = (uint32_t{lut[(i*2U) + 1U]} * PAGES_PER_BLOCK) + (page % PAGES_PER_BLOCK);
+        }
+    }
+    return physical;
+}
+
+//Moves a page into the data buffer, updating the ECC status bits as the internal ECC would. Across a continuous
+//read they accumulate: corrected pages leave 01, one uncorrectable page 10, more than one 11
+void chip::load_page(uint32_t page, bool accumulate){
+    const uint32_t physical = physical_page(page);
+    const auto stored = array.find(physical);
+    if (stored == array.end()){
+        buffer.fill(0xFF);
+    }else{
+        buffer = stored->second;
+    }
+
+    if (!accumulate){
+        status &= static_cast<uint8_t>(~(ECC_1|ECC_0));
+    }
+    const auto error = ecc_errors.find(physical);
+    if (((configuration & ECC_E) != 0U) && (error != ecc_errors.end())){
+        if ((error->second == ECC_CORRECTED) && ((status & ECC_1) == 0U)){
+            status |= ECC_0;
+        }else if ((error->second == ECC_UNCORRECTABLE) && ((status & ECC_1) != 0U)){
+            status |= ECC_0; //Second failure of the stream
+            last_ecc_failure = static_cast<uint16_t>(page);
+        }else if (error->second == ECC_UNCORRECTABLE){
+            status = static_cast<uint8_t>((status & ~ECC_0) | ECC_1);
+            last_ecc_failure = static_cast<uint16_t>(page);
+        }else{
+            //Corrected after a failure, the failure is what gets reported
+        }
+    }
+    last_read_page = page;
+    stats.page_reads++;
+}
+
+uint8_t chip::exchange(uint8_t mosi){
+    uint8_t miso = 0xFF;
+    if (position == 0U){
+        opcode = mosi;
+        header_length = header_for(opcode);
+        if (busy() && !allowed_while_busy(opcode)){
+            ignored = true;
+            stats.busy_violations++;
+        }
+    }else if (ignored){
+        //MISO stays high, MOSI is discarded
+    }else if (header.size() < header_length){
+        header.push_back(mosi);
+        if (header.size() == header_length){
+            if (is_load(opcode) && ((status & WEL) == 0U)){
+                ignored = true;
+                stats.wel_violations++;
+            }else if ((opcode == LOAD) || (opcode == QUAD_LOAD)){
+                buffer.fill(0xFF);
+            }else if (is_read(opcode)){
+                streaming = ((configuration & BUF) == 0U);
+                stream_page = last_read_page;
+                stream_column = streaming ? 0U : (header_word(0) & COLUMN_MASK);
+            }
+        }
+    }else{
+        const size_t index = position - header_length - 1U;
+        miso = data_out(index);
+        data_in(index, mosi);
+    }
+    position++;
+    return miso;
+}
+
+uint8_t chip::data_out(size_t index){
+    uint8_t value = 0xFF;
+    if ((opcode == READ_STATUS) || (opcode == READ_STATUS_ALT)){
+        value = register_value(header[0]);
+    }else if (opcode == JEDEC_ID){
+        value = (index < sizeof(JEDEC)) ? JEDEC[index] : 0xFFU;
+    }else if (opcode == READ_LUT){
+        const size_t entry = index / 4U;
+        if (entry < LUT_ENTRIES){
+            const uint16_t word = (entry < lut_used) ? lut[(entry*2U) + ((index % 4U) / 2U)] : 0U;
+            value = ((index % 2U) == 0U) ? static_cast<uint8_t>(word >> 8U) : static_cast<uint8_t>(word & 0xFFU);
+        }
+    }else if (opcode == LAST_ECC_FAIL){
+        value = (index == 0U) ? static_cast<uint8_t>(last_ecc_failure >> 8U) : static_cast<uint8_t>(last_ecc_failure & 0xFFU);
+    }else if (is_read(opcode) && streaming){ //Data area only, then the next page is read in without a BUSY time
+        value = (stream_page < PAGES) ? buffer[stream_column] : 0xFFU;
+        stream_column++;
+        if ((stream_column == DATA_BYTES) && (stream_page < PAGES)){
+            stream_page++;
+            stream_column = 0;
+            if (stream_page < PAGES){
+                load_page(stream_page, true);
+            }
+        }
+    }else if (is_read(opcode)){
+        value = (stream_column < PAGE_BYTES) ? buffer[stream_column] : 0xFFU;
+        stream_column++;
+    }else{
+        //Nothing driven on MISO
+    }
+    return value;
+}
+
+void chip::data_in(size_t index, uint8_t value){
+    if (((opcode == WRITE_STATUS) || (opcode == WRITE_STATUS_ALT)) && (index == 0U)){
+        header.push_back(value); //Applied once CS goes high
+    }else if (is_load(opcode)){
+        const size_t column = (header_word(0) & COLUMN_MASK) + index;
+        if (column < PAGE_BYTES){
+            buffer[column] = value;
+        }
+    }else{
+        //Ignored
+    }
+}
+
+void chip::program(uint32_t page){
+    const uint32_t physical = physical_page(page);
+    status &= static_cast<uint8_t>(~(P_FAIL|E_FAIL));
+    if ((protection & BP_BITS) != 0U){
+        stats.protect_violations++;
+        status |= P_FAIL;
+    }else if (program_failures[physical]){
+        status |= P_FAIL;
+    }else{
+        auto stored = array.emplace(physical, std::array<uint8_t, PAGE_BYTES>{});
+        if (stored.second){
+            stored.first->second.fill(0xFF);
+        }
+        for (size_t i = 0; i < PAGE_BYTES; i++){ //Programming can only clear bits
+            stored.first->second[i] &= buffer[i];
+        }
+        if (++programs_since_erase[physical] > MAX_PARTIAL_PROGRAMS){
+            stats.nop_violations++;
+        }
+        stats.programs++;
+    }
+    start_busy(times.program_us);
+}
+
+void chip::erase(uint32_t page){
+    const uint32_t first = physical_page(page) - (physical_page(page) % PAGES_PER_BLOCK);
+    status &= static_cast<uint8_t>(~(P_FAIL|E_FAIL));
+    if ((protection & BP_BITS) != 0U){
+        stats.protect_violations++;
+        status |= E_FAIL;
+    }else if (erase_failures[first / PAGES_PER_BLOCK]){
+        status |= E_FAIL;
+    }else{
+        for (uint32_t i = first; i < (first + PAGES_PER_BLOCK); i++){
+            array.erase(i);
+            programs_since_erase.erase(i);
+        }
+        stats.erases++;
+    }
+    start_busy(times.erase_us);
+}
+
+void chip::swap(uint16_t logical_block, uint16_t physical_block){
+    if (lut_used < LUT_ENTRIES){
+        lut[lut_used*2U] = static_cast<uint16_t>(LUT_ENABLE | (logical_block & BLOCK_MASK));
+        lut[(lut_used*2U) + 1U] = physical_block & BLOCK_MASK;
+        lut_used++;
+    }
+    start_busy(times.program_us);
+}
+
+//Instructions that take effect once CS goes high
+void chip::execute(void){
+    const bool writing = (opcode == PROGRAM_EXECUTE) || (opcode == BLOCK_ERASE) || (opcode == BB_SWAP);
+    if (writing && ((status & WEL) == 0U)){
+        stats.wel_violations++;
+    }else if (header.size() < header_length){
+        //Frame cut short, the instruction is dropped
+    }else if (opcode == WRITE_ENABLE){
+        status |= WEL;
+    }else if (opcode == WRITE_DISABLE){
+        status &= static_cast<uint8_t>(~WEL);
+    }else if (opcode == DEVICE_RESET){
+        protection = PROTECTION_DEFAULT;
+        configuration = CONFIG_DEFAULT;
+        status = 0;
+        start_busy(times.reset_us);
+    }else if (((opcode == WRITE_STATUS) || (opcode == WRITE_STATUS_ALT)) && (header.size() == 2U)){
+        if (header[0] == PROTECTION_REG){
+            protection = header[1];
+        }else if (header[0] == CONFIG_REG){
+            configuration = static_cast<uint8_t>((configuration & ~CONFIG_WRITABLE) | (header[1] & CONFIG_WRITABLE));
+        }else{
+            //The Status Register is read only
+        }
+    }else if (opcode == PAGE_DATA_READ){
+        load_page(header_word(1), false);
+        start_busy(times.page_read_us);
+    }else if (opcode == PROGRAM_EXECUTE){
+        program(header_word(1));
+        status &= static_cast<uint8_t>(~WEL);
+    }else if (opcode == BLOCK_ERASE){
+        erase(header_word(1));
+        status &= static_cast<uint8_t>(~WEL);
+    }else if (opcode == BB_SWAP){
+        swap(header_word(0), header_word(2));
+        status &= static_cast<uint8_t>(~WEL);
+    }else if (is_read(opcode) && streaming){ //Ending a continuous read leaves the next page loading
+        start_busy(times.page_read_us);
+    }else{
+        //Nothing left to do
+    }
+}
+
+void chip::deselect(void){
+    if ((position > 0U) && !ignored){
+        execute();
+    }
+    stats.frames++;
+    position = 0;
+    streaming = false;
+}
+
+void chip::set_ecc_error(uint32_t page, ecc_error error){
+    ecc_errors[page] = error;
+}
+
+void chip::set_erase_failure(uint32_t block, bool fail){
+    erase_failures[block] = fail;
+}
+
+void chip::set_program_failure(uint32_t page, bool fail){
+    program_failures[page] = fail;
+}
+
+//The marker is the first spare byte of the first page, as the factory writes it
+void chip::mark_factory_bad(uint32_t block){
+    auto stored = array.emplace(block*PAGES_PER_BLOCK, std::array<uint8_t, PAGE_BYTES>{});
+    if (stored.second){
+        stored.first->second.fill(0xFF);
+    }
+    stored.first->second[DATA_BYTES] = 0x00;
+}
+
+const uint8_t *chip::page(uint32_t page) const{
+    const auto stored = array.find(page);
+    return (stored == array.end()) ? nullptr : stored->second.data();
+}
+
+namespace{
+    std::mutex registry_mutex;
+    std::map<std::pair<int, int>, std::unique_ptr<chip>> registry;
+}
+
+chip *attached(spi_host_device_t host, int cs_pin){
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    std::unique_ptr<chip> &slot = registry[std::make_pair(static_cast<int>(host), cs_pin)];
+    if (!slot){
+        slot.reset(new chip());
+    }
+    return slot.get();
+}
+
+void detach_all(void){
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.clear();
+}
+
+}
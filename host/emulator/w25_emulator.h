@@ -0,0 +1,131 @@
+#ifndef W25N_EMULATOR_H
+#define W25N_EMULATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <unordered_map>
+#include <vector>
+#include "driver/spi_common.h"
+
+//Model of a W25N01GV answering on the shimmed SPI bus, byte by byte, as the pins see it: the opcode,
+//address and dummy bytes, then the data. It keeps the array, the data buffer with its ECC status, the
+//status registers, the BUF/continuous read modes, the BUSY times and the Bad Block Management LUT.
+//Misuse that the real chip would silently ignore is counted, so the tests can assert the driver never does it.
+
+namespace w25_emu{
+
+constexpr size_t PAGE_BYTES = 2112U;     //Data and spare area
+constexpr size_t DATA_BYTES = 2048U;
+constexpr uint32_t PAGES_PER_BLOCK = 64U;
+constexpr uint32_t BLOCKS = 1024U;
+constexpr uint32_t PAGES = PAGES_PER_BLOCK*BLOCKS;
+constexpr size_t LUT_ENTRIES = 20U;
+constexpr uint32_t MAX_PARTIAL_PROGRAMS = 4U;
+
+//BUSY times of the model, typical datasheet values by default
+struct timing{
+    uint32_t page_read_us = 25;  //tRD
+    uint32_t program_us = 250;   //tPP
+    uint32_t erase_us = 2000;    //tBE
+    uint32_t reset_us = 5;       //tRST
+};
+
+//Signal integrity of the board: MISO is sampled wrong above max_clock_hz, and above late_above_hz unless the
+//host compensates at least miso_delay_ns with its input delay
+struct signal_limits{
+    uint32_t max_clock_hz = 104000000;
+    uint32_t late_above_hz = 104000000;
+    int miso_delay_ns = 0;
+};
+
+struct counters{
+    uint64_t frames = 0;           //CS low to CS high
+    uint64_t page_reads = 0;       //Pages moved into the data buffer, continuous reads included
+    uint64_t programs = 0;
+    uint64_t erases = 0;
+    uint32_t busy_violations = 0;  //Commands other than status reads, JEDEC ID and reset sent while BUSY, ignored
+    uint32_t wel_violations = 0;   //Loads, programs, erases and swaps without WEL, ignored
+    uint32_t protect_violations = 0; //Programs and erases on a protected array, failed
+    uint32_t nop_violations = 0;   //Programs of a page past the partial program limit
+};
+
+enum ecc_error : uint8_t{
+    ECC_NONE = 0,
+    ECC_CORRECTED = 1,       //ECC-1/0 = 01 after reading the page
+    ECC_UNCORRECTABLE = 2,   //ECC-1/0 = 10, also recorded as the last ECC failure
+};
+
+class chip{
+public:
+    chip();
+
+    void select(void);
+    uint8_t exchange(uint8_t mosi);
+    void deselect(void);
+
+    timing times;
+    signal_limits wiring;
+    counters stats;
+
+    //Fault injection
+    void set_ecc_error(uint32_t page, ecc_error error);
+    void set_erase_failure(uint32_t block, bool fail);
+    void set_program_failure(uint32_t page, bool fail);
+    void mark_factory_bad(uint32_t block);
+
+    //Array contents, nullptr while the page is erased
+    const uint8_t *page(uint32_t page) const;
+    uint8_t register_value(uint8_t address) const;
+    bool busy(void) const;
+    bool garbles(uint32_t clock_hz, int input_delay_ns) const;
+
+private:
+    uint8_t opcode;
+    size_t position;                    //Bytes exchanged since CS went low
+    std::vector<uint8_t> header;        //Address and dummy bytes after the opcode
+    size_t header_length;
+    bool ignored;                       //The frame was dropped, MISO stays high
+    bool streaming;                     //A read in continuous mode is running
+    uint32_t stream_page;
+    size_t stream_column;
+
+    std::unordered_map<uint32_t, std::array<uint8_t, PAGE_BYTES>> array;
+    std::unordered_map<uint32_t, uint8_t> programs_since_erase;
+    std::unordered_map<uint32_t, ecc_error> ecc_errors;
+    std::unordered_map<uint32_t, bool> erase_failures;
+    std::unordered_map<uint32_t, bool> program_failures;
+    std::array<uint8_t, PAGE_BYTES> buffer;
+    std::array<uint16_t, LUT_ENTRIES*2U> lut;  //LBA (with the enable bit) and PBA pairs
+    size_t lut_used;
+
+    uint8_t protection;
+    uint8_t configuration;
+    uint8_t status;                     //Without the BUSY bit, which comes from busy_until
+    int64_t busy_until;
+    uint32_t last_read_page;
+    uint16_t last_ecc_failure;
+
+    size_t header_for(uint8_t code) const;
+    bool allowed_while_busy(uint8_t code) const;
+    uint16_t header_word(size_t index) const;
+    uint32_t physical_page(uint32_t page) const;
+    void load_page(uint32_t page, bool accumulate);
+    void execute(void);
+    void program(uint32_t page);
+    void erase(uint32_t page);
+    void swap(uint16_t logical_block, uint16_t physical_block);
+    void start_busy(uint32_t us);
+    uint8_t data_out(size_t index);
+    void data_in(size_t index, uint8_t value);
+};
+
+//Memory wired to the CS pin of the host. Created the first time the pin is used, and kept while the process
+//runs so the contents survive the bus being freed and allocated again, like a real chip
+chip *attached(spi_host_device_t host, int cs_pin);
+//Drops every memory, the next access sees a new erased chip
+void detach_all(void);
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+#include "esp_rom_crc.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "host_shim.h"
+
+namespace{
+    std::atomic<int64_t> now_ns{0};
+}
+
+struct esp_timer{
+    esp_timer_cb_t callback;
+    void *arg;
+};
+
+int64_t host_now_us(void){
+    return now_ns.load() / 1000;
+}
+
+void host_advance_us(int64_t us){
+    host_advance_ns(us*1000);
+}
+
+void host_advance_ns(int64_t ns){
+    if (ns > 0){
+        now_ns.fetch_add(ns);
+    }
+}
+
+int64_t esp_timer_get_time(void){
+    return host_now_us();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle){
+    *out_handle = new esp_timer{create_args->callback, create_args->arg};
+    return ESP_OK;
+}
+
+//The time jumps straight to the expiry and the callback runs on the caller, nothing else could happen meanwhile
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us){
+    host_advance_us(static_cast<int64_t>(timeout_us));
+    timer->callback(timer->arg);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer){
+    (void)timer;
+    return ESP_ERR_INVALID_STATE; //Never left running
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer){
+    delete timer;
+    return ESP_OK;
+}
+
+void esp_rom_delay_us(uint32_t us){
+    host_advance_us(us);
+}
+
+//Same as the ROM routine: reflected 0xEDB88320, inverted on the way in and out so calls can be chained
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len){
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++){
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++){
+            crc = (crc >> 1U) ^ (0xEDB88320U & (0U - (crc & 1U)));
+        }
+    }
+    return ~crc;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps){
+    (void)caps;
+    return malloc(size);
+}
+
+void heap_caps_free(void *ptr){
+    free(ptr);
+}
+
+bool esp_ptr_dma_capable(const void *p){
+    return p != nullptr;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode){
+    (void)gpio_num;
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level){
+    (void)gpio_num;
+    (void)level;
+    return ESP_OK;
+}
+
+const char *esp_err_to_name(esp_err_t code){
+    const char *name = "UNKNOWN ERROR";
+    switch (code){
+        case ESP_OK: name = "ESP_OK"; break;
+        case ESP_FAIL: name = "ESP_FAIL"; break;
+        case ESP_ERR_NO_MEM: name = "ESP_ERR_NO_MEM"; break;
+        case ESP_ERR_INVALID_ARG: name = "ESP_ERR_INVALID_ARG"; break;
+        case ESP_ERR_INVALID_STATE: name = "ESP_ERR_INVALID_STATE"; break;
+        case ESP_ERR_INVALID_SIZE: name = "ESP_ERR_INVALID_SIZE"; break;
+        case ESP_ERR_NOT_FOUND: name = "ESP_ERR_NOT_FOUND"; break;
+        case ESP_ERR_NOT_SUPPORTED: name = "ESP_ERR_NOT_SUPPORTED"; break;
+        case ESP_ERR_TIMEOUT: name = "ESP_ERR_TIMEOUT"; break;
+        case ESP_ERR_INVALID_RESPONSE: name = "ESP_ERR_INVALID_RESPONSE"; break;
+        case ESP_ERR_INVALID_CRC: name = "ESP_ERR_INVALID_CRC"; break;
+        case ESP_ERR_INVALID_VERSION: name = "ESP_ERR_INVALID_VERSION"; break;
+        default: break;
+    }
+    return name;
+}
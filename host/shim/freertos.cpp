@@ -0,0 +1,242 @@
+#include <assert.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "host_shim.h"
+
+//Tasks are threads, queues and semaphores are a deque behind a condition variable. Timed waits use the wall
+//clock, a tick being portTICK_PERIOD_MS real milliseconds. Priorities and stack sizes are ignored
+
+namespace{
+    constexpr int64_t TICK_US = int64_t{portTICK_PERIOD_MS}*1000;
+
+    struct task_exit{}; //Unwinds a task that deleted itself
+
+    //Waits until ready() holds or the ticks run out, portMAX_DELAY waits forever
+    template <typename Predicate>
+    bool wait_ticks(std::unique_lock<std::mutex> &lock, std::condition_variable &changed, TickType_t ticks, Predicate ready){
+        bool result = true;
+        if (ticks == portMAX_DELAY){
+            changed.wait(lock, ready);
+        }else{
+            result = changed.wait_for(lock, std::chrono::milliseconds(int64_t{ticks}*portTICK_PERIOD_MS), ready);
+        }
+        return result;
+    }
+
+    //Threads of the tasks still running, joined at exit so none is left unwinding after main returns
+    struct task_registry{
+        std::mutex mutex;
+        std::vector<std::thread> threads;
+        ~task_registry(){
+            std::vector<std::thread> pending;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.swap(threads);
+            }
+            for (std::thread &thread : pending){
+                thread.join();
+            }
+        }
+    };
+
+    task_registry &tasks(void){
+        static task_registry registry;
+        return registry;
+    }
+}
+
+struct tskTaskControlBlock{
+    const char *name;
+};
+
+namespace{
+    thread_local std::unique_ptr<tskTaskControlBlock> current_task;
+}
+
+struct QueueDefinition{
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t capacity;
+    size_t item_size;       //0 for semaphores, only the count matters
+    std::deque<std::vector<uint8_t>> items;
+};
+
+struct EventGroupDef_t{
+    std::mutex mutex;
+    std::condition_variable changed;
+    EventBits_t bits;
+};
+
+/* TASKS */
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *out){
+    (void)stack;
+    (void)prio;
+    tskTaskControlBlock *task = new tskTaskControlBlock{name};
+    if (out != nullptr){
+        *out = task;
+    }
+    std::lock_guard<std::mutex> lock(tasks().mutex);
+    tasks().threads.emplace_back([fn, arg, task](){
+        current_task.reset(task);
+        try{
+            fn(arg);
+        }catch (const task_exit &){
+            //vTaskDelete(NULL)
+        }
+    });
+    return pdPASS;
+}
+
+//Only a task deleting itself is supported, which is all the component does
+void vTaskDelete(TaskHandle_t task){
+    assert((task == nullptr) || (task == xTaskGetCurrentTaskHandle()));
+    (void)task;
+    throw task_exit{};
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void){
+    if (!current_task){ //Threads not created through xTaskCreate, main included
+        current_task.reset(new tskTaskControlBlock{"main"});
+    }
+    return current_task.get();
+}
+
+//Moves the virtual time, and gives the CPU away so the other tasks progress while this one polls
+void vTaskDelay(TickType_t ticks){
+    host_advance_us(int64_t{ticks}*TICK_US);
+    if (ticks > 0U){
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }else{
+        std::this_thread::yield();
+    }
+}
+
+TickType_t xTaskGetTickCount(void){
+    return static_cast<TickType_t>(host_now_us() / TICK_US);
+}
+
+/* QUEUES AND SEMAPHORES */
+
+static QueueHandle_t create_queue(UBaseType_t capacity, UBaseType_t item_size, UBaseType_t initial){
+    QueueHandle_t queue = new QueueDefinition();
+    queue->capacity = capacity;
+    queue->item_size = item_size;
+    for (UBaseType_t i = 0; i < initial; i++){
+        queue->items.emplace_back();
+    }
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size){
+    return create_queue(len, item_size, 0);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t ticks){
+    std::unique_lock<std::mutex> lock(q->mutex);
+    BaseType_t result = pdFALSE;
+    if (wait_ticks(lock, q->changed, ticks, [q](){ return q->items.size() < q->capacity; })){
+        const uint8_t *bytes = static_cast<const uint8_t *>(item);
+        q->items.emplace_back(bytes, bytes + q->item_size);
+        result = pdTRUE;
+        q->changed.notify_all();
+    }
+    return result;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks){
+    std::unique_lock<std::mutex> lock(q->mutex);
+    BaseType_t result = pdFALSE;
+    if (wait_ticks(lock, q->changed, ticks, [q](){ return !q->items.empty(); })){
+        if (q->item_size > 0U){
+            (void)memcpy(item, q->items.front().data(), q->item_size);
+        }
+        q->items.pop_front();
+        result = pdTRUE;
+        q->changed.notify_all();
+    }
+    return result;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q){
+    std::lock_guard<std::mutex> lock(q->mutex);
+    return static_cast<UBaseType_t>(q->items.size());
+}
+
+void vQueueDelete(QueueHandle_t q){
+    delete q;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void){
+    return create_queue(1, 0, 0);
+}
+
+//No priority inheritance, and any task may give it back
+SemaphoreHandle_t xSemaphoreCreateMutex(void){
+    return create_queue(1, 0, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial){
+    return create_queue(max, 0, initial);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks){
+    return xQueueReceive(s, nullptr, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s){
+    return xQueueSendToBack(s, nullptr, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t s){
+    vQueueDelete(s);
+}
+
+/* EVENT GROUPS */
+
+EventGroupHandle_t xEventGroupCreate(void){
+    EventGroupHandle_t group = new EventGroupDef_t();
+    group->bits = 0;
+    return group;
+}
+
+void vEventGroupDelete(EventGroupHandle_t g){
+    delete g;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t g, const EventBits_t bits){
+    std::lock_guard<std::mutex> lock(g->mutex);
+    g->bits |= bits;
+    g->changed.notify_all();
+    return g->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t g, const EventBits_t bits){
+    std::lock_guard<std::mutex> lock(g->mutex);
+    const EventBits_t before = g->bits;
+    g->bits &= ~bits;
+    return before;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t g, const EventBits_t bits, const BaseType_t clear, const BaseType_t all, TickType_t ticks){
+    std::unique_lock<std::mutex> lock(g->mutex);
+    const bool met = wait_ticks(lock, g->changed, ticks, [g, bits, all](){
+        return (all != pdFALSE) ? ((g->bits & bits) == bits) : ((g->bits & bits) != 0U);
+    });
+    const EventBits_t result = g->bits;
+    if (met && (clear != pdFALSE)){
+        g->bits &= ~bits;
+    }
+    return result;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "esp_err.h"
+#include "hal/gpio_types.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,6 @@
+#pragma once
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_SLOW_ATTR
+#define IRAM_ATTR
+#define DRAM_ATTR
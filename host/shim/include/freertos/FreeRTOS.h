@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "freertos/portmacro.h"
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES 25
+#define pdMS_TO_TICKS(x) ((TickType_t)(((TickType_t)(x) * configTICK_RATE_HZ) / 1000U))
@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+
+//Not part of ESP-IDF, controls of the host build.
+//Time is virtual: it only moves with the SPI frames clocked out, the delays and the timers, so the
+//measurements don't depend on the load of the machine running them. Blocking waits on semaphores,
+//queues and event groups still use the wall clock, they are only there to hand work between threads.
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int64_t host_now_us(void);
+void host_advance_us(int64_t us);
+void host_advance_ns(int64_t ns); //Kept in nanoseconds, short frames would round away otherwise
+
+//Time spent by the SPI driver setting up each transaction, on top of the clocked bits (8us by default,
+//close to what spi_device_transmit costs on an ESP32)
+void host_spi_set_overhead_us(uint32_t us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,3 @@
+#pragma once
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_IDF_TARGET_ESP32 1
@@ -0,0 +1,216 @@
+#include <assert.h>
+#include <string.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include "driver/spi_common.h"
+#include "driver/spi_master.h"
+#include "host_shim.h"
+#include "w25_emulator.h"
+
+//SPI master driver clocking the frames straight into the emulated memories. Every frame moves the virtual
+//time by the setup overhead plus its clock cycles: command, address and dummy phases, then the data phase on
+//1, 2 or 4 lines. Transactions run to completion on the caller, queueing one only defers reading its result
+
+namespace{
+    constexpr size_t HOSTS = 3;
+    constexpr uint32_t DEFAULT_OVERHEAD_US = 8;
+    constexpr int MAX_CLOCK_HZ = 80000000; //IO_MUX pins, APB clock undivided
+
+    struct host_bus{
+        std::mutex mutex;
+        std::condition_variable released;
+        bool initialized = false;
+        size_t devices = 0;
+        spi_device_handle_t owner = nullptr;   //Device that acquired the bus
+        bool cs_active = false;                //Left low by SPI_TRANS_CS_KEEP_ACTIVE
+    };
+
+    host_bus buses[HOSTS];
+    uint32_t overhead_us = DEFAULT_OVERHEAD_US;
+}
+
+struct spi_device_t{
+    spi_host_device_t host;
+    spi_device_interface_config_t config;
+    std::deque<spi_transaction_t *> results;
+};
+
+void host_spi_set_overhead_us(uint32_t us){
+    overhead_us = us;
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host_id, const spi_bus_config_t *bus_config, int dma_chan){
+    (void)bus_config;
+    (void)dma_chan;
+    host_bus &bus = buses[host_id];
+    std::lock_guard<std::mutex> lock(bus.mutex);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (!bus.initialized){
+        bus.initialized = true;
+        err = ESP_OK;
+    }
+    return err;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host_id){
+    host_bus &bus = buses[host_id];
+    std::lock_guard<std::mutex> lock(bus.mutex);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (bus.initialized && (bus.devices == 0U)){
+        bus.initialized = false;
+        err = ESP_OK;
+    }
+    return err;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host_id, const spi_device_interface_config_t *dev_config, spi_device_handle_t *handle){
+    host_bus &bus = buses[host_id];
+    std::lock_guard<std::mutex> lock(bus.mutex);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (dev_config->clock_speed_hz > MAX_CLOCK_HZ){
+        err = ESP_ERR_INVALID_ARG;
+    }else if (bus.initialized){
+        *handle = new spi_device_t{host_id, *dev_config, {}};
+        bus.devices++;
+        err = ESP_OK;
+    }
+    return err;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle){
+    host_bus &bus = buses[handle->host];
+    std::lock_guard<std::mutex> lock(bus.mutex);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (bus.owner != handle){
+        bus.devices--;
+        delete handle;
+        err = ESP_OK;
+    }
+    return err;
+}
+
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait){
+    assert(wait == portMAX_DELAY); //Same restriction as ESP-IDF
+    (void)wait;
+    host_bus &bus = buses[device->host];
+    std::unique_lock<std::mutex> lock(bus.mutex);
+    bus.released.wait(lock, [&bus](){ return bus.owner == nullptr; });
+    bus.owner = device;
+    return ESP_OK;
+}
+
+void spi_device_release_bus(spi_device_handle_t dev){
+    host_bus &bus = buses[dev->host];
+    std::lock_guard<std::mutex> lock(bus.mutex);
+    assert(bus.owner == dev);
+    bus.owner = nullptr;
+    bus.released.notify_all();
+}
+
+//Sends the bits MSB first, a byte at a time
+static void send_field(w25_emu::chip *chip, uint64_t value, size_t bits){
+    for (size_t shift = bits; shift >= 8U; shift -= 8U){
+        (void)chip->exchange(static_cast<uint8_t>((value >> (shift - 8U)) & 0xFFU));
+    }
+}
+
+static void clock_frame(const spi_device_t *device, spi_transaction_t *trans, w25_emu::chip *chip){
+    const spi_transaction_ext_t *ext = reinterpret_cast<const spi_transaction_ext_t *>(trans);
+    const bool half_duplex = ((device->config.flags & SPI_DEVICE_HALFDUPLEX) != 0U);
+    const size_t command_bits = ((trans->flags & SPI_TRANS_VARIABLE_CMD) != 0U) ? ext->command_bits : device->config.command_bits;
+    const size_t address_bits = ((trans->flags & SPI_TRANS_VARIABLE_ADDR) != 0U) ? ext->address_bits : device->config.address_bits;
+    const size_t dummy_cycles = ((trans->flags & SPI_TRANS_VARIABLE_DUMMY) != 0U) ? ext->dummy_bits : device->config.dummy_bits;
+
+    size_t data_lines = 1;
+    if ((trans->flags & SPI_TRANS_MODE_QIO) != 0U){
+        data_lines = 4;
+    }else if ((trans->flags & SPI_TRANS_MODE_DIO) != 0U){
+        data_lines = 2;
+    }
+    const size_t address_lines = ((trans->flags & SPI_TRANS_MULTILINE_ADDR) != 0U) ? data_lines : 1U;
+    const size_t command_lines = ((trans->flags & SPI_TRANS_MULTILINE_CMD) != 0U) ? data_lines : 1U;
+
+    const int64_t clock_hz = (device->config.clock_speed_hz > 0) ? device->config.clock_speed_hz : 1;
+    const bool garbled = chip->garbles(static_cast<uint32_t>(clock_hz), device->config.input_delay_ns); //Sampled a bit early
+    const uint8_t *tx = ((trans->flags & SPI_TRANS_USE_TXDATA) != 0U) ? trans->tx_data : static_cast<const uint8_t *>(trans->tx_buffer);
+    uint8_t *rx = ((trans->flags & SPI_TRANS_USE_RXDATA) != 0U) ? trans->rx_data : static_cast<uint8_t *>(trans->rx_buffer);
+    const size_t tx_bytes = trans->length / 8U;
+    size_t rx_bytes = trans->rxlength / 8U;
+
+    send_field(chip, trans->cmd, command_bits);
+    send_field(chip, trans->addr, address_bits);
+    send_field(chip, 0, (dummy_cycles*address_lines) & ~size_t{7}); //Dummy clocks, as bytes on the address lines
+
+    size_t data_bits = 0;
+    if (half_duplex){ //Write phase, then read phase
+        for (size_t i = 0; i < tx_bytes; i++){
+            (void)chip->exchange((tx != nullptr) ? tx[i] : 0x00U);
+        }
+        for (size_t i = 0; i < rx_bytes; i++){
+            const uint8_t miso = chip->exchange(0xFF);
+            if (rx != nullptr){
+                rx[i] = garbled ? static_cast<uint8_t>((miso << 1U) | 1U) : miso;
+            }
+        }
+        data_bits = trans->length + trans->rxlength;
+    }else{ //MISO is sampled while MOSI is sent, the read length defaults to the write one
+        rx_bytes = (rx_bytes == 0U) ? tx_bytes : rx_bytes;
+        for (size_t i = 0; i < tx_bytes; i++){
+            const uint8_t miso = chip->exchange((tx != nullptr) ? tx[i] : 0x00U);
+            if ((rx != nullptr) && (i < rx_bytes)){
+                rx[i] = garbled ? static_cast<uint8_t>((miso << 1U) | 1U) : miso;
+            }
+        }
+        data_bits = trans->length;
+    }
+
+    const uint64_t cycles = (command_bits/command_lines) + (address_bits/address_lines) + dummy_cycles + (data_bits/data_lines);
+    host_advance_ns((int64_t{overhead_us}*1000) + static_cast<int64_t>((cycles*1000000000ULL)/static_cast<uint64_t>(clock_hz)));
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc){
+    host_bus &bus = buses[handle->host];
+    std::unique_lock<std::mutex> lock(bus.mutex);
+    esp_err_t err = ESP_OK;
+
+    if (((trans_desc->flags & SPI_TRANS_CS_KEEP_ACTIVE) != 0U) && (bus.owner != handle)){
+        err = ESP_ERR_INVALID_ARG; //CS can only be kept active with the bus acquired
+    }else{
+        bus.released.wait(lock, [&bus, handle](){ return (bus.owner == nullptr) || (bus.owner == handle); });
+        w25_emu::chip *chip = w25_emu::attached(handle->host, handle->config.spics_io_num);
+        if (!bus.cs_active){
+            chip->select();
+        }
+        clock_frame(handle, trans_desc, chip);
+        bus.cs_active = ((trans_desc->flags & SPI_TRANS_CS_KEEP_ACTIVE) != 0U);
+        if (!bus.cs_active){
+            chip->deselect();
+        }
+    }
+    return err;
+}
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc){
+    return spi_device_transmit(handle, trans_desc);
+}
+
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans_desc, TickType_t ticks_to_wait){
+    (void)ticks_to_wait;
+    esp_err_t err = spi_device_transmit(handle, trans_desc);
+    if (err == ESP_OK){
+        handle->results.push_back(trans_desc);
+    }
+    return err;
+}
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t **trans_desc, TickType_t ticks_to_wait){
+    (void)ticks_to_wait;
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    if (!handle->results.empty()){
+        *trans_desc = handle->results.front();
+        handle->results.pop_front();
+        err = ESP_OK;
+    }
+    return err;
+}
@@ -0,0 +1,715 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "W25N01GV.h"
+#include "W25N01GV_kv.h"
+#include "W25N01GV_metrics.h"
+#include "W25N01GV_pool.h"
+#include "W25N01GV_record.h"
+#include "W25N01GV_sched.h"
+#include "W25N01GV_series.h"
+#include "host_shim.h"
+#include "w25_emulator.h"
+
+//Driver tests against the emulated memory. They complement test/test_bus.c, which needs the hardware:
+//here the faults can be injected, and the emulator tells whether the driver ever broke a datasheet rule
+
+namespace{
+    int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)){ \
+            printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+#define CHECK_ERR(expected, call) do { \
+        const esp_err_t check_err_ = (call); \
+        if (check_err_ != (expected)){ \
+            printf("  %s:%d: %s returned %s, expected %s\n", __FILE__, __LINE__, #call, \
+                esp_err_to_name(check_err_), esp_err_to_name(expected)); \
+            failures++; \
+        } \
+    } while (0)
+
+    //Memory on a fresh erased chip, initialized as an application would
+    winbond_t *setup(w25_bus_mode mode){
+        w25_emu::detach_all();
+        w25_config_t config = W25_CONFIG_DEFAULT();
+        config.clock_speed_hz = 40000000;
+        config.bus_mode = mode;
+        winbond_t *w25 = w25_Create(&config);
+        CHECK_ERR(ESP_OK, vspi_w25_alloc_bus(w25));
+        CHECK_ERR(ESP_OK, w25_Initialize(w25));
+        return w25;
+    }
+
+    w25_emu::chip *chip_of(void){
+        const w25_config_t config = W25_CONFIG_DEFAULT();
+        return w25_emu::attached(config.host, config.cs);
+    }
+
+    void teardown(winbond_t *w25){
+        const w25_emu::counters &stats = chip_of()->stats;
+        CHECK(stats.busy_violations == 0U);
+        CHECK(stats.wel_violations == 0U);
+        CHECK(stats.protect_violations == 0U);
+        CHECK(stats.nop_violations == 0U);
+        CHECK_ERR(ESP_OK, vspi_w25_free_bus(w25));
+        CHECK_ERR(ESP_OK, deinit_w25_struct(w25));
+    }
+
+    std::vector<uint8_t> pattern(size_t size, uint8_t seed){
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; i++){
+            data[i] = static_cast<uint8_t>((i*7U) + seed);
+        }
+        return data;
+    }
+
+    void write_read_every_bus_mode(void){
+        const w25_bus_mode modes[] = {W25_BUS_SINGLE, W25_BUS_DUAL, W25_BUS_QUAD};
+        for (const w25_bus_mode mode : modes){
+            winbond_t *w25 = setup(mode);
+            const std::vector<uint8_t> payload = pattern(W25_PAGE_SIZE, static_cast<uint8_t>(mode));
+            std::vector<uint8_t> receiver(W25_PAGE_SIZE, 0);
+            uint8_t jedec[3] = {0};
+
+            CHECK_ERR(ESP_OK, w25_GetJedecID(w25, jedec, sizeof(jedec)));
+            CHECK((jedec[0] == 0xEF) && (jedec[1] == 0xAA) && (jedec[2] == 0x21));
+            CHECK_ERR(ESP_OK, w25_BlockErase(w25, 3*W25_PAGES_PER_BLOCK, 20U));
+            CHECK_ERR(ESP_OK, w25_WriteMemory(w25, 0, 3*W25_PAGES_PER_BLOCK, payload.data(), payload.size()));
+            CHECK_ERR(ESP_OK, w25_ReadMemory(w25, 0, 3*W25_PAGES_PER_BLOCK, receiver.data(), receiver.size()));
+            CHECK(receiver == payload);
+            CHECK(memcmp(chip_of()->page(3*W25_PAGES_PER_BLOCK), payload.data(), payload.size()) == 0);
+            teardown(w25);
+        }
+    }
+
+    void continuous_read_across_pages(void){
+        winbond_t *w25 = setup(W25_BUS_QUAD);
+        const std::vector<uint8_t> payload = pattern(3*W25_PAGE_SIZE, 0x11);
+        std::vector<uint8_t> receiver(2*W25_PAGE_SIZE, 0);
+
+        CHECK_ERR(ESP_OK, w25_BlockErase(w25, 0, 20U));
+        CHECK_ERR(ESP_OK, w25_WriteRange(w25, 0, 0, payload.data(), payload.size()));
+        CHECK_ERR(ESP_OK, w25_ReadContinuous(w25, 100, 0, receiver.data(), receiver.size()));
+        CHECK(memcmp(receiver.data(), &payload[100], receiver.size()) == 0);
+        CHECK((w25_ReadStatusRegister(w25, CONFIG_REG) & BUF) != 0U);
+        teardown(w25);
+    }
+
+    void failures_reach_the_caller(void){
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        const std::vector<uint8_t> payload = pattern(64, 0x22);
+        bool bad = false;
+
+        chip_of()->set_erase_failure(5, true);
+        chip_of()->set_program_failure(6*W25_PAGES_PER_BLOCK, true);
+        chip_of()->mark_factory_bad(7);
+
+        CHECK_ERR(ESP_ERR_INVALID_STATE, w25_BlockErase(w25, 5*W25_PAGES_PER_BLOCK, 20U));
+        CHECK_ERR(ESP_OK, w25_BlockErase(w25, 6*W25_PAGES_PER_BLOCK, 20U));
+        CHECK_ERR(ESP_ERR_INVALID_STATE, w25_WriteMemory(w25, 0, 6*W25_PAGES_PER_BLOCK, payload.data(), payload.size()));
+        CHECK_ERR(ESP_OK, w25_IsBadBlock(w25, 7, &bad));
+        CHECK(bad);
+        CHECK_ERR(ESP_OK, w25_IsBadBlock(w25, 8, &bad));
+        CHECK(!bad);
+        teardown(w25);
+    }
+
+    void bad_block_swap_redirects_the_block(void){
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        const std::vector<uint8_t> payload = pattern(128, 0x33);
+        std::vector<uint8_t> receiver(payload.size(), 0);
+        w25_bbm_entry_t lut[W25_BBM_LUT_SIZE];
+
+        CHECK_ERR(ESP_OK, w25_BadBlockSwap(w25, 9, 900, 20U));
+        CHECK_ERR(ESP_OK, w25_ReadBBMLut(w25, lut));
+        CHECK(lut[0].enabled && (lut[0].logical_block == 9U) && (lut[0].physical_block == 900U));
+        CHECK(!lut[1].enabled);
+
+        CHECK_ERR(ESP_OK, w25_BlockErase(w25, 9*W25_PAGES_PER_BLOCK, 20U));
+        CHECK_ERR(ESP_OK, w25_WriteMemory(w25, 0, 9*W25_PAGES_PER_BLOCK, payload.data(), payload.size()));
+        CHECK_ERR(ESP_OK, w25_ReadMemory(w25, 0, 9*W25_PAGES_PER_BLOCK, receiver.data(), receiver.size()));
+        CHECK(receiver == payload);
+        CHECK(chip_of()->page(9*W25_PAGES_PER_BLOCK) == nullptr);
+        CHECK(chip_of()->page(900*W25_PAGES_PER_BLOCK) != nullptr);
+        teardown(w25);
+    }
+
+    void ecc_events_are_accounted(void){
+#if W25_METRICS_ENABLED
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        uint8_t receiver[16];
+        w25_metrics_t metrics;
+
+        chip_of()->set_ecc_error(10, w25_emu::ECC_CORRECTED);
+        chip_of()->set_ecc_error(11, w25_emu::ECC_UNCORRECTABLE);
+        CHECK_ERR(ESP_OK, w25_ResetMetrics(w25));
+        CHECK_ERR(ESP_OK, w25_ReadMemory(w25, 0, 10, receiver, sizeof(receiver)));
+        CHECK_ERR(ESP_OK, w25_ReadMemory(w25, 0, 11, receiver, sizeof(receiver)));
+        CHECK_ERR(ESP_OK, w25_ReadMemory(w25, 0, 12, receiver, sizeof(receiver)));
+        CHECK_ERR(ESP_OK, w25_GetMetrics(w25, &metrics));
+        CHECK(metrics.ecc_corrected == 1U);
+        CHECK(metrics.ecc_uncorrectable == 1U);
+        CHECK(metrics.opcodes[0x13] == 3U);
+        CHECK(metrics.latency[W25_LAT_PAGE_READ].count == 3U);
+        teardown(w25);
+#endif
+    }
+
+    //The outcome comes from the BUSY poll of the page load, the data transfer isn't followed by another status read
+    void reads_report_the_ecc_status(void){
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        std::vector<uint8_t> receiver(3*W25_PAGE_SIZE, 0);
+        w25_ecc_status ecc = W25_ECC_CLEAN;
+        uint16_t failed_page = 0;
+
+        chip_of()->set_ecc_error(20, w25_emu::ECC_CORRECTED);
+        chip_of()->set_ecc_error(21, w25_emu::ECC_UNCORRECTABLE);
+        chip_of()->set_ecc_error(22, w25_emu::ECC_UNCORRECTABLE);
+
+        CHECK_ERR(ESP_OK, w25_ReadMemoryECC(w25, 0, 19, receiver.data(), 16, &ecc));
+        CHECK(ecc == W25_ECC_CLEAN);
+        CHECK_ERR(ESP_OK, w25_ReadMemoryECC(w25, 0, 20, receiver.data(), 16, &ecc));
+        CHECK(ecc == W25_ECC_CORRECTED);
+        CHECK_ERR(ESP_OK, w25_ReadMemoryECC(w25, 0, 21, receiver.data(), 16, &ecc));
+        CHECK(ecc == W25_ECC_UNCORRECTABLE);
+        CHECK_ERR(ESP_OK, w25_LastECCFailure(w25, &failed_page, 20U));
+        CHECK(failed_page == 21U);
+
+        //Ending inside a page: finishing one would have the memory load the next one too
+        CHECK_ERR(ESP_OK, w25_ReadContinuousECC(w25, 0, 19, receiver.data(), W25_PAGE_SIZE + 16U, &ecc));
+        CHECK(ecc == W25_ECC_CORRECTED);
+        CHECK_ERR(ESP_OK, w25_ReadContinuousECC(w25, 0, 20, receiver.data(), W25_PAGE_SIZE + 16U, &ecc));
+        CHECK(ecc == W25_ECC_UNCORRECTABLE);
+        CHECK_ERR(ESP_OK, w25_ReadContinuousECC(w25, 0, 20, receiver.data(), (2U*W25_PAGE_SIZE) + 16U, &ecc));
+        CHECK(ecc == W25_ECC_MULTI_PAGE);
+        CHECK_ERR(ESP_OK, w25_LastECCFailure(w25, &failed_page, 20U));
+        CHECK(failed_page == 22U);
+        CHECK((w25_ReadStatusRegister(w25, CONFIG_REG) & BUF) != 0U);
+
+#if W25_METRICS_ENABLED
+        w25_metrics_t metrics;
+        CHECK_ERR(ESP_OK, w25_ResetMetrics(w25));
+        CHECK_ERR(ESP_OK, w25_ReadMemory(w25, 0, 21, receiver.data(), 16));
+        CHECK_ERR(ESP_OK, w25_GetMetrics(w25, &metrics));
+        CHECK(metrics.opcodes[0x05] == 1U); //The one poll after tRD
+#endif
+        teardown(w25);
+    }
+
+    void spare_bytes_go_with_the_data(void){
+        winbond_t *w25 = setup(W25_BUS_QUAD);
+        const std::vector<uint8_t> payload = pattern(W25_PAGE_SIZE, 0x55);
+        const std::vector<uint8_t> spare = pattern(W25_SPARE_SIZE, 0x66);
+        std::vector<uint8_t> receiver(W25_PAGE_SIZE, 0);
+        uint8_t spare_read[W25_SPARE_SIZE] = {0};
+        bool bad = true;
+
+        CHECK_ERR(ESP_OK, w25_BlockErase(w25, 30*W25_PAGES_PER_BLOCK, 20U));
+        const uint64_t programs = chip_of()->stats.programs;
+        CHECK_ERR(ESP_OK, w25_WriteMemorySpare(w25, 0, 30*W25_PAGES_PER_BLOCK, payload.data(), payload.size(), spare.data(), spare.size()));
+        CHECK(chip_of()->stats.programs == programs + 1U);
+        CHECK_ERR(ESP_OK, w25_ReadSpare(w25, 30*W25_PAGES_PER_BLOCK, spare_read, sizeof(spare_read)));
+        CHECK(memcmp(spare_read, spare.data(), sizeof(spare_read)) == 0);
+        CHECK_ERR(ESP_OK, w25_ReadMemory(w25, 0, 30*W25_PAGES_PER_BLOCK, receiver.data(), receiver.size()));
+        CHECK(receiver == payload);
+
+        //Laid out on User Data I, the marker of the block stays good
+        const uint8_t *raw = chip_of()->page(30*W25_PAGES_PER_BLOCK);
+        CHECK((raw[0x804] == spare[0]) && (raw[0x807] == spare[3]) && (raw[0x814] == spare[4]) && (raw[0x837] == spare[15]));
+        CHECK((raw[0x800] == 0xFFU) && (raw[0x808] == 0xFFU) && (raw[0x812] == 0xFFU));
+        CHECK_ERR(ESP_OK, w25_IsBadBlock(w25, 30, &bad));
+        CHECK(!bad);
+
+        //Spare bytes alone, on a page whose data is programmed later
+        CHECK_ERR(ESP_OK, w25_WriteMemorySpare(w25, 0, (30*W25_PAGES_PER_BLOCK) + 1U, nullptr, 0, spare.data(), 4));
+        CHECK_ERR(ESP_OK, w25_ReadSpare(w25, (30*W25_PAGES_PER_BLOCK) + 1U, spare_read, sizeof(spare_read)));
+        CHECK((memcmp(spare_read, spare.data(), 4) == 0) && (spare_read[4] == 0xFFU));
+
+        CHECK_ERR(ESP_ERR_INVALID_ARG, w25_ReadSpare(w25, 0, spare_read, W25_SPARE_SIZE + 1U));
+        CHECK_ERR(ESP_ERR_INVALID_ARG, w25_WriteMemorySpare(w25, 16, 0, payload.data(), payload.size(), spare.data(), spare.size()));
+        teardown(w25);
+    }
+
+    //The board garbles MISO above 45MHz, and above 25MHz without 20ns of input delay: 40MHz with 20ns is the best step
+    void calibration_finds_the_fastest_reliable_clock(void){
+        winbond_t *w25 = setup(W25_BUS_QUAD);
+        const std::vector<uint8_t> payload = pattern(W25_PAGE_SIZE, 0x77);
+        std::vector<uint8_t> receiver(W25_PAGE_SIZE, 0);
+        uint32_t clock_hz = 0;
+
+        chip_of()->wiring.max_clock_hz = 45000000;
+        chip_of()->wiring.late_above_hz = 25000000;
+        chip_of()->wiring.miso_delay_ns = 20;
+        const uint64_t programs = chip_of()->stats.programs;
+        CHECK_ERR(ESP_OK, w25_SetClock(w25, 8000000, 0));
+        CHECK_ERR(ESP_OK, w25_CalibrateClock(w25, 80000000, &clock_hz));
+        CHECK(clock_hz == 40000000U);
+        CHECK(chip_of()->stats.programs == programs); //The data buffer is enough
+
+        CHECK_ERR(ESP_OK, w25_BlockErase(w25, 40*W25_PAGES_PER_BLOCK, 20U));
+        CHECK_ERR(ESP_OK, w25_WriteMemory(w25, 0, 40*W25_PAGES_PER_BLOCK, payload.data(), payload.size()));
+        CHECK_ERR(ESP_OK, w25_ReadMemory(w25, 0, 40*W25_PAGES_PER_BLOCK, receiver.data(), receiver.size()));
+        CHECK(receiver == payload);
+
+        //Capped by the caller, and nothing to gain when the board can't go past the configured clock
+        CHECK_ERR(ESP_OK, w25_SetClock(w25, 8000000, 0));
+        CHECK_ERR(ESP_OK, w25_CalibrateClock(w25, 20000000, &clock_hz));
+        CHECK(clock_hz == 20000000U);
+        chip_of()->wiring.max_clock_hz = 8000000;
+        CHECK_ERR(ESP_OK, w25_SetClock(w25, 8000000, 0));
+        CHECK_ERR(ESP_OK, w25_CalibrateClock(w25, 80000000, &clock_hz));
+        CHECK(clock_hz == 8000000U);
+        CHECK_ERR(ESP_ERR_INVALID_ARG, w25_SetClock(w25, W25_MAX_CLOCK_HZ + 1U, 0));
+        CHECK_ERR(ESP_ERR_INVALID_ARG, w25_SetClock(w25, 100000000, 0)); //Refused by the host, the last clock stays
+        CHECK_ERR(ESP_OK, w25_ReadMemory(w25, 0, 40*W25_PAGES_PER_BLOCK, receiver.data(), receiver.size()));
+        CHECK(receiver == payload);
+        teardown(w25);
+    }
+
+    struct sample{
+        uint16_t sensor;
+        float value;
+    };
+
+    using float_log = w25::RecordLog<float, 50, 4>;
+    using sample_log = w25::RecordLog<sample, 60, 3, 1, 16>;
+    static_assert(float_log::records_per_page == 512U, "floats are packed back to back");
+    static_assert(float_log::capacity == 512U*63U*3U, "the erased block holds nothing");
+    static_assert((sample_log::layout::slot_size == 16U) && (sample_log::records_per_page == 128U), "padded slots");
+
+    void record_log_packs_whole_pages(void){
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        w25_log_stats_t stats;
+        w25_log_reader_t reader;
+        float value = 0.0F;
+
+        {
+            float_log samples;
+            CHECK_ERR(ESP_OK, samples.open(w25, nullptr));
+            CHECK_ERR(ESP_ERR_INVALID_STATE, samples.open(w25, nullptr));
+            for (int i = 0; i < 1000; i++){
+                CHECK_ERR(ESP_OK, samples.append(static_cast<float>(i)*0.5F));
+            }
+            CHECK_ERR(ESP_OK, samples.flush());
+            samples.stats(&stats);
+            CHECK(stats.page_programs == 3U); //Block header, a full page, then the flush of the 488 left
+            CHECK(stats.records == 1000U);
+        } //Closed on destruction
+
+        float_log reopened;
+        CHECK_ERR(ESP_OK, reopened.open(w25, nullptr));
+        reopened.rewind(&reader);
+        int count = 0;
+        bool ordered = true;
+        const uint64_t page_reads = chip_of()->stats.page_reads;
+        while (reopened.read(&reader, &value) == ESP_OK){
+            ordered = ordered && (value == (static_cast<float>(count)*0.5F));
+            count++;
+        }
+        CHECK(ordered && (count == 1000));
+        CHECK((chip_of()->stats.page_reads - page_reads) == 2U); //Each page is loaded once
+        CHECK_ERR(ESP_OK, reopened.close());
+        CHECK_ERR(ESP_ERR_INVALID_STATE, reopened.append(1.0F));
+
+        sample_log padded;
+        sample read_back = {0, 0.0F};
+        CHECK_ERR(ESP_OK, padded.open(w25, nullptr));
+        CHECK_ERR(ESP_OK, padded.append({7, 3.25F}));
+        padded.rewind(&reader);
+        CHECK_ERR(ESP_OK, padded.read(&reader, &read_back));
+        CHECK((read_back.sensor == 7U) && (read_back.value == 3.25F));
+        CHECK_ERR(ESP_OK, padded.close());
+        teardown(w25);
+    }
+
+    void record_log_skips_a_failed_page(void){
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        w25_log_stats_t stats;
+        w25_log_reader_t reader;
+        float value = 0.0F;
+        float_log samples;
+        int rejected = 0;
+
+        chip_of()->set_program_failure((50U*W25_PAGES_PER_BLOCK) + 2U, true); //Second record page of the first block
+        CHECK_ERR(ESP_OK, samples.open(w25, nullptr));
+        for (int i = 0; i < 2000; i++){
+            const float sample = static_cast<float>(i);
+            if (samples.append(sample) != ESP_OK){ //The full page failed, the record wasn't taken
+                rejected++;
+                CHECK_ERR(ESP_OK, samples.append(sample));
+            }
+        }
+        CHECK_ERR(ESP_OK, samples.flush());
+        samples.stats(&stats);
+        CHECK(rejected == 1);
+        CHECK((stats.failed_programs == 1U) && (stats.records == 2000U));
+
+        samples.rewind(&reader);
+        int count = 0;
+        bool ordered = true;
+        while (samples.read(&reader, &value) == ESP_OK){
+            ordered = ordered && (value == static_cast<float>(count));
+            count++;
+        }
+        CHECK(ordered && (count == 2000));
+        CHECK_ERR(ESP_OK, samples.close());
+        teardown(w25);
+    }
+
+    void record_log_passes_over_a_bad_block(void){
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        w25_log_stats_t stats;
+        w25_log_reader_t reader;
+        float value = 0.0F;
+        bool bad = false;
+        const int per_block = static_cast<int>(float_log::records_per_block);
+        const int appended = (8*per_block) - 1000; //Twice around the circle, the head block isn't full
+
+        chip_of()->set_erase_failure(52, true);
+        {
+            float_log samples;
+            CHECK_ERR(ESP_OK, samples.open(w25, nullptr));
+            bool appending = true;
+            for (int i = 0; (i < appended) && appending; i++){
+                appending = (samples.append(static_cast<float>(i)) == ESP_OK);
+            }
+            CHECK(appending);
+            samples.stats(&stats);
+            CHECK(stats.bad_blocks == 3U); //Block 52 fails each time it is erased ahead of the head
+            CHECK(stats.reclaimed_blocks == 7U); //The bad block counts, the tail moves past it
+        }
+        CHECK_ERR(ESP_OK, w25_IsBadBlock(w25, 52, &bad));
+        CHECK(bad);
+
+        float_log reopened; //The head is found again without the block that failed
+        CHECK_ERR(ESP_OK, reopened.open(w25, nullptr));
+        reopened.rewind(&reader);
+        int count = 0;
+        bool ordered = true;
+        const int first = 5*per_block; //Blocks 53, 50 and 51 hold the third lap
+        while (reopened.read(&reader, &value) == ESP_OK){
+            ordered = ordered && (value == static_cast<float>(first + count));
+            count++;
+        }
+        CHECK(ordered && ((first + count) == appended));
+        CHECK_ERR(ESP_OK, reopened.close());
+        teardown(w25);
+    }
+
+    //Slow temperature readings with a 0.01 resolution, as a sensor gives them
+    std::vector<float> readings(size_t count, uint32_t start){
+        std::vector<float> data(count);
+        for (size_t i = 0; i < count; i++){
+            const uint32_t n = start + static_cast<uint32_t>(i);
+            data[i] = 21.0F + (static_cast<float>(static_cast<int>((n / 7U) % 300U) - 150)*0.01F);
+        }
+        return data;
+    }
+
+    void series_compresses_and_seeks(void){
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        const w25_series_config_t config = {70, 2};
+        w25_series_t *series = nullptr;
+        w25_series_stats_t stats;
+        const std::vector<float> samples = readings(20000, 0);
+        std::vector<float> receiver(samples.size(), 0.0F);
+        size_t read = 0;
+        uint32_t first = 1;
+        uint32_t end = 0;
+
+        CHECK_ERR(ESP_OK, w25_SeriesOpen(w25, &config, &series));
+        w25_SeriesRange(series, &first, &end);
+        CHECK((first == 0U) && (end == 0U));
+        CHECK_ERR(ESP_OK, w25_SeriesAppend(series, samples.data(), samples.size()));
+        w25_SeriesGetStats(series, &stats);
+        CHECK(stats.frames > 0U);
+        CHECK((stats.encoded_bytes*3U) < (stats.frames*W25_PAGE_SIZE*8U)); //Compressed well over twice
+
+        //Seeking into a frame on the memory, across frames, into the pending one
+        CHECK_ERR(ESP_OK, w25_SeriesRead(series, 5000, receiver.data(), 12000, &read));
+        CHECK((read == 12000U) && (memcmp(receiver.data(), &samples[5000], read*sizeof(float)) == 0));
+        CHECK_ERR(ESP_OK, w25_SeriesRead(series, 19990, receiver.data(), 100, &read));
+        CHECK((read == 10U) && (memcmp(receiver.data(), &samples[19990], read*sizeof(float)) == 0));
+        CHECK_ERR(ESP_ERR_NOT_FOUND, w25_SeriesRead(series, 20000, receiver.data(), 1, &read));
+        CHECK_ERR(ESP_OK, w25_SeriesClose(series));
+
+        //Reopened from the spare areas alone
+        CHECK_ERR(ESP_OK, w25_SeriesOpen(w25, &config, &series));
+        w25_SeriesRange(series, &first, &end);
+        CHECK((first == 0U) && (end == 20000U));
+        CHECK_ERR(ESP_OK, w25_SeriesRead(series, 0, receiver.data(), receiver.size(), &read));
+        CHECK((read == samples.size()) && (receiver == samples));
+
+        //Flushing every few samples fills both blocks, the oldest one is dropped on the wrap around
+        for (uint32_t n = 20000; n < 20000 + (140U*10U); n += 10U){
+            const std::vector<float> more = readings(10, n);
+            CHECK_ERR(ESP_OK, w25_SeriesAppend(series, more.data(), more.size()));
+            CHECK_ERR(ESP_OK, w25_SeriesFlush(series));
+        }
+        w25_SeriesRange(series, &first, &end);
+        CHECK((first > 0U) && (end == 21400U));
+        CHECK_ERR(ESP_ERR_NOT_FOUND, w25_SeriesRead(series, first - 1U, receiver.data(), 1, &read));
+        CHECK_ERR(ESP_OK, w25_SeriesRead(series, first, receiver.data(), receiver.size(), &read));
+        const std::vector<float> tail = readings(end - first, first);
+        CHECK((read == tail.size()) && (memcmp(receiver.data(), tail.data(), read*sizeof(float)) == 0));
+        CHECK_ERR(ESP_OK, w25_SeriesClose(series));
+        teardown(w25);
+    }
+
+    //Value of key n, its length and bytes change with every version
+    std::vector<uint8_t> kv_value(uint32_t n, uint32_t version){
+        return pattern(size_t{16} + ((n*37U + version*101U) % 600U), static_cast<uint8_t>(n + version));
+    }
+
+    bool kv_value_is(w25_kv_t *kv, const char *key, const std::vector<uint8_t> &expected){
+        std::vector<uint8_t> value(W25_KV_MAX_VALUE_SIZE, 0);
+        size_t size = 0;
+        return (w25_KvGet(kv, key, value.data(), value.size(), &size) == ESP_OK) && (size == expected.size())
+            && (memcmp(value.data(), expected.data(), size) == 0);
+    }
+
+    bool count_keys(const char *key, const void *value, size_t size, void *arg){
+        (void)key;
+        (void)value;
+        (void)size;
+        (*static_cast<uint32_t *>(arg))++;
+        return true;
+    }
+
+    void kv_store_puts_gets_and_compacts(void){
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        const w25_kv_config_t config = {80, 3, 64};
+        w25_kv_t *kv = nullptr;
+        w25_kv_stats_t stats;
+        w25_metrics_t metrics;
+        char key[16];
+        std::vector<uint32_t> versions(48, 0);
+
+        const w25_kv_config_t too_few_blocks = {80, 2, 64};
+        CHECK_ERR(ESP_ERR_INVALID_ARG, w25_KvOpen(w25, &too_few_blocks, &kv));
+        CHECK_ERR(ESP_OK, w25_KvOpen(w25, &config, &kv));
+        for (uint32_t n = 0; n < versions.size(); n++){
+            (void)snprintf(key, sizeof(key), "key%u", static_cast<unsigned int>(n));
+            CHECK_ERR(ESP_OK, w25_KvPut(kv, key, kv_value(n, 0).data(), kv_value(n, 0).size()));
+        }
+        CHECK_ERR(ESP_ERR_INVALID_ARG, w25_KvPut(kv, "", nullptr, 0));
+        CHECK_ERR(ESP_ERR_INVALID_ARG, w25_KvPut(kv, "a key longer than thirty-two chars", nullptr, 0));
+        CHECK_ERR(ESP_ERR_NOT_FOUND, w25_KvGet(kv, "missing", nullptr, 0, nullptr));
+
+        //An entry on the memory costs one page read, one still in RAM none
+        CHECK_ERR(ESP_OK, w25_ResetMetrics(w25));
+        CHECK(kv_value_is(kv, "key0", kv_value(0, 0)));
+        CHECK(kv_value_is(kv, "key47", kv_value(47, 0)));
+        CHECK_ERR(ESP_OK, w25_GetMetrics(w25, &metrics));
+        CHECK(metrics.opcodes[0x13] == 1U);
+        size_t size = 0;
+        uint8_t small[8];
+        CHECK_ERR(ESP_ERR_INVALID_SIZE, w25_KvGet(kv, "key1", small, sizeof(small), &size));
+        CHECK(size == kv_value(1, 0).size());
+
+        //Overwrites and deletes, with the index rebuilt from the memory
+        for (uint32_t n = 0; n < versions.size(); n += 3U){
+            (void)snprintf(key, sizeof(key), "key%u", static_cast<unsigned int>(n));
+            versions[n]++;
+            CHECK_ERR(ESP_OK, w25_KvPut(kv, key, kv_value(n, versions[n]).data(), kv_value(n, versions[n]).size()));
+        }
+        for (uint32_t n = 1; n < versions.size(); n += 4U){
+            (void)snprintf(key, sizeof(key), "key%u", static_cast<unsigned int>(n));
+            CHECK_ERR(ESP_OK, w25_KvDelete(kv, key));
+            CHECK_ERR(ESP_ERR_NOT_FOUND, w25_KvDelete(kv, key));
+        }
+        CHECK_ERR(ESP_OK, w25_KvClose(kv));
+        CHECK_ERR(ESP_OK, w25_KvOpen(w25, &config, &kv));
+        uint32_t keys = 0;
+        CHECK_ERR(ESP_OK, w25_KvIterate(kv, count_keys, &keys));
+        CHECK(keys == 36U);
+        for (uint32_t n = 0; n < versions.size(); n++){
+            (void)snprintf(key, sizeof(key), "key%u", static_cast<unsigned int>(n));
+            if ((n % 4U) == 1U){
+                CHECK_ERR(ESP_ERR_NOT_FOUND, w25_KvGet(kv, key, nullptr, 0, nullptr));
+            }else{
+                CHECK(kv_value_is(kv, key, kv_value(n, versions[n])));
+            }
+        }
+
+        //Rewriting a few keys over and over goes through the blocks many times: the oldest one is compacted
+        for (uint32_t i = 0; i < 3000U; i++){
+            const uint32_t n = (i*4U) % 24U;
+            (void)snprintf(key, sizeof(key), "key%u", static_cast<unsigned int>(n));
+            versions[n]++;
+            CHECK_ERR(ESP_OK, w25_KvPut(kv, key, kv_value(n, versions[n]).data(), kv_value(n, versions[n]).size()));
+        }
+        w25_KvGetStats(kv, &stats);
+        CHECK((stats.keys == 36U) && (stats.compactions > 3U) && (stats.relocated > 0U));
+        CHECK_ERR(ESP_OK, w25_KvClose(kv));
+        CHECK_ERR(ESP_OK, w25_KvOpen(w25, &config, &kv));
+        for (uint32_t n = 0; n < versions.size(); n++){
+            (void)snprintf(key, sizeof(key), "key%u", static_cast<unsigned int>(n));
+            CHECK(((n % 4U) == 1U) || kv_value_is(kv, key, kv_value(n, versions[n])));
+        }
+
+        //Once the live entries fill the blocks, puts fail and leave the store as it was
+        const std::vector<uint8_t> large = pattern(W25_KV_MAX_VALUE_SIZE, 9);
+        esp_err_t err = ESP_OK;
+        uint32_t stored = 0;
+        for (; (err == ESP_OK) && (stored < 64U); stored++){
+            (void)snprintf(key, sizeof(key), "large%u", static_cast<unsigned int>(stored));
+            err = w25_KvPut(kv, key, large.data(), large.size());
+        }
+        CHECK_ERR(ESP_ERR_NO_MEM, err);
+        CHECK(stored > 20U);
+        CHECK(kv_value_is(kv, "large0", large));
+        CHECK(kv_value_is(kv, "key0", kv_value(0, versions[0])));
+        CHECK_ERR(ESP_OK, w25_KvClose(kv));
+        teardown(w25);
+    }
+
+    //A page read costs tRD plus the bits clocked, not a FreeRTOS tick
+    void timing_follows_the_model(void){
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        std::vector<uint8_t> receiver(W25_PAGE_SIZE, 0);
+
+        int64_t start = host_now_us();
+        CHECK_ERR(ESP_OK, w25_ReadMemory(w25, 0, 0, receiver.data(), receiver.size()));
+        const int64_t read_us = host_now_us() - start;
+        CHECK((read_us > 25 + 409) && (read_us < 25 + 409 + 100)); //2048 bytes at 40MHz take 409us
+
+        start = host_now_us();
+        CHECK_ERR(ESP_OK, w25_BlockErase(w25, 0, 20U));
+        const int64_t erase_us = host_now_us() - start;
+        CHECK((erase_us >= 2000) && (erase_us < 2500));
+        teardown(w25);
+    }
+
+    void pool_and_scheduler_run_their_tasks(void){
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        const w25_pool_config_t config = {20, 4, 2, 0};
+        w25_pool_t *pool = nullptr;
+        w25_sched_t *sched = nullptr;
+        uint16_t block = 0;
+        const std::vector<uint8_t> payload = pattern(256, 0x44);
+        std::vector<uint8_t> receiver(payload.size(), 0);
+
+        CHECK_ERR(ESP_OK, w25_PoolCreate(w25, &config, 1, &pool));
+        CHECK_ERR(ESP_OK, w25_PoolTake(pool, &block, 1000));
+        CHECK((block >= 20U) && (block < 24U));
+
+        CHECK_ERR(ESP_OK, w25_SchedCreate(w25, 8, 2, &sched));
+        CHECK_ERR(ESP_OK, w25_SchedWrite(sched, W25_IO_NORMAL, 0, block*W25_PAGES_PER_BLOCK, payload.data(), payload.size()));
+        CHECK_ERR(ESP_OK, w25_SchedSync(sched, 1000));
+        CHECK_ERR(ESP_OK, w25_SchedRead(sched, W25_IO_URGENT, 0, block*W25_PAGES_PER_BLOCK, receiver.data(), receiver.size()));
+        CHECK(receiver == payload);
+        CHECK_ERR(ESP_OK, w25_SchedDestroy(sched));
+
+        CHECK_ERR(ESP_OK, w25_PoolRelease(pool, block));
+        w25_PoolDestroy(pool);
+        teardown(w25);
+    }
+
+    void pool_runs_dry_once_every_block_is_taken(void){
+        winbond_t *w25 = setup(W25_BUS_SINGLE);
+        const w25_pool_config_t config = {20, 4, 2, 0};
+        w25_pool_t *pool = nullptr;
+        w25_pool_stats_t stats;
+        uint16_t blocks[4] = {0};
+        uint16_t extra = 0;
+
+        CHECK_ERR(ESP_OK, w25_PoolCreate(w25, &config, 1, &pool));
+        for (int i = 0; (i < 100) && (w25_PoolReady(pool) < 4U); i++){
+            vTaskDelay(pdMS_TO_TICKS(10)); //The worker erases the whole range first
+        }
+        CHECK(w25_PoolReady(pool) == 4U);
+        for (uint16_t &block : blocks){
+            CHECK_ERR(ESP_OK, w25_PoolTake(pool, &block, 0));
+        }
+        CHECK_ERR(ESP_ERR_TIMEOUT, w25_PoolTake(pool, &extra, 50)); //Nothing is left to erase
+        w25_PoolGetStats(pool, &stats);
+        CHECK((stats.takes == 4U) && (stats.dry == 1U));
+        CHECK((stats.erases == 4U) && (stats.bad_blocks == 0U));
+        CHECK(chip_of()->stats.erases == 4U);
+
+        for (const uint16_t block : blocks){
+            CHECK_ERR(ESP_OK, w25_PoolRelease(pool, block));
+        }
+        w25_PoolDestroy(pool);
+        teardown(w25);
+    }
+
+    void scheduler_loads_a_coalesced_write_in_pieces(void){
+        w25_emu::detach_all();
+        w25_config_t config = W25_CONFIG_DEFAULT();
+        config.max_trans_size = 68U; //Far less than the span of the coalesced write
+        winbond_t *w25 = w25_Create(&config);
+        CHECK_ERR(ESP_OK, vspi_w25_alloc_bus(w25));
+        CHECK_ERR(ESP_OK, w25_Initialize(w25));
+        w25_sched_t *sched = nullptr;
+        w25_sched_stats_t stats;
+        const uint16_t page_addr = 30U*W25_PAGES_PER_BLOCK;
+        const std::vector<uint8_t> head = pattern(32, 0x51);
+        const std::vector<uint8_t> tail = pattern(32, 0x62);
+        std::vector<uint8_t> receiver(1032, 0);
+
+        CHECK_ERR(ESP_OK, w25_SchedCreate(w25, 8, 2, &sched));
+        CHECK_ERR(ESP_OK, w25_Lock(w25)); //The erase waits for the memory, the writes behind it stay queued
+        CHECK_ERR(ESP_OK, w25_SchedErase(sched, W25_IO_BACKGROUND, page_addr));
+        CHECK_ERR(ESP_OK, w25_SchedWrite(sched, W25_IO_BACKGROUND, 0, page_addr, head.data(), head.size()));
+        CHECK_ERR(ESP_OK, w25_SchedWrite(sched, W25_IO_BACKGROUND, 1000, page_addr, tail.data(), tail.size()));
+        w25_Unlock(w25);
+        CHECK_ERR(ESP_OK, w25_SchedSync(sched, 1000));
+        w25_SchedGetStats(sched, &stats);
+        CHECK(stats.coalesced_writes == 1U);
+        CHECK_ERR(ESP_OK, w25_SchedDestroy(sched));
+
+        CHECK_ERR(ESP_OK, w25_ReadRange(w25, 0, page_addr, receiver.data(), receiver.size()));
+        CHECK(std::equal(head.begin(), head.end(), receiver.begin()));
+        CHECK(std::equal(tail.begin(), tail.end(), receiver.begin() + 1000));
+        CHECK(std::all_of(receiver.begin() + 32, receiver.begin() + 1000, [](uint8_t byte){ return byte == 0xFFU; }));
+        teardown(w25);
+    }
+
+    struct host_test{
+        const char *name;
+        void (*run)(void);
+    };
+
+    const host_test tests[] = {
+        {"WRITE/READ A PAGE ON EVERY BUS MODE", write_read_every_bus_mode},
+        {"CONTINUOUS READ ACROSS PAGES", continuous_read_across_pages},
+        {"ERASE AND PROGRAM FAILURES REACH THE CALLER", failures_reach_the_caller},
+        {"BAD BLOCK SWAP REDIRECTS THE BLOCK", bad_block_swap_redirects_the_block},
+        {"ECC EVENTS ARE ACCOUNTED", ecc_events_are_accounted},
+        {"READS REPORT THE ECC STATUS", reads_report_the_ecc_status},
+        {"SPARE BYTES GO WITH THE DATA", spare_bytes_go_with_the_data},
+        {"CALIBRATION FINDS THE FASTEST RELIABLE CLOCK", calibration_finds_the_fastest_reliable_clock},
+        {"RECORD LOG PACKS WHOLE PAGES", record_log_packs_whole_pages},
+        {"RECORD LOG SKIPS A PAGE THAT FAILS TO PROGRAM", record_log_skips_a_failed_page},
+        {"RECORD LOG PASSES OVER A BLOCK THAT FAILS TO ERASE", record_log_passes_over_a_bad_block},
+        {"SERIES COMPRESSES AND SEEKS", series_compresses_and_seeks},
+        {"KV STORE PUTS, GETS AND COMPACTS", kv_store_puts_gets_and_compacts},
+        {"TIMING FOLLOWS THE MODEL", timing_follows_the_model},
+        {"POOL AND SCHEDULER RUN THEIR TASKS", pool_and_scheduler_run_their_tasks},
+        {"POOL RUNS DRY ONCE EVERY BLOCK IS TAKEN", pool_runs_dry_once_every_block_is_taken},
+        {"SCHEDULER LOADS A COALESCED WRITE IN PIECES", scheduler_loads_a_coalesced_write_in_pieces},
+    };
+}
+
+int main(void){
+    int failed_tests = 0;
+    for (const host_test &test : tests){
+        const int before = failures;
+        test.run();
+        const bool passed = (failures == before);
+        printf("%s %s\n", passed ? "PASS" : "FAIL", test.name);
+        failed_tests += passed ? 0 : 1;
+    }
+    printf("%d tests, %d failed\n", static_cast<int>(sizeof(tests)/sizeof(tests[0])), failed_tests);
+    return (failed_tests == 0) ? 0 : 1;
+}
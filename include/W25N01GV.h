@@ -7,6 +7,8 @@ extern "C" {
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include "driver/spi_common.h"
+#include "hal/gpio_types.h"
 
 //Protection Register Bit Fields
 #define SRP0       0b10000000 //Status Regiter Protect-0 (Volatile Writable, OTP Lock)
@@ -29,6 +31,7 @@ extern "C" {
 //Status Register-3
 #define LUT_F      0b01000000 //BBM LUT Full (Status-Only)
 #define ECC_1      0b00100000 //ECC Status Bit (Status-Only)
+#define ECC_0      0b00010000 //ECC Status Bit (Status-Only)
 #define P_FAIL     0b00001000 //Program Failure (Status-Only)
 #define E_FAIL     0b00000100 //Erase Failure (Status-Only)
 #define WEL        0b00000010 //Write Enable Latch (Status-Only)
@@ -37,6 +40,18 @@ extern "C" {
 #define WINBOND_MAN_ID       0xEF
 #define W25_DEV_ID           0xAA21
 
+//Memory Geometry
+#define W25_PAGE_SIZE        2048U //Data bytes per page (the 64 spare bytes aren't included)
+#define W25_PAGES_PER_BLOCK  64U
+#define W25_BLOCK_COUNT      1024U
+#define W25_USABLE_BLOCKS    (W25_BLOCK_COUNT - 1U) //Blocks in the driver's allowed range, the last one is left out
+#define W25_USABLE_PAGES     (W25_USABLE_BLOCKS*W25_PAGES_PER_BLOCK)
+#define W25_ERASE_TIMEOUT_MS 20U   //Block erase timeout of the modules built on the driver, twice tBE max
+#define W25_BBM_LUT_SIZE     20U   //Links kept by the Bad Block Management Look Up Table
+#define W25_MAX_PARTIAL_PROGRAMS 4U //Partial page programs (NOP) allowed on a page between two erases
+#define W25_MAX_CLOCK_HZ     104000000U //Fastest SCLK of the memory, the ESP32 stops at 80MHz (IO_MUX pins)
+#define W25_SPARE_SIZE       16U   //ECC protected spare bytes per page left to the application (User Data I of the 4 sectors)
+
 //Registers
 typedef enum {
 	PROTEC_REG = 0xA0,
@@ -44,24 +59,188 @@ typedef enum {
 	STATUS_REG = 0xC0
 } reg_addr;
 
+//Bus Modes
+typedef enum {
+	W25_BUS_SINGLE = 0, //Standard SPI, data on MOSI/MISO
+	W25_BUS_DUAL   = 1, //Dual I/O reads, data on IO0-IO1
+	W25_BUS_QUAD   = 2  //Quad I/O reads and Quad Program Data Load, WP and HOLD become IO2 and IO3
+} w25_bus_mode;
+
+//Wiring and bus settings of one memory. Memories on different hosts run concurrently, the ones sharing a host
+//share its data pins (and must agree on the bus mode) with a CS pin each
+typedef struct {
+	spi_host_device_t host;   //HSPI_HOST or VSPI_HOST
+	gpio_num_t mosi;
+	gpio_num_t miso;
+	gpio_num_t sclk;
+	gpio_num_t cs;
+	gpio_num_t hold;          //GPIO_NUM_NC when it's tied high on the board
+	gpio_num_t wp;            //GPIO_NUM_NC when it's tied high on the board
+	uint32_t clock_speed_hz;  //Up to W25_MAX_CLOCK_HZ, see w25_CalibrateClock
+	int input_delay_ns;       //MISO valid time after SCLK, lets the host sample later at high clocks
+	w25_bus_mode bus_mode;    //Quad needs hold and wp
+	size_t max_trans_size;    //Size of the driver's internal buffer, see init_w25_struct
+} w25_config_t;
+
+#define W25_CONFIG_DEFAULT() { \
+	.host = VSPI_HOST,            \
+	.mosi = GPIO_NUM_23,          \
+	.miso = GPIO_NUM_19,          \
+	.sclk = GPIO_NUM_18,          \
+	.cs = GPIO_NUM_5,             \
+	.hold = GPIO_NUM_17,          \
+	.wp = GPIO_NUM_16,            \
+	.clock_speed_hz = 8000000,    \
+	.input_delay_ns = 0,          \
+	.bus_mode = W25_BUS_SINGLE,   \
+	.max_trans_size = W25_PAGE_SIZE + 4U \
+}
+
+//Timing model used to wait for the BUSY bit. Defaults to the typical datasheet values
+typedef struct {
+	uint32_t page_read_us; //tRD, Page Data Read
+	uint32_t program_us;   //tPP, Program Execute
+	uint32_t erase_us;     //tBE, Block Erase
+	uint32_t poll_us;      //Shortest interval between status polls
+} w25_timing_t;
+
+//ECC-1 and ECC-0 once a page is in the data buffer, as reported by the read functions
+typedef enum {
+	W25_ECC_CLEAN = 0,          //No errors
+	W25_ECC_CORRECTED = 1,      //1 to 4 bits were wrong and got corrected
+	W25_ECC_UNCORRECTABLE = 2,  //More than 4 bits wrong in a single page, the data isn't reliable
+	W25_ECC_MULTI_PAGE = 3      //Continuous reads only, more than one page failed. w25_LastECCFailure tells the last one
+} w25_ecc_status;
+
+//Bad Block Management Look Up Table entry
+typedef struct {
+	uint16_t logical_block;  //Block that was replaced
+	uint16_t physical_block; //Block accessed in its place
+	bool enabled;            //The link is active
+	bool invalid;            //The link was set but the replacement block failed too
+} w25_bbm_entry_t;
+
+//Scatter-gather segments: buffer_size bytes starting at column_addr of page_addr, can run into the next pages
+typedef struct {
+	uint16_t page_addr;
+	uint16_t column_addr;
+	uint8_t *buffer;
+	size_t buffer_size;
+} w25_read_segment_t;
+
+typedef struct {
+	uint16_t page_addr;
+	uint16_t column_addr;
+	const uint8_t *buffer;
+	size_t buffer_size;
+} w25_write_segment_t;
+
+//Append position, plain data so it can be kept on RTC memory across deep sleep
+typedef struct {
+	uint16_t page_addr;   //Page being filled
+	uint16_t column_addr; //First free byte of the page
+	uint8_t programs;     //Partial programs already done on the page
+} w25_append_cursor_t;
+
 typedef struct winbond winbond_t;
 
+/**
+Completion callback of the asynchronous page functions. It runs on the driver's I/O task while the bus
+is held, so it must not call the synchronous functions of this driver; hand the page over to your own task instead.
+*/
+typedef void (*w25_async_cb_t)(esp_err_t err, uint16_t page_addr, void *arg);
+
+/**
+Same as w25_Create with W25_CONFIG_DEFAULT (VSPI) and the given buffer size.
+*/
 winbond_t *init_w25_struct(size_t max_trans_size);
+/**
+Creates the object of a memory wired as described by config. Several memories can exist at once, each one
+with its own bus lock, buffer and timing model.
+@param const w25_config_t* **config** - host, pins and clock of the memory, see W25_CONFIG_DEFAULT
+@return **winbond_t*** - the object, the bus is allocated afterwards with vspi_w25_alloc_bus.
+*/
+winbond_t *w25_Create(const w25_config_t *config);
 esp_err_t deinit_w25_struct(winbond_t *w25);
+/**
+Initializes the SPI host of the memory, unless another memory already did it, and adds the memory to it.
+@param winbond_t* **w25** - pointer to the object refered to.
+@return **esp_err_t** - ESP_FAIL if the host couldn't be initialized, error of spi_bus_add_device otherwise.
+*/
 esp_err_t vspi_w25_alloc_bus(winbond_t *w25);
+/**
+Removes the memory from its SPI host, which is freed once the last device leaves it.
+@param winbond_t* **w25** - pointer to the object refered to.
+@return **esp_err_t** - ESP_ERR_TIMEOUT if the bus lock wasn't available, ESP_FAIL otherwise.
+*/
 esp_err_t vspi_w25_free_bus(winbond_t *w25);
+/**
+Holds the memory for the calling task until w25_Unlock. Every function taking a const winbond_t* may be called
+from several tasks: each one holds the memory for its whole command sequence (write enable, load, program
+and BUSY wait, or page read and buffer read), so the data buffer and the driver's scratch buffer are never
+shared halfway through. Wrap several calls that must not be interleaved, such as a load followed by a
+random load and a program, in w25_Lock. Calls of the holding task nest and don't block.
+Structure changes (alloc/free of the bus, bus mode, timing, async start and stop) aren't covered by the lock.
+@param winbond_t* **w25** - pointer to the object refered to, with the bus allocated.
+@return **esp_err_t** - ESP_ERR_TIMEOUT if another task held the memory for longer than the semaphore timeout.
+*/
+esp_err_t w25_Lock(const winbond_t *w25);
+void w25_Unlock(const winbond_t *w25);
+/**
+Selects how many data lines are used by the data buffer reads and loads. Must be called before
+vspi_w25_alloc_bus, since the WP/HOLD pins and the duplex mode of the device are set up there.
+\attention Dual and Quad modes turn the SPI device half-duplex. On Quad mode WP and HOLD are driven by the
+SPI peripheral, so the WP-E bit of the Protection Register must be kept cleared (w25_Initialize does it).
+@param winbond_t* **w25** - pointer to the object refered to.
+@param w25_bus_mode **mode** - W25_BUS_SINGLE (default), W25_BUS_DUAL or W25_BUS_QUAD
+@return **esp_err_t** - ESP_ERR_INVALID_STATE if the bus is already allocated, ESP_ERR_INVALID_ARG for Quad without WP and HOLD pins.
+*/
+esp_err_t w25_SetBusMode(winbond_t *w25, w25_bus_mode mode);
+w25_bus_mode w25_GetBusMode(const winbond_t *w25);
+/**
+Changes the SCLK frequency and the MISO input delay of the memory. With the bus allocated, the device is
+removed and added again to its host, which keeps running for the other memories on it.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint32_t **clock_speed_hz** - new clock, up to W25_MAX_CLOCK_HZ
+@param int **input_delay_ns** - new input delay, see w25_config_t
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the clock is out of range, error of spi_bus_add_device (the previous
+setting is kept then), ESP_ERR_INVALID_STATE if called while a stream or batch holds the host.
+*/
+esp_err_t w25_SetClock(winbond_t *w25, uint32_t clock_speed_hz, int input_delay_ns);
+/**
+Looks for the fastest reliable clock, from the configured one up to max_clock_hz. Each step of the ESP32 clock
+divider is tried with increasing input delays: a setting passes when the JEDEC ID and a test pattern loaded into
+the data buffer and read back (no page is programmed) come out intact a few times in a row. Stepping up stops at
+the first clock no delay can fix, and the best setting found is kept. Call it after w25_Initialize.
+\attention The data buffer is overwritten.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint32_t **max_clock_hz** - fastest clock worth trying, as allowed by the board
+@param uint32_t* **clock_hz** - receives the clock kept (can be NULL)
+@return **esp_err_t** - ESP_ERR_INVALID_RESPONSE if even the configured clock fails, error code according to esp idf documentation otherwise.
+*/
+esp_err_t w25_CalibrateClock(winbond_t *w25, uint32_t max_clock_hz, uint32_t *clock_hz);
 
 uint16_t w25_RecoverCurrentAddr(void);
 esp_err_t w25_CommitCurrentAddr(uint16_t page_addr);
 uint16_t w25_RecoverCurrentColumn(void);
 esp_err_t w25_CommitCurrentColumn(uint16_t column_addr);
 
+/**
+Changes the expected durations of the memory operations. Waits sleep for the expected duration
+(esp_timer for the sub-tick ones) and only then poll the BUSY bit, so a slow or aging part can be tuned here.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param const w25_timing_t* **timing** - new timing model
+@return **esp_err_t** - ESP_ERR_TIMEOUT if the device couldn't be locked, the timing is left unchanged then.
+*/
+esp_err_t w25_SetTiming(winbond_t *w25, const w25_timing_t *timing);
+
 /**
 Resets the memory to its initial state, clearing volatile registers
 @param winbond_t* **w25** - pointer to the object refered to.
+@param uint16_t **timeout_ms** - the reset is only issued if the memory stays busy longer than this
 @return **esp_err_t** - Error code according to esp idf documentation. 
 */
-esp_err_t w25_Reset(const winbond_t *w25, uint16_t max_trial_nmb);
+esp_err_t w25_Reset(const winbond_t *w25, uint16_t timeout_ms);
 /**
 Retrieves the memory's JEDEC ID. This function can be used to verify 
 if the device can be reached.
@@ -102,31 +281,219 @@ Turns on or off the ability to write into memory, including the internal registe
 */
 esp_err_t w25_WritePermission(const winbond_t *w25, bool state);
 /**
-
+Reads the data buffer of the memory (filled by w25_PageDataRead) starting at column_addr.
+\remark When out_buffer is DMA capable, word aligned and buffer_size is a multiple of 4, the data is received
+straight into it. Otherwise it goes through the internal buffer and buffer_size is limited by max_trans_size.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint16_t **column_addr** - first byte to be read inside the page
+@param uint8_t* **out_buffer** - receives buffer_size bytes
+@param size_t **buffer_size** - amount of bytes to be read
+@param uint16_t **timeout_ms** - deadline for the memory to leave the BUSY state
+@return **esp_err_t** - Error code according to esp idf documentation.
 */
-esp_err_t w25_ReadDataBuffer(const winbond_t *w25, uint16_t column_addr, uint8_t *out_buffer, size_t buffer_size, uint16_t max_trial_nmb);
+esp_err_t w25_ReadDataBuffer(const winbond_t *w25, uint16_t column_addr, uint8_t *out_buffer, size_t buffer_size, uint16_t timeout_ms);
 esp_err_t w25_PageDataRead(const winbond_t *w25, uint16_t page_addr);
 
-esp_err_t w25_LastECCFailure(const winbond_t *w25, uint16_t *page_addr, uint16_t max_trial_nmb);
+/**
+Reads the address of the last page that failed the ECC check, the only way to locate the failure after a
+continuous read reporting W25_ECC_UNCORRECTABLE or W25_ECC_MULTI_PAGE.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint16_t* **page_addr** - receives the page address
+@param uint16_t **timeout_ms** - deadline for the memory to leave the BUSY state
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_LastECCFailure(const winbond_t *w25, uint16_t *page_addr, uint16_t timeout_ms);
+/**
+Reads the Bad Block Management Look Up Table of the memory.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param w25_bbm_entry_t* **lut** - receives W25_BBM_LUT_SIZE entries
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_ReadBBMLut(const winbond_t *w25, w25_bbm_entry_t *lut);
+/**
+Links a bad block to a replacement block in the Look Up Table, every later access to logical_block
+goes to physical_block. The link is non-volatile and can't be undone.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint16_t **logical_block** - the bad block (block number, not page address)
+@param uint16_t **physical_block** - a good block that isn't used for anything else
+@param uint16_t **timeout_ms** - deadline for the link to be written
+@return **esp_err_t** - ESP_ERR_NO_MEM if the Look Up Table is full, error code according to esp idf documentation otherwise.
+*/
+esp_err_t w25_BadBlockSwap(const winbond_t *w25, uint16_t logical_block, uint16_t physical_block, uint16_t timeout_ms);
+/**
+Checks the bad block marker, the first spare byte of the first page of the block.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint16_t **block** - block number
+@param bool* **bad** - true if the marker isn't 0xFF
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_IsBadBlock(const winbond_t *w25, uint16_t block, bool *bad);
+/**
+Programs the bad block marker of the block, so it's found by w25_IsBadBlock from now on.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint16_t **block** - block number
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_MarkBadBlock(const winbond_t *w25, uint16_t block);
 /**
 Sets all memory of the specified block field on the (page_addr) to the default value.
 \remark See the Issues tab on the github repository for more information on how to use this function.
 @param winbond_t* **w25** - pointer to the object refered to.
 @param uint16_t **page_addr** - the block to be erase corresponds to the 10 most significant bits of the page_addr
+@param uint16_t **timeout_ms** - deadline for the erase cycle to finish
 @return **esp_err_t** - Error code according to esp idf documentation.
 */
-esp_err_t w25_BlockErase(const winbond_t *w25, uint16_t page_addr, uint16_t max_trial_nmb);
+esp_err_t w25_BlockErase(const winbond_t *w25, uint16_t page_addr, uint16_t timeout_ms);
 /**
 
 */
 esp_err_t w25_LoadProgramData(const winbond_t *w25, uint16_t column_addr, const uint8_t *in_buffer, size_t buffer_size);
-esp_err_t w25_ProgramExecute(const winbond_t *w25, uint16_t page_addr, uint16_t max_trial_nmb);
+/**
+Same as w25_LoadProgramData, but the rest of the data buffer keeps what it held instead of being reset to 0xFF.
+*/
+esp_err_t w25_RandomLoadProgramData(const winbond_t *w25, uint16_t column_addr, const uint8_t *in_buffer, size_t buffer_size);
+esp_err_t w25_ProgramExecute(const winbond_t *w25, uint16_t page_addr, uint16_t timeout_ms);
 
 esp_err_t w25_Initialize(const winbond_t *w25);
 esp_err_t w25_ReadMemory(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size);
 /**
+Same as w25_ReadMemory, also handing back the ECC outcome of the page. It comes from the status poll that
+waits for the page load, so it costs no extra transaction.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint16_t **column_addr** - first byte to be read inside the page
+@param uint16_t **page_addr** - page to be read
+@param uint8_t* **out_buffer** - receives buffer_size bytes
+@param size_t **buffer_size** - amount of bytes to be read
+@param w25_ecc_status* **ecc** - receives the ECC outcome, the data is still read when it's W25_ECC_UNCORRECTABLE
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_ReadMemoryECC(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size, w25_ecc_status *ecc);
+/**
 */
 esp_err_t w25_WriteMemory(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size);
+/**
+Reads the W25_SPARE_SIZE application bytes of the spare area of a page. They are the 4 bytes of User Data I of
+every sector (0x804-0x807, 0x814-0x817, 0x824-0x827, 0x834-0x837), covered by the internal ECC, gathered in order.
+Only the spare area is clocked out, 52 bytes instead of the whole page.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint16_t **page_addr** - page to be read
+@param uint8_t* **out_buffer** - receives buffer_size bytes
+@param size_t **buffer_size** - amount of bytes to be read, up to W25_SPARE_SIZE
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the page or the size is out of range, error code according to esp idf documentation otherwise.
+*/
+esp_err_t w25_ReadSpare(const winbond_t *w25, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size);
+/**
+Same as w25_WriteMemory, also programming the application bytes of the spare area (see w25_ReadSpare) in the
+same Program Execute, so the metadata of a record costs no extra program nor partial program.
+\attention The bad block marker, User Data II and the ECC bytes are left at 0xFF.
+@param const uint8_t* **in_buffer** - data of the page, NULL to program the spare bytes alone
+@param size_t **buffer_size** - amount of data bytes, column_addr + buffer_size can't go past W25_PAGE_SIZE
+@param const uint8_t* **spare** - spare bytes, programmed from the first application byte on
+@param size_t **spare_size** - amount of spare bytes, up to W25_SPARE_SIZE
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if a range is exceeded, ESP_ERR_INVALID_STATE if the program failed.
+*/
+esp_err_t w25_WriteMemorySpare(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size, const uint8_t *spare, size_t spare_size);
+/**
+Reads an arbitrary byte range that may span many pages in a single transaction, using the Continuous Read
+Mode (BUF=0). The range is clocked out in chunks of the DMA buffer with CS held low between them, so only
+the first page pays the Page Data Read round trip. Buffer Read Mode is restored before returning.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint16_t **column_addr** - first byte inside the first page
+@param uint16_t **page_addr** - first page of the range
+@param uint8_t* **out_buffer** - receives buffer_size bytes
+@param size_t **buffer_size** - amount of bytes to be read, can go beyond the end of the first page
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the range leaves the allowed memory, error code according to esp idf documentation otherwise.
+*/
+esp_err_t w25_ReadContinuous(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size);
+/**
+Same as w25_ReadContinuous, also handing back the ECC outcome of every page the read went through, taken from
+the status polls the read does anyway. On a failure, w25_LastECCFailure gives the page. A read ending on a page
+boundary also accounts the page after it, which the memory has already started to load.
+@param w25_ecc_status* **ecc** - receives the worst ECC outcome, W25_ECC_MULTI_PAGE if several pages failed
+*/
+esp_err_t w25_ReadContinuousECC(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size, w25_ecc_status *ecc);
+
+/**
+Appends a record at the cursor with a partial page program: only the record goes through the bus, patched
+into the data buffer with Random Program Data Load while it still holds the page. The cursor moves to the
+start of the next page when the record doesn't fit or the page already took W25_MAX_PARTIAL_PROGRAMS programs.
+\attention Pages reached by the cursor must be erased beforehand. The cursor is only moved on success.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param w25_append_cursor_t* **cursor** - append position, start with {first_page, 0, 0}
+@param const uint8_t* **in_buffer** - record to be appended
+@param size_t **buffer_size** - record size, up to W25_PAGE_SIZE
+@return **esp_err_t** - ESP_ERR_INVALID_ARG on an empty or too long record, ESP_ERR_NO_MEM past the last allowed page,
+ESP_ERR_INVALID_STATE on a program failure.
+*/
+esp_err_t w25_AppendData(const winbond_t *w25, w25_append_cursor_t *cursor, const uint8_t *in_buffer, size_t buffer_size);
+/**
+Reads a list of segments under a single bus acquisition. Segments are split on page boundaries, and each page
+is loaded once for all the consecutive segments that touch it, with a single wait on the BUSY bit per page.
+\attention The device is held for the whole batch, other tasks using it wait until it's over.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param const w25_read_segment_t* **segments** - segments to be read, any size (the DMA reads straight into
+word aligned, DMA capable buffers, the rest goes through the internal buffer in pieces)
+@param size_t **count** - amount of segments
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if a segment leaves the allowed memory (nothing is read then).
+*/
+esp_err_t w25_ReadPages(const winbond_t *w25, const w25_read_segment_t *segments, size_t count);
+/**
+Programs a list of segments under a single bus acquisition. Segments are split on page boundaries, consecutive
+segments on the same page are gathered in the data buffer (Random Program Data Load) and programmed once.
+\attention Same erase-before-write rules as w25_WriteMemory. The device is held for the whole batch.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param const w25_write_segment_t* **segments** - segments to be programmed, any size
+@param size_t **count** - amount of segments
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if a segment leaves the allowed memory (nothing is written then).
+*/
+esp_err_t w25_WritePages(const winbond_t *w25, const w25_write_segment_t *segments, size_t count);
+/**
+Same as w25_ReadPages on a single contiguous range, which can span many pages.
+*/
+esp_err_t w25_ReadRange(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size);
+/**
+Same as w25_WritePages on a single contiguous range, which can span many pages.
+*/
+esp_err_t w25_WriteRange(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size);
+
+/**
+Starts the I/O task that serves w25_ReadPageAsync and w25_ProgramPageAsync. Requests are served in order, and
+the callback of a finished page runs while the DMA moves the next one, so the application processing overlaps with the bus.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param size_t **queue_depth** - how many requests can wait in the queue
+@param unsigned int **priority** - FreeRTOS priority of the I/O task
+@return **esp_err_t** - ESP_ERR_INVALID_STATE if already started or if the bus isn't allocated.
+*/
+esp_err_t w25_StartAsync(winbond_t *w25, size_t queue_depth, unsigned int priority);
+/**
+Serves the requests that are still queued and stops the I/O task.
+@param winbond_t* **w25** - pointer to the object refered to.
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_StopAsync(winbond_t *w25);
+/**
+Queues the read of a page. Same parameters as w25_ReadMemory; out_buffer must stay valid until the callback runs.
+@param w25_async_cb_t **callback** - called when the page is in out_buffer (can be NULL)
+@param void* **arg** - passed to the callback
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the read doesn't fit in the page, ESP_ERR_TIMEOUT if the queue stayed full,
+ESP_ERR_INVALID_STATE if the I/O task isn't running.
+*/
+esp_err_t w25_ReadPageAsync(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size, w25_async_cb_t callback, void *arg);
+/**
+Queues the program of a page. Same parameters as w25_WriteMemory; in_buffer must stay valid until the callback runs.
+@param w25_async_cb_t **callback** - called when the page is programmed (can be NULL)
+@param void* **arg** - passed to the callback
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the data doesn't fit in the page (nothing is queued then), ESP_ERR_TIMEOUT if
+the queue stayed full, ESP_ERR_INVALID_STATE if the I/O task isn't running.
+*/
+esp_err_t w25_ProgramPageAsync(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size, w25_async_cb_t callback, void *arg);
+/**
+Blocks until every queued request has completed and had its callback called.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint32_t **timeout_ms** - maximum time waiting for all of them
+@return **esp_err_t** - ESP_ERR_TIMEOUT if the requests didn't complete in time.
+*/
+esp_err_t w25_WaitAsync(const winbond_t *w25, uint32_t timeout_ms);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,75 @@
+#ifndef W25N_BBM_H
+#define W25N_BBM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "W25N01GV.h"
+
+//Default replacement pool: the blocks right below the last one, one per Look Up Table entry
+#define W25_BBM_DEFAULT_SPARE_FIRST  (W25_BLOCK_COUNT - 1U - W25_BBM_LUT_SIZE)
+#define W25_BBM_DEFAULT_SPARE_COUNT  W25_BBM_LUT_SIZE
+
+typedef struct w25_bbm w25_bbm_t;
+
+typedef struct {
+	uint32_t factory_bad;   //Blocks marked bad when the scan ran
+	uint32_t swapped;       //Blocks replaced through the Look Up Table since the init
+	uint32_t skipped;       //Blocks added to the skip list since the init (Look Up Table or pool exhausted)
+	uint32_t lut_free;      //Look Up Table entries still available
+} w25_bbm_stats_t;
+
+/**
+Starts the bad block management. The Look Up Table is read once and kept in RAM, and the bad block
+marker of every block is checked: bad blocks that aren't linked go to the skip list. Blocks that fail later
+on are linked to a block of the replacement pool, or skipped once the pool or the Look Up Table runs out.
+\attention The replacement pool must stay out of the ranges used by the application, the FTL and
+any other layer. Page copies go through the driver's buffer: w25 must be created with init_w25_struct(W25_PAGE_SIZE + 4).
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint16_t **spare_first** - first block of the replacement pool (see W25_BBM_DEFAULT_SPARE_FIRST)
+@param uint16_t **spare_count** - amount of blocks in the replacement pool
+@param w25_bbm_t** **out_bbm** - receives the bad block manager
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the pool leaves the memory, ESP_ERR_NO_MEM, or the error found while scanning.
+*/
+esp_err_t w25_BbmInit(const winbond_t *w25, uint16_t spare_first, uint16_t spare_count, w25_bbm_t **out_bbm);
+void w25_BbmDeinit(w25_bbm_t *bbm);
+/**
+Same as w25_BlockErase. If the erase fails the block is replaced and the replacement is erased instead.
+@param w25_bbm_t* **bbm** - pointer to the bad block manager refered to.
+@return **esp_err_t** - ESP_ERR_INVALID_STATE if the block is (or just went) on the skip list, move on to w25_BbmNextGoodBlock.
+*/
+esp_err_t w25_BbmBlockErase(w25_bbm_t *bbm, uint16_t page_addr, uint16_t timeout_ms);
+/**
+Same as w25_WriteMemory. If the program fails the pages already written in the block are copied into a
+replacement block, which is linked in place of the failing one, and the program is done again.
+\remark Only the data area of the copied pages is moved.
+@param w25_bbm_t* **bbm** - pointer to the bad block manager refered to.
+@return **esp_err_t** - ESP_ERR_INVALID_STATE if the block is (or just went) on the skip list, move on to w25_BbmNextGoodBlock.
+*/
+esp_err_t w25_BbmWriteMemory(w25_bbm_t *bbm, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size);
+/**
+@param w25_bbm_t* **bbm** - pointer to the bad block manager refered to.
+@param uint16_t **block** - block number
+@return **bool** - true if the block is on the skip list or belongs to the replacement pool.
+*/
+bool w25_BbmIsBad(const w25_bbm_t *bbm, uint16_t block);
+/**
+@param w25_bbm_t* **bbm** - pointer to the bad block manager refered to.
+@param uint16_t **block** - block number where the search starts
+@return **uint16_t** - the first usable block from block onwards, W25_BLOCK_COUNT if there isn't any.
+*/
+uint16_t w25_BbmNextGoodBlock(const w25_bbm_t *bbm, uint16_t block);
+/**
+Copies the cached Look Up Table, without any bus access.
+@param w25_bbm_t* **bbm** - pointer to the bad block manager refered to.
+@param w25_bbm_entry_t* **lut** - receives W25_BBM_LUT_SIZE entries
+*/
+void w25_BbmGetLut(w25_bbm_t *bbm, w25_bbm_entry_t *lut);
+void w25_BbmGetStats(w25_bbm_t *bbm, w25_bbm_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef W25N_CACHE_H
+#define W25N_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "W25N01GV.h"
+
+typedef struct w25_cache w25_cache_t;
+
+typedef struct {
+	uint32_t hits;        //Accesses served from RAM
+	uint32_t misses;      //Accesses that had to load the page from the memory
+	uint32_t evictions;   //Slots reused for another page
+	uint32_t write_backs; //Programs issued to save dirty slots
+} w25_cache_stats_t;
+
+/**
+Creates a page cache in front of the memory. Each slot keeps a whole page, reads are served from RAM
+once the page is loaded, and writes only touch the RAM copy until the slot is evicted or flushed.
+The least recently used slot is the one evicted.
+The dirty range of a slot is programmed at once but loaded in pieces, so write-backs fit any driver buffer.
+\attention PSRAM slots aren't DMA capable, so the page is read through the driver's buffer: w25 must be
+created with init_w25_struct(W25_PAGE_SIZE + 4) in that case.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param size_t **n_slots** - number of pages kept in RAM (W25_PAGE_SIZE bytes each)
+@param bool **use_psram** - allocate the slots on external RAM
+@return **w25_cache_t*** - the cache, NULL if there wasn't enough memory.
+*/
+w25_cache_t *w25_CacheCreate(const winbond_t *w25, size_t n_slots, bool use_psram);
+/**
+Flushes the dirty slots and frees the cache.
+@param w25_cache_t* **cache** - pointer to the cache refered to.
+@return **esp_err_t** - the error of the flush, the cache is freed regardless.
+*/
+esp_err_t w25_CacheDestroy(w25_cache_t *cache);
+/**
+Same as w25_ReadMemory, loading the whole page into a slot on a miss.
+@param w25_cache_t* **cache** - pointer to the cache refered to.
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_CacheRead(w25_cache_t *cache, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size);
+/**
+Same as w25_WriteMemory, but the data is only programmed when the slot is evicted or flushed. Only the
+range written since the last program is sent to the memory, so the usual erase-before-write rules still apply.
+@param w25_cache_t* **cache** - pointer to the cache refered to.
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_CacheWrite(w25_cache_t *cache, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size);
+/**
+Programs every dirty slot. The slots stay cached.
+@param w25_cache_t* **cache** - pointer to the cache refered to.
+@return **esp_err_t** - the first error found, the remaining slots are still flushed.
+*/
+esp_err_t w25_CacheFlush(w25_cache_t *cache);
+/**
+Erases a block through the cache, dropping the cached pages of that block (even the dirty ones).
+@param w25_cache_t* **cache** - pointer to the cache refered to.
+@param uint16_t **page_addr** - any page of the block to be erased
+@param uint16_t **timeout_ms** - deadline for the erase cycle to finish
+@return **esp_err_t** - Error code of w25_BlockErase.
+*/
+esp_err_t w25_CacheBlockErase(w25_cache_t *cache, uint16_t page_addr, uint16_t timeout_ms);
+void w25_CacheGetStats(const w25_cache_t *cache, w25_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
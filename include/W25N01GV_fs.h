@@ -0,0 +1,56 @@
+#ifndef W25N_FS_H
+#define W25N_FS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "W25N01GV.h"
+#include "W25N01GV_ftl.h"
+#include "esp_vfs_fat.h"
+
+/**
+Registers the FTL as a FATFS disk and mounts it on the VFS, so the standard C file functions work under base_path.
+FATFS sectors are as large as a page when the FATFS configuration allows it (4096 bytes sector size in menuconfig),
+so every sector write is a whole page program. The FTL takes care of the erases and the wear leveling.
+@param w25_ftl_t* **ftl** - mounted FTL holding the filesystem
+@param const char* **base_path** - path prefix, e.g. "/w25"
+@param const esp_vfs_fat_mount_config_t* **mount_config** - allocation_unit_size defaults to 4 pages when 0
+@return **esp_err_t** - ESP_ERR_NO_MEM if no FATFS drive is available, ESP_FAIL if the filesystem couldn't be mounted.
+*/
+esp_err_t w25_VfsFatMount(w25_ftl_t *ftl, const char *base_path, const esp_vfs_fat_mount_config_t *mount_config);
+/**
+Unmounts the filesystem and syncs the FTL. The FTL is left mounted.
+@param w25_ftl_t* **ftl** - FTL given to w25_VfsFatMount
+@param const char* **base_path** - path given to w25_VfsFatMount
+@return **esp_err_t** - ESP_ERR_INVALID_STATE if the FTL isn't mounted on the VFS.
+*/
+esp_err_t w25_VfsFatUnmount(w25_ftl_t *ftl, const char *base_path);
+
+#if defined(__has_include)
+#if __has_include("lfs.h")
+#include "lfs.h"
+#define W25_HAS_LITTLEFS 1
+
+/**
+Fills a littlefs configuration whose callbacks read, program and erase a range of blocks. Reads and programs are
+whole pages through page sized DMA capable caches, and the lookahead covers the whole range so block allocation
+needs a single scan. littlefs does its own wear leveling, so the range must not be shared with the FTL.
+\attention w25 must be created with init_w25_struct(W25_PAGE_SIZE + 4).
+@param winbond_t* **w25** - pointer to the object refered to.
+@param uint16_t **first_block** - first block of the filesystem
+@param uint16_t **block_count** - amount of blocks of the filesystem
+@param lfs_config* **config** - receives the configuration, ready for lfs_mount/lfs_format
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the range leaves the memory, ESP_ERR_NO_MEM.
+*/
+esp_err_t w25_LfsConfigInit(const winbond_t *w25, uint16_t first_block, uint16_t block_count, struct lfs_config *config);
+void w25_LfsConfigDeinit(struct lfs_config *config);
+
+#endif
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
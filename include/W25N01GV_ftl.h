@@ -0,0 +1,100 @@
+#ifndef W25N_FTL_H
+#define W25N_FTL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "W25N01GV.h"
+
+typedef struct w25_ftl w25_ftl_t;
+
+//Garbage Collection Victim Policies
+typedef enum {
+	W25_GC_GREEDY       = 0, //Block with the fewest valid pages
+	W25_GC_COST_BENEFIT = 1  //Weighs the free space reclaimed against the age of the block, keeps hot blocks around longer
+} w25_gc_policy;
+
+typedef struct {
+	uint16_t first_block;     //First block managed by the FTL
+	uint16_t block_count;     //Amount of blocks managed, first_block + block_count must stay below the last block
+	                          //and out of the bad block replacement pool
+	uint16_t reserved_blocks; //Over-provisioning kept out of the logical capacity, at least 4
+	w25_gc_policy gc_policy;
+	uint32_t wear_threshold;  //Erase count spread that forces cold data to be moved (static wear leveling), 0 disables it
+	bool use_psram;           //Allocate the logical to physical map on external RAM
+} w25_ftl_config_t;
+
+#define W25_FTL_CONFIG_DEFAULT() { \
+	.first_block = 0,                     \
+	.block_count = W25_BLOCK_COUNT - 1U - W25_BBM_LUT_SIZE, \
+	.reserved_blocks = 32,                \
+	.gc_policy = W25_GC_COST_BENEFIT,     \
+	.wear_threshold = 100,                \
+	.use_psram = false                    \
+}
+
+typedef struct {
+	uint32_t host_writes;    //Logical pages written by the application
+	uint32_t page_programs;  //Every page programmed, including garbage collection moves and metadata
+	uint32_t erases;
+	uint32_t gc_collections; //Blocks reclaimed to keep the free pool above its low-water mark
+	uint32_t wear_moves;     //Blocks reclaimed by the static wear leveling
+	uint32_t bad_blocks;     //Blocks retired after an erase failure
+	uint32_t min_erase_count;
+	uint32_t max_erase_count;
+} w25_ftl_stats_t;
+
+/**
+Mounts the Flash Translation Layer over a range of blocks. Logical pages are written out of place into
+pre-erased blocks, so overwriting a page never waits for an erase. Every block is recognised by a header
+written after its erase and by summary pages listing the logical pages it holds, which are the only places
+read while mounting. Blocks that don't carry the FTL metadata are erased when they are first needed, unless
+their bad block marker is set. Blocks that fail to erase get the marker and are never used again.
+\attention The data moves through the driver's buffer: w25 must be created with init_w25_struct(W25_PAGE_SIZE + 4).
+@param winbond_t* **w25** - pointer to the object refered to.
+@param const w25_ftl_config_t* **config** - blocks managed and policies, see W25_FTL_CONFIG_DEFAULT
+@param w25_ftl_t** **out_ftl** - receives the mounted FTL
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the configuration is invalid, ESP_ERR_NO_MEM, or the read error found while mounting.
+*/
+esp_err_t w25_FtlMount(const winbond_t *w25, const w25_ftl_config_t *config, w25_ftl_t **out_ftl);
+/**
+Syncs the FTL and frees it.
+@param w25_ftl_t* **ftl** - pointer to the FTL refered to.
+@return **esp_err_t** - the error of the sync, the FTL is freed regardless.
+*/
+esp_err_t w25_FtlUnmount(w25_ftl_t *ftl);
+/**
+@param w25_ftl_t* **ftl** - pointer to the FTL refered to.
+@return **uint16_t** - amount of logical pages, each one W25_PAGE_SIZE bytes long.
+*/
+uint16_t w25_FtlCapacity(const w25_ftl_t *ftl);
+/**
+Same as w25_ReadMemory on a logical page. Pages never written read as erased memory (0xFF).
+@param w25_ftl_t* **ftl** - pointer to the FTL refered to.
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the range leaves the logical page or the capacity.
+*/
+esp_err_t w25_FtlRead(w25_ftl_t *ftl, uint16_t column_addr, uint16_t logical_page, uint8_t *out_buffer, size_t buffer_size);
+/**
+Same as w25_WriteMemory on a logical page, without erasing anything first. The page is programmed into the
+next free physical page; writes shorter than a page keep the remaining bytes of the previous version.
+\remark The new location is only known after a remount once the block summary is written, which happens
+when the block fills up or on w25_FtlSync.
+@param w25_ftl_t* **ftl** - pointer to the FTL refered to.
+@return **esp_err_t** - ESP_ERR_NO_MEM if garbage collection couldn't free a block, error code according to esp idf documentation otherwise.
+*/
+esp_err_t w25_FtlWrite(w25_ftl_t *ftl, uint16_t column_addr, uint16_t logical_page, const uint8_t *in_buffer, size_t buffer_size);
+/**
+Programs the summary of the open block, so every page written so far is found again after a power loss.
+Costs one physical page when there is something to sync, nothing otherwise.
+@param w25_ftl_t* **ftl** - pointer to the FTL refered to.
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_FtlSync(w25_ftl_t *ftl);
+void w25_FtlGetStats(w25_ftl_t *ftl, w25_ftl_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef W25N_KV_H
+#define W25N_KV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "W25N01GV.h"
+
+#define W25_KV_MAX_KEY_SIZE   32U                      //Characters of a key, the terminating NUL isn't stored
+#define W25_KV_MAX_VALUE_SIZE (W25_PAGE_SIZE - 44U)    //An entry (12 bytes header, key and value) never straddles two pages
+
+typedef struct w25_kv w25_kv_t;
+
+typedef struct {
+	uint16_t first_block;  //First block of the store
+	uint16_t block_count;  //Amount of blocks, at least 3: one is kept free for the compactions
+	uint16_t max_keys;     //Keys the RAM index can hold, it takes 24 bytes per key
+} w25_kv_config_t;
+
+typedef struct {
+	uint32_t keys;           //Keys stored
+	uint32_t live_bytes;     //Bytes of the entries the index points to
+	uint32_t entry_reads;    //Entries read from the memory by gets, iterations and key checks
+	uint32_t page_programs;  //Programs issued, full pages and syncs
+	uint32_t erases;
+	uint32_t compactions;    //Blocks compacted
+	uint32_t relocated;      //Live entries copied by the compactions
+} w25_kv_stats_t;
+
+/**
+Called by w25_KvIterate for every key.
+@param const char* **key** - the key, NUL terminated
+@param const void* **value** - its value, only valid during the call
+@param size_t **size** - size of the value
+@param void* **arg** - argument given to w25_KvIterate
+@return **bool** - false to stop the iteration
+*/
+typedef bool (*w25_kv_iterator_t)(const char *key, const void *value, size_t size, void *arg);
+
+/**
+Opens a log-structured key-value store. Puts and deletes append entries to a RAM copy of the head page, which is
+programmed when it's full or on w25_KvSync (with a partial page program, see w25_AppendData). Blocks are filled
+one after the other around the circle, page 0 holding a header with the sequence number of the block.
+An open-addressing hash index in RAM maps every key to the page, offset and size of its last entry, so a get
+costs one read of that entry. The index is rebuilt on open by reading the blocks from the oldest one on, an entry
+replacing one on another page also reads the key of that one.
+When the head needs a block and only one is left free, the oldest block is compacted: its live entries are
+copied to the head and it's erased. Deletions leave a tombstone entry, dropped once its block is compacted.
+\attention The driver's buffer (init_w25_struct) must take a whole page plus 4 bytes, pages are loaded through it.
+Entries still in RAM are lost on a power loss, call w25_KvSync for the ones that must persist.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param const w25_kv_config_t* **config** - blocks of the store and size of the index
+@param w25_kv_t** **out_kv** - receives the store
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the configuration is invalid, ESP_ERR_NO_MEM (also when the memory holds more
+than max_keys keys), or the error found while rebuilding the index.
+*/
+esp_err_t w25_KvOpen(const winbond_t *w25, const w25_kv_config_t *config, w25_kv_t **out_kv);
+/**
+Programs the entries still in RAM and frees the store.
+@param w25_kv_t* **kv** - pointer to the store refered to.
+@return **esp_err_t** - the error of the sync, the store is freed regardless.
+*/
+esp_err_t w25_KvClose(w25_kv_t *kv);
+/**
+Stores a value, replacing the one the key had. Only touches RAM until the head page is full, but replacing
+a key reads the header and key of its previous entry to make sure it's the same key, unless it's in RAM.
+@param w25_kv_t* **kv** - pointer to the store refered to.
+@param const char* **key** - NUL terminated key, 1 to W25_KV_MAX_KEY_SIZE characters
+@param const void* **value** - value to store
+@param size_t **size** - size of the value, up to W25_KV_MAX_VALUE_SIZE
+@return **esp_err_t** - ESP_ERR_INVALID_ARG on an invalid key or size, ESP_ERR_NO_MEM when the index or the blocks are full,
+or the error of the program, erase or compaction.
+*/
+esp_err_t w25_KvPut(w25_kv_t *kv, const char *key, const void *value, size_t size);
+/**
+Reads the value of a key: one read of its entry, none while the entry is still in the RAM page.
+@param w25_kv_t* **kv** - pointer to the store refered to.
+@param const char* **key** - NUL terminated key
+@param void* **value** - receives the value, NULL to only get its size
+@param size_t **buffer_size** - size of value
+@param size_t* **size** - receives the size of the value, can be NULL
+@return **esp_err_t** - ESP_ERR_NOT_FOUND, ESP_ERR_INVALID_SIZE if the value doesn't fit in buffer_size (size is still set),
+ESP_ERR_INVALID_CRC if the entry is corrupted.
+*/
+esp_err_t w25_KvGet(w25_kv_t *kv, const char *key, void *value, size_t buffer_size, size_t *size);
+/**
+Deletes a key, appending a tombstone entry.
+@param w25_kv_t* **kv** - pointer to the store refered to.
+@param const char* **key** - NUL terminated key
+@return **esp_err_t** - ESP_ERR_NOT_FOUND if the key isn't stored, or the error of the program, erase or compaction.
+*/
+esp_err_t w25_KvDelete(w25_kv_t *kv, const char *key);
+/**
+Calls callback for every key, in no particular order. Every entry is read once.
+\attention The store is locked meanwhile, the callback must not call it.
+@param w25_kv_t* **kv** - pointer to the store refered to.
+@param w25_kv_iterator_t **callback** - function called for every key
+@param void* **arg** - handed to callback
+@return **esp_err_t** - the error of the first entry that couldn't be read, the iteration stops there.
+*/
+esp_err_t w25_KvIterate(w25_kv_t *kv, w25_kv_iterator_t callback, void *arg);
+/**
+Programs the entries still in RAM. Each page takes W25_MAX_PARTIAL_PROGRAMS programs at most, the following
+syncs move to the next page.
+@param w25_kv_t* **kv** - pointer to the store refered to.
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_KvSync(w25_kv_t *kv);
+/**
+Compacts the oldest block now, during idle time for instance, instead of on the put that needs its room.
+Nothing is done while the head is the only block in use.
+@param w25_kv_t* **kv** - pointer to the store refered to.
+@return **esp_err_t** - Error code of the reads, programs and erase.
+*/
+esp_err_t w25_KvCompact(w25_kv_t *kv);
+void w25_KvGetStats(w25_kv_t *kv, w25_kv_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
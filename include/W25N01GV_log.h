@@ -0,0 +1,109 @@
+#ifndef W25N_LOG_H
+#define W25N_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "W25N01GV.h"
+
+#define W25_LOG_RECORD_PAGES (W25_PAGES_PER_BLOCK - 1U) //Pages of a block holding records, page 0 holds the block header
+
+typedef struct w25_log w25_log_t;
+
+typedef struct {
+	uint16_t first_block;  //First block of the circular log
+	uint16_t block_count;  //Amount of blocks, at least erase_ahead + 2
+	uint16_t record_size;  //Bytes per record, up to W25_PAGE_SIZE. Records never straddle two pages
+	uint16_t erase_ahead;  //Blocks kept erased ahead of the write head, at least 1
+} w25_log_config_t;
+
+//Write position of the log. Kept on RTC memory it survives deep sleep, so reopening needs no flash scan
+typedef struct {
+	uint32_t magic;
+	uint16_t first_block;
+	uint16_t block_count;
+	uint16_t record_size;
+	uint16_t head_block;         //Block index (from first_block) being filled
+	uint16_t tail_block;         //Block index holding the oldest records
+	uint16_t erased_ahead;       //Blocks already erased after the head
+	uint32_t head_seq;           //Sequence number of the head block, 0 while the log is empty
+	w25_append_cursor_t cursor;  //Next free byte of the head block
+	uint32_t crc;
+} w25_log_state_t;
+
+//Read position, starts at the oldest record
+typedef struct {
+	uint32_t seq;     //Sequence number of the block being read
+	uint8_t page;     //Page within the block
+	uint16_t slot;    //Record within the page
+} w25_log_reader_t;
+
+typedef struct {
+	uint32_t records;          //Records appended since the log was opened
+	uint32_t page_programs;    //Programs issued, full pages and flushes
+	uint32_t erases;
+	uint32_t reclaimed_blocks; //Oldest blocks dropped to make room for new records
+	uint32_t failed_programs;  //Pages skipped after a failed program (P-FAIL)
+	uint32_t bad_blocks;       //Blocks that failed to erase (E-FAIL), marked bad and passed over
+} w25_log_stats_t;
+
+/**
+Opens a circular log of fixed size records. Records are packed into a RAM copy of the head page, which is
+programmed once the next record doesn't fit or on w25_LogFlush (with a partial page program, see w25_AppendData).
+A page that fails to program is skipped, its pending records are programmed on the next one. The blocks
+ahead of the head are erased when the head moves into a new block, and once the log wraps around the oldest
+block is dropped. A block that fails to erase is marked bad (w25_MarkBadBlock) and the head passes over it,
+the log holds one block less then. The position is recovered from rtc_state when it's valid, otherwise the block headers
+are scanned (the rest of the last page written before a power loss is left unused then).
+\attention Records made only of 0xFF bytes can't be told apart from erased memory, they are skipped when reading.
+The reader loads a whole page at a time into a page buffer of the log and serves its records from there.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param const w25_log_config_t* **config** - blocks and record size
+@param w25_log_state_t* **rtc_state** - RTC_DATA_ATTR state kept up to date by the log, NULL to always scan
+@param w25_log_t** **out_log** - receives the log
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the configuration is invalid, ESP_ERR_NO_MEM, or the read error found while scanning.
+*/
+esp_err_t w25_LogOpen(const winbond_t *w25, const w25_log_config_t *config, w25_log_state_t *rtc_state, w25_log_t **out_log);
+/**
+Flushes the pending records and frees the log.
+@param w25_log_t* **log** - pointer to the log refered to.
+@return **esp_err_t** - the error of the flush, the log is freed regardless.
+*/
+esp_err_t w25_LogClose(w25_log_t *log);
+/**
+Appends a record. Only touches RAM until the head page is full, the full page is programmed before the record is taken.
+@param w25_log_t* **log** - pointer to the log refered to.
+@param const void* **record** - record_size bytes
+@return **esp_err_t** - Error code of the page program or of the block erase, the record isn't taken then.
+*/
+esp_err_t w25_LogAppend(w25_log_t *log, const void *record);
+/**
+Programs the records still in RAM, before a deep sleep for instance. Each page takes W25_MAX_PARTIAL_PROGRAMS
+programs at most, the following flushes move to the next page.
+@param w25_log_t* **log** - pointer to the log refered to.
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_LogFlush(w25_log_t *log);
+/**
+Places the reader on the oldest record.
+@param w25_log_t* **log** - pointer to the log refered to.
+@param w25_log_reader_t* **reader** - reader to be initialized
+*/
+void w25_LogReaderInit(w25_log_t *log, w25_log_reader_t *reader);
+/**
+Reads the record under the reader and moves it to the next one. Records still in RAM are read as well.
+A reader left behind by the reclaim of the oldest block jumps to the oldest record left.
+@param w25_log_t* **log** - pointer to the log refered to.
+@param w25_log_reader_t* **reader** - position of the record
+@param void* **record** - receives record_size bytes
+@return **esp_err_t** - ESP_ERR_NOT_FOUND once every record was read.
+*/
+esp_err_t w25_LogRead(w25_log_t *log, w25_log_reader_t *reader, void *record);
+void w25_LogGetStats(w25_log_t *log, w25_log_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
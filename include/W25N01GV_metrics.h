@@ -0,0 +1,68 @@
+#ifndef W25N_METRICS_H
+#define W25N_METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "W25N01GV.h"
+
+//Set to 1 (the W25_METRICS option of the component's CMakeLists) to collect the driver metrics.
+//Disabled, the hooks compile to nothing and w25_GetMetrics returns ESP_ERR_NOT_SUPPORTED
+#ifndef W25_METRICS_ENABLED
+#define W25_METRICS_ENABLED 0
+#endif
+
+#define W25_HIST_BUCKETS 12U //Bucket 0 holds latencies under 16us, bucket n under 16us << n, the last one the rest
+
+//Latencies are measured from the end of the command to the BUSY bit clearing, lock waits from the request
+//of the device to getting it
+typedef enum {
+	W25_LAT_PAGE_READ = 0,
+	W25_LAT_PROGRAM,
+	W25_LAT_ERASE,
+	W25_LAT_LOCK_WAIT,
+	W25_LAT_KINDS
+} w25_latency_kind;
+
+typedef struct {
+	uint32_t count;
+	uint32_t max_us;
+	uint64_t total_us;
+	uint32_t buckets[W25_HIST_BUCKETS];
+} w25_histogram_t;
+
+typedef struct {
+	uint32_t opcodes[256];        //Frames sent, by instruction code
+	uint64_t data_bytes;          //Bytes clocked in the data phases, reads and writes
+	uint32_t busy_polls;          //Status reads that found the memory still busy
+	uint32_t ecc_corrected;       //Page reads the ECC had to correct
+	uint32_t ecc_uncorrectable;   //Page reads with more errors than the ECC can correct
+	uint32_t erase_failures;      //E-FAIL
+	uint32_t program_failures;    //P-FAIL
+	w25_histogram_t latency[W25_LAT_KINDS];
+} w25_metrics_t;
+
+/**
+Copies the metrics collected since the object was created or since the last w25_ResetMetrics.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param w25_metrics_t* **metrics** - receives the metrics
+@return **esp_err_t** - ESP_ERR_NOT_SUPPORTED if the component was built without W25_METRICS_ENABLED.
+*/
+esp_err_t w25_GetMetrics(const winbond_t *w25, w25_metrics_t *metrics);
+esp_err_t w25_ResetMetrics(const winbond_t *w25);
+/**
+Writes the metrics as a single line JSON object, instruction codes that were never sent are left out.
+Available even with the metrics disabled, to format a copy taken elsewhere.
+@param const w25_metrics_t* **metrics** - metrics to be formatted
+@param char* **out** - receives the null terminated text
+@param size_t **size** - size of out, around 1.5 KB is enough
+@return **esp_err_t** - ESP_ERR_INVALID_SIZE if the text was truncated.
+*/
+esp_err_t w25_MetricsToJson(const w25_metrics_t *metrics, char *out, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef W25N_POOL_H
+#define W25N_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "W25N01GV.h"
+
+typedef struct w25_pool w25_pool_t;
+
+typedef struct {
+	uint16_t first_block;  //First block managed by the pool
+	uint16_t block_count;  //Amount of blocks
+	uint16_t low_water;    //The worker is woken up once fewer blocks than this are erased, at least 1
+	uint16_t target;       //Erased blocks the worker refills up to, 0 to erase every reclaimable block
+} w25_pool_config_t;
+
+typedef struct {
+	uint32_t takes;        //Blocks handed to writers
+	uint32_t dry;          //Takes that found no erased block and had to wait for one
+	uint32_t erases;       //Blocks erased by the worker
+	uint32_t bad_blocks;   //Blocks that failed to erase, marked bad and left out of the pool
+} w25_pool_stats_t;
+
+/**
+Keeps a pool of erased blocks so writers never wait for an erase. Blocks given back with w25_PoolRelease are
+erased by a worker task in the background, which is meant to run below the writers' priority. The worker
+sleeps until the erased blocks drop below low_water, then erases up to target. Blocks are handed out in the
+order they were erased, which spreads the wear over the whole range.
+Every block of the range is taken as reclaimable when the pool is created, except the ones marked bad.
+\attention A foreground operation issued while the worker erases still waits for that erase to finish.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param const w25_pool_config_t* **config** - blocks and marks
+@param unsigned int **priority** - FreeRTOS priority of the worker
+@param w25_pool_t** **out_pool** - receives the pool
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the configuration is invalid, ESP_ERR_NO_MEM, or the error reading the bad block markers.
+*/
+esp_err_t w25_PoolCreate(const winbond_t *w25, const w25_pool_config_t *config, unsigned int priority, w25_pool_t **out_pool);
+void w25_PoolDestroy(w25_pool_t *pool);
+/**
+Hands out an erased block.
+@param w25_pool_t* **pool** - pointer to the pool refered to.
+@param uint16_t* **block** - receives the block number
+@param uint32_t **timeout_ms** - maximum time waiting for the worker if the pool ran dry
+@return **esp_err_t** - ESP_ERR_TIMEOUT if no block got erased in time.
+*/
+esp_err_t w25_PoolTake(w25_pool_t *pool, uint16_t *block, uint32_t timeout_ms);
+/**
+Gives a block back once its data is no longer needed, the worker erases it.
+@param w25_pool_t* **pool** - pointer to the pool refered to.
+@param uint16_t **block** - block taken from the pool
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the block is out of the pool's range, ESP_ERR_INVALID_STATE if every
+block of the range is already waiting to be erased (a block released twice).
+*/
+esp_err_t w25_PoolRelease(w25_pool_t *pool, uint16_t block);
+/**
+@param w25_pool_t* **pool** - pointer to the pool refered to.
+@return **size_t** - erased blocks ready to be taken.
+*/
+size_t w25_PoolReady(const w25_pool_t *pool);
+void w25_PoolGetStats(w25_pool_t *pool, w25_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
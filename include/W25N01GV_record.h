@@ -0,0 +1,138 @@
+#ifndef W25N_RECORD_H
+#define W25N_RECORD_H
+
+#include "W25N01GV.h"
+#include "W25N01GV_log.h"
+
+#ifdef __cplusplus
+
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+/*
+Typed front end of the circular log, header only. The layout of the records is worked out at compile time from
+the record type: slot size, records per page and per block, capacity of the blocks given to the log. The records
+are packed back to back, a page takes W25_PAGE_SIZE/slot of them and is programmed in one go once it's full.
+
+    w25::RecordLog<float, 0, 8> samples; //Blocks 0 to 7, 512 samples a page
+    ESP_ERROR_CHECK(samples.open(flash_memory, &log_state));
+    ESP_ERROR_CHECK(samples.append(12.85f));
+*/
+
+namespace w25 {
+
+//Geometry of the memory, as seen by the application
+struct geometry{
+    static constexpr size_t page_size = W25_PAGE_SIZE;
+    static constexpr size_t pages_per_block = W25_PAGES_PER_BLOCK;
+    static constexpr size_t block_count = W25_USABLE_BLOCKS;
+    static constexpr size_t block_size = page_size*pages_per_block;
+};
+
+//Place of the records of type T in the log. Alignment pads every slot to a multiple of it, 1 packs them densely
+template <typename T, size_t Alignment = 1U>
+struct record_layout{
+    static_assert(std::is_trivially_copyable<T>::value, "records are copied as raw bytes");
+    static_assert((Alignment > 0U) && ((Alignment & (Alignment - 1U)) == 0U), "the alignment is a power of two");
+
+    static constexpr size_t record_size = sizeof(T);
+    static constexpr size_t slot_size = ((sizeof(T) + Alignment) - 1U) & ~(Alignment - 1U);
+    static_assert(slot_size <= geometry::page_size, "a record never straddles two pages");
+
+    static constexpr size_t records_per_page = geometry::page_size/slot_size;
+    static constexpr size_t unused_per_page = geometry::page_size - (records_per_page*slot_size);
+    static constexpr size_t records_per_block = records_per_page*W25_LOG_RECORD_PAGES;
+};
+
+/**
+Circular log of records of type T on blocks FirstBlock to FirstBlock + BlockCount - 1, see w25_LogOpen.
+EraseAhead blocks are kept erased ahead of the write head. The log is closed (and flushed) on destruction.
+\attention Records made only of 0xFF bytes are skipped when reading.
+*/
+template <typename T, uint16_t FirstBlock, uint16_t BlockCount, uint16_t EraseAhead = 1U, size_t Alignment = 1U>
+class RecordLog{
+public:
+    using layout = record_layout<T, Alignment>;
+
+    static_assert(EraseAhead >= 1U, "at least a block is kept erased");
+    static_assert(BlockCount >= (EraseAhead + 2U), "the head, the tail and the erased blocks are all different");
+    static_assert((size_t{FirstBlock} + BlockCount) <= geometry::block_count, "the log fits in the memory");
+
+    static constexpr size_t records_per_page = layout::records_per_page;
+    static constexpr size_t records_per_block = layout::records_per_block;
+    static constexpr size_t page_count = size_t{BlockCount}*geometry::pages_per_block;
+    static constexpr size_t capacity = records_per_block*(BlockCount - EraseAhead); //Records held before the oldest are dropped
+
+    RecordLog(void) = default;
+    RecordLog(const RecordLog &) = delete;
+    RecordLog &operator=(const RecordLog &) = delete;
+    ~RecordLog(void){
+        (void)close();
+    }
+
+    /**
+    @param winbond_t* **w25** - pointer to the object refered to.
+    @param w25_log_state_t* **rtc_state** - RTC_DATA_ATTR state kept up to date by the log, NULL to always scan
+    @return **esp_err_t** - ESP_ERR_INVALID_STATE if the log is already open, otherwise the error of w25_LogOpen.
+    */
+    esp_err_t open(const winbond_t *w25, w25_log_state_t *rtc_state){
+        esp_err_t err = ESP_ERR_INVALID_STATE;
+        if (log_ == nullptr){
+            const w25_log_config_t config = {FirstBlock, BlockCount, static_cast<uint16_t>(layout::slot_size), EraseAhead};
+            err = w25_LogOpen(w25, &config, rtc_state, &log_);
+        }
+        return err;
+    }
+
+    esp_err_t close(void){
+        esp_err_t err = ESP_OK;
+        if (log_ != nullptr){
+            err = w25_LogClose(log_);
+            log_ = nullptr;
+        }
+        return err;
+    }
+
+    esp_err_t append(const T &record){
+        uint8_t slot[layout::slot_size] = {0};
+        (void)memcpy(slot, &record, sizeof(T));
+        return (log_ != nullptr) ? w25_LogAppend(log_, slot) : ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t flush(void){
+        return (log_ != nullptr) ? w25_LogFlush(log_) : ESP_ERR_INVALID_STATE;
+    }
+
+    //Places the reader on the oldest record
+    void rewind(w25_log_reader_t *reader){
+        w25_LogReaderInit(log_, reader);
+    }
+
+    //ESP_ERR_NOT_FOUND once every record was read
+    esp_err_t read(w25_log_reader_t *reader, T *record){
+        uint8_t slot[layout::slot_size];
+        esp_err_t err = (log_ != nullptr) ? w25_LogRead(log_, reader, slot) : ESP_ERR_INVALID_STATE;
+        if (err == ESP_OK){
+            (void)memcpy(record, slot, sizeof(T));
+        }
+        return err;
+    }
+
+    void stats(w25_log_stats_t *out) const{
+        w25_LogGetStats(log_, out);
+    }
+
+    bool is_open(void) const{
+        return log_ != nullptr;
+    }
+
+private:
+    w25_log_t *log_ = nullptr;
+};
+
+} //namespace w25
+
+#endif //__cplusplus
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef W25N_SCHED_H
+#define W25N_SCHED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "W25N01GV.h"
+
+#define W25_SCHED_MAX_MERGE 8U //Reads served by a single merged request
+
+typedef struct w25_sched w25_sched_t;
+
+//Served in this order, the oldest request first within a class
+typedef enum {
+	W25_IO_URGENT = 0,     //Latency sensitive reads, metadata for instance
+	W25_IO_NORMAL,
+	W25_IO_BACKGROUND,     //Logging programs and erases
+	W25_IO_CLASSES
+} w25_io_class;
+
+typedef struct {
+	uint32_t requests;     //Requests completed
+	uint32_t max_us;       //Worst time from submission to completion
+	uint64_t total_us;     //Sum of the times from submission to completion
+} w25_sched_latency_t;
+
+typedef struct {
+	w25_sched_latency_t latency[W25_IO_CLASSES];
+	uint32_t merged_reads;     //Reads served together with an adjacent one
+	uint32_t coalesced_writes; //Writes folded into a queued write of the same page
+} w25_sched_stats_t;
+
+/**
+Starts an I/O task fronted by a request queue. The task serves the most urgent request first, but a request
+never overtakes an older one touching the same page (or block, for erases), so every location sees its
+requests in the order they were submitted. Queued reads on adjacent pages are served by one w25_ReadPages
+call, and a write to a page that already has a queued write is folded into it.
+\attention An erase or a program that already started can't be preempted: an urgent read still waits for it,
+at most the erase time of the memory. A steady flow of urgent requests starves the background ones.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param size_t **queue_depth** - requests that can wait in the queue, each one keeps a page buffer for writes
+@param unsigned int **priority** - FreeRTOS priority of the I/O task
+@param w25_sched_t** **out_sched** - receives the scheduler
+@return **esp_err_t** - ESP_ERR_INVALID_ARG on a zero depth, ESP_ERR_NO_MEM.
+*/
+esp_err_t w25_SchedCreate(const winbond_t *w25, size_t queue_depth, unsigned int priority, w25_sched_t **out_sched);
+/**
+Serves what is still queued and stops the I/O task.
+@param w25_sched_t* **sched** - pointer to the scheduler refered to.
+@return **esp_err_t** - the first error of the writes and erases served since the last w25_SchedSync.
+*/
+esp_err_t w25_SchedDestroy(w25_sched_t *sched);
+/**
+Reads through the queue and waits for the data. The range must stay within the page.
+@param w25_sched_t* **sched** - pointer to the scheduler refered to.
+@param w25_io_class **io_class** - priority of the request
+@param uint16_t **column_addr** - first byte of the page
+@param uint16_t **page_addr** - page to be read
+@param uint8_t* **out_buffer** - receives the data
+@param size_t **buffer_size** - bytes to be read
+@return **esp_err_t** - ESP_ERR_INVALID_ARG on a range leaving the page, ESP_ERR_TIMEOUT if the queue stayed full,
+or the error of the read.
+*/
+esp_err_t w25_SchedRead(w25_sched_t *sched, w25_io_class io_class, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size);
+/**
+Queues a write and returns, the data is copied into the queue. The range must stay within the page, and the
+usual erase-before-write rules apply. Errors are reported by w25_SchedSync.
+@param w25_sched_t* **sched** - pointer to the scheduler refered to.
+@param w25_io_class **io_class** - priority of the request
+@return **esp_err_t** - ESP_ERR_INVALID_ARG on a range leaving the page, ESP_ERR_TIMEOUT if the queue stayed full.
+*/
+esp_err_t w25_SchedWrite(w25_sched_t *sched, w25_io_class io_class, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size);
+/**
+Queues the erase of a block and returns. Errors are reported by w25_SchedSync.
+@param w25_sched_t* **sched** - pointer to the scheduler refered to.
+@param w25_io_class **io_class** - priority of the request
+@param uint16_t **page_addr** - any page of the block to be erased
+@return **esp_err_t** - ESP_ERR_INVALID_ARG on a wrong page, ESP_ERR_TIMEOUT if the queue stayed full.
+*/
+esp_err_t w25_SchedErase(w25_sched_t *sched, w25_io_class io_class, uint16_t page_addr);
+/**
+Waits until the queue is empty.
+@param w25_sched_t* **sched** - pointer to the scheduler refered to.
+@param uint32_t **timeout_ms** - maximum time waiting
+@return **esp_err_t** - ESP_ERR_TIMEOUT, or the first error of the writes and erases served since the last call.
+*/
+esp_err_t w25_SchedSync(w25_sched_t *sched, uint32_t timeout_ms);
+void w25_SchedGetStats(w25_sched_t *sched, w25_sched_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef W25N_SERIES_H
+#define W25N_SERIES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "W25N01GV.h"
+
+typedef struct w25_series w25_series_t;
+
+typedef struct {
+	uint16_t first_block;  //First block of the circular series
+	uint16_t block_count;  //Amount of blocks, at least 2
+} w25_series_config_t;
+
+typedef struct {
+	uint32_t samples;         //Samples appended since the series was opened
+	uint32_t frames;          //Frames programmed, one page each
+	uint32_t raw_bytes;       //Size of those samples uncompressed
+	uint32_t encoded_bytes;   //Bytes of page data programmed for them
+	uint32_t erases;
+} w25_series_stats_t;
+
+/**
+Opens a compressed series of float samples. Each sample is XOR'ed with the previous one and only the bits that
+changed are kept (leading and trailing zero counts plus the meaningful bits, the window of the previous sample
+being reused when it still fits), which suits slowly changing sensor readings.
+Samples are encoded into a RAM page and every page is a self-contained frame: it starts from a raw sample, so a
+reader can decode from any frame. The frame's index entry (first sample number, count, bit length and CRC) is
+programmed in the spare area of the same page by the same Program Execute, see w25_WriteMemorySpare.
+Blocks are erased when the head moves into them; once the series wraps around the oldest block is dropped.
+The head and the index of the blocks are recovered on open from the spare area only.
+\attention The driver's buffer (init_w25_struct) must take a whole page plus 4 bytes, pages are loaded through it.
+@param winbond_t* **w25** - pointer to the object refered to.
+@param const w25_series_config_t* **config** - blocks of the series
+@param w25_series_t** **out_series** - receives the series
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the configuration is invalid, ESP_ERR_NO_MEM, or the read error found while scanning.
+*/
+esp_err_t w25_SeriesOpen(const winbond_t *w25, const w25_series_config_t *config, w25_series_t **out_series);
+/**
+Flushes the pending frame and frees the series.
+@param w25_series_t* **series** - pointer to the series refered to.
+@return **esp_err_t** - the error of the flush, the series is freed regardless.
+*/
+esp_err_t w25_SeriesClose(w25_series_t *series);
+/**
+Encodes samples. Only touches RAM until the frame is full, then programs it and starts the next one.
+@param w25_series_t* **series** - pointer to the series refered to.
+@param const float* **samples** - samples to append
+@param size_t **count** - amount of samples
+@return **esp_err_t** - Error code of the page program or of the block erase. The samples encoded before it are kept.
+*/
+esp_err_t w25_SeriesAppend(w25_series_t *series, const float *samples, size_t count);
+/**
+Programs the pending frame, before a deep sleep for instance. The frame is closed: the next sample starts a new
+one on the next page, so frequent flushes cost compression.
+@param w25_series_t* **series** - pointer to the series refered to.
+@return **esp_err_t** - Error code according to esp idf documentation.
+*/
+esp_err_t w25_SeriesFlush(w25_series_t *series);
+/**
+Samples kept by the series: first is the oldest one still on the memory, end the number the next sample will take.
+@param w25_series_t* **series** - pointer to the series refered to.
+@param uint32_t* **first** - receives the number of the oldest sample
+@param uint32_t* **end** - receives the number of the next sample
+*/
+void w25_SeriesRange(w25_series_t *series, uint32_t *first, uint32_t *end);
+/**
+Decodes samples starting at a sample number. The frame holding it is found through the block index kept in RAM
+and a binary search over the spare areas of the block, then frames are read and decoded one after the other.
+The pending frame is read as well.
+@param w25_series_t* **series** - pointer to the series refered to.
+@param uint32_t **first_sample** - number of the first sample wanted, see w25_SeriesRange
+@param float* **out** - receives up to count samples
+@param size_t **count** - amount of samples wanted
+@param size_t* **read** - receives the amount of samples decoded, fewer than count when the end of the series is reached
+@return **esp_err_t** - ESP_ERR_NOT_FOUND if first_sample isn't kept, ESP_ERR_INVALID_CRC if a frame is corrupted.
+*/
+esp_err_t w25_SeriesRead(w25_series_t *series, uint32_t first_sample, float *out, size_t count, size_t *read);
+void w25_SeriesGetStats(w25_series_t *series, w25_series_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
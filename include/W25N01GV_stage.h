@@ -0,0 +1,60 @@
+#ifndef W25N_STAGE_H
+#define W25N_STAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <time.h>
+#include "W25N01GV.h"
+#include "W25N01GV_log.h"
+
+//Samples staged in RTC slow memory between deep sleeps. Declare it RTC_DATA_ATTR, it takes a page and a few bytes
+typedef struct {
+	uint32_t magic;
+	uint16_t record_size;
+	uint16_t used;          //Bytes staged
+	uint16_t threshold;     //Records that make a commit due
+	uint32_t deadline_s;    //Age of the oldest staged record that makes a commit due, 0 to never commit on age
+	time_t first_time;      //System time (kept across deep sleep) of the oldest staged record
+	uint8_t data[W25_PAGE_SIZE];
+} w25_rtc_stage_t;
+
+/**
+Prepares the staging buffer, to be called on every wake up: the staged records are kept as long as the
+record size doesn't change, and they are dropped on a cold boot. Nothing touches the SPI bus or the flash,
+so the memory only has to be brought up when w25_StageCommitDue says so.
+@param w25_rtc_stage_t* **stage** - RTC_DATA_ATTR staging buffer
+@param uint16_t **record_size** - bytes per record, the same as the log they are committed to
+@param uint16_t **threshold** - records that make a commit due, 0 or more than a page holds means a full page
+@param uint32_t **deadline_s** - age of the oldest record that makes a commit due, 0 to disable it
+*/
+void w25_StageInit(w25_rtc_stage_t *stage, uint16_t record_size, uint16_t threshold, uint32_t deadline_s);
+/**
+Stages a record in RTC memory.
+@param w25_rtc_stage_t* **stage** - staging buffer
+@param const void* **record** - record_size bytes
+@return **esp_err_t** - ESP_ERR_NO_MEM if a page worth of records is already staged, commit them first.
+*/
+esp_err_t w25_StagePush(w25_rtc_stage_t *stage, const void *record);
+/**
+@param w25_rtc_stage_t* **stage** - staging buffer
+@return **bool** - true once the threshold is reached or the oldest record is older than the deadline.
+*/
+bool w25_StageCommitDue(const w25_rtc_stage_t *stage);
+uint16_t w25_StageCount(const w25_rtc_stage_t *stage);
+/**
+Appends every staged record to the log and flushes it, so they are all programmed before the next deep sleep.
+The stage is emptied only once the flush succeeds: on an error every record stays staged for the next commit.
+The log may still program the ones it took on a later flush or close, so a retry can store some of them twice.
+@param w25_rtc_stage_t* **stage** - staging buffer
+@param w25_log_t* **log** - log opened with the same record size
+@return **esp_err_t** - Error code of w25_LogAppend or w25_LogFlush.
+*/
+esp_err_t w25_StageCommit(w25_rtc_stage_t *stage, w25_log_t *log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef W25N_STRIPE_H
+#define W25N_STRIPE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "W25N01GV.h"
+
+#define W25_STRIPE_MAX_CHIPS 4U
+
+typedef struct w25_stripe w25_stripe_t;
+
+/**
+Joins several memories into a single array of pages: logical page n lives on chip n % count, at page n / count.
+Every chip gets a worker task, so a transfer of consecutive pages runs on all the chips at once. Chips on
+different SPI hosts transfer in parallel, chips sharing a host still overlap their program and read cycles.
+@param const winbond_t* const* **chips** - initialized memories, they must outlive the stripe
+@param size_t **count** - amount of memories, up to W25_STRIPE_MAX_CHIPS
+@param unsigned int **priority** - priority of the worker tasks
+@param w25_stripe_t** **out_stripe** - receives the stripe
+@return **esp_err_t** - ESP_ERR_INVALID_ARG on a wrong count, ESP_ERR_NO_MEM.
+*/
+esp_err_t w25_StripeCreate(const winbond_t *const *chips, size_t count, unsigned int priority, w25_stripe_t **out_stripe);
+void w25_StripeDestroy(w25_stripe_t *stripe);
+/**
+@param w25_stripe_t* **stripe** - pointer to the stripe refered to.
+@return **uint32_t** - amount of logical pages, each one W25_PAGE_SIZE bytes long.
+*/
+uint32_t w25_StripeCapacity(const w25_stripe_t *stripe);
+/**
+Programs whole consecutive logical pages, spread over the chips. Same erase-before-write rules as w25_WriteMemory.
+@param w25_stripe_t* **stripe** - pointer to the stripe refered to.
+@param uint32_t **logical_page** - first logical page
+@param const uint8_t* **in_buffer** - pages * W25_PAGE_SIZE bytes
+@param size_t **pages** - amount of pages
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the range leaves the capacity, the first error of a chip otherwise.
+*/
+esp_err_t w25_StripeWritePages(w25_stripe_t *stripe, uint32_t logical_page, const uint8_t *in_buffer, size_t pages);
+/**
+Reads whole consecutive logical pages, spread over the chips.
+@param w25_stripe_t* **stripe** - pointer to the stripe refered to.
+@param uint32_t **logical_page** - first logical page
+@param uint8_t* **out_buffer** - pages * W25_PAGE_SIZE bytes, DMA capable and word aligned to skip the driver's buffer
+@param size_t **pages** - amount of pages
+@return **esp_err_t** - ESP_ERR_INVALID_ARG if the range leaves the capacity, the first error of a chip otherwise.
+*/
+esp_err_t w25_StripeReadPages(w25_stripe_t *stripe, uint32_t logical_page, uint8_t *out_buffer, size_t pages);
+/**
+Erases a block on every chip at once, which clears W25_PAGES_PER_BLOCK * count logical pages
+starting at block * W25_PAGES_PER_BLOCK * count.
+@param w25_stripe_t* **stripe** - pointer to the stripe refered to.
+@param uint16_t **block** - block number on each chip
+@return **esp_err_t** - the first error of a chip.
+*/
+esp_err_t w25_StripeBlockErase(w25_stripe_t *stripe, uint16_t block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
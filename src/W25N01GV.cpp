@@ -6,16 +6,23 @@
 #include "freertos/portmacro.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
 #include "driver/spi_common.h"
 #include "driver/spi_master.h"
 #include "../include/W25N01GV.h"
+#include "../include/W25N01GV_metrics.h"
 #include "sdkconfig.h"
 #include "hal/gpio_types.h"
 #include <stdbool.h>
 #include "driver/gpio.h"
+#include "soc/soc_memory_layout.h"
 #include <bitset>
+#include <atomic>
 
-#define N_OF_TRIAL 100
+#define DEFAULT_TIMEOUT_MS 100
+#define ASYNC_TASK_STACK 4096
 
 namespace{
     //Instruction Set Table
@@ -35,22 +42,43 @@ namespace{
         PROG_EXEC          = 0x10,
         PAGE_DATA_READ     = 0x13,
         READ_DATA          = 0x03,
-        FAST_READ          = 0x0B
+        FAST_READ          = 0x0B,
+        FAST_READ_DUAL_OUT = 0x3B,
+        FAST_READ_QUAD_OUT = 0x6B,
+        FAST_READ_DUAL_IO  = 0xBB,
+        FAST_READ_QUAD_IO  = 0xEB,
+        QUAD_PROG_LOAD     = 0x32, //Reset Buffer
+        RAND_QUAD_PROG_LOAD= 0x34
     };
 }
 
-constexpr gpio_num_t MOSI = GPIO_NUM_23;
-constexpr gpio_num_t MISO = GPIO_NUM_19;
-constexpr gpio_num_t SCLK = GPIO_NUM_18;
-constexpr gpio_num_t CS = GPIO_NUM_5;
-constexpr gpio_num_t HOLD = GPIO_NUM_17;
-constexpr gpio_num_t WP = GPIO_NUM_16;
 
-constexpr uint32_t CLOCK_SPEED = 8000000; // up to 1MHz for all registers
+//Typical datasheet timings. The wait sleeps for them before polling the BUSY bit
+constexpr uint32_t T_RD_US = 25;      //Page Data Read with ECC (60us max)
+constexpr uint32_t T_PROG_US = 250;   //Program Execute (700us max)
+constexpr uint32_t T_BE_US = 2000;    //Block Erase (10ms max)
+constexpr uint32_t T_RST_US = 5;      //Device Reset while idle (500us max when it interrupts an erase)
+constexpr uint32_t T_POLL_US = 10;    //Spin between status polls once the expected time has elapsed
+constexpr uint32_t SPIN_LIMIT_US = 100; //Shorter waits spin instead of blocking on the wake-up timer
 
 constexpr size_t MAX_TRANS_SIZE = 2048+4;
+constexpr size_t MAX_CMD_PREFIX = 9; //opcode + up to 64 bits sent as address phase on half-duplex transactions
 constexpr uint16_t MAX_ALLOWED_ADDR = 2047U;
-constexpr uint16_t MAX_ALLOWED_PAGEBLOCK = 65472U; //This might be wrong, CHECK IT LATER
+constexpr uint16_t BAD_BLOCK_MARKER_ADDR = 2048U; //First spare byte of the first page of a block, not 0xFF on bad blocks
+constexpr size_t PAGE_WITH_SPARE = 2112U;
+constexpr uint16_t SPARE_USER_ADDR = 0x804U; //User Data I of the first sector, ECC protected
+constexpr size_t SPARE_SECTOR_STRIDE = 16U;  //Spare bytes per sector
+constexpr size_t SPARE_USER_BYTES = W25_SPARE_SIZE/4U;
+constexpr size_t SPARE_WINDOW = (3U*SPARE_SECTOR_STRIDE) + SPARE_USER_BYTES; //From the first to the last User Data I byte
+constexpr uint32_t CALIBRATION_CLOCKS[] = {10000000U, 16000000U, 20000000U, 26666667U, 40000000U, 80000000U}; //80MHz APB divided by 8, 5, 4, 3, 2 and 1
+constexpr int CALIBRATION_DELAYS_NS[] = {0, 10, 20, 30, 40};
+constexpr size_t CALIBRATION_BYTES = 64U;
+constexpr size_t CALIBRATION_ROUNDS = 3U;
+constexpr size_t BBM_ENTRY_SIZE = 4U; //LBA and PBA, MSB first
+constexpr uint16_t BBM_BLOCK_MASK = 0x03FFU;
+constexpr uint16_t MAX_ALLOWED_PAGEBLOCK = W25_USABLE_PAGES; //This might be wrong, CHECK IT LATER
+
+struct w25_async;
 
 RTC_DATA_ATTR uint16_t current_address_RTC;
 RTC_DATA_ATTR uint16_t current_column_RTC;
@@ -58,7 +86,7 @@ RTC_DATA_ATTR uint16_t current_column_RTC;
 struct winbond{
 	//cppcheck-suppress misra-c2012-2.7 
 	//cppcheck-supress misra-c2012-17.8
-	explicit winbond(size_t max_trans_size, TickType_t p_timeout = 1000) : dev_config{
+	explicit winbond(const w25_config_t &p_config, TickType_t p_timeout = 1000) : config{p_config}, dev_config{
         .command_bits = 0,
         .address_bits = 0,
         .dummy_bits = 0,
@@ -66,48 +94,101 @@ struct winbond{
         .duty_cycle_pos = 128,
         .cs_ena_pretrans = 0,
         .cs_ena_posttrans= 0,
-        .clock_speed_hz = CLOCK_SPEED,
-        .input_delay_ns = 0,
-        .spics_io_num = CS,
+        .clock_speed_hz = static_cast<int>(p_config.clock_speed_hz),
+        .input_delay_ns = p_config.input_delay_ns,
+        .spics_io_num = p_config.cs,
         .flags = SPI_DEVICE_NO_DUMMY,
         .queue_size = 1,
         .pre_cb = 0,
         .post_cb = 0
-    }, buffer_size{max_trans_size}, semaphore_timeout{p_timeout}{
+    }, handle{nullptr}, buffer_size{p_config.max_trans_size}, semaphore_timeout{p_timeout}, bus_mode{p_config.bus_mode}, async{nullptr},
+    timing{T_RD_US, T_PROG_US, T_BE_US, T_POLL_US}, bus_owner{nullptr}, lock_depth{0}, acquire_depth{0}, buffer_page{UINT32_MAX}{
         
-        opCode = static_cast<uint8_t *>(heap_caps_malloc(max_trans_size, MALLOC_CAP_DMA)); //creates a DMA-suitable chunk of memory
-        (void)memset(opCode, 0, max_trans_size);
+        opCode = static_cast<uint8_t *>(heap_caps_malloc(buffer_size, MALLOC_CAP_DMA)); //creates a DMA-suitable chunk of memory
+        (void)memset(opCode, 0, buffer_size);
 
         spi_bus_mutex = xSemaphoreCreateBinary();
 
-        gpio_set_direction(HOLD,GPIO_MODE_OUTPUT);
-        gpio_set_direction(WP,GPIO_MODE_OUTPUT);
-        gpio_set_level(HOLD, 1);
-        gpio_set_level(WP, 1);
+        wake = xSemaphoreCreateBinary();
+        wake_owner = xSemaphoreCreateMutex();
+        const esp_timer_create_args_t wake_timer_args = {
+            .callback = &winbond::wake_up,
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "w25_wake",
+            .skip_unhandled_events = false
+        };
+        (void)esp_timer_create(&wake_timer_args, &wake_timer);
+
+        release_hold_wp();
     }
 
+    w25_config_t config;
     spi_device_interface_config_t dev_config;
     spi_device_handle_t handle;
     uint8_t *opCode;
     size_t buffer_size;
     SemaphoreHandle_t spi_bus_mutex;
     TickType_t semaphore_timeout;
-
+    w25_bus_mode bus_mode;
+    w25_async *async;
+    w25_timing_t timing;
+    esp_timer_handle_t wake_timer;
+    SemaphoreHandle_t wake;
+    SemaphoreHandle_t wake_owner;
+    mutable TaskHandle_t bus_owner; //Task holding the device for a whole operation, its frames skip the semaphore
+    mutable uint32_t lock_depth;    //Nested operations of bus_owner
+    mutable uint32_t acquire_depth; //Nested operations of bus_owner that also hold the SPI host
+    mutable uint32_t buffer_page; //Page whose last program left the data buffer matching it, UINT32_MAX if unknown
+#if W25_METRICS_ENABLED
+    mutable w25_metrics_t metrics{};
+#endif
+
+    ~winbond();
     void opCode_free(void);
+    void release_hold_wp(void) const;
+    bool half_duplex(void) const;
+    static void wake_up(void *arg);
 };	
 
+winbond::~winbond(){
+    (void)esp_timer_delete(this->wake_timer);
+    vSemaphoreDelete(this->wake);
+    vSemaphoreDelete(this->wake_owner);
+}
+
+void winbond::wake_up(void *arg){
+    (void)xSemaphoreGive(static_cast<winbond *>(arg)->wake);
+}
+
+//Keeps the memory out of hold and write protection while WP and HOLD are plain GPIOs
+void winbond::release_hold_wp(void) const{
+    if (this->config.hold != GPIO_NUM_NC){
+        gpio_set_direction(this->config.hold,GPIO_MODE_OUTPUT);
+        gpio_set_level(this->config.hold, 1);
+    }
+    if (this->config.wp != GPIO_NUM_NC){
+        gpio_set_direction(this->config.wp,GPIO_MODE_OUTPUT);
+        gpio_set_level(this->config.wp, 1);
+    }
+}
+
 void winbond::opCode_free(void){
     heap_caps_free(this->opCode);
 }
 
+bool winbond::half_duplex(void) const{
+    return (this->bus_mode != W25_BUS_SINGLE); //Dual and Quad data phases are only available on half-duplex devices
+}
+
 /*INITIALIZING THE BUS */
 
 esp_err_t vspi_w25_alloc_bus(winbond_t *w25){
 
     spi_bus_config_t vspi_config = {
-        .mosi_io_num = MOSI,
-        .miso_io_num = MISO,
-        .sclk_io_num = SCLK,
+        .mosi_io_num = w25->config.mosi,
+        .miso_io_num = w25->config.miso,
+        .sclk_io_num = w25->config.sclk,
         .quadwp_io_num = -1,
         .quadhd_io_num = -1,
         .max_transfer_sz = 4092,
@@ -115,9 +196,22 @@ esp_err_t vspi_w25_alloc_bus(winbond_t *w25){
         .intr_flags = 0
     };
 
-    esp_err_t err = spi_bus_initialize(VSPI_HOST, &vspi_config, 2);
-    if (err == ESP_OK){
-        err = spi_bus_add_device(VSPI_HOST, &w25->dev_config, &w25->handle);
+    if (w25->bus_mode == W25_BUS_QUAD){ //WP and HOLD are handed over to the SPI peripheral as IO2 and IO3
+        vspi_config.quadwp_io_num = w25->config.wp;
+        vspi_config.quadhd_io_num = w25->config.hold;
+        vspi_config.flags = SPICOMMON_BUSFLAG_QUAD;
+    }else if (w25->bus_mode == W25_BUS_DUAL){
+        vspi_config.flags = SPICOMMON_BUSFLAG_DUAL;
+    }
+    if (w25->half_duplex()){
+        w25->dev_config.flags |= SPI_DEVICE_HALFDUPLEX;
+    }else{
+        w25->dev_config.flags &= ~static_cast<uint32_t>(SPI_DEVICE_HALFDUPLEX);
+    }
+
+    esp_err_t err = spi_bus_initialize(w25->config.host, &vspi_config, SPI_DMA_CH_AUTO);
+    if ((err == ESP_OK) || (err == ESP_ERR_INVALID_STATE)){ //Already initialized for another memory sharing the host
+        err = spi_bus_add_device(w25->config.host, &w25->dev_config, &w25->handle);
     }else{
         err = ESP_FAIL;
     }
@@ -132,7 +226,14 @@ esp_err_t vspi_w25_free_bus(winbond_t *w25){
     if (sem_timeout == pdTRUE){
         err = spi_bus_remove_device(w25->handle);
         if (err == ESP_OK){
-            err = spi_bus_free(VSPI_HOST);
+            w25->handle = nullptr;
+            err = spi_bus_free(w25->config.host);
+            if (err == ESP_ERR_INVALID_STATE){ //Other memories are still on the host, the last one frees it
+                err = ESP_OK;
+            }
+            if (w25->bus_mode == W25_BUS_QUAD){ //Gives WP and HOLD back to the GPIO driver, keeping the memory out of hold
+                w25->release_hold_wp();
+            }
         }else{
             err = ESP_FAIL;
         }
@@ -144,12 +245,39 @@ esp_err_t vspi_w25_free_bus(winbond_t *w25){
 }
 
 winbond_t *init_w25_struct(size_t max_trans_size){
-    assert(max_trans_size <= MAX_TRANS_SIZE);
-	winbond_t *w25 = new winbond_t(max_trans_size);
+    w25_config_t config = W25_CONFIG_DEFAULT();
+    config.max_trans_size = max_trans_size;
+	return w25_Create(&config);
+}
+
+winbond_t *w25_Create(const w25_config_t *config){
+    assert(config != nullptr);
+    assert(config->max_trans_size <= MAX_TRANS_SIZE);
+    assert((config->bus_mode != W25_BUS_QUAD) || ((config->hold != GPIO_NUM_NC) && (config->wp != GPIO_NUM_NC)));
+	winbond_t *w25 = new winbond_t(*config);
 	return w25;
 }
 
+esp_err_t w25_SetBusMode(winbond_t *w25, w25_bus_mode mode){
+    esp_err_t err = ESP_OK;
+    if (w25->handle != nullptr){ //The pins and the duplex mode are only configured when the bus is allocated
+        err = ESP_ERR_INVALID_STATE;
+    }else if ((mode == W25_BUS_QUAD) && ((w25->config.hold == GPIO_NUM_NC) || (w25->config.wp == GPIO_NUM_NC))){
+        err = ESP_ERR_INVALID_ARG;
+    }else{
+        w25->bus_mode = mode;
+    }
+    return err;
+}
+
+w25_bus_mode w25_GetBusMode(const winbond_t *w25){
+    return w25->bus_mode;
+}
+
 esp_err_t deinit_w25_struct(winbond_t *w25){
+    if (w25->async != nullptr){ //The I/O task needs the bus to finish what was already queued
+        (void)w25_StopAsync(w25);
+    }
     auto sem_timeout = xSemaphoreTake(w25->spi_bus_mutex, w25->semaphore_timeout); //If the bus isn't initialized, 
                                                        //this semaphore won't be never taken (DANGER!!!)
     esp_err_t err = ESP_OK;
@@ -182,55 +310,451 @@ esp_err_t w25_CommitCurrentColumn(uint16_t column_addr){
     return err;
 }
 
-static esp_err_t vspi_transmission(const uint8_t *opCode, size_t opCode_size, uint8_t *out_buffer, spi_device_handle_t handle, SemaphoreHandle_t spi_bus_mutex, TickType_t timeout){
-    spi_transaction_t transaction = {
-        .flags = 0,
-        .cmd = 0,
-        .addr = 0,
-        .length = opCode_size*size_t{8},
-        .rxlength = 0,
-        .user = nullptr,
-        .tx_buffer = opCode,
-        .rx_buffer = out_buffer
-    };
-    auto sem_timeout = xSemaphoreTake(spi_bus_mutex, timeout);
+//Driver metrics. They are only updated with the device held, and compile to nothing unless W25_METRICS_ENABLED
+static inline int64_t metrics_now(void){
+    return W25_METRICS_ENABLED ? esp_timer_get_time() : 0;
+}
+
+#if W25_METRICS_ENABLED
+static void metrics_latency(const winbond_t *w25, w25_latency_kind kind, int64_t start_us){
+    const uint32_t elapsed_us = static_cast<uint32_t>(esp_timer_get_time() - start_us);
+    w25_histogram_t *histogram = &w25->metrics.latency[kind];
+    uint32_t bucket = 0;
+    while ((bucket < (W25_HIST_BUCKETS - 1U)) && (elapsed_us >= (16U << bucket))){
+        bucket++;
+    }
+    histogram->count++;
+    histogram->total_us += elapsed_us;
+    histogram->max_us = (elapsed_us > histogram->max_us) ? elapsed_us : histogram->max_us;
+    histogram->buckets[bucket]++;
+}
+
+static void metrics_frame(const winbond_t *w25, const spi_transaction_t *transaction){
+    if ((transaction->flags & SPI_TRANS_VARIABLE_CMD) != 0U){
+        w25->metrics.opcodes[transaction->cmd & 0xFFU]++;
+    }else if ((transaction->tx_buffer != nullptr) && (transaction->length >= 8U)){
+        w25->metrics.opcodes[static_cast<const uint8_t *>(transaction->tx_buffer)[0]]++;
+    }else{
+        //Continuation of a stream, no instruction on it
+    }
+    w25->metrics.data_bytes += (transaction->length + transaction->rxlength) / 8U;
+}
+
+static void metrics_busy_poll(const winbond_t *w25){
+    w25->metrics.busy_polls++;
+}
+
+//Accounts the Status Register read once an operation is over
+static void metrics_status(const winbond_t *w25, uint8_t status){
+    const uint8_t ecc = status & (ECC_1|ECC_0);
+    if (ecc == ECC_0){
+        w25->metrics.ecc_corrected++;
+    }else if (ecc != 0U){
+        w25->metrics.ecc_uncorrectable++;
+    }else{
+        //No ECC event
+    }
+    w25->metrics.erase_failures += ((status & E_FAIL) != 0U) ? 1U : 0U;
+    w25->metrics.program_failures += ((status & P_FAIL) != 0U) ? 1U : 0U;
+}
+#else
+static inline void metrics_latency(const winbond_t *, w25_latency_kind, int64_t){}
+static inline void metrics_frame(const winbond_t *, const spi_transaction_t *){}
+static inline void metrics_busy_poll(const winbond_t *){}
+static inline void metrics_status(const winbond_t *, uint8_t){}
+#endif
+
+//Holds the device for a whole sequence of commands, so no other task can touch the data buffer or the
+//scratch buffer halfway through. The owner's frames skip the semaphore, and its nested operations just count
+static esp_err_t op_lock(const winbond_t *w25){
+    esp_err_t err = ESP_OK;
+    const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    const int64_t start = metrics_now();
+    if (w25->bus_owner == self){
+        w25->lock_depth++;
+    }else if (xSemaphoreTake(w25->spi_bus_mutex, w25->semaphore_timeout) == pdTRUE){
+        w25->bus_owner = self;
+        w25->lock_depth = 1;
+        metrics_latency(w25, W25_LAT_LOCK_WAIT, start);
+    }else{
+        err = ESP_ERR_TIMEOUT;
+    }
+    return err;
+}
+
+static void op_unlock(const winbond_t *w25){
+    w25->lock_depth--;
+    if (w25->lock_depth == 0U){
+        w25->bus_owner = nullptr;
+        xSemaphoreGive(w25->spi_bus_mutex);
+    }
+}
+
+//Also holds the SPI host, so the frames skip the bus arbitration and CS can stay active between them.
+//Other memories sharing the host wait meanwhile, so it's kept for batches and streams only
+static esp_err_t bus_lock(const winbond_t *w25){
+    esp_err_t err = op_lock(w25);
+    if ((err == ESP_OK) && (w25->acquire_depth == 0U)){
+        err = spi_device_acquire_bus(w25->handle, portMAX_DELAY);
+        if (err != ESP_OK){
+            op_unlock(w25);
+        }
+    }
+    if (err == ESP_OK){
+        w25->acquire_depth++;
+    }
+    return err;
+}
+
+static void bus_unlock(const winbond_t *w25){
+    w25->acquire_depth--;
+    if (w25->acquire_depth == 0U){
+        spi_device_release_bus(w25->handle);
+    }
+    op_unlock(w25);
+}
+
+esp_err_t w25_GetMetrics(const winbond_t *w25, w25_metrics_t *metrics){
+    esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+#if W25_METRICS_ENABLED
+    err = op_lock(w25);
+    if (err == ESP_OK){
+        *metrics = w25->metrics;
+        op_unlock(w25);
+    }
+#else
+    (void)w25;
+    (void)metrics;
+#endif
+    return err;
+}
+
+esp_err_t w25_ResetMetrics(const winbond_t *w25){
+    esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+#if W25_METRICS_ENABLED
+    err = op_lock(w25);
+    if (err == ESP_OK){
+        w25->metrics = {};
+        op_unlock(w25);
+    }
+#else
+    (void)w25;
+#endif
+    return err;
+}
+
+esp_err_t w25_Lock(const winbond_t *w25){
+    return op_lock(w25);
+}
+
+void w25_Unlock(const winbond_t *w25){
+    op_unlock(w25);
+}
+
+//Re-adds the device with the new clock, the previous one is restored if the host refuses it
+static esp_err_t apply_clock(winbond_t *w25, uint32_t clock_speed_hz, int input_delay_ns){
+    const spi_device_interface_config_t previous = w25->dev_config;
+    w25->dev_config.clock_speed_hz = static_cast<int>(clock_speed_hz);
+    w25->dev_config.input_delay_ns = input_delay_ns;
+
+    esp_err_t err = ESP_OK;
+    if (w25->handle != nullptr){
+        err = spi_bus_remove_device(w25->handle);
+        if (err == ESP_OK){
+            w25->handle = nullptr;
+            err = spi_bus_add_device(w25->config.host, &w25->dev_config, &w25->handle);
+            if (err != ESP_OK){
+                w25->dev_config = previous;
+                (void)spi_bus_add_device(w25->config.host, &w25->dev_config, &w25->handle);
+            }
+        }
+    }
+    if (err == ESP_OK){
+        w25->config.clock_speed_hz = clock_speed_hz;
+        w25->config.input_delay_ns = input_delay_ns;
+    }else{
+        w25->dev_config = previous;
+    }
+    return err;
+}
+
+esp_err_t w25_SetClock(winbond_t *w25, uint32_t clock_speed_hz, int input_delay_ns){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if ((clock_speed_hz > 0U) && (clock_speed_hz <= W25_MAX_CLOCK_HZ) && (input_delay_ns >= 0)){
+        err = op_lock(w25); //No frame of another task can be in flight while the device is re-added
+    }
+    if (err == ESP_OK){
+        if (w25->acquire_depth > 0U){
+            err = ESP_ERR_INVALID_STATE;
+        }else{
+            err = apply_clock(w25, clock_speed_hz, input_delay_ns);
+        }
+        op_unlock(w25);
+    }
+    return err;
+}
+
+static esp_err_t vspi_locked_transmit(const winbond_t *w25, spi_transaction_t *transaction){
     esp_err_t err = ESP_FAIL;
-    if (sem_timeout == pdTRUE){
-        err = spi_device_transmit(handle,&transaction);
-        xSemaphoreGive(spi_bus_mutex);
+    const int64_t start = metrics_now();
+    if (w25->bus_owner == xTaskGetCurrentTaskHandle()){
+        metrics_frame(w25, transaction); //Before the full-duplex reply lands on the opcode
+        err = spi_device_transmit(w25->handle,transaction);
+    }else if (xSemaphoreTake(w25->spi_bus_mutex, w25->semaphore_timeout) == pdTRUE){
+        metrics_latency(w25, W25_LAT_LOCK_WAIT, start);
+        metrics_frame(w25, transaction);
+        err = spi_device_transmit(w25->handle,transaction);
+        xSemaphoreGive(w25->spi_bus_mutex);
     }else{
         err = ESP_ERR_TIMEOUT;
     }
     return err;
 }
 
-/* LOW LEVEL DRIVER FUNCTIONS*/
+static esp_err_t vspi_transmission(const winbond_t *w25, const uint8_t *opCode, size_t opCode_size, uint8_t *out_buffer, size_t rx_offset){
+    spi_transaction_ext_t transaction = {
+        .base = {
+            .flags = 0,
+            .cmd = 0,
+            .addr = 0,
+            .length = opCode_size*size_t{8},
+            .rxlength = 0,
+            .user = nullptr,
+            .tx_buffer = opCode,
+            .rx_buffer = out_buffer
+        },
+        .command_bits = 0,
+        .address_bits = 0,
+        .dummy_bits = 0
+    };
+    if (w25->half_duplex() && (out_buffer != nullptr)){
+        //DMA can't drive a write and a read data phase on the same half-duplex transaction, so the
+        //first rx_offset bytes (opcode, address and dummy bytes) are sent through the command and address phases
+        assert((rx_offset > size_t{0}) && (rx_offset <= MAX_CMD_PREFIX) && (rx_offset < opCode_size));
+        transaction.base.flags = SPI_TRANS_VARIABLE_CMD|SPI_TRANS_VARIABLE_ADDR|SPI_TRANS_VARIABLE_DUMMY;
+        transaction.base.cmd = opCode[0];
+        for (size_t i = 1; i < rx_offset; i++){
+            transaction.base.addr = (transaction.base.addr << 8U) | opCode[i];
+        }
+        transaction.command_bits = 8;
+        transaction.address_bits = static_cast<uint8_t>((rx_offset - size_t{1})*size_t{8});
+        transaction.base.length = 0;
+        transaction.base.rxlength = (opCode_size - rx_offset)*size_t{8};
+        transaction.base.tx_buffer = nullptr;
+        transaction.base.rx_buffer = &out_buffer[rx_offset];
+    }
+    return vspi_locked_transmit(w25, &transaction.base);
+}
 
-esp_err_t w25_Reset(const winbond_t *w25, uint16_t max_trial_nmb){
-    
+//Transaction split in command, address and dummy phases, with the data phase on 1, 2 or 4 lines
+static spi_transaction_ext_t phase_transaction(const winbond_t *w25, uint8_t command, uint32_t address, uint8_t address_bits, uint8_t dummy_cycles, uint32_t line_flags, const uint8_t *in_buffer, uint8_t *out_buffer, size_t buffer_size){
+    spi_transaction_ext_t transaction = {
+        .base = {
+            .flags = SPI_TRANS_VARIABLE_CMD|SPI_TRANS_VARIABLE_ADDR|SPI_TRANS_VARIABLE_DUMMY|line_flags,
+            .cmd = command,
+            .addr = address,
+            .length = 0,
+            .rxlength = 0,
+            .user = nullptr,
+            .tx_buffer = in_buffer,
+            .rx_buffer = out_buffer
+        },
+        .command_bits = 8,
+        .address_bits = address_bits,
+        .dummy_bits = dummy_cycles
+    };
+    if (in_buffer != nullptr){
+        transaction.base.length = buffer_size*size_t{8};
+    }else{
+        transaction.base.rxlength = buffer_size*size_t{8};
+        if (!w25->half_duplex()){ //Full-duplex reads still need a write phase as long as the read one
+            transaction.base.length = buffer_size*size_t{8};
+        }
+    }
+    return transaction;
+}
+
+//Read Data on single mode, Fast Read Dual/Quad I/O otherwise
+static spi_transaction_ext_t read_data_transaction(const winbond_t *w25, uint16_t column_addr, uint8_t *out_buffer, size_t buffer_size){
+    uint8_t command = instruction_code::READ_DATA;
+    uint32_t address = static_cast<uint32_t>(column_addr) << 8U; //Column followed by the dummy byte
+    uint8_t address_bits = 24;
+    uint8_t dummy_cycles = 0;
+    uint32_t line_flags = 0;
+    if (w25->bus_mode != W25_BUS_SINGLE){ //The column goes out on 2/4 lines, followed by 4 dummy clocks
+        command = (w25->bus_mode == W25_BUS_QUAD) ? instruction_code::FAST_READ_QUAD_IO : instruction_code::FAST_READ_DUAL_IO;
+        address = column_addr;
+        address_bits = 16;
+        dummy_cycles = 4;
+        line_flags = SPI_TRANS_MULTILINE_ADDR | ((w25->bus_mode == W25_BUS_QUAD) ? SPI_TRANS_MODE_QIO : SPI_TRANS_MODE_DIO);
+    }
+    return phase_transaction(w25, command, address, address_bits, dummy_cycles, line_flags, nullptr, out_buffer, buffer_size);
+}
+
+//Program Data Load, or Quad Program Data Load on quad mode. Both reset the rest of the data buffer to 0xFF,
+//unless their Random variant is used
+static spi_transaction_ext_t load_data_transaction(const winbond_t *w25, uint16_t column_addr, const uint8_t *in_buffer, size_t buffer_size, bool random_load){
+    uint8_t command = random_load ? instruction_code::RAND_PROG_LOAD : instruction_code::PROG_DATA_LOAD;
+    uint32_t line_flags = 0;
+    if (w25->bus_mode == W25_BUS_QUAD){
+        command = random_load ? instruction_code::RAND_QUAD_PROG_LOAD : instruction_code::QUAD_PROG_LOAD;
+        line_flags = SPI_TRANS_MODE_QIO;
+    }
+    return phase_transaction(w25, command, column_addr, 16, 0, line_flags, in_buffer, nullptr, buffer_size);
+}
+
+//The SPI driver only receives straight into buffers that DMA can reach with whole words, otherwise
+//it mallocs a temporary buffer for every transaction
+static bool dma_direct(const uint8_t *buffer, size_t buffer_size){
+    return esp_ptr_dma_capable(buffer) && ((reinterpret_cast<uintptr_t>(buffer) % 4U) == 0U) && ((buffer_size % size_t{4}) == 0U);
+}
+
+//Sleeps whole ticks when possible, blocks on the esp_timer for sub-tick waits and only spins the short ones
+static void sleep_us(const winbond_t *w25, uint32_t us){
+    const uint32_t tick_us = portTICK_PERIOD_MS*1000U;
+    if (us >= tick_us){
+        vTaskDelay(us/tick_us); //The remainder is covered by the polling
+    }else if ((us > SPIN_LIMIT_US) && (xSemaphoreTake(w25->wake_owner, 0) == pdTRUE)){
+        (void)xSemaphoreTake(w25->wake, 0); //Clears a wake up left by a stopped timer
+        if (esp_timer_start_once(w25->wake_timer, us) == ESP_OK){
+            (void)xSemaphoreTake(w25->wake, portMAX_DELAY);
+        }else{
+            esp_rom_delay_us(us);
+        }
+        xSemaphoreGive(w25->wake_owner);
+    }else if (us > 0U){
+        esp_rom_delay_us(us);
+    }else{
+        //Nothing to wait for
+    }
+}
+
+//Waits the expected duration of the operation, then polls the BUSY bit until the deadline.
+//The last Status Register value is handed back so the callers don't need to read it again
+static esp_err_t wait_ready(const winbond_t *w25, uint32_t expected_us, uint16_t timeout_ms, uint8_t *status_out){
     esp_err_t err = ESP_OK;
-    uint16_t trial = 0;
-    while(w25_evaluateStatusRegisterBit(w25_ReadStatusRegister(w25,STATUS_REG),STAT_BUSY)){
-        ESP_LOGW("MEMORY IS BUSY","\n");
-        if(trial >= max_trial_nmb){ //This ends the endless loop when the nmb of trials is exceeded
+    const int64_t deadline = esp_timer_get_time() + (static_cast<int64_t>(timeout_ms)*1000);
+    const uint32_t interval = ((expected_us/8U) > w25->timing.poll_us) ? (expected_us/8U) : w25->timing.poll_us;
+
+    sleep_us(w25, expected_us);
+    uint8_t status = w25_ReadStatusRegister(w25,STATUS_REG);
+    while(w25_evaluateStatusRegisterBit(status,STAT_BUSY)){
+        metrics_busy_poll(w25);
+        const int64_t remaining = deadline - esp_timer_get_time();
+        if (remaining <= 0){
             err = ESP_ERR_TIMEOUT;
             break;
         }
-        trial++;
-        vTaskDelay(1);
+        sleep_us(w25, (remaining < static_cast<int64_t>(interval)) ? static_cast<uint32_t>(remaining) : interval);
+        status = w25_ReadStatusRegister(w25,STATUS_REG);
+    }
+    if (status_out != nullptr){
+        *status_out = status;
+    }
+    return err;
+}
+
+//ECC-1 and ECC-0 of a Status Register value
+static w25_ecc_status ecc_status(uint8_t status){
+    return static_cast<w25_ecc_status>((status & (ECC_1|ECC_0)) >> 4U);
+}
+
+//Waits for a Page Data Read to move the page into the data buffer. The ECC outcome comes with the last poll
+static esp_err_t wait_page_read(const winbond_t *w25, w25_ecc_status *ecc){
+    const int64_t start = metrics_now();
+    uint8_t status = 0;
+    esp_err_t err = wait_ready(w25, w25->timing.page_read_us, DEFAULT_TIMEOUT_MS, &status);
+    metrics_latency(w25, W25_LAT_PAGE_READ, start);
+    metrics_status(w25, status);
+    if (ecc != nullptr){
+        *ecc = ecc_status(status);
+    }
+    return err;
+}
+
+//Clocks the already loaded page out with CS held low, discarding the first skip bytes. In Continuous Read Mode
+//the memory moves to the next page by itself when the end of the current one is reached
+static esp_err_t continuous_stream(const winbond_t *w25, size_t skip, uint8_t *out_buffer, size_t buffer_size){
+    uint8_t command = instruction_code::READ_DATA;
+    uint8_t dummy_bytes = 3;
+    uint32_t line_flags = 0;
+    if (w25->bus_mode == W25_BUS_QUAD){
+        command = instruction_code::FAST_READ_QUAD_OUT;
+        dummy_bytes = 4;
+        line_flags = SPI_TRANS_MODE_QIO;
+    }else if (w25->bus_mode == W25_BUS_DUAL){
+        command = instruction_code::FAST_READ_DUAL_OUT;
+        dummy_bytes = 4;
+        line_flags = SPI_TRANS_MODE_DIO;
+    }else{
+        //Single line Read Data, 3 dummy bytes on BUF=0
+    }
+
+    const size_t chunk_max = w25->buffer_size & ~size_t{3}; //DMA reads are word sized
+    const size_t total = skip + buffer_size;
+    size_t done = 0;
+
+    esp_err_t err = bus_lock(w25); //Needed to keep CS active between transactions
+    if (err == ESP_OK){
+        while ((err == ESP_OK) && (done < total)){
+            size_t chunk = ((total - done) < chunk_max) ? (total - done) : chunk_max;
+            spi_transaction_ext_t transaction = {};
+            transaction.base.flags = line_flags;
+            if (done == size_t{0}){ //The dummy bytes go out as a zeroed address phase
+                transaction.base.flags |= SPI_TRANS_VARIABLE_CMD|SPI_TRANS_VARIABLE_ADDR|SPI_TRANS_VARIABLE_DUMMY;
+                transaction.base.cmd = command;
+                transaction.command_bits = 8;
+                transaction.address_bits = static_cast<uint8_t>(dummy_bytes*8U);
+            }
+            if ((done + chunk) < total){
+                transaction.base.flags |= SPI_TRANS_CS_KEEP_ACTIVE;
+            }
+            transaction.base.length = w25->half_duplex() ? size_t{0} : (chunk*size_t{8});
+            transaction.base.rxlength = chunk*size_t{8};
+            uint8_t *direct = (done >= skip) ? &out_buffer[done - skip] : nullptr;
+            transaction.base.rx_buffer = ((direct != nullptr) && dma_direct(direct, chunk)) ? direct : w25->opCode;
+
+            err = spi_device_transmit(w25->handle, &transaction.base);
+            metrics_frame(w25, &transaction.base);
+            if ((err == ESP_OK) && (transaction.base.rx_buffer == w25->opCode) && ((done + chunk) > skip)){
+                size_t first = (done < skip) ? (skip - done) : size_t{0};
+                (void)memcpy(&out_buffer[(done + first) - skip], &w25->opCode[first], chunk - first);
+            }
+            done += chunk;
+        }
+        bus_unlock(w25);
     }
+    return err;
+}
+
+/* LOW LEVEL DRIVER FUNCTIONS*/
+
+esp_err_t w25_Reset(const winbond_t *w25, uint16_t timeout_ms){
+    
+    esp_err_t err = wait_ready(w25, 0, timeout_ms, nullptr);
     if (err == ESP_ERR_TIMEOUT){
         uint8_t opCode[] = {instruction_code::W25_DEVICE_RESET};
-        err = vspi_transmission(opCode,sizeof(opCode),nullptr,w25->handle, w25->spi_bus_mutex, w25->semaphore_timeout);
+        err = vspi_transmission(w25, opCode, sizeof(opCode), nullptr, 0);
+        w25->buffer_page = UINT32_MAX;
     }
     
     return err;
 }
 
+esp_err_t w25_SetTiming(winbond_t *w25, const w25_timing_t *timing){
+    assert(timing != nullptr);
+    esp_err_t err = op_lock(w25); //A wait of another task could read the model while it's being copied
+    if (err == ESP_OK){
+        w25->timing = *timing;
+        op_unlock(w25);
+    }
+    return err;
+}
+
 esp_err_t w25_GetJedecID(const winbond_t *w25, uint8_t *out_buffer, size_t buffer_size){
     assert(buffer_size >= size_t{3});
     uint8_t opCode[5] = {instruction_code::JEDEC_ID, 0x00, 0x00, 0x00, 0x00};
-    esp_err_t err = vspi_transmission(opCode,sizeof(opCode),opCode,w25->handle, w25->spi_bus_mutex, w25->semaphore_timeout);
+    esp_err_t err = vspi_transmission(w25, opCode, sizeof(opCode), opCode, 2);
     out_buffer[0] = opCode[2];
     out_buffer[1] = opCode[3];
     out_buffer[2] = opCode[4];
@@ -240,7 +764,7 @@ esp_err_t w25_GetJedecID(const winbond_t *w25, uint8_t *out_buffer, size_t buffe
 uint8_t w25_ReadStatusRegister(const winbond_t *w25, reg_addr register_address){
     uint8_t opCode[9] = {instruction_code::READ_STATUS_REG, register_address, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
     uint8_t buffer = 0;
-    esp_err_t err = vspi_transmission(opCode,sizeof(opCode),opCode,w25->handle, w25->spi_bus_mutex, w25->semaphore_timeout);
+    esp_err_t err = vspi_transmission(w25, opCode, sizeof(opCode), opCode, 2);
     if (err == ESP_OK){
         buffer = opCode[2];
     }
@@ -253,7 +777,7 @@ bool w25_evaluateStatusRegisterBit(uint8_t registerOutput, uint8_t bitValue){
 
 esp_err_t w25_WriteStatusRegister(const winbond_t *w25, reg_addr register_address, uint8_t bitValue){
     uint8_t opCode[3] = {instruction_code::WRITE_STATUS_REG, register_address, bitValue};
-    return vspi_transmission(opCode,sizeof(opCode), nullptr, w25->handle, w25->spi_bus_mutex, w25->semaphore_timeout);
+    return vspi_transmission(w25, opCode, sizeof(opCode), nullptr, 0);
 }
 
 esp_err_t w25_WritePermission(const winbond_t *w25, bool state){
@@ -263,37 +787,36 @@ esp_err_t w25_WritePermission(const winbond_t *w25, bool state){
     }else{
         opCode[0] = WRITE_DISABLE;
     }
-    return vspi_transmission(opCode,1,nullptr,w25->handle, w25->spi_bus_mutex, w25->semaphore_timeout);
+    return vspi_transmission(w25, opCode, 1, nullptr, 0);
 }
 
-esp_err_t w25_ReadDataBuffer(const winbond_t *w25, uint16_t column_addr, uint8_t *out_buffer, size_t buffer_size, uint16_t max_trial_nmb){
+//Reads the data buffer without checking the BUSY bit first
+static esp_err_t read_data_buffer(const winbond_t *w25, uint16_t column_addr, uint8_t *out_buffer, size_t buffer_size){
     esp_err_t err = ESP_OK;
-    assert(column_addr<=MAX_ALLOWED_ADDR); //MAXIMUM ALLOWED ADDRESS
-    uint16_t trial = 0;
-    while(w25_evaluateStatusRegisterBit(w25_ReadStatusRegister(w25,STATUS_REG),STAT_BUSY)){
-        ESP_LOGW("MEMORY IS BUSY","\n");
-        if(trial >= max_trial_nmb){ //This ends the endless loop when the nmb of trials is exceeded
-            err = ESP_ERR_TIMEOUT;
-            break;
-        }
-        trial++;
-        vTaskDelay(1);
+    assert((size_t{column_addr} + buffer_size) <= PAGE_WITH_SPARE);
+
+    //The page lands straight into the caller's buffer when DMA can reach it, the shared buffer is only a fallback
+    uint8_t *rx_buffer = dma_direct(out_buffer, buffer_size) ? out_buffer : w25->opCode;
+    assert((rx_buffer == out_buffer) || (buffer_size <= w25->buffer_size));
+    spi_transaction_ext_t transaction = read_data_transaction(w25, column_addr, rx_buffer, buffer_size);
+    err = vspi_locked_transmit(w25, &transaction.base);
+    if ((err == ESP_OK) && (rx_buffer != out_buffer)){
+        (void)memcpy(out_buffer,rx_buffer,buffer_size);
     }
-    if (err != ESP_ERR_TIMEOUT){
-        uint8_t *p_column_bits = reinterpret_cast<uint8_t *>(&column_addr);
-        
-        w25->opCode[0] = instruction_code::READ_DATA;
-        w25->opCode[1] = p_column_bits[1];
-        w25->opCode[2] = p_column_bits[0];
-        w25->opCode[3] = 0x66; //Dummy byte
+     
+    return err;
+}
 
-        assert((buffer_size + size_t{4}) <= w25->buffer_size); //Size of the sent message cant be bigger than the actual transmitted buffer
-        err = vspi_transmission(w25->opCode, buffer_size + size_t{4}, w25->opCode, w25->handle, w25->spi_bus_mutex, w25->semaphore_timeout); //THIS LINE IS CORRUPTING THE HEAP MEMORY
-        heap_caps_check_integrity_all(true); //CHECKS THE INTEGRITY OF THE ENTIRE HEAP
-        (void)memcpy(out_buffer,&w25->opCode[4],buffer_size);
-        heap_caps_check_integrity_all(true); //CHECKS THE INTEGRITY OF THE ENTIRE HEAP
+esp_err_t w25_ReadDataBuffer(const winbond_t *w25, uint16_t column_addr, uint8_t *out_buffer, size_t buffer_size, uint16_t timeout_ms){
+    assert(column_addr < PAGE_WITH_SPARE); //The spare area can be read too
+    esp_err_t err = op_lock(w25);
+    if (err == ESP_OK){
+        err = wait_ready(w25, 0, timeout_ms, nullptr);
+        if (err == ESP_OK){
+            err = read_data_buffer(w25, column_addr, out_buffer, buffer_size);
+        }
+        op_unlock(w25);
     }
-     
     return err;
 }
 
@@ -305,11 +828,12 @@ esp_err_t w25_PageDataRead(const winbond_t *w25, uint16_t page_addr){
     opCode[2] = p_page_addr[1];
     opCode[3] = p_page_addr[0];
 
-    return vspi_transmission(opCode, sizeof(opCode), nullptr, w25->handle, w25->spi_bus_mutex, w25->semaphore_timeout);
+    w25->buffer_page = UINT32_MAX; //The data buffer is overwritten by the page read
+    return vspi_transmission(w25, opCode, sizeof(opCode), nullptr, 0);
 
 }
 
-esp_err_t w25_BlockErase(const winbond_t *w25, uint16_t page_addr, uint16_t max_trial_nmb){
+esp_err_t w25_BlockErase(const winbond_t *w25, uint16_t page_addr, uint16_t timeout_ms){
     esp_err_t err = ESP_ERR_INVALID_ARG;
     
     if (page_addr < MAX_ALLOWED_PAGEBLOCK){
@@ -320,46 +844,81 @@ esp_err_t w25_BlockErase(const winbond_t *w25, uint16_t page_addr, uint16_t max_
         opCode[2] = p_page_addr[1];
         opCode[3] = p_page_addr[0];
 
-        w25_WritePermission(w25,true);
-        err = vspi_transmission(opCode, sizeof(opCode), nullptr, w25->handle, w25->spi_bus_mutex, w25->semaphore_timeout);
-        uint16_t trial = 0;
-        while(w25_evaluateStatusRegisterBit(w25_ReadStatusRegister(w25,STATUS_REG),STAT_BUSY)){ //The BUSY bit is a 1 during the Block Erase cycle and becomes a 0 when the cycle is finished 
-            ESP_LOGW("MEMORY IS BUSY","\n");
-            if(trial >= max_trial_nmb){ //This ends the endless loop when the nmb of trials is exceeded
-                err = ESP_ERR_TIMEOUT;
-                break;
+        uint8_t status = 0;
+        err = op_lock(w25);
+        if (err == ESP_OK){
+            w25_WritePermission(w25,true);
+            err = vspi_transmission(w25, opCode, sizeof(opCode), nullptr, 0);
+            if (err == ESP_OK){ //The BUSY bit is a 1 during the Block Erase cycle and becomes a 0 when the cycle is finished 
+                const int64_t start = metrics_now();
+                err = wait_ready(w25, w25->timing.erase_us, timeout_ms, &status);
+                metrics_latency(w25, W25_LAT_ERASE, start);
+                metrics_status(w25, status);
             }
-            trial++;
-            vTaskDelay(1);
+            op_unlock(w25);
         }
 
-        if (w25_evaluateStatusRegisterBit(w25_ReadStatusRegister(w25,STATUS_REG),E_FAIL)){
+        if (w25_evaluateStatusRegisterBit(status,E_FAIL)){
             err = ESP_ERR_INVALID_STATE;
         }
     }
     return err;
 }
 
-esp_err_t w25_LoadProgramData(const winbond_t *w25, uint16_t column_addr, const uint8_t *in_buffer, size_t buffer_size){
+//Loads the data buffer through the internal buffer. The column isn't limited to the data area, and a random
+//load keeps what was loaded before instead of resetting the buffer to 0xFF
+static esp_err_t load_data(const winbond_t *w25, uint16_t column_addr, const uint8_t *in_buffer, size_t buffer_size, bool random_load){
     esp_err_t err = ESP_OK;
-    assert(column_addr <= MAX_ALLOWED_ADDR); //MAXIMUM ALLOWED ADDRESS
-    assert(buffer_size <= size_t{2048+4});
+    if (!random_load){
+        w25->buffer_page = UINT32_MAX;
+    }
 
-    uint8_t *p_column_bits = reinterpret_cast<uint8_t *>(&column_addr);
+    if (w25->bus_mode == W25_BUS_QUAD){ //Quad Program Data Load: opcode and column on IO0, data on IO0-IO3
+        assert(buffer_size <= w25->buffer_size);
+        (void)memcpy(w25->opCode,in_buffer,buffer_size);
 
-    w25->opCode[0] = instruction_code::PROG_DATA_LOAD;
-    w25->opCode[1] = p_column_bits[1];
-    w25->opCode[2] = p_column_bits[0];
-    
-    (void)memcpy(&(w25->opCode[3]),in_buffer,buffer_size);
+        spi_transaction_ext_t transaction = load_data_transaction(w25, column_addr, w25->opCode, buffer_size, random_load);
+        w25_WritePermission(w25,true);
+        err = vspi_locked_transmit(w25, &transaction.base);
+    }else{
+        assert((buffer_size + size_t{3}) <= w25->buffer_size);
+        uint8_t *p_column_bits = reinterpret_cast<uint8_t *>(&column_addr);
+
+        w25->opCode[0] = random_load ? instruction_code::RAND_PROG_LOAD : instruction_code::PROG_DATA_LOAD;
+        w25->opCode[1] = p_column_bits[1];
+        w25->opCode[2] = p_column_bits[0];
 
-    w25_WritePermission(w25,true);
-    err = vspi_transmission(w25->opCode, buffer_size + size_t{3}, w25->opCode, w25->handle, w25->spi_bus_mutex, w25->semaphore_timeout);
-   
+        (void)memcpy(&(w25->opCode[3]),in_buffer,buffer_size);
+
+        w25_WritePermission(w25,true);
+        err = vspi_transmission(w25, w25->opCode, buffer_size + size_t{3}, nullptr, 0);
+    }
+    return err;
+}
+
+esp_err_t w25_LoadProgramData(const winbond_t *w25, uint16_t column_addr, const uint8_t *in_buffer, size_t buffer_size){
+    assert(column_addr < PAGE_WITH_SPARE); //The spare area can be loaded too
+    assert(buffer_size <= size_t{2048+4});
+    esp_err_t err = op_lock(w25);
+    if (err == ESP_OK){
+        err = load_data(w25, column_addr, in_buffer, buffer_size, false);
+        op_unlock(w25);
+    }
+    return err;
+}
+
+esp_err_t w25_RandomLoadProgramData(const winbond_t *w25, uint16_t column_addr, const uint8_t *in_buffer, size_t buffer_size){
+    assert(column_addr < PAGE_WITH_SPARE); //The spare area can be loaded too
+    assert(buffer_size <= size_t{2048+4});
+    esp_err_t err = op_lock(w25);
+    if (err == ESP_OK){
+        err = load_data(w25, column_addr, in_buffer, buffer_size, true);
+        op_unlock(w25);
+    }
     return err;
 }
 
-esp_err_t w25_ProgramExecute(const winbond_t *w25, uint16_t page_addr, uint16_t max_trial_nmb){
+esp_err_t w25_ProgramExecute(const winbond_t *w25, uint16_t page_addr, uint16_t timeout_ms){
     
     assert(page_addr<MAX_ALLOWED_PAGEBLOCK);
     uint8_t opCode[4] = {instruction_code::PROG_EXEC,0x00,0x00,0x00};
@@ -368,32 +927,39 @@ esp_err_t w25_ProgramExecute(const winbond_t *w25, uint16_t page_addr, uint16_t
     opCode[2] = p_page_addr[1];
     opCode[3] = p_page_addr[0];
 
-    esp_err_t err = vspi_transmission(opCode, sizeof(opCode), nullptr, w25->handle, w25->spi_bus_mutex, w25->semaphore_timeout);
+    esp_err_t err = op_lock(w25);
+    if (err == ESP_OK){
+        err = vspi_transmission(w25, opCode, sizeof(opCode), nullptr, 0);
 
-    if (w25_evaluateStatusRegisterBit(w25_ReadStatusRegister(w25,STATUS_REG),P_FAIL)){
-        err = ESP_ERR_INVALID_STATE;
-    }else if (err == ESP_OK){
-        uint16_t trial = 0;
-        while(w25_evaluateStatusRegisterBit(w25_ReadStatusRegister(w25,STATUS_REG),STAT_BUSY)){
-            ESP_LOGW("MEMORY IS BUSY","\n");
-            if(trial >= max_trial_nmb){ //This ends the endless loop when the nmb of trials is exceeded
-                err = ESP_ERR_TIMEOUT;
-                break;
+        if (err == ESP_OK){
+            uint8_t status = 0;
+            const int64_t start = metrics_now();
+            err = wait_ready(w25, w25->timing.program_us, timeout_ms, &status);
+            metrics_latency(w25, W25_LAT_PROGRAM, start);
+            metrics_status(w25, status);
+            if (w25_evaluateStatusRegisterBit(status,P_FAIL)){ //Only valid once the program cycle is over
+                err = ESP_ERR_INVALID_STATE;
             }
-            trial++;
-            vTaskDelay(1);
+        }else{
+            err = ESP_FAIL;
         }
-    }else{
-        err = ESP_FAIL;
+        op_unlock(w25);
     }
     return err;
 }
 
-esp_err_t w25_LastECCFailure(const winbond_t *w25, uint16_t *page_addr){
+esp_err_t w25_LastECCFailure(const winbond_t *w25, uint16_t *page_addr, uint16_t timeout_ms){
 	assert(page_addr!=nullptr);
 	uint8_t opCode[]{instruction_code::LAST_ECC_FAIL_ADDR,0x00,0x66,0x66};
 	
-	esp_err_t err = vspi_transmission(opCode, sizeof(opCode), opCode, w25->handle, w25->spi_bus_mutex, w25->semaphore_timeout);
+	esp_err_t err = op_lock(w25);
+	if (err == ESP_OK){
+		err = wait_ready(w25, 0, timeout_ms, nullptr); //Ignored by the memory while BUSY
+		if (err == ESP_OK){
+			err = vspi_transmission(w25, opCode, sizeof(opCode), opCode, 2);
+		}
+		op_unlock(w25);
+	}
 
 	if (err == ESP_OK){
 
@@ -404,57 +970,758 @@ esp_err_t w25_LastECCFailure(const winbond_t *w25, uint16_t *page_addr){
 	return err;
 }
 
-//High Level Functions
+esp_err_t w25_ReadBBMLut(const winbond_t *w25, w25_bbm_entry_t *lut){
+    assert(lut != nullptr);
+    uint8_t opCode[2 + (W25_BBM_LUT_SIZE*BBM_ENTRY_SIZE)] = {instruction_code::READ_BBM_LUT, 0x00};
 
-esp_err_t w25_Initialize(const winbond_t *w25){
-    esp_err_t err = ESP_OK;
+    esp_err_t err = vspi_transmission(w25, opCode, sizeof(opCode), opCode, 2);
+    if (err == ESP_OK){
+        for (size_t i = 0; i < W25_BBM_LUT_SIZE; i++){
+            const uint8_t *entry = &opCode[2 + (i*BBM_ENTRY_SIZE)];
+            const uint16_t lba = static_cast<uint16_t>((uint16_t{entry[0]} << 8U) | entry[1]);
+            const uint16_t pba = static_cast<uint16_t>((uint16_t{entry[2]} << 8U) | entry[3]);
+            lut[i].logical_block = lba & BBM_BLOCK_MASK;
+            lut[i].physical_block = pba & BBM_BLOCK_MASK;
+            lut[i].enabled = ((lba & 0x8000U) != 0U);
+            lut[i].invalid = ((lba & 0x4000U) != 0U);
+        }
+    }
+    return err;
+}
 
-    if (w25 == nullptr){
-        err = ESP_ERR_NOT_FOUND;
-    }else{
+esp_err_t w25_BadBlockSwap(const winbond_t *w25, uint16_t logical_block, uint16_t physical_block, uint16_t timeout_ms){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
 
-        err = w25_Reset(w25, N_OF_TRIAL);
-        vTaskDelay(800/portTICK_PERIOD_MS);
+    if ((logical_block < W25_BLOCK_COUNT) && (physical_block < W25_BLOCK_COUNT)){
+        uint8_t opCode[5] = {instruction_code::BB_MANAG,0x00,0x00,0x00,0x00};
+        opCode[1] = static_cast<uint8_t>(logical_block >> 8U);
+        opCode[2] = static_cast<uint8_t>(logical_block & 0xFFU);
+        opCode[3] = static_cast<uint8_t>(physical_block >> 8U);
+        opCode[4] = static_cast<uint8_t>(physical_block & 0xFFU);
 
+        uint8_t status = 0;
+        err = op_lock(w25);
         if (err == ESP_OK){
-
-            err = w25_WriteStatusRegister(w25, CONFIG_REG, ECC_E|BUF|0x00);
+            err = w25_WritePermission(w25,true);
             if (err == ESP_OK){
-                err = w25_WriteStatusRegister(w25, PROTEC_REG, 0x00);
+                err = vspi_transmission(w25, opCode, sizeof(opCode), nullptr, 0);
+            }
+            if (err == ESP_OK){ //The link is written into the non-volatile LUT
+                err = wait_ready(w25, w25->timing.program_us, timeout_ms, &status);
             }
+            op_unlock(w25);
+        }
+        if ((err == ESP_OK) && w25_evaluateStatusRegisterBit(status, LUT_F)){
+            err = ESP_ERR_NO_MEM;
         }
     }
-
     return err;
 }
 
-esp_err_t w25_ReadMemory(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size){
-    esp_err_t err = ESP_OK;
-
-    err = w25_PageDataRead(w25, page_addr);
-    if((err == ESP_OK)){
-        err = w25_ReadDataBuffer(w25, column_addr, out_buffer, buffer_size, N_OF_TRIAL);
+esp_err_t w25_IsBadBlock(const winbond_t *w25, uint16_t block, bool *bad){
+    assert(bad != nullptr);
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    uint8_t marker = 0;
 
-        if((err != ESP_OK)){
-            ESP_LOGE("READ MEMORY ERROR: ", "ESP_FAIL");
-            err = ESP_FAIL;
+    if (block < (MAX_ALLOWED_PAGEBLOCK/W25_PAGES_PER_BLOCK)){
+        err = op_lock(w25);
+        if (err == ESP_OK){
+            err = w25_PageDataRead(w25, static_cast<uint16_t>(block*W25_PAGES_PER_BLOCK));
+            if (err == ESP_OK){
+                err = wait_page_read(w25, nullptr);
+            }
+            if (err == ESP_OK){
+                err = read_data_buffer(w25, BAD_BLOCK_MARKER_ADDR, &marker, 1);
+            }
+            op_unlock(w25);
         }
     }
+    *bad = (err == ESP_OK) && (marker != 0xFFU);
+    return err;
+}
 
-    if((w25_evaluateStatusRegisterBit(w25_ReadStatusRegister(w25,STATUS_REG),ECC_1))){
-        ESP_LOGW("Wrong ECC_1: ", " Values might've been wrongly read");
-    }
+esp_err_t w25_MarkBadBlock(const winbond_t *w25, uint16_t block){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    const uint8_t marker = 0x00;
 
+    if (block < (MAX_ALLOWED_PAGEBLOCK/W25_PAGES_PER_BLOCK)){
+        err = op_lock(w25);
+        if (err == ESP_OK){
+            err = load_data(w25, BAD_BLOCK_MARKER_ADDR, &marker, 1, false);
+            if (err == ESP_OK){
+                err = w25_ProgramExecute(w25, static_cast<uint16_t>(block*W25_PAGES_PER_BLOCK), DEFAULT_TIMEOUT_MS);
+            }
+            op_unlock(w25);
+        }
+    }
     return err;
 }
 
-esp_err_t w25_WriteMemory(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size){
-    esp_err_t err = ESP_OK;
-    err = w25_LoadProgramData(w25, column_addr, in_buffer, buffer_size);
+//High Level Functions
+
+esp_err_t w25_Initialize(const winbond_t *w25){
+    esp_err_t err = ESP_OK;
+
+    if (w25 == nullptr){
+        err = ESP_ERR_NOT_FOUND;
+    }else{
+
+        err = op_lock(w25);
+    }
+    if (err == ESP_OK){
+        err = w25_Reset(w25, DEFAULT_TIMEOUT_MS);
+        if (err == ESP_OK){ //The memory is ready as soon as BUSY clears, which is what takes longest on a wake up
+            err = wait_ready(w25, T_RST_US, DEFAULT_TIMEOUT_MS, nullptr);
+        }
+
+        if (err == ESP_OK){
+
+            err = w25_WriteStatusRegister(w25, CONFIG_REG, ECC_E|BUF|0x00);
+            if (err == ESP_OK){
+                err = w25_WriteStatusRegister(w25, PROTEC_REG, 0x00);
+            }
+        }
+        op_unlock(w25);
+    }
+
+    return err;
+}
+
+//Whether the current clock moves the JEDEC ID and a pattern through the data buffer intact, a few times in a row
+static bool clock_reliable(const winbond_t *w25){
+    const size_t size = ((w25->buffer_size - size_t{4}) < CALIBRATION_BYTES) ? (w25->buffer_size - size_t{4}) : CALIBRATION_BYTES;
+    uint8_t pattern[CALIBRATION_BYTES];
+    uint8_t receiver[CALIBRATION_BYTES];
+    bool reliable = true;
+
+    for (size_t round = 0; (round < CALIBRATION_ROUNDS) && reliable; round++){
+        uint8_t jedec[3] = {0};
+        reliable = (w25_GetJedecID(w25, jedec, sizeof(jedec)) == ESP_OK) && (jedec[0] == WINBOND_MAN_ID) &&
+            (((uint16_t{jedec[1]} << 8U) | jedec[2]) == W25_DEV_ID);
+
+        for (size_t i = 0; i < size; i++){ //Alternating bits, edges on every line, then a walking one
+            const uint8_t walking = static_cast<uint8_t>(1U << ((i + round) % 8U));
+            const uint8_t alternating = (((i + round) % 2U) == 0U) ? 0x55U : 0xAAU;
+            pattern[i] = ((i % 4U) == 3U) ? walking : alternating;
+        }
+        if (reliable){
+            reliable = (load_data(w25, 0, pattern, size, false) == ESP_OK) &&
+                (read_data_buffer(w25, 0, receiver, size) == ESP_OK) && (memcmp(pattern, receiver, size) == 0);
+        }
+    }
+    return reliable;
+}
+
+esp_err_t w25_CalibrateClock(winbond_t *w25, uint32_t max_clock_hz, uint32_t *clock_hz){
+    uint32_t best_hz = 0;
+    int best_delay_ns = 0;
+
+    esp_err_t err = op_lock(w25);
+    if (err == ESP_OK){
+        const uint32_t base_hz = w25->config.clock_speed_hz; //Read under the lock, another calibration may be running
+        best_hz = base_hz;
+        best_delay_ns = w25->config.input_delay_ns;
+        if ((w25->acquire_depth > 0U) || (w25->handle == nullptr)){
+            err = ESP_ERR_INVALID_STATE;
+        }else if (!clock_reliable(w25)){
+            err = ESP_ERR_INVALID_RESPONSE;
+        }else{
+            bool stepping = true;
+            for (size_t c = 0; (c < (sizeof(CALIBRATION_CLOCKS)/sizeof(CALIBRATION_CLOCKS[0]))) && stepping; c++){
+                const uint32_t candidate = CALIBRATION_CLOCKS[c];
+                if ((candidate > base_hz) && (candidate <= max_clock_hz) && (candidate <= W25_MAX_CLOCK_HZ)){
+                    stepping = false;
+                    for (size_t d = 0; (d < (sizeof(CALIBRATION_DELAYS_NS)/sizeof(CALIBRATION_DELAYS_NS[0]))) && !stepping; d++){
+                        stepping = (apply_clock(w25, candidate, CALIBRATION_DELAYS_NS[d]) == ESP_OK) && clock_reliable(w25);
+                        if (stepping){
+                            best_hz = candidate;
+                            best_delay_ns = CALIBRATION_DELAYS_NS[d];
+                        }
+                    }
+                }
+            }
+            err = apply_clock(w25, best_hz, best_delay_ns);
+        }
+        op_unlock(w25);
+    }
+    if (err == ESP_OK){
+        ESP_LOGI("W25N01GV", "SPI clock %u Hz, input delay %d ns", static_cast<unsigned int>(best_hz), best_delay_ns);
+        if (clock_hz != nullptr){
+            *clock_hz = best_hz;
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_ReadMemory(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size){
+    w25_ecc_status ecc = W25_ECC_CLEAN;
+    esp_err_t err = w25_ReadMemoryECC(w25, column_addr, page_addr, out_buffer, buffer_size, &ecc);
+    if (ecc >= W25_ECC_UNCORRECTABLE){
+        ESP_LOGW("Wrong ECC_1: ", " Values might've been wrongly read");
+    }
+    return err;
+}
+
+esp_err_t w25_ReadMemoryECC(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size, w25_ecc_status *ecc){
+    esp_err_t err = ESP_OK;
+    assert(column_addr<=MAX_ALLOWED_ADDR); //MAXIMUM ALLOWED ADDRESS
+    assert(ecc != nullptr);
+    *ecc = W25_ECC_CLEAN;
+
+    err = op_lock(w25);
+    if (err == ESP_OK){
+        err = w25_PageDataRead(w25, page_addr);
+        if((err == ESP_OK)){
+            err = wait_page_read(w25, ecc);
+        }
+        if((err == ESP_OK)){
+            err = read_data_buffer(w25, column_addr, out_buffer, buffer_size);
+
+            if((err != ESP_OK)){
+                ESP_LOGE("READ MEMORY ERROR: ", "ESP_FAIL");
+                err = ESP_FAIL;
+            }
+        }
+        op_unlock(w25);
+    }
+
+    return err;
+}
+
+esp_err_t w25_WriteMemory(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size){
+    esp_err_t err = op_lock(w25);
+    if (err == ESP_OK){
+        err = w25_LoadProgramData(w25, column_addr, in_buffer, buffer_size);
     
+        if (err == ESP_OK){
+            err = w25_ProgramExecute(w25, page_addr, DEFAULT_TIMEOUT_MS);
+        }
+        op_unlock(w25);
+    }
+
+    return err;
+}
+
+esp_err_t w25_ReadSpare(const winbond_t *w25, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    uint8_t window[SPARE_WINDOW];
+
+    if ((page_addr < MAX_ALLOWED_PAGEBLOCK) && (buffer_size <= W25_SPARE_SIZE)){
+        err = op_lock(w25);
+    }
+    if (err == ESP_OK){
+        err = w25_PageDataRead(w25, page_addr);
+        if (err == ESP_OK){
+            err = wait_page_read(w25, nullptr);
+        }
+        if (err == ESP_OK){
+            err = read_data_buffer(w25, SPARE_USER_ADDR, window, sizeof(window));
+        }
+        op_unlock(w25);
+    }
+    if (err == ESP_OK){ //The User Data I fields are 4 bytes every 16
+        for (size_t i = 0; i < buffer_size; i++){
+            out_buffer[i] = window[((i/SPARE_USER_BYTES)*SPARE_SECTOR_STRIDE) + (i%SPARE_USER_BYTES)];
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_WriteMemorySpare(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size, const uint8_t *spare, size_t spare_size){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    uint8_t window[SPARE_WINDOW];
+
+    if ((page_addr < MAX_ALLOWED_PAGEBLOCK) && (spare_size <= W25_SPARE_SIZE) && ((size_t{column_addr} + buffer_size) <= W25_PAGE_SIZE)){
+        err = op_lock(w25);
+    }
+    if (err == ESP_OK){
+        //Bytes left at 0xFF are left untouched by the program, the ECC ones are generated by the memory
+        (void)memset(window, 0xFF, sizeof(window));
+        for (size_t i = 0; i < spare_size; i++){
+            window[((i/SPARE_USER_BYTES)*SPARE_SECTOR_STRIDE) + (i%SPARE_USER_BYTES)] = spare[i];
+        }
+
+        if (in_buffer != nullptr){
+            err = load_data(w25, column_addr, in_buffer, buffer_size, false);
+        }
+        if (err == ESP_OK){
+            err = load_data(w25, SPARE_USER_ADDR, window, sizeof(window), (in_buffer != nullptr));
+        }
+        if (err == ESP_OK){
+            err = w25_ProgramExecute(w25, page_addr, DEFAULT_TIMEOUT_MS);
+        }
+        op_unlock(w25);
+    }
+    return err;
+}
+
+esp_err_t w25_ReadContinuous(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size){
+    w25_ecc_status ecc = W25_ECC_CLEAN;
+    return w25_ReadContinuousECC(w25, column_addr, page_addr, out_buffer, buffer_size, &ecc);
+}
+
+esp_err_t w25_ReadContinuousECC(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size, w25_ecc_status *ecc){
+    assert(ecc != nullptr);
+    *ecc = W25_ECC_CLEAN;
+    esp_err_t err = ESP_OK;
+    const uint32_t end_addr = (static_cast<uint32_t>(page_addr)*W25_PAGE_SIZE) + column_addr + buffer_size;
+
+    if ((column_addr > MAX_ALLOWED_ADDR) || (end_addr > (uint32_t{MAX_ALLOWED_PAGEBLOCK}*W25_PAGE_SIZE))){
+        err = ESP_ERR_INVALID_ARG;
+    }else{
+        err = op_lock(w25); //The BUF bit is cleared for the whole read
+    }
+    if (err == ESP_OK){
+        const uint8_t config = w25_ReadStatusRegister(w25, CONFIG_REG);
+
+        err = w25_WriteStatusRegister(w25, CONFIG_REG, config & static_cast<uint8_t>(~BUF));
+        if (err == ESP_OK){
+            err = w25_PageDataRead(w25, page_addr);
+        }
+        if (err == ESP_OK){
+            err = wait_page_read(w25, ecc);
+        }
+        if (err == ESP_OK){
+            err = continuous_stream(w25, column_addr, out_buffer, buffer_size);
+        }
+        uint8_t status = 0;
+        if ((wait_ready(w25, 0, DEFAULT_TIMEOUT_MS, &status) == ESP_OK) && (ecc_status(status) > *ecc)){ //The memory may still be loading the page after the one that was interrupted
+            *ecc = ecc_status(status); //Accumulated over the pages streamed
+        }
+
+        esp_err_t restore_err = w25_WriteStatusRegister(w25, CONFIG_REG, config | BUF);
+        if (err == ESP_OK){
+            err = restore_err;
+        }
+        op_unlock(w25);
+    }
+    return err;
+}
+
+//Scatter-Gather Page I/O
+
+static bool range_allowed(uint16_t column_addr, uint16_t page_addr, size_t buffer_size){
+    const uint32_t end_addr = (static_cast<uint32_t>(page_addr)*W25_PAGE_SIZE) + column_addr + buffer_size;
+    return (column_addr <= MAX_ALLOWED_ADDR) && (end_addr <= (uint32_t{MAX_ALLOWED_PAGEBLOCK}*W25_PAGE_SIZE));
+}
+
+//Reads the loaded page in pieces the internal buffer can hold, unless DMA can reach out_buffer
+static esp_err_t read_data_chunks(const winbond_t *w25, uint16_t column_addr, uint8_t *out_buffer, size_t buffer_size){
+    esp_err_t err = ESP_OK;
+    const size_t piece_max = dma_direct(out_buffer, buffer_size) ? buffer_size : (w25->buffer_size & ~size_t{3});
+    size_t done = 0;
+
+    while ((done < buffer_size) && (err == ESP_OK)){
+        const size_t piece = ((buffer_size - done) < piece_max) ? (buffer_size - done) : piece_max;
+        err = read_data_buffer(w25, static_cast<uint16_t>(column_addr + done), &out_buffer[done], piece);
+        done += piece;
+    }
+    return err;
+}
+
+//Loads the data buffer in pieces the internal buffer can hold, only the first one resets the buffer
+static esp_err_t load_data_chunks(const winbond_t *w25, uint16_t column_addr, const uint8_t *in_buffer, size_t buffer_size, bool random_load){
+    esp_err_t err = ESP_OK;
+    const size_t piece_max = (w25->bus_mode == W25_BUS_QUAD) ? w25->buffer_size : (w25->buffer_size - size_t{3});
+    size_t done = 0;
+
+    while ((done < buffer_size) && (err == ESP_OK)){
+        const size_t piece = ((buffer_size - done) < piece_max) ? (buffer_size - done) : piece_max;
+        err = load_data(w25, static_cast<uint16_t>(column_addr + done), &in_buffer[done], piece, random_load || (done > size_t{0}));
+        done += piece;
+    }
+    return err;
+}
+
+//Every page is loaded once for all the consecutive segments touching it
+static esp_err_t read_segments(const winbond_t *w25, const w25_read_segment_t *segments, size_t count){
+    esp_err_t err = ESP_OK;
+    uint32_t loaded = UINT32_MAX;
+
+    for (size_t i = 0; (i < count) && (err == ESP_OK); i++){
+        uint16_t page_addr = segments[i].page_addr;
+        uint16_t column_addr = segments[i].column_addr;
+        uint8_t *out_buffer = segments[i].buffer;
+        size_t left = segments[i].buffer_size;
+
+        while ((left > size_t{0}) && (err == ESP_OK)){
+            const size_t chunk = ((W25_PAGE_SIZE - column_addr) < left) ? (W25_PAGE_SIZE - column_addr) : left;
+            if (page_addr != loaded){
+                err = w25_PageDataRead(w25, page_addr);
+                if (err == ESP_OK){
+                    err = wait_page_read(w25, nullptr);
+                }
+                loaded = page_addr;
+            }
+            if (err == ESP_OK){
+                err = read_data_chunks(w25, column_addr, out_buffer, chunk);
+            }
+            out_buffer = &out_buffer[chunk];
+            left -= chunk;
+            page_addr++;
+            column_addr = 0;
+        }
+    }
+    return err;
+}
+
+//Consecutive segments on the same page are gathered in the data buffer and programmed together
+static esp_err_t write_segments(const winbond_t *w25, const w25_write_segment_t *segments, size_t count){
+    esp_err_t err = ESP_OK;
+    uint32_t pending = UINT32_MAX;
+
+    for (size_t i = 0; (i < count) && (err == ESP_OK); i++){
+        uint16_t page_addr = segments[i].page_addr;
+        uint16_t column_addr = segments[i].column_addr;
+        const uint8_t *in_buffer = segments[i].buffer;
+        size_t left = segments[i].buffer_size;
+
+        while ((left > size_t{0}) && (err == ESP_OK)){
+            const size_t chunk = ((W25_PAGE_SIZE - column_addr) < left) ? (W25_PAGE_SIZE - column_addr) : left;
+            const bool same_page = (page_addr == pending);
+            if (!same_page && (pending != UINT32_MAX)){
+                err = w25_ProgramExecute(w25, static_cast<uint16_t>(pending), DEFAULT_TIMEOUT_MS);
+            }
+            if (err == ESP_OK){
+                err = load_data_chunks(w25, column_addr, in_buffer, chunk, same_page);
+            }
+            pending = page_addr;
+            in_buffer = &in_buffer[chunk];
+            left -= chunk;
+            page_addr++;
+            column_addr = 0;
+        }
+    }
+    if ((err == ESP_OK) && (pending != UINT32_MAX)){
+        err = w25_ProgramExecute(w25, static_cast<uint16_t>(pending), DEFAULT_TIMEOUT_MS);
+    }
+    return err;
+}
+
+esp_err_t w25_ReadPages(const winbond_t *w25, const w25_read_segment_t *segments, size_t count){
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; (i < count) && (err == ESP_OK); i++){
+        if (!range_allowed(segments[i].column_addr, segments[i].page_addr, segments[i].buffer_size)){
+            err = ESP_ERR_INVALID_ARG;
+        }
+    }
+    if (err == ESP_OK){
+        err = bus_lock(w25);
+    }
+    if (err == ESP_OK){
+        err = read_segments(w25, segments, count);
+        bus_unlock(w25);
+    }
+    return err;
+}
+
+esp_err_t w25_WritePages(const winbond_t *w25, const w25_write_segment_t *segments, size_t count){
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; (i < count) && (err == ESP_OK); i++){
+        if (!range_allowed(segments[i].column_addr, segments[i].page_addr, segments[i].buffer_size)){
+            err = ESP_ERR_INVALID_ARG;
+        }
+    }
+    if (err == ESP_OK){
+        err = bus_lock(w25);
+    }
+    if (err == ESP_OK){
+        err = write_segments(w25, segments, count);
+        bus_unlock(w25);
+    }
+    return err;
+}
+
+esp_err_t w25_ReadRange(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size){
+    const w25_read_segment_t segment = {page_addr, column_addr, out_buffer, buffer_size};
+    return w25_ReadPages(w25, &segment, 1);
+}
+
+esp_err_t w25_WriteRange(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size){
+    const w25_write_segment_t segment = {page_addr, column_addr, in_buffer, buffer_size};
+    return w25_WritePages(w25, &segment, 1);
+}
+
+//Partial Page Append
+
+esp_err_t w25_AppendData(const winbond_t *w25, w25_append_cursor_t *cursor, const uint8_t *in_buffer, size_t buffer_size){
+    assert(cursor != nullptr);
+    esp_err_t err = ESP_OK;
+    w25_append_cursor_t next = *cursor;
+
+    if ((buffer_size == size_t{0}) || (buffer_size > W25_PAGE_SIZE)){
+        err = ESP_ERR_INVALID_ARG;
+    }else if (((next.column_addr + buffer_size) > W25_PAGE_SIZE) || (next.programs >= W25_MAX_PARTIAL_PROGRAMS)){
+        next.page_addr++; //Records never straddle two pages
+        next.column_addr = 0;
+        next.programs = 0;
+    }else{
+        //Fits in the current page
+    }
+    if ((err == ESP_OK) && (next.page_addr >= MAX_ALLOWED_PAGEBLOCK)){
+        err = ESP_ERR_NO_MEM;
+    }
+
     if (err == ESP_OK){
-        err = w25_ProgramExecute(w25, page_addr, N_OF_TRIAL);
+        err = bus_lock(w25);
+    }
+    if (err == ESP_OK){
+        //Only the new bytes are sent: patched into the image of the page when the buffer still holds it,
+        //otherwise into a buffer reset to 0xFF, which leaves the bytes already programmed untouched
+        err = load_data_chunks(w25, next.column_addr, in_buffer, buffer_size, w25->buffer_page == next.page_addr);
+        if (err == ESP_OK){
+            err = w25_ProgramExecute(w25, next.page_addr, DEFAULT_TIMEOUT_MS);
+        }
+        w25->buffer_page = (err == ESP_OK) ? next.page_addr : UINT32_MAX;
+        bus_unlock(w25);
     }
 
+    if (err == ESP_OK){
+        next.column_addr = static_cast<uint16_t>(next.column_addr + buffer_size);
+        next.programs++;
+        *cursor = next;
+    }
+    return err;
+}
+
+//Asynchronous Page I/O
+
+namespace{
+    enum class async_op : uint8_t {
+        READ_PAGE,
+        PROGRAM_PAGE,
+        STOP
+    };
+
+    struct async_request{
+        async_op op;
+        uint16_t column_addr;
+        uint16_t page_addr;
+        uint8_t *out_buffer;
+        const uint8_t *in_buffer;
+        size_t buffer_size;
+        w25_async_cb_t callback;
+        void *arg;
+    };
+
+    struct async_completion{
+        bool valid;
+        async_request request;
+        esp_err_t err;
+    };
+}
+
+struct w25_async{
+    QueueHandle_t requests;
+    SemaphoreHandle_t drained;
+    SemaphoreHandle_t stopped;
+    TaskHandle_t task;
+    std::atomic<size_t> outstanding;
+};
+
+static void async_complete(const winbond_t *w25, async_completion *done){
+    if (done->valid){
+        done->valid = false;
+        if (done->request.callback != nullptr){
+            done->request.callback(done->err, done->request.page_addr, done->request.arg);
+        }
+        if (--w25->async->outstanding == size_t{0}){
+            xSemaphoreGive(w25->async->drained);
+        }
+    }
+}
+
+//Queues the data transfer and, while the DMA moves it, hands the previous page over to the application
+static esp_err_t async_overlapped_transmit(const winbond_t *w25, spi_transaction_t *transaction, async_completion *previous){
+    esp_err_t err = op_lock(w25);
+    if (err == ESP_OK){
+        err = spi_device_queue_trans(w25->handle, transaction, w25->semaphore_timeout);
+        async_complete(w25, previous);
+        if (err == ESP_OK){
+            spi_transaction_t *result = nullptr;
+            err = spi_device_get_trans_result(w25->handle, &result, portMAX_DELAY);
+            metrics_frame(w25, transaction);
+        }
+        op_unlock(w25);
+    }
+    return err;
+}
+
+static esp_err_t async_read(const winbond_t *w25, const async_request *request, async_completion *previous){
+    esp_err_t err = w25_PageDataRead(w25, request->page_addr);
+    if (err == ESP_OK){
+        err = wait_page_read(w25, nullptr);
+    }
+    if (err == ESP_OK){
+        uint8_t *rx_buffer = dma_direct(request->out_buffer, request->buffer_size) ? request->out_buffer : w25->opCode;
+        if ((rx_buffer != request->out_buffer) && (request->buffer_size > w25->buffer_size)){
+            err = ESP_ERR_INVALID_SIZE;
+        }else{
+            spi_transaction_ext_t transaction = read_data_transaction(w25, request->column_addr, rx_buffer, request->buffer_size);
+            err = async_overlapped_transmit(w25, &transaction.base, previous);
+            if ((err == ESP_OK) && (rx_buffer != request->out_buffer)){
+                (void)memcpy(request->out_buffer, rx_buffer, request->buffer_size);
+            }
+        }
+    }
+    return err;
+}
+
+static esp_err_t async_program(const winbond_t *w25, const async_request *request, async_completion *previous){
+    esp_err_t err = ESP_OK;
+    const uint8_t *tx_buffer = request->in_buffer;
+    if (!dma_direct(request->in_buffer, request->buffer_size)){
+        if (request->buffer_size > w25->buffer_size){
+            err = ESP_ERR_INVALID_SIZE;
+        }else{
+            (void)memcpy(w25->opCode, request->in_buffer, request->buffer_size);
+            tx_buffer = w25->opCode;
+        }
+    }
+    if (err == ESP_OK){
+        spi_transaction_ext_t transaction = load_data_transaction(w25, request->column_addr, tx_buffer, request->buffer_size, false);
+        w25->buffer_page = UINT32_MAX;
+        err = w25_WritePermission(w25, true);
+        if (err == ESP_OK){
+            err = async_overlapped_transmit(w25, &transaction.base, previous);
+        }
+    }
+    if (err == ESP_OK){
+        err = w25_ProgramExecute(w25, request->page_addr, DEFAULT_TIMEOUT_MS);
+    }
+    return err;
+}
+
+static void async_task(void *arg){
+    const winbond_t *w25 = static_cast<const winbond_t *>(arg);
+    async_completion pending = {};
+    bool running = true;
+
+    while (running){
+        async_request request = {};
+        //A finished request is only held back while there is a next one to overlap its callback with
+        TickType_t wait = pending.valid ? TickType_t{0} : portMAX_DELAY;
+        if (xQueueReceive(w25->async->requests, &request, wait) != pdTRUE){
+            async_complete(w25, &pending);
+        }else if (request.op == async_op::STOP){
+            async_complete(w25, &pending);
+            running = false;
+        }else{
+            esp_err_t err = op_lock(w25); //The page is loaded and moved as a whole
+            if (err == ESP_OK){
+                err = (request.op == async_op::READ_PAGE) ? async_read(w25, &request, &pending) : async_program(w25, &request, &pending);
+                op_unlock(w25);
+            }
+            async_complete(w25, &pending); //In case the request failed before its data transfer
+            pending.request = request;
+            pending.err = err;
+            pending.valid = true;
+        }
+    }
+    xSemaphoreGive(w25->async->stopped);
+    vTaskDelete(nullptr);
+}
+
+static esp_err_t async_submit(const winbond_t *w25, const async_request *request){
+    esp_err_t err = ESP_OK;
+    if (w25->async == nullptr){
+        err = ESP_ERR_INVALID_STATE;
+    }else{
+        w25->async->outstanding++;
+        if (xQueueSendToBack(w25->async->requests, request, w25->semaphore_timeout) != pdTRUE){
+            w25->async->outstanding--;
+            err = ESP_ERR_TIMEOUT;
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_StartAsync(winbond_t *w25, size_t queue_depth, unsigned int priority){
+    esp_err_t err = ESP_OK;
+    if ((w25->async != nullptr) || (w25->handle == nullptr)){
+        err = ESP_ERR_INVALID_STATE;
+    }else{
+        w25_async *async = new w25_async;
+        async->requests = xQueueCreate(queue_depth, sizeof(async_request));
+        async->drained = xSemaphoreCreateBinary();
+        async->stopped = xSemaphoreCreateBinary();
+        async->task = nullptr;
+        async->outstanding = 0;
+        w25->async = async;
+
+        if ((async->requests == nullptr) || (async->drained == nullptr) || (async->stopped == nullptr) ||
+            (xTaskCreate(async_task, "w25_async", ASYNC_TASK_STACK, w25, priority, &async->task) != pdPASS)){
+            err = ESP_ERR_NO_MEM;
+        }
+        if (err != ESP_OK){
+            if (async->requests != nullptr){ vQueueDelete(async->requests); }
+            if (async->drained != nullptr){ vSemaphoreDelete(async->drained); }
+            if (async->stopped != nullptr){ vSemaphoreDelete(async->stopped); }
+            delete async;
+            w25->async = nullptr;
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_StopAsync(winbond_t *w25){
+    esp_err_t err = ESP_OK;
+    if (w25->async == nullptr){
+        err = ESP_ERR_INVALID_STATE;
+    }else{
+        const async_request stop = {async_op::STOP, 0, 0, nullptr, nullptr, 0, nullptr, nullptr};
+        if (xQueueSendToBack(w25->async->requests, &stop, portMAX_DELAY) == pdTRUE){ //Requests already queued are still served
+            (void)xSemaphoreTake(w25->async->stopped, portMAX_DELAY);
+            vQueueDelete(w25->async->requests);
+            vSemaphoreDelete(w25->async->drained);
+            vSemaphoreDelete(w25->async->stopped);
+            delete w25->async;
+            w25->async = nullptr;
+        }else{
+            err = ESP_FAIL;
+        }
+    }
+    return err;
+}
+
+//The transaction of an asynchronous request is built straight from it, so it must stay within its page
+static bool async_range_allowed(uint16_t column_addr, uint16_t page_addr, size_t buffer_size){
+    return range_allowed(column_addr, page_addr, buffer_size) && ((size_t{column_addr} + buffer_size) <= W25_PAGE_SIZE);
+}
+
+esp_err_t w25_ReadPageAsync(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size, w25_async_cb_t callback, void *arg){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (async_range_allowed(column_addr, page_addr, buffer_size)){
+        const async_request request = {async_op::READ_PAGE, column_addr, page_addr, out_buffer, nullptr, buffer_size, callback, arg};
+        err = async_submit(w25, &request);
+    }
+    return err;
+}
+
+esp_err_t w25_ProgramPageAsync(const winbond_t *w25, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size, w25_async_cb_t callback, void *arg){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (async_range_allowed(column_addr, page_addr, buffer_size)){
+        const async_request request = {async_op::PROGRAM_PAGE, column_addr, page_addr, nullptr, in_buffer, buffer_size, callback, arg};
+        err = async_submit(w25, &request);
+    }
+    return err;
+}
+
+esp_err_t w25_WaitAsync(const winbond_t *w25, uint32_t timeout_ms){
+    esp_err_t err = ESP_OK;
+    const int64_t deadline = esp_timer_get_time() + (static_cast<int64_t>(timeout_ms)*1000);
+    if (w25->async == nullptr){
+        err = ESP_ERR_INVALID_STATE;
+    }
+    while ((err == ESP_OK) && (w25->async->outstanding > size_t{0})){
+        const int64_t remaining = deadline - esp_timer_get_time(); //One deadline for every wake-up
+        if (remaining <= 0){
+            err = ESP_ERR_TIMEOUT;
+        }else if (xSemaphoreTake(w25->async->drained, pdMS_TO_TICKS(static_cast<uint32_t>((remaining + 999) / 1000))) != pdTRUE){
+            err = ESP_ERR_TIMEOUT;
+        }else{
+            //Woken by a completion, check what's left
+        }
+    }
     return err;
 }
@@ -0,0 +1,219 @@
+#include <string.h>
+#include <bitset>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_bbm.h"
+
+struct w25_bbm{
+    const winbond_t *w25;
+    w25_bbm_entry_t lut[W25_BBM_LUT_SIZE];
+    std::bitset<W25_BLOCK_COUNT> skip;
+    uint16_t spare_first;
+    uint16_t spare_count;
+    uint8_t *page; //DMA capable copy buffer
+    SemaphoreHandle_t mutex;
+    w25_bbm_stats_t stats;
+};
+
+static bool in_pool(const w25_bbm_t *bbm, uint16_t block){
+    return (block >= bbm->spare_first) && (block < (bbm->spare_first + bbm->spare_count));
+}
+
+static bool linked(const w25_bbm_t *bbm, uint16_t block, bool as_replacement){
+    bool found = false;
+    for (size_t i = 0; (i < W25_BBM_LUT_SIZE) && !found; i++){
+        const w25_bbm_entry_t *entry = &bbm->lut[i];
+        found = entry->enabled && ((as_replacement ? entry->physical_block : entry->logical_block) == block);
+    }
+    return found;
+}
+
+static uint32_t lut_free(const w25_bbm_t *bbm){
+    uint32_t free_entries = 0;
+    for (size_t i = 0; i < W25_BBM_LUT_SIZE; i++){
+        if (!bbm->lut[i].enabled){
+            free_entries++;
+        }
+    }
+    return free_entries;
+}
+
+static bool all_erased(const uint8_t *data, size_t size){
+    bool erased = true;
+    for (size_t i = 0; (i < size) && erased; i++){
+        erased = (data[i] == 0xFFU);
+    }
+    return erased;
+}
+
+//Erases an unused block of the pool and copies the first pages of the failing block into it
+static esp_err_t prepare_replacement(w25_bbm_t *bbm, uint16_t block, uint8_t pages_to_copy, uint16_t *replacement){
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+
+    for (uint16_t spare = bbm->spare_first; (spare < (bbm->spare_first + bbm->spare_count)) && (err == ESP_ERR_NOT_FOUND); spare++){
+        if (!bbm->skip[spare] && !linked(bbm, spare, true)){
+            err = w25_BlockErase(bbm->w25, static_cast<uint16_t>(spare*W25_PAGES_PER_BLOCK), W25_ERASE_TIMEOUT_MS);
+            if (err == ESP_ERR_INVALID_STATE){ //The spare is bad as well
+                bbm->skip.set(spare);
+                err = ESP_ERR_NOT_FOUND;
+            }else{
+                *replacement = spare;
+            }
+        }
+    }
+
+    for (uint8_t p = 0; (p < pages_to_copy) && (err == ESP_OK); p++){
+        err = w25_ReadMemory(bbm->w25, 0, static_cast<uint16_t>((block*W25_PAGES_PER_BLOCK) + p), bbm->page, W25_PAGE_SIZE);
+        if ((err == ESP_OK) && !all_erased(bbm->page, W25_PAGE_SIZE)){
+            err = w25_WriteMemory(bbm->w25, 0, static_cast<uint16_t>((*replacement*W25_PAGES_PER_BLOCK) + p), bbm->page, W25_PAGE_SIZE);
+        }
+    }
+    return err;
+}
+
+//Links the failing block to a replacement, or puts it on the skip list when that isn't possible
+static esp_err_t replace_block(w25_bbm_t *bbm, uint16_t block, uint8_t pages_to_copy){
+    uint16_t replacement = 0;
+    esp_err_t err = ESP_ERR_NO_MEM;
+
+    if (lut_free(bbm) > 0U){
+        err = prepare_replacement(bbm, block, pages_to_copy, &replacement);
+    }
+    if (err == ESP_OK){
+        err = w25_BadBlockSwap(bbm->w25, block, replacement, W25_ERASE_TIMEOUT_MS);
+    }
+    if (err == ESP_OK){
+        err = w25_ReadBBMLut(bbm->w25, bbm->lut);
+        bbm->stats.swapped++;
+        ESP_LOGW("W25 BBM", "Block %u replaced by block %u", static_cast<unsigned int>(block), static_cast<unsigned int>(replacement));
+    }else{
+        ESP_LOGW("W25 BBM", "Block %u can't be replaced (%s), skipping it", static_cast<unsigned int>(block), esp_err_to_name(err));
+        (void)w25_MarkBadBlock(bbm->w25, block); //So the next scan finds it
+        bbm->skip.set(block);
+        bbm->stats.skipped++;
+        err = ESP_ERR_INVALID_STATE;
+    }
+    return err;
+}
+
+//Factory bad blocks, and blocks that were skipped before, carry the bad block marker
+static esp_err_t scan(w25_bbm_t *bbm){
+    esp_err_t err = ESP_OK;
+    for (uint16_t block = 0; (block < W25_USABLE_BLOCKS) && (err == ESP_OK); block++){
+        bool bad = false;
+        if (!linked(bbm, block, false)){ //A linked block reads through its replacement
+            err = w25_IsBadBlock(bbm->w25, block, &bad);
+        }
+        if (bad){
+            bbm->skip.set(block);
+            bbm->stats.factory_bad++;
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_BbmInit(const winbond_t *w25, uint16_t spare_first, uint16_t spare_count, w25_bbm_t **out_bbm){
+    assert(out_bbm != nullptr);
+    esp_err_t err = ESP_OK;
+    *out_bbm = nullptr;
+
+    if ((uint32_t{spare_first} + spare_count) > W25_USABLE_BLOCKS){
+        err = ESP_ERR_INVALID_ARG;
+    }else{
+        w25_bbm_t *bbm = new w25_bbm_t{};
+        bbm->w25 = w25;
+        bbm->spare_first = spare_first;
+        bbm->spare_count = spare_count;
+        bbm->page = static_cast<uint8_t *>(heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA));
+        bbm->mutex = xSemaphoreCreateMutex();
+
+        if ((bbm->page == nullptr) || (bbm->mutex == nullptr)){
+            err = ESP_ERR_NO_MEM;
+        }else{
+            err = w25_ReadBBMLut(w25, bbm->lut);
+        }
+        if (err == ESP_OK){
+            err = scan(bbm);
+        }
+
+        if (err == ESP_OK){
+            ESP_LOGI("W25 BBM", "%u bad blocks, %u free Look Up Table entries",
+                static_cast<unsigned int>(bbm->stats.factory_bad), static_cast<unsigned int>(lut_free(bbm)));
+            *out_bbm = bbm;
+        }else{
+            w25_BbmDeinit(bbm);
+        }
+    }
+    return err;
+}
+
+void w25_BbmDeinit(w25_bbm_t *bbm){
+    if (bbm->mutex != nullptr){
+        vSemaphoreDelete(bbm->mutex);
+    }
+    heap_caps_free(bbm->page);
+    delete bbm;
+}
+
+esp_err_t w25_BbmBlockErase(w25_bbm_t *bbm, uint16_t page_addr, uint16_t timeout_ms){
+    const uint16_t block = static_cast<uint16_t>(page_addr / W25_PAGES_PER_BLOCK);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+
+    (void)xSemaphoreTake(bbm->mutex, portMAX_DELAY);
+    if (!w25_BbmIsBad(bbm, block)){
+        err = w25_BlockErase(bbm->w25, page_addr, timeout_ms);
+        if (err == ESP_ERR_INVALID_STATE){
+            err = replace_block(bbm, block, 0);
+        }
+        //A replaced block was already erased in the pool
+    }
+    xSemaphoreGive(bbm->mutex);
+    return err;
+}
+
+esp_err_t w25_BbmWriteMemory(w25_bbm_t *bbm, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size){
+    const uint16_t block = static_cast<uint16_t>(page_addr / W25_PAGES_PER_BLOCK);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+
+    (void)xSemaphoreTake(bbm->mutex, portMAX_DELAY);
+    if (!w25_BbmIsBad(bbm, block)){
+        err = w25_WriteMemory(bbm->w25, column_addr, page_addr, in_buffer, buffer_size);
+        if (err == ESP_ERR_INVALID_STATE){
+            err = replace_block(bbm, block, static_cast<uint8_t>(page_addr % W25_PAGES_PER_BLOCK));
+            if (err == ESP_OK){
+                err = w25_WriteMemory(bbm->w25, column_addr, page_addr, in_buffer, buffer_size);
+            }
+        }
+    }
+    xSemaphoreGive(bbm->mutex);
+    return err;
+}
+
+bool w25_BbmIsBad(const w25_bbm_t *bbm, uint16_t block){
+    return (block >= W25_USABLE_BLOCKS) || bbm->skip[block] || in_pool(bbm, block);
+}
+
+uint16_t w25_BbmNextGoodBlock(const w25_bbm_t *bbm, uint16_t block){
+    uint16_t next = block;
+    while ((next < W25_BLOCK_COUNT) && w25_BbmIsBad(bbm, next)){
+        next++;
+    }
+    return next;
+}
+
+void w25_BbmGetLut(w25_bbm_t *bbm, w25_bbm_entry_t *lut){
+    (void)xSemaphoreTake(bbm->mutex, portMAX_DELAY);
+    (void)memcpy(lut, bbm->lut, sizeof(bbm->lut));
+    xSemaphoreGive(bbm->mutex);
+}
+
+void w25_BbmGetStats(w25_bbm_t *bbm, w25_bbm_stats_t *stats){
+    (void)xSemaphoreTake(bbm->mutex, portMAX_DELAY);
+    bbm->stats.lut_free = lut_free(bbm);
+    *stats = bbm->stats;
+    xSemaphoreGive(bbm->mutex);
+}
@@ -0,0 +1,191 @@
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_cache.h"
+
+namespace{
+    constexpr uint16_t CLEAN_RANGE = 0xFFFFU; //dirty_first of a slot without pending writes
+
+    struct cache_slot{
+        uint8_t *data;
+        uint16_t page_addr;
+        bool valid;
+        uint16_t dirty_first;
+        uint16_t dirty_last;
+        uint32_t last_use;
+    };
+}
+
+struct w25_cache{
+    const winbond_t *w25;
+    cache_slot *slots;
+    size_t n_slots;
+    uint32_t use_counter;
+    SemaphoreHandle_t mutex;
+    w25_cache_stats_t stats;
+};
+
+static esp_err_t write_back(w25_cache_t *cache, cache_slot *slot){
+    esp_err_t err = ESP_OK;
+    if (slot->valid && (slot->dirty_first != CLEAN_RANGE)){
+        const size_t size = (size_t{slot->dirty_last} - slot->dirty_first) + size_t{1};
+        err = w25_WriteRange(cache->w25, slot->dirty_first, slot->page_addr, &slot->data[slot->dirty_first], size); //Loaded in pieces of the driver's buffer
+        if (err == ESP_OK){
+            slot->dirty_first = CLEAN_RANGE;
+            cache->stats.write_backs++;
+        }
+    }
+    return err;
+}
+
+//Returns the slot holding page_addr, loading it over the least recently used one on a miss
+static esp_err_t get_slot(w25_cache_t *cache, uint16_t page_addr, cache_slot **out_slot){
+    esp_err_t err = ESP_OK;
+    cache_slot *victim = &cache->slots[0];
+    cache_slot *found = nullptr;
+
+    for (size_t i = 0; (i < cache->n_slots) && (found == nullptr); i++){
+        cache_slot *slot = &cache->slots[i];
+        if (slot->valid && (slot->page_addr == page_addr)){
+            found = slot;
+        }else if (!slot->valid || (victim->valid && (slot->last_use < victim->last_use))){
+            victim = slot;
+        }else{
+            //Keeps the current victim
+        }
+    }
+
+    if (found != nullptr){
+        cache->stats.hits++;
+    }else{
+        cache->stats.misses++;
+        if (victim->valid){
+            err = write_back(cache, victim);
+            cache->stats.evictions++;
+        }
+        if (err == ESP_OK){
+            victim->valid = false;
+            err = w25_ReadMemory(cache->w25, 0, page_addr, victim->data, W25_PAGE_SIZE);
+        }
+        if (err == ESP_OK){
+            victim->page_addr = page_addr;
+            victim->valid = true;
+            victim->dirty_first = CLEAN_RANGE;
+            found = victim;
+        }
+    }
+
+    if (found != nullptr){
+        found->last_use = ++cache->use_counter;
+    }
+    *out_slot = found;
+    return err;
+}
+
+w25_cache_t *w25_CacheCreate(const winbond_t *w25, size_t n_slots, bool use_psram){
+    assert(n_slots > size_t{0});
+    const uint32_t caps = use_psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_DMA;
+    w25_cache_t *cache = new w25_cache_t{w25, nullptr, n_slots, 0, nullptr, {0, 0, 0, 0}};
+    bool allocated = true;
+
+    cache->slots = new cache_slot[n_slots];
+    for (size_t i = 0; i < n_slots; i++){
+        cache->slots[i] = {nullptr, 0, false, CLEAN_RANGE, 0, 0};
+        cache->slots[i].data = static_cast<uint8_t *>(heap_caps_malloc(W25_PAGE_SIZE, caps));
+        allocated = allocated && (cache->slots[i].data != nullptr);
+    }
+    cache->mutex = xSemaphoreCreateMutex();
+    allocated = allocated && (cache->mutex != nullptr);
+
+    if (!allocated){
+        ESP_LOGE("W25 CACHE", "Not enough memory for %u slots", static_cast<unsigned int>(n_slots));
+        (void)w25_CacheDestroy(cache);
+        cache = nullptr;
+    }
+    return cache;
+}
+
+esp_err_t w25_CacheDestroy(w25_cache_t *cache){
+    esp_err_t err = ESP_OK;
+    if (cache->mutex != nullptr){
+        err = w25_CacheFlush(cache);
+        vSemaphoreDelete(cache->mutex);
+    }
+    for (size_t i = 0; i < cache->n_slots; i++){
+        heap_caps_free(cache->slots[i].data);
+    }
+    delete[] cache->slots;
+    delete cache;
+    return err;
+}
+
+esp_err_t w25_CacheRead(w25_cache_t *cache, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if ((size_t{column_addr} + buffer_size) <= W25_PAGE_SIZE){
+        (void)xSemaphoreTake(cache->mutex, portMAX_DELAY);
+        cache_slot *slot = nullptr;
+        err = get_slot(cache, page_addr, &slot);
+        if (err == ESP_OK){
+            (void)memcpy(out_buffer, &slot->data[column_addr], buffer_size);
+        }
+        xSemaphoreGive(cache->mutex);
+    }
+    return err;
+}
+
+esp_err_t w25_CacheWrite(w25_cache_t *cache, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if ((buffer_size > size_t{0}) && ((size_t{column_addr} + buffer_size) <= W25_PAGE_SIZE)){
+        (void)xSemaphoreTake(cache->mutex, portMAX_DELAY);
+        cache_slot *slot = nullptr;
+        err = get_slot(cache, page_addr, &slot);
+        if (err == ESP_OK){
+            const uint16_t last = static_cast<uint16_t>((column_addr + buffer_size) - size_t{1});
+            (void)memcpy(&slot->data[column_addr], in_buffer, buffer_size);
+            if (slot->dirty_first == CLEAN_RANGE){
+                slot->dirty_first = column_addr;
+                slot->dirty_last = last;
+            }else{
+                slot->dirty_first = (column_addr < slot->dirty_first) ? column_addr : slot->dirty_first;
+                slot->dirty_last = (last > slot->dirty_last) ? last : slot->dirty_last;
+            }
+        }
+        xSemaphoreGive(cache->mutex);
+    }
+    return err;
+}
+
+esp_err_t w25_CacheFlush(w25_cache_t *cache){
+    esp_err_t err = ESP_OK;
+    (void)xSemaphoreTake(cache->mutex, portMAX_DELAY);
+    for (size_t i = 0; i < cache->n_slots; i++){
+        esp_err_t slot_err = write_back(cache, &cache->slots[i]);
+        if (err == ESP_OK){
+            err = slot_err;
+        }
+    }
+    xSemaphoreGive(cache->mutex);
+    return err;
+}
+
+esp_err_t w25_CacheBlockErase(w25_cache_t *cache, uint16_t page_addr, uint16_t timeout_ms){
+    const uint16_t block = static_cast<uint16_t>(page_addr / W25_PAGES_PER_BLOCK);
+    (void)xSemaphoreTake(cache->mutex, portMAX_DELAY);
+    for (size_t i = 0; i < cache->n_slots; i++){
+        if ((cache->slots[i].page_addr / W25_PAGES_PER_BLOCK) == block){
+            cache->slots[i].valid = false;
+        }
+    }
+    esp_err_t err = w25_BlockErase(cache->w25, page_addr, timeout_ms);
+    xSemaphoreGive(cache->mutex);
+    return err;
+}
+
+void w25_CacheGetStats(const w25_cache_t *cache, w25_cache_stats_t *stats){
+    (void)xSemaphoreTake(cache->mutex, portMAX_DELAY);
+    *stats = cache->stats;
+    xSemaphoreGive(cache->mutex);
+}
@@ -0,0 +1,286 @@
+#include <string.h>
+#include <algorithm>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_vfs_fat.h"
+#include "diskio_impl.h"
+#include "ff.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_ftl.h"
+#include "../include/W25N01GV_fs.h"
+
+namespace{
+    //A sector per page when FATFS is built with variable sector sizes, otherwise the pages are split
+    constexpr UINT FAT_SECTOR_SIZE = ((FF_MAX_SS != FF_MIN_SS) && (FF_MAX_SS >= W25_PAGE_SIZE)) ? W25_PAGE_SIZE : FF_MIN_SS;
+    constexpr uint32_t SECTORS_PER_PAGE = W25_PAGE_SIZE / FAT_SECTOR_SIZE;
+    constexpr size_t DEFAULT_ALLOCATION_UNIT = 4U * W25_PAGE_SIZE;
+    static_assert(FF_MIN_SS <= W25_PAGE_SIZE, "FATFS sectors larger than a page aren't supported");
+}
+
+static w25_ftl_t *fat_disks[FF_VOLUMES] = {nullptr};
+
+//FATFS Disk I/O
+
+static DSTATUS fat_init(BYTE pdrv){
+    return (fat_disks[pdrv] == nullptr) ? STA_NOINIT : 0U;
+}
+
+static DSTATUS fat_status(BYTE pdrv){
+    return fat_init(pdrv);
+}
+
+//Splits the sectors on page boundaries, so aligned runs are read and written a whole page at a time
+static DRESULT fat_transfer(BYTE pdrv, uint8_t *out_buffer, const uint8_t *in_buffer, uint32_t sector, UINT count){
+    esp_err_t err = ESP_OK;
+    size_t done = 0;
+
+    while ((count > 0U) && (err == ESP_OK)){
+        const uint16_t logical_page = static_cast<uint16_t>(sector / SECTORS_PER_PAGE);
+        const uint32_t first = sector % SECTORS_PER_PAGE;
+        const uint32_t sectors = std::min(SECTORS_PER_PAGE - first, static_cast<uint32_t>(count));
+        const uint16_t column = static_cast<uint16_t>(first * FAT_SECTOR_SIZE);
+        const size_t size = sectors * FAT_SECTOR_SIZE;
+
+        if (out_buffer != nullptr){
+            err = w25_FtlRead(fat_disks[pdrv], column, logical_page, &out_buffer[done], size);
+        }else{
+            err = w25_FtlWrite(fat_disks[pdrv], column, logical_page, &in_buffer[done], size);
+        }
+        sector += sectors;
+        count -= sectors;
+        done += size;
+    }
+    if (err != ESP_OK){
+        ESP_LOGE("W25 FAT", "Sector %u: %s", static_cast<unsigned int>(sector), esp_err_to_name(err));
+    }
+    return (err == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT fat_read(BYTE pdrv, BYTE *buff, uint32_t sector, UINT count){
+    return fat_transfer(pdrv, buff, nullptr, sector, count);
+}
+
+static DRESULT fat_write(BYTE pdrv, const BYTE *buff, uint32_t sector, UINT count){
+    return fat_transfer(pdrv, nullptr, buff, sector, count);
+}
+
+static DRESULT fat_ioctl(BYTE pdrv, BYTE cmd, void *buff){
+    DRESULT res = RES_OK;
+    switch (cmd){
+        case CTRL_SYNC:
+            res = (w25_FtlSync(fat_disks[pdrv]) == ESP_OK) ? RES_OK : RES_ERROR;
+            break;
+        case GET_SECTOR_COUNT:
+            *static_cast<DWORD *>(buff) = uint32_t{w25_FtlCapacity(fat_disks[pdrv])} * SECTORS_PER_PAGE;
+            break;
+        case GET_SECTOR_SIZE:
+            *static_cast<WORD *>(buff) = static_cast<WORD>(FAT_SECTOR_SIZE);
+            break;
+        case GET_BLOCK_SIZE: //Erases are hidden by the FTL, aligning the data to pages is what matters
+            *static_cast<DWORD *>(buff) = SECTORS_PER_PAGE;
+            break;
+        default:
+            res = RES_PARERR;
+            break;
+    }
+    return res;
+}
+
+static const ff_diskio_impl_t fat_diskio = {
+    .init = &fat_init,
+    .status = &fat_status,
+    .read = &fat_read,
+    .write = &fat_write,
+    .ioctl = &fat_ioctl
+};
+
+static void fat_drive_name(BYTE pdrv, char *drv){
+    drv[0] = static_cast<char>('0' + pdrv);
+    drv[1] = ':';
+    drv[2] = '\0';
+}
+
+static FRESULT fat_format(const char *drv, size_t allocation_unit){
+    FRESULT res = FR_NOT_ENOUGH_CORE;
+    void *work = heap_caps_malloc(FF_MAX_SS, MALLOC_CAP_DEFAULT);
+    if (work != nullptr){
+        const MKFS_PARM opt = {static_cast<BYTE>(FM_ANY|FM_SFD), 0, 0, 0, static_cast<DWORD>(allocation_unit)};
+        res = f_mkfs(drv, &opt, work, FF_MAX_SS);
+        heap_caps_free(work);
+    }
+    return res;
+}
+
+esp_err_t w25_VfsFatMount(w25_ftl_t *ftl, const char *base_path, const esp_vfs_fat_mount_config_t *mount_config){
+    assert((ftl != nullptr) && (base_path != nullptr) && (mount_config != nullptr));
+    BYTE pdrv = 0xFFU;
+    char drv[3];
+    FATFS *fs = nullptr;
+
+    esp_err_t err = ff_diskio_get_drive(&pdrv);
+    if ((err != ESP_OK) || (pdrv == 0xFFU)){
+        err = ESP_ERR_NO_MEM;
+    }else{
+        fat_disks[pdrv] = ftl;
+        ff_diskio_register(pdrv, &fat_diskio);
+        fat_drive_name(pdrv, drv);
+        err = esp_vfs_fat_register(base_path, drv, static_cast<size_t>(mount_config->max_files), &fs);
+    }
+
+    if (err == ESP_OK){
+        FRESULT res = f_mount(fs, drv, 1);
+        if ((res != FR_OK) && mount_config->format_if_mount_failed){
+            const size_t allocation_unit = (mount_config->allocation_unit_size > 0U) ? mount_config->allocation_unit_size : DEFAULT_ALLOCATION_UNIT;
+            ESP_LOGW("W25 FAT", "Mount failed (%d), formatting", static_cast<int>(res));
+            res = fat_format(drv, allocation_unit);
+            if (res == FR_OK){
+                res = f_mount(fs, drv, 1);
+            }
+        }
+        if (res != FR_OK){
+            ESP_LOGE("W25 FAT", "Mount failed (%d)", static_cast<int>(res));
+            (void)f_mount(nullptr, drv, 0);
+            (void)esp_vfs_fat_unregister_path(base_path);
+            err = ESP_FAIL;
+        }
+    }
+
+    if ((err != ESP_OK) && (pdrv != 0xFFU)){
+        ff_diskio_register(pdrv, nullptr);
+        fat_disks[pdrv] = nullptr;
+    }
+    return err;
+}
+
+esp_err_t w25_VfsFatUnmount(w25_ftl_t *ftl, const char *base_path){
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    for (BYTE pdrv = 0; (pdrv < FF_VOLUMES) && (err == ESP_ERR_INVALID_STATE); pdrv++){
+        if (fat_disks[pdrv] == ftl){
+            char drv[3];
+            fat_drive_name(pdrv, drv);
+            (void)f_mount(nullptr, drv, 0);
+            ff_diskio_register(pdrv, nullptr);
+            fat_disks[pdrv] = nullptr;
+            err = esp_vfs_fat_unregister_path(base_path);
+            if (err == ESP_OK){
+                err = w25_FtlSync(ftl);
+            }
+        }
+    }
+    return err;
+}
+
+//littlefs Block Device
+
+#ifdef W25_HAS_LITTLEFS
+
+namespace{
+    struct lfs_context{
+        const winbond_t *w25;
+        uint16_t first_block;
+    };
+
+    constexpr int32_t LFS_BLOCK_CYCLES = 500;
+}
+
+static int lfs_error(esp_err_t err){
+    int res = LFS_ERR_IO;
+    if (err == ESP_OK){
+        res = LFS_ERR_OK;
+    }else if (err == ESP_ERR_INVALID_STATE){ //E_FAIL/P_FAIL, littlefs moves the data to another block
+        res = LFS_ERR_CORRUPT;
+    }else{
+        //Bus error
+    }
+    return res;
+}
+
+static uint16_t lfs_page(const struct lfs_config *c, lfs_block_t block, lfs_off_t off){
+    const lfs_context *context = static_cast<const lfs_context *>(c->context);
+    return static_cast<uint16_t>(((context->first_block + block) * W25_PAGES_PER_BLOCK) + (off / W25_PAGE_SIZE));
+}
+
+static int lfs_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size){
+    const lfs_context *context = static_cast<const lfs_context *>(c->context);
+    uint8_t *out_buffer = static_cast<uint8_t *>(buffer);
+    esp_err_t err = ESP_OK;
+
+    while ((size > 0U) && (err == ESP_OK)){
+        const uint16_t column = static_cast<uint16_t>(off % W25_PAGE_SIZE);
+        const lfs_size_t chunk = std::min(size, static_cast<lfs_size_t>(W25_PAGE_SIZE - column));
+        err = w25_ReadMemory(context->w25, column, lfs_page(c, block, off), out_buffer, chunk);
+        out_buffer = &out_buffer[chunk];
+        off += chunk;
+        size -= chunk;
+    }
+    return lfs_error(err);
+}
+
+static int lfs_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size){
+    const lfs_context *context = static_cast<const lfs_context *>(c->context);
+    const uint8_t *in_buffer = static_cast<const uint8_t *>(buffer);
+    esp_err_t err = ESP_OK;
+
+    while ((size > 0U) && (err == ESP_OK)){
+        const uint16_t column = static_cast<uint16_t>(off % W25_PAGE_SIZE);
+        const lfs_size_t chunk = std::min(size, static_cast<lfs_size_t>(W25_PAGE_SIZE - column));
+        err = w25_WriteMemory(context->w25, column, lfs_page(c, block, off), in_buffer, chunk);
+        in_buffer = &in_buffer[chunk];
+        off += chunk;
+        size -= chunk;
+    }
+    return lfs_error(err);
+}
+
+static int lfs_erase(const struct lfs_config *c, lfs_block_t block){
+    const lfs_context *context = static_cast<const lfs_context *>(c->context);
+    return lfs_error(w25_BlockErase(context->w25, lfs_page(c, block, 0), W25_ERASE_TIMEOUT_MS));
+}
+
+static int lfs_sync(const struct lfs_config *c){
+    (void)c; //Programs are complete when w25_WriteMemory returns
+    return LFS_ERR_OK;
+}
+
+esp_err_t w25_LfsConfigInit(const winbond_t *w25, uint16_t first_block, uint16_t block_count, struct lfs_config *config){
+    assert(config != nullptr);
+    esp_err_t err = ESP_OK;
+    (void)memset(config, 0, sizeof(*config));
+
+    if ((block_count == 0U) || ((uint32_t{first_block} + block_count) > W25_USABLE_BLOCKS)){
+        err = ESP_ERR_INVALID_ARG;
+    }else{
+        config->context = new lfs_context{w25, first_block};
+        config->read = &lfs_read;
+        config->prog = &lfs_prog;
+        config->erase = &lfs_erase;
+        config->sync = &lfs_sync;
+        config->read_size = W25_PAGE_SIZE;
+        config->prog_size = W25_PAGE_SIZE; //Whole pages, the partial program limit is never reached
+        config->block_size = W25_PAGE_SIZE * W25_PAGES_PER_BLOCK;
+        config->block_count = block_count;
+        config->block_cycles = LFS_BLOCK_CYCLES;
+        config->cache_size = W25_PAGE_SIZE;
+        config->lookahead_size = ((block_count + 63U) / 64U) * 8U; //A bit per block, multiple of 8 bytes
+        config->read_buffer = heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA);
+        config->prog_buffer = heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA);
+        config->lookahead_buffer = heap_caps_malloc(config->lookahead_size, MALLOC_CAP_8BIT);
+
+        if ((config->read_buffer == nullptr) || (config->prog_buffer == nullptr) || (config->lookahead_buffer == nullptr)){
+            w25_LfsConfigDeinit(config);
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+    return err;
+}
+
+void w25_LfsConfigDeinit(struct lfs_config *config){
+    delete static_cast<lfs_context *>(config->context);
+    heap_caps_free(config->read_buffer);
+    heap_caps_free(config->prog_buffer);
+    heap_caps_free(config->lookahead_buffer);
+    (void)memset(config, 0, sizeof(*config));
+}
+
+#endif
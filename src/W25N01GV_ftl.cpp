@@ -0,0 +1,638 @@
+#include <string.h>
+#include <stddef.h>
+#include <algorithm>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_ftl.h"
+
+/*
+Physical layout of a block managed by the FTL:
+    page 0      header with the erase count, programmed right after the erase
+    page 1      first summary, programmed when the block is opened for writing
+    pages 2-62  logical pages, with extra summaries wherever w25_FtlSync was called
+    page 63     final summary, programmed when the block is full
+Summaries are cumulative, the last one lists the logical page held by every page before it.
+*/
+
+namespace{
+    constexpr uint32_t HEADER_MAGIC = 0x57324548U;
+    constexpr uint32_t SUMMARY_MAGIC = 0x57325355U;
+    constexpr uint16_t UNMAPPED = 0xFFFFU;
+    constexpr uint16_t NO_BLOCK = 0xFFFFU;
+    constexpr uint8_t FIRST_SUMMARY_PAGE = 1U;
+    constexpr uint8_t FIRST_DATA_PAGE = 2U;
+    constexpr uint8_t LAST_SUMMARY_PAGE = static_cast<uint8_t>(W25_PAGES_PER_BLOCK - 1U);
+    constexpr uint16_t DATA_PAGES = LAST_SUMMARY_PAGE - FIRST_DATA_PAGE;
+    constexpr size_t GC_FREE_BLOCKS = 2U;  //Low-water mark of the free pool, garbage collection keeps it above
+
+    enum class block_state : uint8_t {
+        FREE,   //Erased, header programmed
+        DIRTY,  //Must be erased before being used
+        OPEN,
+        CLOSED,
+        BAD
+    };
+
+    struct ftl_block{
+        uint32_t erase_count;
+        uint32_t seq;
+        block_state state;
+        uint8_t valid;   //Pages holding the current version of a logical page
+        uint8_t written; //Pages programmed with logical pages
+        uint8_t summary_page;
+    };
+
+    struct ftl_header{
+        uint32_t magic;
+        uint32_t erase_count;
+        uint32_t crc;
+    };
+
+    struct ftl_summary{
+        uint32_t magic;
+        uint32_t seq;
+        uint32_t erase_count;
+        uint16_t page;
+        uint16_t lpn[W25_PAGES_PER_BLOCK];
+        uint32_t crc;
+    };
+}
+
+struct w25_ftl{
+    const winbond_t *w25;
+    w25_ftl_config_t config;
+    uint16_t logical_pages;
+    uint16_t *l2p;
+    ftl_block *blocks;
+    uint8_t *stage; //DMA capable page used by every transfer
+    uint16_t open;
+    uint8_t next_page;
+    bool unsynced;
+    bool in_gc;
+    uint32_t seq;
+    uint16_t open_lpn[W25_PAGES_PER_BLOCK];
+    SemaphoreHandle_t mutex;
+    w25_ftl_stats_t stats;
+};
+
+static uint16_t physical_page(const w25_ftl_t *ftl, uint16_t block, uint8_t page){
+    return static_cast<uint16_t>(((uint32_t{ftl->config.first_block} + block) * W25_PAGES_PER_BLOCK) + page);
+}
+
+static uint16_t block_of(const w25_ftl_t *ftl, uint16_t ppn){
+    return static_cast<uint16_t>((ppn / W25_PAGES_PER_BLOCK) - ftl->config.first_block);
+}
+
+static uint32_t record_crc(const void *record, size_t crc_offset){
+    return esp_rom_crc32_le(0, static_cast<const uint8_t *>(record), static_cast<uint32_t>(crc_offset));
+}
+
+static esp_err_t read_record(w25_ftl_t *ftl, uint16_t ppn, void *record, size_t size){
+    esp_err_t err = w25_ReadMemory(ftl->w25, 0, ppn, ftl->stage, size);
+    if (err == ESP_OK){
+        (void)memcpy(record, ftl->stage, size);
+    }
+    return err;
+}
+
+static esp_err_t program_record(w25_ftl_t *ftl, uint16_t ppn, const void *record, size_t size){
+    (void)memcpy(ftl->stage, record, size);
+    ftl->stats.page_programs++;
+    return w25_WriteMemory(ftl->w25, 0, ppn, ftl->stage, size);
+}
+
+static bool summary_valid(const ftl_summary *summary, uint8_t page){
+    return (summary->magic == SUMMARY_MAGIC) && (summary->page == page)
+        && (summary->crc == record_crc(summary, offsetof(ftl_summary, crc)));
+}
+
+static bool all_erased(const uint8_t *data, size_t size){
+    bool erased = true;
+    for (size_t i = 0; (i < size) && erased; i++){
+        erased = (data[i] == 0xFFU);
+    }
+    return erased;
+}
+
+static esp_err_t write_summary(w25_ftl_t *ftl, uint8_t page){
+    ftl_summary summary;
+    summary.magic = SUMMARY_MAGIC;
+    summary.seq = ftl->blocks[ftl->open].seq;
+    summary.erase_count = ftl->blocks[ftl->open].erase_count;
+    summary.page = page;
+    (void)memcpy(summary.lpn, ftl->open_lpn, sizeof(summary.lpn));
+    summary.crc = record_crc(&summary, offsetof(ftl_summary, crc));
+
+    esp_err_t err = program_record(ftl, physical_page(ftl, ftl->open, page), &summary, sizeof(summary));
+    if (err == ESP_OK){
+        ftl->blocks[ftl->open].summary_page = page;
+        ftl->unsynced = false;
+    }
+    return err;
+}
+
+//Erases the block and programs its header. A block that fails to erase is retired
+static esp_err_t format_block(w25_ftl_t *ftl, uint16_t block){
+    ftl_block *info = &ftl->blocks[block];
+    esp_err_t err = w25_BlockErase(ftl->w25, physical_page(ftl, block, 0), W25_ERASE_TIMEOUT_MS);
+    ftl->stats.erases++;
+    info->erase_count++;
+    info->valid = 0;
+    info->written = 0;
+
+    if (err == ESP_ERR_INVALID_STATE){
+        ESP_LOGW("W25 FTL", "Block %u failed to erase, retiring it", static_cast<unsigned int>(block + ftl->config.first_block));
+        (void)w25_MarkBadBlock(ftl->w25, static_cast<uint16_t>(block + ftl->config.first_block)); //Not tried again on the next mount
+        info->state = block_state::BAD;
+        ftl->stats.bad_blocks++;
+    }else if (err == ESP_OK){
+        ftl_header header = {HEADER_MAGIC, info->erase_count, 0};
+        header.crc = record_crc(&header, offsetof(ftl_header, crc));
+        err = program_record(ftl, physical_page(ftl, block, 0), &header, sizeof(header));
+        info->state = (err == ESP_OK) ? block_state::FREE : block_state::DIRTY;
+    }else{
+        info->state = block_state::DIRTY;
+    }
+    return err;
+}
+
+static size_t free_blocks(const w25_ftl_t *ftl){
+    size_t count = 0;
+    for (uint16_t b = 0; b < ftl->config.block_count; b++){
+        if ((ftl->blocks[b].state == block_state::FREE) || (ftl->blocks[b].state == block_state::DIRTY)){
+            count++;
+        }
+    }
+    return count;
+}
+
+//Dynamic wear leveling: the least erased block of the pool is the next one written
+static esp_err_t open_block(w25_ftl_t *ftl){
+    esp_err_t err = ESP_ERR_NO_MEM;
+    bool opened = false;
+
+    while (!opened){
+        uint16_t chosen = NO_BLOCK;
+        for (uint16_t b = 0; b < ftl->config.block_count; b++){
+            const block_state state = ftl->blocks[b].state;
+            if (((state == block_state::FREE) || (state == block_state::DIRTY))
+                && ((chosen == NO_BLOCK) || (ftl->blocks[b].erase_count < ftl->blocks[chosen].erase_count))){
+                chosen = b;
+            }
+        }
+        if (chosen == NO_BLOCK){
+            err = ESP_ERR_NO_MEM;
+            break;
+        }
+
+        err = ESP_OK;
+        if (ftl->blocks[chosen].state == block_state::DIRTY){
+            err = format_block(ftl, chosen);
+        }
+        if (ftl->blocks[chosen].state == block_state::FREE){
+            ftl->open = chosen;
+            ftl->blocks[chosen].state = block_state::OPEN;
+            ftl->blocks[chosen].seq = ++ftl->seq;
+            std::fill(ftl->open_lpn, &ftl->open_lpn[W25_PAGES_PER_BLOCK], UNMAPPED);
+            err = write_summary(ftl, FIRST_SUMMARY_PAGE);
+            ftl->next_page = FIRST_DATA_PAGE;
+            opened = true;
+        }else if (err != ESP_ERR_INVALID_STATE){
+            break; //Bus error, a retired block just moves on to the next candidate
+        }else{
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+    return err;
+}
+
+static esp_err_t close_open_block(w25_ftl_t *ftl){
+    esp_err_t err = ESP_OK;
+    if (ftl->open != NO_BLOCK){
+        err = write_summary(ftl, LAST_SUMMARY_PAGE);
+        ftl->blocks[ftl->open].state = block_state::CLOSED;
+        ftl->open = NO_BLOCK;
+    }
+    return err;
+}
+
+//Programs a summary after the last page written, the final one if the block is full
+static esp_err_t sync_open_block(w25_ftl_t *ftl){
+    esp_err_t err = ESP_OK;
+    if ((ftl->open != NO_BLOCK) && ftl->unsynced){
+        if (ftl->next_page >= LAST_SUMMARY_PAGE){
+            err = close_open_block(ftl);
+        }else{
+            err = write_summary(ftl, ftl->next_page);
+            ftl->next_page++;
+        }
+    }
+    return err;
+}
+
+static void map_page(w25_ftl_t *ftl, uint16_t lpn, uint16_t ppn){
+    const uint16_t old = ftl->l2p[lpn];
+    if (old != UNMAPPED){
+        ftl->blocks[block_of(ftl, old)].valid--;
+    }
+    ftl->l2p[lpn] = ppn;
+    ftl->blocks[block_of(ftl, ppn)].valid++;
+    ftl->blocks[block_of(ftl, ppn)].written++;
+    ftl->open_lpn[ppn % W25_PAGES_PER_BLOCK] = lpn;
+    ftl->unsynced = true;
+}
+
+static esp_err_t maintain(w25_ftl_t *ftl);
+
+static bool open_full(const w25_ftl_t *ftl){
+    return (ftl->open == NO_BLOCK) || (ftl->next_page >= LAST_SUMMARY_PAGE);
+}
+
+static esp_err_t alloc_page(w25_ftl_t *ftl, uint16_t *ppn){
+    esp_err_t err = ESP_OK;
+
+    if (open_full(ftl) && !ftl->in_gc){
+        err = close_open_block(ftl);
+        if (err == ESP_OK){
+            err = maintain(ftl);
+        }
+    }
+    if ((err == ESP_OK) && open_full(ftl)){ //Garbage collection may have filled the block it moved pages into
+        err = close_open_block(ftl);
+        if (err == ESP_OK){
+            err = open_block(ftl);
+        }
+    }
+    if (err == ESP_OK){
+        *ppn = physical_page(ftl, ftl->open, ftl->next_page);
+        ftl->next_page++;
+    }
+    return err;
+}
+
+//Moves the valid pages of a closed block into the open one and erases it
+static esp_err_t collect_block(w25_ftl_t *ftl, uint16_t victim){
+    ftl_summary summary;
+    const uint8_t summary_page = ftl->blocks[victim].summary_page;
+    esp_err_t err = read_record(ftl, physical_page(ftl, victim, summary_page), &summary, sizeof(summary));
+    if ((err == ESP_OK) && !summary_valid(&summary, summary_page)){
+        err = ESP_ERR_INVALID_CRC;
+    }
+
+    ftl->in_gc = true;
+    for (uint8_t p = FIRST_DATA_PAGE; (p < summary_page) && (err == ESP_OK); p++){
+        const uint16_t lpn = summary.lpn[p];
+        const uint16_t src = physical_page(ftl, victim, p);
+        if ((lpn < ftl->logical_pages) && (ftl->l2p[lpn] == src)){
+            uint16_t dst = 0;
+            err = alloc_page(ftl, &dst);
+            if (err == ESP_OK){
+                err = w25_ReadMemory(ftl->w25, 0, src, ftl->stage, W25_PAGE_SIZE);
+            }
+            if (err == ESP_OK){
+                ftl->stats.page_programs++;
+                err = w25_WriteMemory(ftl->w25, 0, dst, ftl->stage, W25_PAGE_SIZE);
+            }
+            if (err == ESP_OK){
+                map_page(ftl, lpn, dst);
+            }
+        }
+    }
+    ftl->in_gc = false;
+
+    //The moved pages must be found after a power loss before their old copies are erased
+    if (err == ESP_OK){
+        err = sync_open_block(ftl);
+    }
+    if (err == ESP_OK){
+        err = format_block(ftl, victim);
+        if (err == ESP_ERR_INVALID_STATE){
+            err = ESP_OK; //Retired, its data was already moved
+        }
+    }
+    return err;
+}
+
+static uint16_t select_victim(const w25_ftl_t *ftl){
+    uint16_t victim = NO_BLOCK;
+    uint64_t best = 0;
+
+    for (uint16_t b = 0; b < ftl->config.block_count; b++){
+        const ftl_block *info = &ftl->blocks[b];
+        if ((info->state == block_state::CLOSED) && ((info->valid < info->written) || (info->valid == 0U))){
+            uint64_t score = 0;
+            if (ftl->config.gc_policy == W25_GC_COST_BENEFIT){ //(1-u)/(1+u) * age, u being the valid ratio
+                const uint64_t age = uint64_t{ftl->seq - info->seq} + 1U;
+                score = ((uint64_t{DATA_PAGES} - info->valid) * age * 1024U) / (uint64_t{DATA_PAGES} + info->valid);
+            }else{
+                score = uint64_t{DATA_PAGES} - info->valid;
+            }
+            if ((victim == NO_BLOCK) || (score > best)){
+                victim = b;
+                best = score;
+            }
+        }
+    }
+    return victim;
+}
+
+//Keeps the free pool above its low-water mark, then moves cold data out of the least worn block if needed
+static esp_err_t maintain(w25_ftl_t *ftl){
+    esp_err_t err = ESP_OK;
+    bool pool_ok = true;
+
+    for (uint16_t i = 0; (i < ftl->config.block_count) && (free_blocks(ftl) <= GC_FREE_BLOCKS) && (err == ESP_OK); i++){
+        const uint16_t victim = select_victim(ftl);
+        if (victim == NO_BLOCK){
+            pool_ok = false;
+            break;
+        }
+        err = collect_block(ftl, victim);
+        ftl->stats.gc_collections++;
+    }
+
+    if ((err == ESP_OK) && pool_ok && (ftl->config.wear_threshold > 0U)){
+        uint16_t coldest = NO_BLOCK;
+        uint32_t max_erase = 0;
+        for (uint16_t b = 0; b < ftl->config.block_count; b++){
+            const ftl_block *info = &ftl->blocks[b];
+            if (info->state != block_state::BAD){
+                max_erase = std::max(max_erase, info->erase_count);
+            }
+            if ((info->state == block_state::CLOSED) && ((coldest == NO_BLOCK) || (info->erase_count < ftl->blocks[coldest].erase_count))){
+                coldest = b;
+            }
+        }
+        if ((coldest != NO_BLOCK) && ((max_erase - ftl->blocks[coldest].erase_count) > ftl->config.wear_threshold)){
+            err = collect_block(ftl, coldest);
+            ftl->stats.wear_moves++;
+        }
+    }
+    return err;
+}
+
+//Finds the newest summary of a block left open by a power loss and seals it with a final summary
+static esp_err_t recover_block(w25_ftl_t *ftl, uint16_t block, ftl_summary *summary){
+    esp_err_t err = ESP_OK;
+    uint8_t found = FIRST_SUMMARY_PAGE;
+
+    for (uint8_t p = LAST_SUMMARY_PAGE - 1U; (p > FIRST_SUMMARY_PAGE) && (err == ESP_OK); p--){
+        ftl_summary candidate;
+        err = read_record(ftl, physical_page(ftl, block, p), &candidate, sizeof(candidate));
+        if ((err == ESP_OK) && summary_valid(&candidate, p) && (candidate.seq == summary->seq)){
+            *summary = candidate;
+            found = p;
+            break;
+        }
+    }
+
+    ftl->blocks[block].summary_page = found;
+    if (err == ESP_OK){
+        err = w25_ReadMemory(ftl->w25, 0, physical_page(ftl, block, LAST_SUMMARY_PAGE), ftl->stage, W25_PAGE_SIZE);
+    }
+    if ((err == ESP_OK) && all_erased(ftl->stage, W25_PAGE_SIZE)){
+        summary->page = LAST_SUMMARY_PAGE;
+        summary->crc = record_crc(summary, offsetof(ftl_summary, crc));
+        err = program_record(ftl, physical_page(ftl, block, LAST_SUMMARY_PAGE), summary, sizeof(*summary));
+        if (err == ESP_OK){
+            ftl->blocks[block].summary_page = LAST_SUMMARY_PAGE;
+        }
+    }
+    return err;
+}
+
+//Reads the header and summaries of a block to find out its state
+static esp_err_t scan_block(w25_ftl_t *ftl, uint16_t block, bool *erase_count_known){
+    ftl_block *info = &ftl->blocks[block];
+    ftl_header header;
+    ftl_summary summary;
+
+    *info = {0, 0, block_state::DIRTY, 0, 0, 0};
+    *erase_count_known = false;
+    esp_err_t err = read_record(ftl, physical_page(ftl, block, 0), &header, sizeof(header));
+    if ((err == ESP_OK) && (header.magic == HEADER_MAGIC) && (header.crc == record_crc(&header, offsetof(ftl_header, crc)))){
+        info->erase_count = header.erase_count;
+        *erase_count_known = true;
+
+        err = read_record(ftl, physical_page(ftl, block, LAST_SUMMARY_PAGE), &summary, sizeof(summary));
+        if ((err == ESP_OK) && summary_valid(&summary, LAST_SUMMARY_PAGE)){
+            info->state = block_state::CLOSED;
+            info->seq = summary.seq;
+            info->summary_page = LAST_SUMMARY_PAGE;
+        }else if (err == ESP_OK){
+            err = read_record(ftl, physical_page(ftl, block, FIRST_SUMMARY_PAGE), &summary, sizeof(summary));
+            if ((err == ESP_OK) && summary_valid(&summary, FIRST_SUMMARY_PAGE)){
+                info->state = block_state::CLOSED;
+                info->seq = summary.seq;
+                err = recover_block(ftl, block, &summary);
+            }else if ((err == ESP_OK) && all_erased(ftl->stage, sizeof(summary))){
+                info->state = block_state::FREE;
+            }else{
+                //Interrupted while being opened, left DIRTY
+            }
+        }else{
+            //Read error, reported by the caller
+        }
+    }else if (err == ESP_OK){ //Never formatted, factory bad or retired
+        bool bad = false;
+        err = w25_IsBadBlock(ftl->w25, static_cast<uint16_t>(block + ftl->config.first_block), &bad);
+        info->state = bad ? block_state::BAD : block_state::DIRTY;
+    }else{
+        //Read error, reported by the caller
+    }
+    return err;
+}
+
+//Replays the summaries from the oldest block to the newest, so the last copy of each logical page wins
+static esp_err_t rebuild_map(w25_ftl_t *ftl){
+    esp_err_t err = ESP_OK;
+    uint16_t *order = new uint16_t[ftl->config.block_count];
+    uint16_t used = 0;
+
+    for (uint16_t b = 0; b < ftl->config.block_count; b++){
+        if (ftl->blocks[b].state == block_state::CLOSED){
+            order[used] = b;
+            used++;
+            ftl->seq = std::max(ftl->seq, ftl->blocks[b].seq);
+        }
+    }
+    std::sort(order, &order[used], [ftl](uint16_t a, uint16_t b){ return ftl->blocks[a].seq < ftl->blocks[b].seq; });
+
+    for (uint16_t i = 0; (i < used) && (err == ESP_OK); i++){
+        ftl_summary summary;
+        const uint16_t block = order[i];
+        const uint8_t summary_page = ftl->blocks[block].summary_page;
+        err = read_record(ftl, physical_page(ftl, block, summary_page), &summary, sizeof(summary));
+        for (uint8_t p = FIRST_DATA_PAGE; (p < summary_page) && (err == ESP_OK); p++){
+            if (summary.lpn[p] < ftl->logical_pages){
+                ftl->l2p[summary.lpn[p]] = physical_page(ftl, block, p);
+                ftl->blocks[block].written++;
+            }
+        }
+    }
+    delete[] order;
+
+    for (uint16_t lpn = 0; lpn < ftl->logical_pages; lpn++){
+        if (ftl->l2p[lpn] != UNMAPPED){
+            ftl->blocks[block_of(ftl, ftl->l2p[lpn])].valid++;
+        }
+    }
+    return err;
+}
+
+static esp_err_t mount(w25_ftl_t *ftl){
+    esp_err_t err = ESP_OK;
+    uint64_t known_sum = 0;
+    uint32_t known = 0;
+    bool *erase_count_known = new bool[ftl->config.block_count];
+
+    for (uint16_t b = 0; (b < ftl->config.block_count) && (err == ESP_OK); b++){
+        err = scan_block(ftl, b, &erase_count_known[b]);
+        if (erase_count_known[b]){
+            known_sum += ftl->blocks[b].erase_count;
+            known++;
+        }
+    }
+    //Blocks without a header lost their erase count, they are assumed to be as worn as the average
+    const uint32_t average = (known > 0U) ? static_cast<uint32_t>(known_sum / known) : 0U;
+    for (uint16_t b = 0; b < ftl->config.block_count; b++){
+        if (!erase_count_known[b]){
+            ftl->blocks[b].erase_count = average;
+        }
+    }
+    delete[] erase_count_known;
+
+    if (err == ESP_OK){
+        err = rebuild_map(ftl);
+    }
+    return err;
+}
+
+static void free_ftl(w25_ftl_t *ftl){
+    if (ftl->mutex != nullptr){
+        vSemaphoreDelete(ftl->mutex);
+    }
+    heap_caps_free(ftl->l2p);
+    heap_caps_free(ftl->stage);
+    delete[] ftl->blocks;
+    delete ftl;
+}
+
+esp_err_t w25_FtlMount(const winbond_t *w25, const w25_ftl_config_t *config, w25_ftl_t **out_ftl){
+    assert((config != nullptr) && (out_ftl != nullptr));
+    esp_err_t err = ESP_OK;
+    *out_ftl = nullptr;
+
+    if ((config->reserved_blocks < (GC_FREE_BLOCKS + 2U)) || (config->block_count <= config->reserved_blocks)
+        || ((uint32_t{config->first_block} + config->block_count) > W25_USABLE_BLOCKS)){
+        err = ESP_ERR_INVALID_ARG;
+    }else{
+        w25_ftl_t *ftl = new w25_ftl_t{};
+        ftl->w25 = w25;
+        ftl->config = *config;
+        ftl->logical_pages = static_cast<uint16_t>((config->block_count - config->reserved_blocks) * DATA_PAGES);
+        ftl->open = NO_BLOCK;
+        ftl->blocks = new ftl_block[config->block_count];
+        ftl->l2p = static_cast<uint16_t *>(heap_caps_malloc(size_t{ftl->logical_pages} * sizeof(uint16_t),
+            config->use_psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT));
+        ftl->stage = static_cast<uint8_t *>(heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA));
+        ftl->mutex = xSemaphoreCreateMutex();
+
+        if ((ftl->l2p == nullptr) || (ftl->stage == nullptr) || (ftl->mutex == nullptr)){
+            err = ESP_ERR_NO_MEM;
+        }else{
+            std::fill(ftl->l2p, &ftl->l2p[ftl->logical_pages], UNMAPPED);
+            err = mount(ftl);
+        }
+
+        if (err == ESP_OK){
+            *out_ftl = ftl;
+        }else{
+            ESP_LOGE("W25 FTL", "Mount failed (%s)", esp_err_to_name(err));
+            free_ftl(ftl);
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_FtlUnmount(w25_ftl_t *ftl){
+    esp_err_t err = w25_FtlSync(ftl);
+    free_ftl(ftl);
+    return err;
+}
+
+uint16_t w25_FtlCapacity(const w25_ftl_t *ftl){
+    return ftl->logical_pages;
+}
+
+esp_err_t w25_FtlRead(w25_ftl_t *ftl, uint16_t column_addr, uint16_t logical_page, uint8_t *out_buffer, size_t buffer_size){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if ((logical_page < ftl->logical_pages) && ((size_t{column_addr} + buffer_size) <= W25_PAGE_SIZE)){
+        (void)xSemaphoreTake(ftl->mutex, portMAX_DELAY);
+        const uint16_t ppn = ftl->l2p[logical_page];
+        if (ppn == UNMAPPED){
+            (void)memset(out_buffer, 0xFF, buffer_size);
+            err = ESP_OK;
+        }else{
+            err = w25_ReadMemory(ftl->w25, column_addr, ppn, out_buffer, buffer_size);
+        }
+        xSemaphoreGive(ftl->mutex);
+    }
+    return err;
+}
+
+esp_err_t w25_FtlWrite(w25_ftl_t *ftl, uint16_t column_addr, uint16_t logical_page, const uint8_t *in_buffer, size_t buffer_size){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if ((logical_page < ftl->logical_pages) && (buffer_size > size_t{0}) && ((size_t{column_addr} + buffer_size) <= W25_PAGE_SIZE)){
+        (void)xSemaphoreTake(ftl->mutex, portMAX_DELAY);
+        uint16_t dst = 0;
+        err = alloc_page(ftl, &dst); //First, garbage collection goes through the stage buffer
+
+        if ((err == ESP_OK) && (buffer_size < W25_PAGE_SIZE)){ //Keeps the rest of the previous version
+            const uint16_t old = ftl->l2p[logical_page];
+            if (old == UNMAPPED){
+                (void)memset(ftl->stage, 0xFF, W25_PAGE_SIZE);
+            }else{
+                err = w25_ReadMemory(ftl->w25, 0, old, ftl->stage, W25_PAGE_SIZE);
+            }
+        }
+        if (err == ESP_OK){
+            (void)memcpy(&ftl->stage[column_addr], in_buffer, buffer_size);
+            ftl->stats.page_programs++;
+            ftl->stats.host_writes++;
+            err = w25_WriteMemory(ftl->w25, 0, dst, ftl->stage, W25_PAGE_SIZE);
+        }
+        if (err == ESP_OK){
+            map_page(ftl, logical_page, dst);
+        }
+        xSemaphoreGive(ftl->mutex);
+    }
+    return err;
+}
+
+esp_err_t w25_FtlSync(w25_ftl_t *ftl){
+    esp_err_t err = ESP_OK;
+    (void)xSemaphoreTake(ftl->mutex, portMAX_DELAY);
+    err = sync_open_block(ftl);
+    xSemaphoreGive(ftl->mutex);
+    return err;
+}
+
+void w25_FtlGetStats(w25_ftl_t *ftl, w25_ftl_stats_t *stats){
+    (void)xSemaphoreTake(ftl->mutex, portMAX_DELAY);
+    ftl->stats.min_erase_count = UINT32_MAX;
+    ftl->stats.max_erase_count = 0;
+    for (uint16_t b = 0; b < ftl->config.block_count; b++){
+        if (ftl->blocks[b].state != block_state::BAD){
+            ftl->stats.min_erase_count = std::min(ftl->stats.min_erase_count, ftl->blocks[b].erase_count);
+            ftl->stats.max_erase_count = std::max(ftl->stats.max_erase_count, ftl->blocks[b].erase_count);
+        }
+    }
+    *stats = ftl->stats;
+    xSemaphoreGive(ftl->mutex);
+}
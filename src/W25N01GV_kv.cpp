@@ -0,0 +1,648 @@
+#include <string.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_kv.h"
+
+/*
+Layout of a block of the store:
+    page 0      header with the sequence number of the block, programmed when the head moves into it
+    pages 1-63  entries, packed from the start of each page: entry_header, key, value
+Sequence numbers grow by one from block to block around the circle. The blocks in use go from the tail (lowest
+sequence number) to the head, the others are free. Replaying the entries from the tail on gives the last entry of
+every key, which is what the RAM index points to.
+*/
+
+namespace{
+    constexpr uint32_t HEADER_MAGIC = 0x57324B56U;
+    constexpr uint16_t ENTRY_MAGIC = 0x4B56U;
+    constexpr uint8_t KIND_VALUE = 0x56U;
+    constexpr uint8_t KIND_TOMBSTONE = 0x44U;
+    constexpr uint8_t FIRST_ENTRY_PAGE = 1U;
+    constexpr uint16_t NO_PAGE = UINT16_MAX;
+    constexpr uint16_t FREE_RESERVE = 1U; //Blocks kept free outside compactions, room for the live entries of the tail
+
+    struct block_header{
+        uint32_t magic;
+        uint32_t seq;
+        uint32_t crc;
+    };
+
+    struct entry_header{
+        uint16_t magic;
+        uint8_t key_len;
+        uint8_t kind;
+        uint16_t value_len;
+        uint16_t reserved;
+        uint32_t crc;       //Fields above, key and value
+    };
+    constexpr size_t ENTRY_HEADER_SIZE = sizeof(entry_header);
+    static_assert(ENTRY_HEADER_SIZE == 12U, "W25_KV_MAX_VALUE_SIZE relies on the size of the header");
+    static_assert((ENTRY_HEADER_SIZE + W25_KV_MAX_KEY_SIZE + W25_KV_MAX_VALUE_SIZE) == W25_PAGE_SIZE, "the largest entry takes a page");
+
+    struct kv_slot{
+        uint32_t hash;
+        uint16_t page;      //page_addr of the entry
+        uint16_t offset;
+        uint16_t size;      //Size of the entry, 0 for an empty slot
+    };
+}
+
+struct w25_kv{
+    const winbond_t *w25;
+    w25_kv_config_t config;
+    kv_slot *slots;             //Open addressing with linear probing, a power of two of them
+    uint32_t mask;
+    uint32_t keys;
+    uint32_t *live;             //Bytes of live entries per block
+    bool *erased;               //Free blocks known to be erased
+    uint16_t tail_block;
+    uint16_t head_block;
+    uint16_t used;              //Blocks from the tail to the head
+    uint32_t head_seq;          //Sequence number of the head block, 0 while the store is empty
+    w25_append_cursor_t cursor; //Next byte programmed on the head page
+    uint8_t *page;              //DMA capable copy of the head page, the entries from cursor.column_addr on aren't programmed
+    size_t pending;
+    uint8_t *scratch;           //DMA capable page or entry read from the memory
+    uint16_t scratch_page;      //Page held by scratch as a whole, NO_PAGE otherwise
+    uint8_t probe[ENTRY_HEADER_SIZE + W25_KV_MAX_KEY_SIZE]; //Header and key of an entry being compared
+    bool compacting;
+    SemaphoreHandle_t mutex;
+    w25_kv_stats_t stats;
+};
+
+static uint16_t page_addr_of(const w25_kv_t *kv, uint16_t block, uint8_t page){
+    return static_cast<uint16_t>(((kv->config.first_block + block)*W25_PAGES_PER_BLOCK) + page);
+}
+
+static uint16_t block_of(const w25_kv_t *kv, uint16_t page_addr){
+    return static_cast<uint16_t>((page_addr / W25_PAGES_PER_BLOCK) - kv->config.first_block);
+}
+
+static uint16_t next_block(const w25_kv_t *kv, uint16_t block){
+    return ((block + 1U) == kv->config.block_count) ? uint16_t{0} : static_cast<uint16_t>(block + 1U);
+}
+
+static uint16_t free_blocks(const w25_kv_t *kv){
+    return static_cast<uint16_t>(kv->config.block_count - kv->used);
+}
+
+static uint32_t header_crc(const block_header *header){
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(header), static_cast<uint32_t>(offsetof(block_header, crc)));
+}
+
+static uint32_t entry_crc(const entry_header *header, const uint8_t *payload){
+    const uint32_t crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(header), static_cast<uint32_t>(offsetof(entry_header, crc)));
+    return esp_rom_crc32_le(crc, payload, uint32_t{header->key_len} + header->value_len);
+}
+
+//FNV-1a
+static uint32_t key_hash(const uint8_t *key, size_t length){
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; i++){
+        hash = (hash ^ key[i])*16777619U;
+    }
+    return hash;
+}
+
+static size_t entry_size(const entry_header *header){
+    return ENTRY_HEADER_SIZE + header->key_len + header->value_len;
+}
+
+//Header of a complete entry with a valid CRC within the available bytes
+static bool parse_entry(const uint8_t *entry, size_t available, entry_header *header){
+    bool valid = (available >= ENTRY_HEADER_SIZE);
+    if (valid){
+        (void)memcpy(header, entry, ENTRY_HEADER_SIZE);
+        valid = (header->magic == ENTRY_MAGIC) && ((header->kind == KIND_VALUE) || (header->kind == KIND_TOMBSTONE))
+            && (header->key_len > 0U) && (header->key_len <= W25_KV_MAX_KEY_SIZE) && (header->value_len <= W25_KV_MAX_VALUE_SIZE)
+            && (entry_size(header) <= available) && (header->crc == entry_crc(header, &entry[ENTRY_HEADER_SIZE]));
+    }
+    return valid;
+}
+
+static void start_page(w25_kv_t *kv, uint16_t page_addr){
+    kv->cursor.page_addr = page_addr;
+    kv->cursor.column_addr = 0;
+    kv->cursor.programs = 0;
+    kv->pending = 0;
+    (void)memset(kv->page, 0xFF, W25_PAGE_SIZE);
+}
+
+static esp_err_t read_page(w25_kv_t *kv, uint16_t page_addr){
+    kv->scratch_page = NO_PAGE;
+    esp_err_t err = w25_ReadMemory(kv->w25, 0, page_addr, kv->scratch, W25_PAGE_SIZE);
+    if (err == ESP_OK){
+        kv->scratch_page = page_addr;
+    }
+    return err;
+}
+
+//Entry a slot points to: from the head page in RAM, otherwise read into scratch
+static esp_err_t load_entry(w25_kv_t *kv, const kv_slot *slot, const uint8_t **entry){
+    esp_err_t err = ESP_OK;
+    if (slot->page == kv->cursor.page_addr){
+        *entry = &kv->page[slot->offset];
+    }else{
+        kv->scratch_page = NO_PAGE;
+        err = w25_ReadMemory(kv->w25, slot->offset, slot->page, kv->scratch, slot->size);
+        kv->stats.entry_reads++;
+        *entry = kv->scratch;
+    }
+    return err;
+}
+
+//Compares the key of the entry a slot points to, only reading its header and key when the page isn't in RAM
+static esp_err_t key_matches(w25_kv_t *kv, const kv_slot *slot, const uint8_t *key, size_t length, bool *match){
+    esp_err_t err = ESP_OK;
+    const uint8_t *entry = nullptr;
+    if (slot->page == kv->cursor.page_addr){
+        entry = &kv->page[slot->offset];
+    }else if (slot->page == kv->scratch_page){
+        entry = &kv->scratch[slot->offset];
+    }else{
+        const size_t wanted = ENTRY_HEADER_SIZE + length;
+        err = w25_ReadMemory(kv->w25, slot->offset, slot->page, kv->probe, (wanted < slot->size) ? wanted : size_t{slot->size});
+        kv->stats.entry_reads++;
+        entry = kv->probe;
+    }
+    *match = false;
+    if (err == ESP_OK){
+        entry_header header = {};
+        (void)memcpy(&header, entry, ENTRY_HEADER_SIZE);
+        *match = (header.key_len == length) && (memcmp(&entry[ENTRY_HEADER_SIZE], key, length) == 0);
+    }
+    return err;
+}
+
+//Slot holding key, or the empty slot ending its probe sequence
+static esp_err_t find_slot(w25_kv_t *kv, uint32_t hash, const uint8_t *key, size_t length, uint32_t *index, bool *found){
+    esp_err_t err = ESP_OK;
+    uint32_t i = hash & kv->mask;
+    *found = false;
+    while ((err == ESP_OK) && !*found && (kv->slots[i].size != 0U)){
+        if (kv->slots[i].hash == hash){
+            err = key_matches(kv, &kv->slots[i], key, length, found);
+        }
+        if (!*found){
+            i = (i + 1U) & kv->mask;
+        }
+    }
+    *index = i;
+    return err;
+}
+
+//Backward shift deletion: the slots after it move back unless it would put them before their home slot
+static void remove_slot(w25_kv_t *kv, uint32_t index){
+    uint32_t hole = index;
+    uint32_t i = index;
+    for (;;){
+        i = (i + 1U) & kv->mask;
+        if (kv->slots[i].size == 0U){
+            break;
+        }
+        const uint32_t home = kv->slots[i].hash & kv->mask;
+        if (((i - home) & kv->mask) >= ((i - hole) & kv->mask)){
+            kv->slots[hole] = kv->slots[i];
+            hole = i;
+        }
+    }
+    kv->slots[hole].size = 0;
+}
+
+//Points the slot found for the key of an entry to it, or empties it for a tombstone
+static void set_slot(w25_kv_t *kv, uint32_t index, bool found, uint32_t hash, const entry_header *header, uint16_t page_addr, uint16_t offset){
+    kv_slot *slot = &kv->slots[index];
+    if (found){
+        kv->live[block_of(kv, slot->page)] -= slot->size;
+    }
+    if (header->kind == KIND_VALUE){
+        kv->keys += found ? 0U : 1U;
+        *slot = kv_slot{hash, page_addr, offset, static_cast<uint16_t>(entry_size(header))};
+        kv->live[block_of(kv, page_addr)] += slot->size;
+    }else if (found){
+        remove_slot(kv, index);
+        kv->keys--;
+    }else{
+        //Tombstone of a key already gone
+    }
+}
+
+//Replays an entry found on the memory
+static esp_err_t index_entry(w25_kv_t *kv, const entry_header *header, const uint8_t *key, uint16_t page_addr, uint16_t offset){
+    const uint32_t hash = key_hash(key, header->key_len);
+    uint32_t index = 0;
+    bool found = false;
+    esp_err_t err = find_slot(kv, hash, key, header->key_len, &index, &found);
+    if ((err == ESP_OK) && !found && (header->kind == KIND_VALUE) && (kv->keys >= kv->config.max_keys)){
+        err = ESP_ERR_NO_MEM;
+    }
+    if (err == ESP_OK){
+        set_slot(kv, index, found, hash, header, page_addr, offset);
+    }
+    return err;
+}
+
+//Programs the entries still in RAM
+static esp_err_t program_pending(w25_kv_t *kv){
+    esp_err_t err = ESP_OK;
+    if (kv->pending > size_t{0}){
+        err = w25_AppendData(kv->w25, &kv->cursor, &kv->page[kv->cursor.column_addr], kv->pending);
+        if (err == ESP_OK){
+            kv->pending = 0;
+            kv->stats.page_programs++;
+        }
+    }
+    return err;
+}
+
+static esp_err_t compact(w25_kv_t *kv);
+
+//Moves the head into the next free block. Unless this is for a compaction, the oldest blocks are compacted first
+//while fewer than FREE_RESERVE blocks would be left free; they may move the head themselves
+static esp_err_t open_block(w25_kv_t *kv){
+    esp_err_t err = ESP_OK;
+    const uint32_t full_seq = kv->head_seq;
+    const uint16_t needed = kv->compacting ? 1U : static_cast<uint16_t>(1U + FREE_RESERVE);
+
+    for (uint16_t i = 0; (err == ESP_OK) && !kv->compacting && (kv->head_seq == full_seq) && (free_blocks(kv) < needed) && (i < kv->config.block_count); i++){
+        err = compact(kv);
+    }
+    if ((err == ESP_OK) && (kv->head_seq == full_seq)){
+        const uint16_t block = (kv->used == 0U) ? kv->tail_block : next_block(kv, kv->head_block);
+        if (free_blocks(kv) < needed){
+            err = ESP_ERR_NO_MEM; //Every entry is live
+        }else if (!kv->erased[block]){
+            err = w25_BlockErase(kv->w25, page_addr_of(kv, block, 0), W25_ERASE_TIMEOUT_MS);
+            kv->stats.erases += (err == ESP_OK) ? 1U : 0U;
+        }else{
+            //Erased by its compaction
+        }
+        if (err == ESP_OK){
+            kv->erased[block] = false;
+            block_header header = {HEADER_MAGIC, kv->head_seq + 1U, 0};
+            header.crc = header_crc(&header);
+            err = w25_WriteMemory(kv->w25, 0, page_addr_of(kv, block, 0), reinterpret_cast<const uint8_t *>(&header), sizeof(header));
+            kv->stats.page_programs++;
+        }
+        if (err == ESP_OK){
+            kv->head_block = block;
+            kv->head_seq++;
+            kv->used++;
+            kv->live[block] = 0;
+            start_page(kv, page_addr_of(kv, block, FIRST_ENTRY_PAGE));
+        }
+    }
+    return err;
+}
+
+static bool fits(const w25_kv_t *kv, size_t size){
+    return (kv->cursor.page_addr != NO_PAGE) && (kv->cursor.programs < W25_MAX_PARTIAL_PROGRAMS)
+        && ((kv->cursor.column_addr + kv->pending + size) <= W25_PAGE_SIZE);
+}
+
+//Moves the head until the page in RAM takes size more bytes
+static esp_err_t make_room(w25_kv_t *kv, size_t size){
+    esp_err_t err = ESP_OK;
+    while ((err == ESP_OK) && !fits(kv, size)){
+        err = program_pending(kv);
+        if (err == ESP_OK){
+            if ((kv->cursor.page_addr == NO_PAGE) || ((kv->cursor.page_addr % W25_PAGES_PER_BLOCK) == (W25_PAGES_PER_BLOCK - 1U))){
+                err = open_block(kv);
+            }else{
+                start_page(kv, static_cast<uint16_t>(kv->cursor.page_addr + 1U));
+            }
+        }
+    }
+    return err;
+}
+
+//Copies the live entries of the tail block to the head, then erases it
+static esp_err_t compact(w25_kv_t *kv){
+    esp_err_t err = ESP_OK;
+    const uint16_t victim = kv->tail_block;
+    kv->compacting = true;
+
+    for (uint8_t page = FIRST_ENTRY_PAGE; (page < W25_PAGES_PER_BLOCK) && (err == ESP_OK) && (kv->live[victim] > 0U); page++){
+        const uint16_t page_addr = page_addr_of(kv, victim, page);
+        entry_header header = {};
+        err = read_page(kv, page_addr);
+        for (size_t offset = 0; (err == ESP_OK) && parse_entry(&kv->scratch[offset], W25_PAGE_SIZE - offset, &header); offset += entry_size(&header)){
+            const uint8_t *key = &kv->scratch[offset + ENTRY_HEADER_SIZE];
+            const uint32_t hash = key_hash(key, header.key_len);
+            uint32_t i = hash & kv->mask;
+            while ((kv->slots[i].size != 0U) && ((kv->slots[i].page != page_addr) || (kv->slots[i].offset != offset))){
+                i = (i + 1U) & kv->mask;
+            }
+            if (kv->slots[i].size != 0U){ //Still the last entry of its key
+                const size_t size = entry_size(&header);
+                err = make_room(kv, size);
+                if (err == ESP_OK){
+                    const uint16_t column = static_cast<uint16_t>(kv->cursor.column_addr + kv->pending);
+                    (void)memcpy(&kv->page[column], &kv->scratch[offset], size);
+                    kv->pending += size;
+                    kv->slots[i].page = kv->cursor.page_addr;
+                    kv->slots[i].offset = column;
+                    kv->live[victim] -= static_cast<uint32_t>(size);
+                    kv->live[kv->head_block] += static_cast<uint32_t>(size);
+                    kv->stats.relocated++;
+                }
+            }
+        }
+    }
+    if (err == ESP_OK){ //The copies reach the memory before the originals are erased
+        err = program_pending(kv);
+    }
+    if (err == ESP_OK){
+        err = w25_BlockErase(kv->w25, page_addr_of(kv, victim, 0), W25_ERASE_TIMEOUT_MS);
+    }
+    if (err == ESP_OK){
+        kv->erased[victim] = true;
+        kv->live[victim] = 0;
+        kv->tail_block = next_block(kv, victim);
+        kv->used--;
+        kv->stats.erases++;
+        kv->stats.compactions++;
+    }
+    kv->scratch_page = NO_PAGE;
+    kv->compacting = false;
+    return err;
+}
+
+//Finds the blocks in use through their headers, then replays their entries from the tail to the head
+static esp_err_t rebuild(w25_kv_t *kv){
+    esp_err_t err = ESP_OK;
+    uint32_t max_seq = 0;
+    uint32_t min_seq = UINT32_MAX;
+
+    for (uint16_t block = 0; (block < kv->config.block_count) && (err == ESP_OK); block++){
+        block_header header = {};
+        err = w25_ReadMemory(kv->w25, 0, page_addr_of(kv, block, 0), reinterpret_cast<uint8_t *>(&header), sizeof(header));
+        if ((err == ESP_OK) && (header.magic == HEADER_MAGIC) && (header.crc == header_crc(&header))){
+            if (header.seq > max_seq){
+                max_seq = header.seq;
+                kv->head_block = block;
+            }
+            if (header.seq < min_seq){
+                min_seq = header.seq;
+                kv->tail_block = block;
+            }
+        }
+    }
+
+    if ((err == ESP_OK) && (max_seq == 0U)){
+        err = open_block(kv);
+    }else if ((err == ESP_OK) && ((max_seq - min_seq) >= kv->config.block_count)){
+        err = ESP_ERR_INVALID_STATE; //Headers left by something else
+    }else if (err == ESP_OK){
+        kv->head_seq = max_seq;
+        kv->used = static_cast<uint16_t>((max_seq - min_seq) + 1U);
+        uint8_t last_page = 0;
+        uint16_t block = kv->tail_block;
+        for (uint16_t n = 0; (n < kv->used) && (err == ESP_OK); n++){
+            last_page = 0;
+            for (uint8_t page = FIRST_ENTRY_PAGE; (page < W25_PAGES_PER_BLOCK) && (err == ESP_OK) && (last_page == (page - 1U)); page++){
+                const uint16_t page_addr = page_addr_of(kv, block, page);
+                err = read_page(kv, page_addr);
+                if ((err == ESP_OK) && ((kv->scratch[0] != 0xFFU) || (kv->scratch[1] != 0xFFU))){ //Pages are programmed in order
+                    last_page = page;
+                    entry_header header = {};
+                    for (size_t offset = 0; (err == ESP_OK) && parse_entry(&kv->scratch[offset], W25_PAGE_SIZE - offset, &header); offset += entry_size(&header)){
+                        err = index_entry(kv, &header, &kv->scratch[offset + ENTRY_HEADER_SIZE], page_addr, static_cast<uint16_t>(offset));
+                    }
+                }
+            }
+            block = next_block(kv, block);
+        }
+
+        if (err == ESP_OK){
+            //The rest of the last page programmed is left unused, a full head block is kept with its last page in RAM
+            if (last_page < (W25_PAGES_PER_BLOCK - 1U)){
+                start_page(kv, page_addr_of(kv, kv->head_block, static_cast<uint8_t>(last_page + 1U)));
+            }else{
+                (void)memcpy(kv->page, kv->scratch, W25_PAGE_SIZE);
+                kv->cursor.page_addr = page_addr_of(kv, kv->head_block, last_page);
+                kv->cursor.column_addr = W25_PAGE_SIZE;
+                kv->cursor.programs = W25_MAX_PARTIAL_PROGRAMS;
+                kv->pending = 0;
+            }
+        }
+        ESP_LOGI("W25 KV", "%u keys, head on block %u", static_cast<unsigned int>(kv->keys),
+            static_cast<unsigned int>(kv->config.first_block + kv->head_block));
+    }
+    return err;
+}
+
+static void free_kv(w25_kv_t *kv){
+    if (kv->mutex != nullptr){
+        vSemaphoreDelete(kv->mutex);
+    }
+    heap_caps_free(kv->page);
+    heap_caps_free(kv->scratch);
+    delete[] kv->slots;
+    delete[] kv->live;
+    delete[] kv->erased;
+    delete kv;
+}
+
+//Length of a valid key, 0 otherwise
+static size_t key_length(const char *key){
+    const size_t length = (key != nullptr) ? strnlen(key, W25_KV_MAX_KEY_SIZE + 1U) : size_t{0};
+    return (length > W25_KV_MAX_KEY_SIZE) ? size_t{0} : length;
+}
+
+//Appends an entry to the head page and points the index to it. Compactions done to make room only move the
+//entries of the slots, so the slot found beforehand stays the one of the key
+static esp_err_t append(w25_kv_t *kv, uint8_t kind, const char *key, size_t key_len, const void *value, size_t size){
+    const uint8_t *key_bytes = reinterpret_cast<const uint8_t *>(key);
+    const uint32_t hash = key_hash(key_bytes, key_len);
+    uint32_t index = 0;
+    bool found = false;
+    esp_err_t err = find_slot(kv, hash, key_bytes, key_len, &index, &found);
+    if ((err == ESP_OK) && !found){
+        err = (kind == KIND_TOMBSTONE) ? ESP_ERR_NOT_FOUND : ((kv->keys >= kv->config.max_keys) ? ESP_ERR_NO_MEM : ESP_OK);
+    }
+
+    entry_header header = {ENTRY_MAGIC, static_cast<uint8_t>(key_len), kind, static_cast<uint16_t>(size), 0xFFFFU, 0};
+    const size_t total = entry_size(&header);
+    if (err == ESP_OK){
+        err = make_room(kv, total);
+    }
+    if (err == ESP_OK){
+        const uint16_t column = static_cast<uint16_t>(kv->cursor.column_addr + kv->pending);
+        uint8_t *entry = &kv->page[column];
+        (void)memcpy(&entry[ENTRY_HEADER_SIZE], key, key_len);
+        if (size > size_t{0}){
+            (void)memcpy(&entry[ENTRY_HEADER_SIZE + key_len], value, size);
+        }
+        header.crc = entry_crc(&header, &entry[ENTRY_HEADER_SIZE]);
+        (void)memcpy(entry, &header, ENTRY_HEADER_SIZE);
+        kv->pending += total;
+        set_slot(kv, index, found, hash, &header, kv->cursor.page_addr, column);
+    }
+    return err;
+}
+
+esp_err_t w25_KvOpen(const winbond_t *w25, const w25_kv_config_t *config, w25_kv_t **out_kv){
+    esp_err_t err = ESP_OK;
+    if ((config->block_count < (2U + FREE_RESERVE)) || ((uint32_t{config->first_block} + config->block_count) > W25_USABLE_BLOCKS) || (config->max_keys == 0U)){
+        err = ESP_ERR_INVALID_ARG;
+    }else{
+        uint32_t capacity = 1;
+        while (capacity < (2U*uint32_t{config->max_keys})){ //Probe sequences stay short below half full
+            capacity <<= 1U;
+        }
+        w25_kv_t *kv = new w25_kv_t{};
+        kv->w25 = w25;
+        kv->config = *config;
+        kv->slots = new kv_slot[capacity]{};
+        kv->mask = capacity - 1U;
+        kv->live = new uint32_t[config->block_count]{};
+        kv->erased = new bool[config->block_count]{};
+        kv->head_block = static_cast<uint16_t>(config->block_count - 1U);
+        kv->cursor.page_addr = NO_PAGE;
+        kv->scratch_page = NO_PAGE;
+        kv->page = static_cast<uint8_t *>(heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA));
+        kv->scratch = static_cast<uint8_t *>(heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA));
+        kv->mutex = xSemaphoreCreateMutex();
+
+        if ((kv->page == nullptr) || (kv->scratch == nullptr) || (kv->mutex == nullptr)){
+            err = ESP_ERR_NO_MEM;
+        }else{
+            err = rebuild(kv);
+        }
+
+        if (err == ESP_OK){
+            *out_kv = kv;
+        }else{
+            free_kv(kv);
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_KvClose(w25_kv_t *kv){
+    esp_err_t err = w25_KvSync(kv);
+    free_kv(kv);
+    return err;
+}
+
+esp_err_t w25_KvPut(w25_kv_t *kv, const char *key, const void *value, size_t size){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    const size_t key_len = key_length(key);
+    if ((key_len > size_t{0}) && (size <= W25_KV_MAX_VALUE_SIZE) && ((value != nullptr) || (size == size_t{0}))){
+        (void)xSemaphoreTake(kv->mutex, portMAX_DELAY);
+        err = append(kv, KIND_VALUE, key, key_len, value, size);
+        xSemaphoreGive(kv->mutex);
+    }
+    return err;
+}
+
+esp_err_t w25_KvGet(w25_kv_t *kv, const char *key, void *value, size_t buffer_size, size_t *size){
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    const size_t key_len = key_length(key);
+    const uint8_t *key_bytes = reinterpret_cast<const uint8_t *>(key);
+    const uint32_t hash = key_hash(key_bytes, key_len);
+    bool found = false;
+
+    (void)xSemaphoreTake(kv->mutex, portMAX_DELAY);
+    //The whole entry is read on a hash match, the key is compared afterwards
+    for (uint32_t i = hash & kv->mask; (key_len > size_t{0}) && !found && (kv->slots[i].size != 0U); i = (i + 1U) & kv->mask){
+        if (kv->slots[i].hash == hash){
+            const uint8_t *entry = nullptr;
+            entry_header header = {};
+            err = load_entry(kv, &kv->slots[i], &entry);
+            if ((err == ESP_OK) && !parse_entry(entry, kv->slots[i].size, &header)){
+                err = ESP_ERR_INVALID_CRC;
+            }
+            if ((err == ESP_OK) && (header.key_len == key_len) && (memcmp(&entry[ENTRY_HEADER_SIZE], key, key_len) == 0)){
+                found = true;
+                if (size != nullptr){
+                    *size = header.value_len;
+                }
+                if ((value != nullptr) && (header.value_len > buffer_size)){
+                    err = ESP_ERR_INVALID_SIZE;
+                }else if ((value != nullptr) && (header.value_len > 0U)){
+                    (void)memcpy(value, &entry[ENTRY_HEADER_SIZE + key_len], header.value_len);
+                }else{
+                    //Only the size was wanted
+                }
+            }else if (err == ESP_OK){
+                err = ESP_ERR_NOT_FOUND; //Another key with the same hash
+            }else{
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(kv->mutex);
+    return err;
+}
+
+esp_err_t w25_KvDelete(w25_kv_t *kv, const char *key){
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    const size_t key_len = key_length(key);
+    if (key_len > size_t{0}){
+        (void)xSemaphoreTake(kv->mutex, portMAX_DELAY);
+        err = append(kv, KIND_TOMBSTONE, key, key_len, nullptr, 0);
+        xSemaphoreGive(kv->mutex);
+    }
+    return err;
+}
+
+esp_err_t w25_KvIterate(w25_kv_t *kv, w25_kv_iterator_t callback, void *arg){
+    esp_err_t err = ESP_OK;
+    bool more = true;
+    char key[W25_KV_MAX_KEY_SIZE + 1U];
+
+    (void)xSemaphoreTake(kv->mutex, portMAX_DELAY);
+    for (uint32_t i = 0; (i <= kv->mask) && more && (err == ESP_OK); i++){
+        if (kv->slots[i].size != 0U){
+            const uint8_t *entry = nullptr;
+            entry_header header = {};
+            err = load_entry(kv, &kv->slots[i], &entry);
+            if ((err == ESP_OK) && !parse_entry(entry, kv->slots[i].size, &header)){
+                err = ESP_ERR_INVALID_CRC;
+            }
+            if (err == ESP_OK){
+                (void)memcpy(key, &entry[ENTRY_HEADER_SIZE], header.key_len);
+                key[header.key_len] = '\0';
+                more = callback(key, &entry[ENTRY_HEADER_SIZE + header.key_len], header.value_len, arg);
+            }
+        }
+    }
+    xSemaphoreGive(kv->mutex);
+    return err;
+}
+
+esp_err_t w25_KvSync(w25_kv_t *kv){
+    (void)xSemaphoreTake(kv->mutex, portMAX_DELAY);
+    const esp_err_t err = program_pending(kv);
+    xSemaphoreGive(kv->mutex);
+    return err;
+}
+
+esp_err_t w25_KvCompact(w25_kv_t *kv){
+    esp_err_t err = ESP_OK;
+    (void)xSemaphoreTake(kv->mutex, portMAX_DELAY);
+    if (kv->used > 1U){
+        err = compact(kv);
+    }
+    xSemaphoreGive(kv->mutex);
+    return err;
+}
+
+void w25_KvGetStats(w25_kv_t *kv, w25_kv_stats_t *stats){
+    (void)xSemaphoreTake(kv->mutex, portMAX_DELAY);
+    *stats = kv->stats;
+    stats->keys = kv->keys;
+    stats->live_bytes = 0;
+    for (uint16_t block = 0; block < kv->config.block_count; block++){
+        stats->live_bytes += kv->live[block];
+    }
+    xSemaphoreGive(kv->mutex);
+}
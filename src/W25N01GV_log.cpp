@@ -0,0 +1,430 @@
+#include <string.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_log.h"
+
+/*
+Layout of a block of the log:
+    page 0      header with the sequence number of the block, programmed when the head moves into it
+    pages 1-63  records, packed from the start of each page
+Sequence numbers grow by one from block to block around the circle, the highest one is the head.
+*/
+
+namespace{
+    constexpr uint32_t HEADER_MAGIC = 0x57324C47U;
+    constexpr uint32_t STATE_MAGIC = 0x57324C53U;
+    constexpr uint8_t FIRST_RECORD_PAGE = 1U;
+    static_assert((W25_PAGES_PER_BLOCK - FIRST_RECORD_PAGE) == W25_LOG_RECORD_PAGES, "the header page is the first one");
+    constexpr uint16_t NO_PAGE = UINT16_MAX;
+
+    struct log_header{
+        uint32_t magic;
+        uint32_t seq;
+        uint32_t crc;
+    };
+}
+
+struct w25_log{
+    const winbond_t *w25;
+    w25_log_config_t config;
+    uint16_t page_bytes;        //Bytes of a page taken by whole records
+    w25_log_state_t state;
+    w25_log_state_t *rtc_state;
+    uint8_t *page;              //DMA capable copy of the head page, the records from state.cursor.column on aren't programmed
+    size_t pending;
+    uint8_t *read_page;         //DMA capable copy of the last page read by w25_LogRead
+    uint16_t read_page_addr;    //Page held by read_page, NO_PAGE when it must be loaded again
+    SemaphoreHandle_t mutex;
+    w25_log_stats_t stats;
+};
+
+static uint16_t page_addr_of(const w25_log_t *log, uint16_t block, uint8_t page){
+    return static_cast<uint16_t>(((log->config.first_block + block)*W25_PAGES_PER_BLOCK) + page);
+}
+
+static uint16_t next_block(const w25_log_t *log, uint16_t block){
+    return ((block + 1U) == log->config.block_count) ? uint16_t{0} : static_cast<uint16_t>(block + 1U);
+}
+
+static uint32_t header_crc(const log_header *header){
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(header), static_cast<uint32_t>(offsetof(log_header, crc)));
+}
+
+static uint32_t state_crc(const w25_log_state_t *state){
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(state), static_cast<uint32_t>(offsetof(w25_log_state_t, crc)));
+}
+
+static uint32_t tail_seq(const w25_log_t *log){
+    const uint32_t used = (static_cast<uint32_t>(log->state.head_block) + log->config.block_count - log->state.tail_block) % log->config.block_count;
+    return log->state.head_seq - used;
+}
+
+static uint16_t block_of_seq(const w25_log_t *log, uint32_t seq){
+    const uint32_t behind = (log->state.head_seq - seq) % log->config.block_count;
+    return static_cast<uint16_t>((log->state.head_block + log->config.block_count - behind) % log->config.block_count);
+}
+
+static bool all_erased(const uint8_t *data, size_t size){
+    bool erased = true;
+    for (size_t i = 0; (i < size) && erased; i++){
+        erased = (data[i] == 0xFFU);
+    }
+    return erased;
+}
+
+//The state is copied as raw bytes, padding included, so the CRC matches on the copy
+static void save_state(w25_log_t *log){
+    log->state.crc = state_crc(&log->state);
+    if (log->rtc_state != nullptr){
+        (void)memcpy(log->rtc_state, &log->state, sizeof(w25_log_state_t));
+    }
+}
+
+static void reset_state(w25_log_t *log){
+    (void)memset(&log->state, 0, sizeof(w25_log_state_t));
+    log->state.magic = STATE_MAGIC;
+    log->state.first_block = log->config.first_block;
+    log->state.block_count = log->config.block_count;
+    log->state.record_size = log->config.record_size;
+    log->state.head_block = static_cast<uint16_t>(log->config.block_count - 1U); //The first block opened is block 0
+}
+
+//Erases the first block that isn't erased yet after the head, dropping the oldest records when it's the tail.
+//A block that fails to erase (E-FAIL) is marked bad and still counted as erased, the head passes over it
+static esp_err_t erase_next(w25_log_t *log){
+    const uint16_t target = static_cast<uint16_t>((log->state.head_block + 1U + log->state.erased_ahead) % log->config.block_count);
+    log->read_page_addr = NO_PAGE;
+    esp_err_t err = w25_BlockErase(log->w25, page_addr_of(log, target, 0), W25_ERASE_TIMEOUT_MS);
+    if (err == ESP_ERR_INVALID_STATE){
+        ESP_LOGW("W25 LOG", "Block %u failed to erase, marked bad", static_cast<unsigned int>(log->config.first_block + target));
+        (void)w25_MarkBadBlock(log->w25, static_cast<uint16_t>(log->config.first_block + target));
+        log->stats.bad_blocks++;
+        err = ESP_OK;
+    }else if (err == ESP_OK){
+        log->stats.erases++;
+    }else{
+        //Bus trouble, the same block is tried again
+    }
+    if (err == ESP_OK){
+        if ((log->state.head_seq != 0U) && (target == log->state.tail_block)){
+            log->state.tail_block = next_block(log, log->state.tail_block);
+            log->stats.reclaimed_blocks++;
+        }
+        log->state.erased_ahead++;
+    }
+    return err;
+}
+
+//Moves the head into the next good block and keeps erase_ahead blocks erased after it. The sequence number
+//of a bad block is left unused, the reader finds no header of it there
+static esp_err_t open_block(w25_log_t *log){
+    esp_err_t err = ESP_OK;
+    bool bad = true;
+    for (uint16_t tried = 0; (err == ESP_OK) && bad; tried++){
+        if (tried == log->config.block_count){
+            err = ESP_ERR_NO_MEM; //Every block is bad
+        }else if (log->state.erased_ahead == 0U){
+            err = erase_next(log);
+        }else{
+            //Erased already
+        }
+        if (err == ESP_OK){
+            log->state.head_block = next_block(log, log->state.head_block);
+            log->state.erased_ahead--;
+            log->state.head_seq++;
+            err = w25_IsBadBlock(log->w25, static_cast<uint16_t>(log->config.first_block + log->state.head_block), &bad);
+        }
+    }
+    if (err == ESP_OK){
+        log_header header = {HEADER_MAGIC, log->state.head_seq, 0};
+        header.crc = header_crc(&header);
+        err = w25_WriteMemory(log->w25, 0, page_addr_of(log, log->state.head_block, 0), reinterpret_cast<const uint8_t *>(&header), sizeof(header));
+        log->stats.page_programs++;
+    }
+    if (err == ESP_OK){
+        log->state.cursor.page_addr = page_addr_of(log, log->state.head_block, FIRST_RECORD_PAGE);
+        log->state.cursor.column_addr = 0;
+        log->state.cursor.programs = 0;
+    }
+    while ((err == ESP_OK) && (log->state.erased_ahead < log->config.erase_ahead)){
+        err = erase_next(log);
+    }
+    save_state(log);
+    return err;
+}
+
+//Programs the records still in RAM. The cursor moves on once the page is full or can't take more partial programs.
+//A page that fails to program (P-FAIL) is skipped, its records stay pending and move to the start of the next page
+static esp_err_t program_pending(w25_log_t *log){
+    esp_err_t err = ESP_OK;
+    w25_append_cursor_t *cursor = &log->state.cursor;
+    const uint16_t failed_column = cursor->column_addr;
+    bool skip = false;
+
+    if (log->pending > size_t{0}){
+        if (log->read_page_addr == cursor->page_addr){ //The copy misses the records programmed now
+            log->read_page_addr = NO_PAGE;
+        }
+        err = w25_AppendData(log->w25, cursor, &log->page[cursor->column_addr], log->pending);
+        if (err == ESP_OK){
+            log->pending = 0;
+            log->stats.page_programs++;
+        }else if (err == ESP_ERR_INVALID_STATE){
+            skip = true;
+            log->stats.failed_programs++;
+        }else{
+            //Bus trouble, the same page is tried again
+        }
+    }
+    if (skip || ((err == ESP_OK) && ((cursor->programs >= W25_MAX_PARTIAL_PROGRAMS) || ((cursor->column_addr + log->config.record_size) > log->page_bytes)))){
+        esp_err_t move_err = ESP_OK;
+        if ((cursor->page_addr % W25_PAGES_PER_BLOCK) == (W25_PAGES_PER_BLOCK - 1U)){
+            move_err = open_block(log);
+        }else{
+            cursor->page_addr++;
+            cursor->column_addr = 0;
+            cursor->programs = 0;
+        }
+        if (skip && (move_err == ESP_OK)){
+            (void)memmove(log->page, &log->page[failed_column], log->pending);
+        }
+        err = (err == ESP_OK) ? move_err : err;
+    }
+    save_state(log);
+    return err;
+}
+
+static bool state_valid(const w25_log_t *log, const w25_log_state_t *state){
+    return (state->magic == STATE_MAGIC) && (state->crc == state_crc(state))
+        && (state->first_block == log->config.first_block) && (state->block_count == log->config.block_count)
+        && (state->record_size == log->config.record_size);
+}
+
+//Finds the head and the tail through the block headers, and the first empty page of the head block
+static esp_err_t scan(w25_log_t *log){
+    esp_err_t err = ESP_OK;
+    uint32_t max_seq = 0;
+    uint32_t min_seq = UINT32_MAX;
+
+    reset_state(log);
+    for (uint16_t block = 0; (block < log->config.block_count) && (err == ESP_OK); block++){
+        log_header header = {};
+        bool bad = false;
+        err = w25_ReadMemory(log->w25, 0, page_addr_of(log, block, 0), reinterpret_cast<uint8_t *>(&header), sizeof(header));
+        const bool valid = (err == ESP_OK) && (header.magic == HEADER_MAGIC) && (header.crc == header_crc(&header));
+        if (valid){ //A block that failed to erase keeps the header of its last lap
+            err = w25_IsBadBlock(log->w25, static_cast<uint16_t>(log->config.first_block + block), &bad);
+        }
+        if ((err == ESP_OK) && valid && !bad){
+            if (header.seq > max_seq){
+                max_seq = header.seq;
+                log->state.head_block = block;
+            }
+            if (header.seq < min_seq){
+                min_seq = header.seq;
+                log->state.tail_block = block;
+            }
+        }
+    }
+
+    if ((err == ESP_OK) && (max_seq != 0U)){
+        log->state.head_seq = max_seq;
+        //Pages are programmed in order, the partial ones leave the rest of the page erased
+        uint8_t first = FIRST_RECORD_PAGE;
+        uint8_t last = W25_PAGES_PER_BLOCK;
+        while ((first < last) && (err == ESP_OK)){
+            const uint8_t middle = static_cast<uint8_t>((first + last) / 2U);
+            err = w25_ReadMemory(log->w25, 0, page_addr_of(log, log->state.head_block, middle), log->page, W25_PAGE_SIZE);
+            if (all_erased(log->page, W25_PAGE_SIZE)){
+                last = middle;
+            }else{
+                first = static_cast<uint8_t>(middle + 1U);
+            }
+        }
+        if (err == ESP_OK){
+            if (first == W25_PAGES_PER_BLOCK){
+                err = open_block(log);
+            }else{
+                log->state.cursor.page_addr = page_addr_of(log, log->state.head_block, first);
+            }
+        }
+        ESP_LOGI("W25 LOG", "Head found on block %u, page %u", static_cast<unsigned int>(log->config.first_block + log->state.head_block),
+            static_cast<unsigned int>(first));
+    }
+    save_state(log);
+    return err;
+}
+
+esp_err_t w25_LogOpen(const winbond_t *w25, const w25_log_config_t *config, w25_log_state_t *rtc_state, w25_log_t **out_log){
+    assert((config != nullptr) && (out_log != nullptr));
+    esp_err_t err = ESP_OK;
+    *out_log = nullptr;
+
+    if ((config->record_size == 0U) || (config->record_size > W25_PAGE_SIZE) || (config->erase_ahead == 0U)
+        || (config->block_count < (config->erase_ahead + 2U)) || ((uint32_t{config->first_block} + config->block_count) > W25_USABLE_BLOCKS)){
+        err = ESP_ERR_INVALID_ARG;
+    }else{
+        w25_log_t *log = new w25_log_t{};
+        log->w25 = w25;
+        log->config = *config;
+        log->page_bytes = static_cast<uint16_t>((W25_PAGE_SIZE / config->record_size)*config->record_size);
+        log->rtc_state = rtc_state;
+        log->page = static_cast<uint8_t *>(heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA));
+        log->read_page = static_cast<uint8_t *>(heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA));
+        log->read_page_addr = NO_PAGE;
+        log->mutex = xSemaphoreCreateMutex();
+
+        if ((log->page == nullptr) || (log->read_page == nullptr) || (log->mutex == nullptr)){
+            err = ESP_ERR_NO_MEM;
+        }else if ((rtc_state != nullptr) && state_valid(log, rtc_state)){
+            (void)memcpy(&log->state, rtc_state, sizeof(w25_log_state_t));
+        }else{
+            err = scan(log);
+        }
+
+        if (err == ESP_OK){
+            *out_log = log;
+        }else{
+            if (log->mutex != nullptr){
+                vSemaphoreDelete(log->mutex);
+            }
+            heap_caps_free(log->page);
+            heap_caps_free(log->read_page);
+            delete log;
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_LogClose(w25_log_t *log){
+    esp_err_t err = w25_LogFlush(log);
+    vSemaphoreDelete(log->mutex);
+    heap_caps_free(log->page);
+    heap_caps_free(log->read_page);
+    delete log;
+    return err;
+}
+
+esp_err_t w25_LogAppend(w25_log_t *log, const void *record){
+    esp_err_t err = ESP_OK;
+    (void)xSemaphoreTake(log->mutex, portMAX_DELAY);
+    if (log->state.head_seq == 0U){ //First record of an empty log
+        err = open_block(log);
+    }
+    if ((err == ESP_OK) && ((log->state.cursor.column_addr + log->pending + log->config.record_size) > log->page_bytes)){
+        err = program_pending(log); //The head page is full, it's programmed before taking the record
+    }
+    if (err == ESP_OK){
+        (void)memcpy(&log->page[log->state.cursor.column_addr + log->pending], record, log->config.record_size);
+        log->pending += log->config.record_size;
+        log->stats.records++;
+    }
+    xSemaphoreGive(log->mutex);
+    return err;
+}
+
+esp_err_t w25_LogFlush(w25_log_t *log){
+    esp_err_t err = ESP_OK;
+    (void)xSemaphoreTake(log->mutex, portMAX_DELAY);
+    if (log->pending > size_t{0}){
+        err = program_pending(log);
+    }
+    xSemaphoreGive(log->mutex);
+    return err;
+}
+
+void w25_LogReaderInit(w25_log_t *log, w25_log_reader_t *reader){
+    (void)xSemaphoreTake(log->mutex, portMAX_DELAY);
+    reader->seq = tail_seq(log);
+    reader->page = FIRST_RECORD_PAGE;
+    reader->slot = 0;
+    xSemaphoreGive(log->mutex);
+}
+
+esp_err_t w25_LogRead(w25_log_t *log, w25_log_reader_t *reader, void *record){
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    const uint16_t record_size = log->config.record_size;
+    uint8_t *out = static_cast<uint8_t *>(record);
+
+    (void)xSemaphoreTake(log->mutex, portMAX_DELAY);
+    bool done = (log->state.head_seq == 0U);
+    if (!done && (reader->seq < tail_seq(log))){
+        reader->seq = tail_seq(log);
+        reader->page = FIRST_RECORD_PAGE;
+        reader->slot = 0;
+    }
+
+    while (!done && (reader->seq <= log->state.head_seq)){
+        const uint16_t block = block_of_seq(log, reader->seq);
+        const uint16_t page_addr = page_addr_of(log, block, reader->page);
+        const size_t offset = size_t{reader->slot}*record_size;
+        const w25_append_cursor_t *cursor = &log->state.cursor;
+        esp_err_t read_err = ESP_OK;
+        bool skip_block = false;
+
+        if ((reader->page == FIRST_RECORD_PAGE) && (reader->slot == 0U) && (reader->seq != log->state.head_seq)){
+            //The head passes over the bad blocks, their sequence number is on no header
+            log_header header = {};
+            read_err = w25_ReadMemory(log->w25, 0, page_addr_of(log, block, 0), reinterpret_cast<uint8_t *>(&header), sizeof(header));
+            skip_block = (read_err == ESP_OK) && ((header.magic != HEADER_MAGIC) || (header.crc != header_crc(&header)) || (header.seq != reader->seq));
+        }
+
+        if (read_err != ESP_OK){
+            err = read_err;
+            done = true;
+        }else if (skip_block){
+            reader->seq++;
+        }else if ((reader->seq == log->state.head_seq) && ((page_addr > cursor->page_addr)
+            || ((page_addr == cursor->page_addr) && (offset >= (cursor->column_addr + log->pending))))){
+            done = true; //Every record was read
+        }else{
+            if ((page_addr == cursor->page_addr) && (offset >= cursor->column_addr)){ //Still in RAM
+                (void)memcpy(out, &log->page[offset], record_size);
+            }else{
+                if (log->read_page_addr != page_addr){ //One page read serves every record of the page
+                    log->read_page_addr = NO_PAGE;
+                    read_err = w25_ReadMemory(log->w25, 0, page_addr, log->read_page, W25_PAGE_SIZE);
+                    if (read_err == ESP_OK){
+                        log->read_page_addr = page_addr;
+                    }
+                }
+                if (read_err == ESP_OK){
+                    (void)memcpy(out, &log->read_page[offset], record_size);
+                }
+            }
+
+            if (read_err != ESP_OK){
+                err = read_err;
+                done = true;
+            }else{
+                if (!all_erased(out, record_size)){ //Erased slots are left by flushes and power losses
+                    err = ESP_OK;
+                    done = true;
+                }
+                reader->slot++;
+                if ((size_t{reader->slot}*record_size) >= log->page_bytes){
+                    reader->slot = 0;
+                    reader->page++;
+                    if (reader->page == W25_PAGES_PER_BLOCK){
+                        reader->page = FIRST_RECORD_PAGE;
+                        reader->seq++;
+                    }
+                }
+            }
+        }
+    }
+    xSemaphoreGive(log->mutex);
+    return err;
+}
+
+void w25_LogGetStats(w25_log_t *log, w25_log_stats_t *stats){
+    (void)xSemaphoreTake(log->mutex, portMAX_DELAY);
+    *stats = log->stats;
+    xSemaphoreGive(log->mutex);
+}
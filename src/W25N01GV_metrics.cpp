@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include "esp_err.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_metrics.h"
+
+namespace{
+    const char *const LATENCY_NAMES[W25_LAT_KINDS] = {"page_read", "program", "erase", "lock_wait"};
+
+    //Keeps appending to the text, the length goes on counting once it's full so truncation can be told
+    struct json_writer{
+        char *out;
+        size_t size;
+        size_t length;
+    };
+}
+
+static void append(json_writer *writer, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void append(json_writer *writer, const char *format, ...){
+    va_list args;
+    va_start(args, format);
+    const size_t room = (writer->length < writer->size) ? (writer->size - writer->length) : size_t{0};
+    const int written = vsnprintf((room > size_t{0}) ? &writer->out[writer->length] : nullptr, room, format, args);
+    va_end(args);
+    if (written > 0){
+        writer->length += static_cast<size_t>(written);
+    }
+}
+
+esp_err_t w25_MetricsToJson(const w25_metrics_t *metrics, char *out, size_t size){
+    json_writer writer = {out, size, 0};
+
+    append(&writer, "{\"opcodes\":{");
+    bool first = true;
+    for (size_t i = 0; i < size_t{256}; i++){
+        if (metrics->opcodes[i] != 0U){
+            append(&writer, "%s\"0x%02X\":%" PRIu32, first ? "" : ",", static_cast<unsigned int>(i), metrics->opcodes[i]);
+            first = false;
+        }
+    }
+    append(&writer, "},\"data_bytes\":%" PRIu64 ",\"busy_polls\":%" PRIu32 ",\"ecc_corrected\":%" PRIu32
+           ",\"ecc_uncorrectable\":%" PRIu32 ",\"erase_failures\":%" PRIu32 ",\"program_failures\":%" PRIu32 ",\"latency\":{",
+           metrics->data_bytes, metrics->busy_polls, metrics->ecc_corrected, metrics->ecc_uncorrectable,
+           metrics->erase_failures, metrics->program_failures);
+    for (size_t kind = 0; kind < W25_LAT_KINDS; kind++){
+        const w25_histogram_t *histogram = &metrics->latency[kind];
+        append(&writer, "%s\"%s\":{\"count\":%" PRIu32 ",\"max_us\":%" PRIu32 ",\"total_us\":%" PRIu64 ",\"buckets\":[",
+               (kind == size_t{0}) ? "" : ",", LATENCY_NAMES[kind], histogram->count, histogram->max_us, histogram->total_us);
+        for (size_t bucket = 0; bucket < W25_HIST_BUCKETS; bucket++){
+            append(&writer, "%s%" PRIu32, (bucket == size_t{0}) ? "" : ",", histogram->buckets[bucket]);
+        }
+        append(&writer, "]}");
+    }
+    append(&writer, "}}");
+
+    return (writer.length < size) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
@@ -0,0 +1,177 @@
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_pool.h"
+
+namespace{
+    constexpr uint32_t POOL_TASK_STACK = 3072U;
+}
+
+struct w25_pool{
+    const winbond_t *w25;
+    w25_pool_config_t config;
+    QueueHandle_t ready;        //Erased blocks, oldest erase first
+    QueueHandle_t dirty;        //Blocks waiting to be erased
+    SemaphoreHandle_t kick;     //Wakes the worker up
+    SemaphoreHandle_t stopped;
+    SemaphoreHandle_t mutex;    //Guards the stats
+    TaskHandle_t task;
+    volatile bool stopping;
+    w25_pool_stats_t stats;
+};
+
+static bool below_target(const w25_pool_t *pool){
+    const size_t target = (pool->config.target == 0U) ? size_t{pool->config.block_count} : size_t{pool->config.target};
+    return uxQueueMessagesWaiting(pool->ready) < target;
+}
+
+static void wake_if_low(w25_pool_t *pool){
+    if (uxQueueMessagesWaiting(pool->ready) < pool->config.low_water){
+        xSemaphoreGive(pool->kick);
+    }
+}
+
+//Returns false on a bus error, the worker stops until it's woken up again
+static bool erase_one(w25_pool_t *pool, uint16_t block){
+    esp_err_t err = w25_BlockErase(pool->w25, static_cast<uint16_t>(block*W25_PAGES_PER_BLOCK), W25_ERASE_TIMEOUT_MS);
+    if (err == ESP_ERR_INVALID_STATE){ //E-FAIL, the block is worn out
+        ESP_LOGW("W25 POOL", "Block %u failed to erase, marked bad", static_cast<unsigned int>(block));
+        (void)w25_MarkBadBlock(pool->w25, block);
+    }else if (err != ESP_OK){ //Bus trouble, the block is tried again later
+        (void)xQueueSendToBack(pool->dirty, &block, 0);
+    }else{
+        (void)xQueueSendToBack(pool->ready, &block, 0);
+    }
+
+    (void)xSemaphoreTake(pool->mutex, portMAX_DELAY);
+    if (err == ESP_OK){
+        pool->stats.erases++;
+    }else if (err == ESP_ERR_INVALID_STATE){
+        pool->stats.bad_blocks++;
+    }else{
+        //Not accounted
+    }
+    xSemaphoreGive(pool->mutex);
+    return (err == ESP_OK) || (err == ESP_ERR_INVALID_STATE);
+}
+
+static void pool_task(void *arg){
+    w25_pool_t *pool = static_cast<w25_pool_t *>(arg);
+
+    while (!pool->stopping){
+        (void)xSemaphoreTake(pool->kick, portMAX_DELAY);
+        uint16_t block = 0;
+        bool erasing = true;
+        while (erasing && !pool->stopping && below_target(pool) && (xQueueReceive(pool->dirty, &block, 0) == pdTRUE)){
+            erasing = erase_one(pool, block);
+        }
+    }
+    xSemaphoreGive(pool->stopped);
+    vTaskDelete(nullptr);
+}
+
+static void free_pool(w25_pool_t *pool){
+    if (pool->ready != nullptr){ vQueueDelete(pool->ready); }
+    if (pool->dirty != nullptr){ vQueueDelete(pool->dirty); }
+    if (pool->kick != nullptr){ vSemaphoreDelete(pool->kick); }
+    if (pool->stopped != nullptr){ vSemaphoreDelete(pool->stopped); }
+    if (pool->mutex != nullptr){ vSemaphoreDelete(pool->mutex); }
+    delete pool;
+}
+
+esp_err_t w25_PoolCreate(const winbond_t *w25, const w25_pool_config_t *config, unsigned int priority, w25_pool_t **out_pool){
+    assert(out_pool != nullptr);
+    esp_err_t err = ESP_OK;
+    *out_pool = nullptr;
+
+    if ((config->block_count == 0U) || ((uint32_t{config->first_block} + config->block_count) > W25_USABLE_BLOCKS) ||
+        (config->low_water == 0U) || (config->low_water > config->block_count) ||
+        ((config->target != 0U) && (config->target < config->low_water))){
+        err = ESP_ERR_INVALID_ARG;
+    }else{
+        w25_pool_t *pool = new w25_pool_t{};
+        pool->w25 = w25;
+        pool->config = *config;
+        pool->ready = xQueueCreate(config->block_count, sizeof(uint16_t));
+        pool->dirty = xQueueCreate(config->block_count, sizeof(uint16_t));
+        pool->kick = xSemaphoreCreateBinary();
+        pool->stopped = xSemaphoreCreateBinary();
+        pool->mutex = xSemaphoreCreateMutex();
+        if ((pool->ready == nullptr) || (pool->dirty == nullptr) || (pool->kick == nullptr) ||
+            (pool->stopped == nullptr) || (pool->mutex == nullptr)){
+            err = ESP_ERR_NO_MEM;
+        }
+
+        for (uint16_t i = 0; (i < config->block_count) && (err == ESP_OK); i++){
+            const uint16_t block = static_cast<uint16_t>(config->first_block + i);
+            bool bad = false;
+            err = w25_IsBadBlock(w25, block, &bad);
+            if ((err == ESP_OK) && !bad){
+                (void)xQueueSendToBack(pool->dirty, &block, 0);
+            }
+        }
+
+        if ((err == ESP_OK) &&
+            (xTaskCreate(pool_task, "w25_pool", POOL_TASK_STACK, pool, priority, &pool->task) != pdPASS)){
+            err = ESP_ERR_NO_MEM;
+        }
+
+        if (err == ESP_OK){
+            xSemaphoreGive(pool->kick);
+            *out_pool = pool;
+        }else{
+            free_pool(pool);
+        }
+    }
+    return err;
+}
+
+void w25_PoolDestroy(w25_pool_t *pool){
+    pool->stopping = true;
+    xSemaphoreGive(pool->kick);
+    (void)xSemaphoreTake(pool->stopped, portMAX_DELAY);
+    free_pool(pool);
+}
+
+esp_err_t w25_PoolTake(w25_pool_t *pool, uint16_t *block, uint32_t timeout_ms){
+    esp_err_t err = ESP_OK;
+    bool dry = false;
+
+    if (xQueueReceive(pool->ready, block, 0) != pdTRUE){
+        dry = true;
+        xSemaphoreGive(pool->kick);
+        if (xQueueReceive(pool->ready, block, pdMS_TO_TICKS(timeout_ms)) != pdTRUE){
+            err = ESP_ERR_TIMEOUT;
+        }
+    }
+    wake_if_low(pool);
+
+    (void)xSemaphoreTake(pool->mutex, portMAX_DELAY);
+    pool->stats.dry += dry ? 1U : 0U;
+    pool->stats.takes += (err == ESP_OK) ? 1U : 0U;
+    xSemaphoreGive(pool->mutex);
+    return err;
+}
+
+esp_err_t w25_PoolRelease(w25_pool_t *pool, uint16_t block){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if ((block >= pool->config.first_block) && (block < (pool->config.first_block + pool->config.block_count))){
+        err = (xQueueSendToBack(pool->dirty, &block, 0) == pdTRUE) ? ESP_OK : ESP_ERR_INVALID_STATE;
+        wake_if_low(pool);
+    }
+    return err;
+}
+
+size_t w25_PoolReady(const w25_pool_t *pool){
+    return uxQueueMessagesWaiting(pool->ready);
+}
+
+void w25_PoolGetStats(w25_pool_t *pool, w25_pool_stats_t *stats){
+    (void)xSemaphoreTake(pool->mutex, portMAX_DELAY);
+    *stats = pool->stats;
+    xSemaphoreGive(pool->mutex);
+}
@@ -0,0 +1,421 @@
+#include <string.h>
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_sched.h"
+
+namespace{
+    constexpr uint32_t SCHED_TASK_STACK = 3072U;
+    constexpr uint32_t SUBMIT_TIMEOUT_MS = 1000U;
+    constexpr EventBits_t IDLE_BIT = EventBits_t{1};
+
+    enum class sched_op : uint8_t {
+        READ,
+        WRITE,
+        ERASE
+    };
+
+    enum class slot_state : uint8_t {
+        FREE,
+        QUEUED,
+        SERVING
+    };
+
+    struct sched_slot{
+        slot_state state;
+        sched_op op;
+        w25_io_class io_class;
+        uint32_t seq;           //Submission order
+        uint16_t page_addr;
+        uint16_t column_addr;   //First byte read, or first byte written of the page image
+        size_t buffer_size;
+        uint8_t *out_buffer;
+        uint8_t *data;          //Page image of a write, 0xFF (left unprogrammed) out of the written ranges
+        int64_t submitted_us;
+        SemaphoreHandle_t done; //Wakes up the reader waiting on the slot
+        esp_err_t err;
+    };
+}
+
+struct w25_sched{
+    const winbond_t *w25;
+    sched_slot *slots;
+    size_t depth;
+    size_t busy;                //Slots not free
+    uint32_t seq;
+    bool stopping;
+    esp_err_t first_err;        //First error of a write or an erase since the last sync
+    SemaphoreHandle_t mutex;
+    SemaphoreHandle_t space;    //Counts the free slots
+    SemaphoreHandle_t kick;     //Wakes the I/O task up
+    SemaphoreHandle_t stopped;
+    EventGroupHandle_t events;
+    TaskHandle_t task;
+    w25_sched_stats_t stats;
+};
+
+static bool older(const sched_slot *a, const sched_slot *b){
+    return static_cast<int32_t>(a->seq - b->seq) < 0;
+}
+
+//Two requests that must keep their order: anything but two reads on the same page, or on the block of an erase
+static bool conflicts(const sched_slot *a, const sched_slot *b){
+    bool clash = false;
+    if ((a->op == sched_op::ERASE) || (b->op == sched_op::ERASE)){
+        clash = ((a->page_addr / W25_PAGES_PER_BLOCK) == (b->page_addr / W25_PAGES_PER_BLOCK));
+    }else if ((a->op == sched_op::WRITE) || (b->op == sched_op::WRITE)){
+        clash = (a->page_addr == b->page_addr);
+    }else{
+        //Reads never conflict
+    }
+    return clash;
+}
+
+//A request can be served once no older request touches the same location
+static bool servable(const w25_sched_t *sched, const sched_slot *slot){
+    bool ok = true;
+    for (size_t i = 0; (i < sched->depth) && ok; i++){
+        const sched_slot *other = &sched->slots[i];
+        if ((other != slot) && (other->state != slot_state::FREE) && older(other, slot) && conflicts(other, slot)){
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static sched_slot *pick_next(const w25_sched_t *sched){
+    sched_slot *best = nullptr;
+    for (size_t i = 0; i < sched->depth; i++){
+        sched_slot *slot = &sched->slots[i];
+        if ((slot->state == slot_state::QUEUED) &&
+            ((best == nullptr) || (slot->io_class < best->io_class) || ((slot->io_class == best->io_class) && older(slot, best))) &&
+            servable(sched, slot)){
+            best = slot;
+        }
+    }
+    return best;
+}
+
+//Adds the queued reads of the following pages to the one picked, as long as the pages stay adjacent
+static size_t gather_reads(w25_sched_t *sched, sched_slot **batch){
+    size_t count = 1;
+    uint32_t page_addr = batch[0]->page_addr;
+    bool adjacent = true;
+
+    while (adjacent && (count < W25_SCHED_MAX_MERGE)){
+        adjacent = false;
+        for (size_t i = 0; (i < sched->depth) && (count < W25_SCHED_MAX_MERGE); i++){
+            sched_slot *slot = &sched->slots[i];
+            if ((slot->state == slot_state::QUEUED) && (slot->op == sched_op::READ) &&
+                (slot->page_addr == page_addr) && servable(sched, slot)){
+                slot->state = slot_state::SERVING;
+                batch[count] = slot;
+                count++;
+            }
+        }
+        page_addr++;
+        for (size_t i = 0; (i < sched->depth) && !adjacent; i++){
+            const sched_slot *slot = &sched->slots[i];
+            adjacent = (slot->state == slot_state::QUEUED) && (slot->op == sched_op::READ) &&
+                       (slot->page_addr == page_addr) && servable(sched, slot);
+        }
+    }
+    return count;
+}
+
+static void free_slot(w25_sched_t *sched, sched_slot *slot){
+    slot->state = slot_state::FREE;
+    sched->busy--;
+    if (sched->busy == size_t{0}){
+        (void)xEventGroupSetBits(sched->events, IDLE_BIT);
+    }
+    xSemaphoreGive(sched->space);
+}
+
+static void account(w25_sched_t *sched, const sched_slot *slot){
+    w25_sched_latency_t *latency = &sched->stats.latency[slot->io_class];
+    const uint32_t elapsed_us = static_cast<uint32_t>(esp_timer_get_time() - slot->submitted_us);
+    latency->requests++;
+    latency->total_us += elapsed_us;
+    latency->max_us = (elapsed_us > latency->max_us) ? elapsed_us : latency->max_us;
+}
+
+//Serves the most urgent request, returns false once nothing can be served
+static bool serve_next(w25_sched_t *sched){
+    sched_slot *batch[W25_SCHED_MAX_MERGE] = {};
+    size_t count = 0;
+
+    (void)xSemaphoreTake(sched->mutex, portMAX_DELAY);
+    batch[0] = pick_next(sched);
+    if (batch[0] != nullptr){
+        batch[0]->state = slot_state::SERVING;
+        count = (batch[0]->op == sched_op::READ) ? gather_reads(sched, batch) : size_t{1};
+    }
+    xSemaphoreGive(sched->mutex);
+
+    if (count > size_t{0}){
+        esp_err_t err = ESP_OK;
+        if (batch[0]->op == sched_op::READ){
+            w25_read_segment_t segments[W25_SCHED_MAX_MERGE] = {};
+            for (size_t i = 0; i < count; i++){
+                segments[i] = {batch[i]->page_addr, batch[i]->column_addr, batch[i]->out_buffer, batch[i]->buffer_size};
+            }
+            err = w25_ReadPages(sched->w25, segments, count);
+        }else if (batch[0]->op == sched_op::WRITE){
+            //A coalesced span can outgrow the driver's buffer, the range is loaded in pieces
+            err = w25_WriteRange(sched->w25, batch[0]->column_addr, batch[0]->page_addr,
+                                 &batch[0]->data[batch[0]->column_addr], batch[0]->buffer_size);
+        }else{
+            err = w25_BlockErase(sched->w25, batch[0]->page_addr, W25_ERASE_TIMEOUT_MS);
+        }
+
+        (void)xSemaphoreTake(sched->mutex, portMAX_DELAY);
+        sched->stats.merged_reads += static_cast<uint32_t>(count - size_t{1});
+        for (size_t i = 0; i < count; i++){
+            account(sched, batch[i]);
+            batch[i]->err = err;
+            if (batch[i]->op == sched_op::READ){
+                xSemaphoreGive(batch[i]->done); //The reader frees its slot
+            }else{
+                if (sched->first_err == ESP_OK){
+                    sched->first_err = err;
+                }
+                free_slot(sched, batch[i]);
+            }
+        }
+        xSemaphoreGive(sched->mutex);
+    }
+    return count > size_t{0};
+}
+
+static void sched_task(void *arg){
+    w25_sched_t *sched = static_cast<w25_sched_t *>(arg);
+    bool running = true;
+
+    while (running){
+        (void)xSemaphoreTake(sched->kick, portMAX_DELAY);
+        while (serve_next(sched)){
+        }
+        (void)xSemaphoreTake(sched->mutex, portMAX_DELAY);
+        bool queued = false;
+        for (size_t i = 0; (i < sched->depth) && !queued; i++){
+            queued = (sched->slots[i].state == slot_state::QUEUED);
+        }
+        running = !sched->stopping || queued;
+        xSemaphoreGive(sched->mutex);
+    }
+    xSemaphoreGive(sched->stopped);
+    vTaskDelete(nullptr);
+}
+
+//Takes a free slot, waiting for one while the queue is full. Returns with the mutex taken
+static sched_slot *claim_slot(w25_sched_t *sched, sched_op op, w25_io_class io_class, uint16_t page_addr){
+    sched_slot *slot = nullptr;
+    if (xSemaphoreTake(sched->space, pdMS_TO_TICKS(SUBMIT_TIMEOUT_MS)) == pdTRUE){
+        (void)xSemaphoreTake(sched->mutex, portMAX_DELAY);
+        for (size_t i = 0; (i < sched->depth) && (slot == nullptr); i++){
+            if (sched->slots[i].state == slot_state::FREE){
+                slot = &sched->slots[i];
+            }
+        }
+        slot->state = slot_state::QUEUED;
+        slot->op = op;
+        slot->io_class = io_class;
+        slot->seq = ++sched->seq;
+        slot->page_addr = page_addr;
+        slot->submitted_us = esp_timer_get_time();
+        if (sched->busy == size_t{0}){
+            (void)xEventGroupClearBits(sched->events, IDLE_BIT);
+        }
+        sched->busy++;
+    }
+    return slot;
+}
+
+//Folds the write into a queued write of the same page, unless a later request depends on the queued one
+static bool coalesce(w25_sched_t *sched, w25_io_class io_class, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size){
+    sched_slot *target = nullptr;
+    for (size_t i = 0; i < sched->depth; i++){
+        sched_slot *slot = &sched->slots[i];
+        if ((slot->state == slot_state::QUEUED) && (slot->op == sched_op::WRITE) && (slot->page_addr == page_addr) &&
+            ((target == nullptr) || older(target, slot))){
+            target = slot;
+        }
+    }
+    for (size_t i = 0; (i < sched->depth) && (target != nullptr); i++){
+        const sched_slot *slot = &sched->slots[i];
+        if ((slot != target) && (slot->state != slot_state::FREE) && older(target, slot) && conflicts(slot, target)){
+            target = nullptr;
+        }
+    }
+    if (target != nullptr){
+        const size_t first = (column_addr < target->column_addr) ? column_addr : target->column_addr;
+        const size_t end = ((column_addr + buffer_size) > (target->column_addr + target->buffer_size)) ?
+                           (column_addr + buffer_size) : (target->column_addr + target->buffer_size);
+        (void)memcpy(&target->data[column_addr], in_buffer, buffer_size);
+        target->column_addr = static_cast<uint16_t>(first);
+        target->buffer_size = end - first;
+        target->io_class = (io_class < target->io_class) ? io_class : target->io_class;
+        sched->stats.coalesced_writes++;
+    }
+    return target != nullptr;
+}
+
+static void free_sched(w25_sched_t *sched){
+    for (size_t i = 0; i < sched->depth; i++){
+        if (sched->slots[i].data != nullptr){
+            heap_caps_free(sched->slots[i].data);
+        }
+        if (sched->slots[i].done != nullptr){
+            vSemaphoreDelete(sched->slots[i].done);
+        }
+    }
+    delete[] sched->slots;
+    if (sched->mutex != nullptr){ vSemaphoreDelete(sched->mutex); }
+    if (sched->space != nullptr){ vSemaphoreDelete(sched->space); }
+    if (sched->kick != nullptr){ vSemaphoreDelete(sched->kick); }
+    if (sched->stopped != nullptr){ vSemaphoreDelete(sched->stopped); }
+    if (sched->events != nullptr){ vEventGroupDelete(sched->events); }
+    delete sched;
+}
+
+esp_err_t w25_SchedCreate(const winbond_t *w25, size_t queue_depth, unsigned int priority, w25_sched_t **out_sched){
+    assert(out_sched != nullptr);
+    esp_err_t err = ESP_OK;
+    *out_sched = nullptr;
+
+    if (queue_depth == size_t{0}){
+        err = ESP_ERR_INVALID_ARG;
+    }else{
+        w25_sched_t *sched = new w25_sched_t{};
+        sched->w25 = w25;
+        sched->depth = queue_depth;
+        sched->first_err = ESP_OK;
+        sched->slots = new sched_slot[queue_depth]{};
+        sched->mutex = xSemaphoreCreateMutex();
+        sched->space = xSemaphoreCreateCounting(queue_depth, queue_depth);
+        sched->kick = xSemaphoreCreateBinary();
+        sched->stopped = xSemaphoreCreateBinary();
+        sched->events = xEventGroupCreate();
+        bool allocated = (sched->mutex != nullptr) && (sched->space != nullptr) && (sched->kick != nullptr) &&
+                         (sched->stopped != nullptr) && (sched->events != nullptr);
+        for (size_t i = 0; (i < queue_depth) && allocated; i++){
+            sched->slots[i].data = static_cast<uint8_t *>(heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA));
+            sched->slots[i].done = xSemaphoreCreateBinary();
+            allocated = (sched->slots[i].data != nullptr) && (sched->slots[i].done != nullptr);
+        }
+        if (allocated){
+            (void)xEventGroupSetBits(sched->events, IDLE_BIT);
+            allocated = (xTaskCreate(sched_task, "w25_sched", SCHED_TASK_STACK, sched, priority, &sched->task) == pdPASS);
+        }
+
+        if (allocated){
+            *out_sched = sched;
+        }else{
+            free_sched(sched);
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_SchedDestroy(w25_sched_t *sched){
+    (void)xSemaphoreTake(sched->mutex, portMAX_DELAY);
+    sched->stopping = true;
+    xSemaphoreGive(sched->mutex);
+    xSemaphoreGive(sched->kick);
+    (void)xSemaphoreTake(sched->stopped, portMAX_DELAY);
+
+    const esp_err_t err = sched->first_err;
+    free_sched(sched);
+    return err;
+}
+
+esp_err_t w25_SchedRead(w25_sched_t *sched, w25_io_class io_class, uint16_t column_addr, uint16_t page_addr, uint8_t *out_buffer, size_t buffer_size){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if ((buffer_size > size_t{0}) && ((size_t{column_addr} + buffer_size) <= W25_PAGE_SIZE) && (page_addr < W25_USABLE_PAGES) &&
+        (io_class < W25_IO_CLASSES)){
+        sched_slot *slot = claim_slot(sched, sched_op::READ, io_class, page_addr);
+        if (slot == nullptr){
+            err = ESP_ERR_TIMEOUT;
+        }else{
+            slot->column_addr = column_addr;
+            slot->out_buffer = out_buffer;
+            slot->buffer_size = buffer_size;
+            xSemaphoreGive(sched->mutex);
+            xSemaphoreGive(sched->kick);
+
+            (void)xSemaphoreTake(slot->done, portMAX_DELAY); //The buffer belongs to the I/O task until then
+            (void)xSemaphoreTake(sched->mutex, portMAX_DELAY);
+            err = slot->err;
+            free_slot(sched, slot);
+            xSemaphoreGive(sched->mutex);
+            xSemaphoreGive(sched->kick); //A write of the page may have been waiting for the slot
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_SchedWrite(w25_sched_t *sched, w25_io_class io_class, uint16_t column_addr, uint16_t page_addr, const uint8_t *in_buffer, size_t buffer_size){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if ((buffer_size > size_t{0}) && ((size_t{column_addr} + buffer_size) <= W25_PAGE_SIZE) && (page_addr < W25_USABLE_PAGES) &&
+        (io_class < W25_IO_CLASSES)){
+        (void)xSemaphoreTake(sched->mutex, portMAX_DELAY);
+        const bool coalesced = coalesce(sched, io_class, column_addr, page_addr, in_buffer, buffer_size);
+        xSemaphoreGive(sched->mutex);
+
+        err = ESP_OK;
+        if (!coalesced){
+            sched_slot *slot = claim_slot(sched, sched_op::WRITE, io_class, page_addr);
+            if (slot == nullptr){
+                err = ESP_ERR_TIMEOUT;
+            }else{
+                (void)memset(slot->data, 0xFF, W25_PAGE_SIZE);
+                (void)memcpy(&slot->data[column_addr], in_buffer, buffer_size);
+                slot->column_addr = column_addr;
+                slot->buffer_size = buffer_size;
+                xSemaphoreGive(sched->mutex);
+                xSemaphoreGive(sched->kick);
+            }
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_SchedErase(w25_sched_t *sched, w25_io_class io_class, uint16_t page_addr){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if ((page_addr < W25_USABLE_PAGES) && (io_class < W25_IO_CLASSES)){
+        sched_slot *slot = claim_slot(sched, sched_op::ERASE, io_class, page_addr);
+        if (slot == nullptr){
+            err = ESP_ERR_TIMEOUT;
+        }else{
+            xSemaphoreGive(sched->mutex);
+            xSemaphoreGive(sched->kick);
+            err = ESP_OK;
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_SchedSync(w25_sched_t *sched, uint32_t timeout_ms){
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    const EventBits_t bits = xEventGroupWaitBits(sched->events, IDLE_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    if ((bits & IDLE_BIT) != 0U){
+        (void)xSemaphoreTake(sched->mutex, portMAX_DELAY);
+        err = sched->first_err;
+        sched->first_err = ESP_OK;
+        xSemaphoreGive(sched->mutex);
+    }
+    return err;
+}
+
+void w25_SchedGetStats(w25_sched_t *sched, w25_sched_stats_t *stats){
+    (void)xSemaphoreTake(sched->mutex, portMAX_DELAY);
+    *stats = sched->stats;
+    xSemaphoreGive(sched->mutex);
+}
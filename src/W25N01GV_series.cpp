@@ -0,0 +1,472 @@
+#include <string.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_series.h"
+
+/*
+Layout of a frame, one per page:
+    data area   bit stream, MSB first: the first sample raw (32 bits), then for every sample
+                    0                               same bits as the previous sample
+                    1 0 <meaningful bits>           changed bits inside the previous window
+                    1 1 <lead:5> <length-1:5> <bits> new window of length bits after lead zeros
+    spare area  frame_index, programmed with the data
+Pages are filled in order, a block is erased when the head moves into it. Sample numbers keep growing around
+the circle, so the block holding the highest first sample is the head.
+*/
+
+namespace{
+    constexpr uint16_t INDEX_MAGIC = 0x5753U;
+    constexpr uint32_t FRAME_BITS = W25_PAGE_SIZE*8U;
+    constexpr uint32_t NO_SAMPLE = UINT32_MAX; //First sample of an erased block
+    constexpr uint8_t LEAD_BITS = 5U;
+    constexpr uint8_t LENGTH_BITS = 5U;
+
+    struct frame_index{
+        uint16_t magic;
+        uint16_t count;          //Samples in the frame
+        uint32_t first_sample;   //Number of the raw sample that starts it
+        uint16_t bits;           //Length of the bit stream
+        uint16_t reserved;
+        uint32_t crc;            //Fields above and the data bytes
+    };
+    static_assert(sizeof(frame_index) == W25_SPARE_SIZE, "the index takes the application bytes of the spare area");
+
+    //XOR state shared by the encoder and the decoder
+    struct codec{
+        uint32_t previous;
+        uint8_t lead;
+        uint8_t trail;
+        bool window;    //lead and trail describe the window of an earlier sample
+        uint16_t count; //Samples coded so far
+    };
+
+    struct bit_reader{
+        const uint8_t *data;
+        uint32_t position;
+    };
+}
+
+struct w25_series{
+    const winbond_t *w25;
+    w25_series_config_t config;
+    uint32_t *block_first;      //First sample of every block, the RAM index of the frames
+    uint16_t head_block;        //Block of the page the pending frame goes to
+    uint16_t head_page;         //Page within head_block
+    bool head_erased;           //The pages of head_block from head_page on are erased
+    uint8_t *frame;             //DMA capable pending frame
+    uint8_t *scratch;           //DMA capable page decoded by w25_SeriesRead
+    uint32_t frame_bits;
+    uint32_t frame_first;
+    codec encoder;
+    uint32_t next_sample;
+    SemaphoreHandle_t mutex;
+    w25_series_stats_t stats;
+};
+
+static uint32_t float_bits(float sample){
+    uint32_t bits = 0;
+    (void)memcpy(&bits, &sample, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits){
+    float sample = 0.0F;
+    (void)memcpy(&sample, &bits, sizeof(sample));
+    return sample;
+}
+
+static uint8_t leading_zeros(uint32_t value){ //Capped to what fits in LEAD_BITS
+    const uint32_t lead = static_cast<uint32_t>(__builtin_clz(value));
+    return static_cast<uint8_t>((lead > 31U) ? 31U : lead);
+}
+
+static uint8_t trailing_zeros(uint32_t value){
+    return static_cast<uint8_t>(__builtin_ctz(value));
+}
+
+//Bits taken by the next sample, value being its raw bits
+static uint32_t encoded_bits(const codec *state, uint32_t value){
+    uint32_t bits = 32U;
+    if (state->count > 0U){
+        const uint32_t changed = value ^ state->previous;
+        if (changed == 0U){
+            bits = 1U;
+        }else if (state->window && (leading_zeros(changed) >= state->lead) && (trailing_zeros(changed) >= state->trail)){
+            bits = 2U + (32U - state->lead - state->trail);
+        }else{
+            bits = 2U + LEAD_BITS + LENGTH_BITS + (32U - leading_zeros(changed) - trailing_zeros(changed));
+        }
+    }
+    return bits;
+}
+
+static void put_bits(uint8_t *data, uint32_t *position, uint32_t value, uint8_t count){
+    for (uint8_t i = count; i > 0U; i--){
+        if (((value >> (i - 1U)) & 1U) != 0U){
+            data[*position / 8U] |= static_cast<uint8_t>(0x80U >> (*position % 8U));
+        }
+        (*position)++;
+    }
+}
+
+static uint32_t get_bits(bit_reader *reader, uint8_t count){
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < count; i++){
+        const uint32_t bit = (reader->data[reader->position / 8U] >> (7U - (reader->position % 8U))) & 1U;
+        value = (value << 1U) | bit;
+        reader->position++;
+    }
+    return value;
+}
+
+static void encode(codec *state, uint8_t *data, uint32_t *position, uint32_t value){
+    if (state->count == 0U){
+        put_bits(data, position, value, 32U);
+    }else{
+        const uint32_t changed = value ^ state->previous;
+        if (changed == 0U){
+            put_bits(data, position, 0U, 1U);
+        }else if (state->window && (leading_zeros(changed) >= state->lead) && (trailing_zeros(changed) >= state->trail)){
+            put_bits(data, position, 2U, 2U);
+            put_bits(data, position, changed >> state->trail, static_cast<uint8_t>(32U - state->lead - state->trail));
+        }else{
+            state->lead = leading_zeros(changed);
+            state->trail = trailing_zeros(changed);
+            state->window = true;
+            const uint8_t length = static_cast<uint8_t>(32U - state->lead - state->trail);
+            put_bits(data, position, 3U, 2U);
+            put_bits(data, position, state->lead, LEAD_BITS);
+            put_bits(data, position, length - 1U, LENGTH_BITS);
+            put_bits(data, position, changed >> state->trail, length);
+        }
+    }
+    state->previous = value;
+    state->count++;
+}
+
+static uint32_t decode(codec *state, bit_reader *reader){
+    uint32_t value = 0;
+    if (state->count == 0U){
+        value = get_bits(reader, 32U);
+    }else if (get_bits(reader, 1U) == 0U){
+        value = state->previous;
+    }else{
+        if (get_bits(reader, 1U) != 0U){
+            state->lead = static_cast<uint8_t>(get_bits(reader, LEAD_BITS));
+            const uint8_t length = static_cast<uint8_t>(get_bits(reader, LENGTH_BITS) + 1U);
+            state->trail = static_cast<uint8_t>(32U - state->lead - length);
+            state->window = true;
+        }
+        value = state->previous ^ (get_bits(reader, static_cast<uint8_t>(32U - state->lead - state->trail)) << state->trail);
+    }
+    state->previous = value;
+    state->count++;
+    return value;
+}
+
+//Decodes a frame, handing over the samples from first_wanted on. Returns the amount handed over
+static size_t decode_frame(const uint8_t *data, uint32_t frame_first, uint16_t frame_count, uint32_t first_wanted, float *out, size_t count){
+    codec state = {};
+    bit_reader reader = {data, 0};
+    size_t delivered = 0;
+    for (uint32_t sample = frame_first; (sample < (frame_first + frame_count)) && (delivered < count); sample++){
+        const uint32_t value = decode(&state, &reader);
+        if (sample >= first_wanted){
+            out[delivered] = bits_float(value);
+            delivered++;
+        }
+    }
+    return delivered;
+}
+
+static uint32_t index_crc(const frame_index *index, const uint8_t *data){
+    const uint32_t crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(index), static_cast<uint32_t>(offsetof(frame_index, crc)));
+    return esp_rom_crc32_le(crc, data, (uint32_t{index->bits} + 7U) / 8U);
+}
+
+static uint16_t page_addr_of(const w25_series_t *series, uint16_t block, uint16_t page){
+    return static_cast<uint16_t>(((series->config.first_block + block)*W25_PAGES_PER_BLOCK) + page);
+}
+
+static uint16_t next_block(const w25_series_t *series, uint16_t block){
+    return ((block + 1U) == series->config.block_count) ? uint16_t{0} : static_cast<uint16_t>(block + 1U);
+}
+
+//The index of a page, false when the page holds no frame
+static esp_err_t read_index(const w25_series_t *series, uint16_t block, uint16_t page, frame_index *index, bool *valid){
+    uint8_t spare[W25_SPARE_SIZE];
+    esp_err_t err = w25_ReadSpare(series->w25, page_addr_of(series, block, page), spare, sizeof(spare));
+    if (err == ESP_OK){
+        (void)memcpy(index, spare, sizeof(frame_index));
+    }
+    *valid = (err == ESP_OK) && (index->magic == INDEX_MAGIC) && (index->count > 0U) && (index->bits <= FRAME_BITS);
+    return err;
+}
+
+static void start_frame(w25_series_t *series){
+    (void)memset(series->frame, 0, W25_PAGE_SIZE);
+    series->frame_bits = 0;
+    series->frame_first = series->next_sample;
+    series->encoder = codec{};
+}
+
+//Programs the pending frame on the head page, erasing the head block first when the head just moved into it.
+//A page that fails to program is skipped, the frame stays pending for the next one
+static esp_err_t program_frame(w25_series_t *series){
+    esp_err_t err = ESP_OK;
+    if (!series->head_erased){
+        series->block_first[series->head_block] = NO_SAMPLE; //The oldest samples when the series wrapped around
+        err = w25_BlockErase(series->w25, page_addr_of(series, series->head_block, 0), W25_ERASE_TIMEOUT_MS);
+        if (err == ESP_OK){
+            series->head_erased = true;
+            series->stats.erases++;
+        }
+    }
+    if (err == ESP_OK){
+        frame_index index = {INDEX_MAGIC, series->encoder.count, series->frame_first, static_cast<uint16_t>(series->frame_bits), 0xFFFFU, 0};
+        index.crc = index_crc(&index, series->frame);
+        const size_t bytes = (series->frame_bits + 7U) / 8U;
+        uint8_t spare[W25_SPARE_SIZE];
+        (void)memcpy(spare, &index, sizeof(spare));
+
+        err = w25_WriteMemorySpare(series->w25, 0, page_addr_of(series, series->head_block, series->head_page), series->frame, bytes, spare, sizeof(spare));
+        if (err == ESP_OK){
+            if (series->block_first[series->head_block] == NO_SAMPLE){
+                series->block_first[series->head_block] = series->frame_first;
+            }
+            series->stats.frames++;
+            series->stats.encoded_bytes += static_cast<uint32_t>(bytes);
+            start_frame(series);
+        }
+        series->head_page++;
+        if (series->head_page == W25_PAGES_PER_BLOCK){
+            series->head_block = next_block(series, series->head_block);
+            series->head_page = 0;
+            series->head_erased = false;
+        }
+    }
+    return err;
+}
+
+//Builds the block index from the first page of every block, then finds the first free page of the head block
+static esp_err_t scan(w25_series_t *series){
+    esp_err_t err = ESP_OK;
+    frame_index index = {};
+    bool valid = false;
+    bool found = false;
+
+    for (uint16_t block = 0; (block < series->config.block_count) && (err == ESP_OK); block++){
+        err = read_index(series, block, 0, &index, &valid);
+        series->block_first[block] = valid ? index.first_sample : NO_SAMPLE;
+        if (valid && (!found || (index.first_sample > series->block_first[series->head_block]))){
+            series->head_block = block;
+            found = true;
+        }
+    }
+    if ((err == ESP_OK) && found){ //Pages are written in order, the first free one is found by bisection
+        uint16_t low = 1;
+        uint16_t high = W25_PAGES_PER_BLOCK;
+        while ((err == ESP_OK) && (low < high)){
+            const uint16_t middle = static_cast<uint16_t>((low + high) / 2U);
+            err = read_index(series, series->head_block, middle, &index, &valid);
+            if (valid){
+                low = static_cast<uint16_t>(middle + 1U);
+            }else{
+                high = middle;
+            }
+        }
+        frame_index last = {};
+        if (err == ESP_OK){
+            err = read_index(series, series->head_block, static_cast<uint16_t>(low - 1U), &last, &valid);
+        }
+        series->head_page = low;
+        series->next_sample = last.first_sample + last.count;
+        series->head_erased = true;
+        if (series->head_page == W25_PAGES_PER_BLOCK){
+            series->head_block = next_block(series, series->head_block);
+            series->head_page = 0;
+            series->head_erased = false;
+        }
+    }
+    return err;
+}
+
+//Oldest sample kept, on the memory or in the pending frame
+static uint32_t oldest_sample(const w25_series_t *series){
+    uint32_t oldest = (series->encoder.count > 0U) ? series->frame_first : series->next_sample;
+    for (uint16_t block = 0; block < series->config.block_count; block++){
+        if ((series->block_first[block] != NO_SAMPLE) && (series->block_first[block] < oldest)){
+            oldest = series->block_first[block];
+        }
+    }
+    return oldest;
+}
+
+//Page holding sample: the block comes from the RAM index, the page from a bisection over the spare areas
+static esp_err_t locate(const w25_series_t *series, uint32_t sample, uint16_t *block, uint16_t *page){
+    bool found = false;
+    for (uint16_t b = 0; b < series->config.block_count; b++){
+        const uint32_t first = series->block_first[b];
+        if ((first != NO_SAMPLE) && (first <= sample) && (!found || (first > series->block_first[*block]))){
+            *block = b;
+            found = true;
+        }
+    }
+    esp_err_t err = found ? ESP_OK : ESP_ERR_NOT_FOUND;
+    if (err == ESP_OK){
+        uint16_t low = 0; //Its frame starts at or before sample
+        uint16_t high = ((*block == series->head_block) && series->head_erased) ? series->head_page : uint16_t{W25_PAGES_PER_BLOCK};
+        while ((err == ESP_OK) && ((low + 1U) < high)){
+            const uint16_t middle = static_cast<uint16_t>((low + high) / 2U);
+            frame_index index = {};
+            bool valid = false;
+            err = read_index(series, *block, middle, &index, &valid);
+            if (valid && (index.first_sample <= sample)){
+                low = middle;
+            }else{
+                high = middle;
+            }
+        }
+        *page = low;
+    }
+    return err;
+}
+
+esp_err_t w25_SeriesOpen(const winbond_t *w25, const w25_series_config_t *config, w25_series_t **out_series){
+    esp_err_t err = ESP_OK;
+    if ((config->block_count < 2U) || ((uint32_t{config->first_block} + config->block_count) > W25_USABLE_BLOCKS)){
+        err = ESP_ERR_INVALID_ARG;
+    }else{
+        w25_series_t *series = new w25_series_t{};
+        series->w25 = w25;
+        series->config = *config;
+        series->block_first = new uint32_t[config->block_count];
+        series->frame = static_cast<uint8_t *>(heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA));
+        series->scratch = static_cast<uint8_t *>(heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA));
+        series->mutex = xSemaphoreCreateMutex();
+
+        if ((series->frame == nullptr) || (series->scratch == nullptr) || (series->mutex == nullptr)){
+            err = ESP_ERR_NO_MEM;
+        }else{
+            err = scan(series);
+        }
+
+        if (err == ESP_OK){
+            start_frame(series);
+            *out_series = series;
+        }else{
+            if (series->mutex != nullptr){
+                vSemaphoreDelete(series->mutex);
+            }
+            heap_caps_free(series->frame);
+            heap_caps_free(series->scratch);
+            delete[] series->block_first;
+            delete series;
+        }
+    }
+    return err;
+}
+
+esp_err_t w25_SeriesClose(w25_series_t *series){
+    esp_err_t err = w25_SeriesFlush(series);
+    vSemaphoreDelete(series->mutex);
+    heap_caps_free(series->frame);
+    heap_caps_free(series->scratch);
+    delete[] series->block_first;
+    delete series;
+    return err;
+}
+
+esp_err_t w25_SeriesAppend(w25_series_t *series, const float *samples, size_t count){
+    esp_err_t err = ESP_OK;
+    (void)xSemaphoreTake(series->mutex, portMAX_DELAY);
+    for (size_t i = 0; (i < count) && (err == ESP_OK); i++){
+        const uint32_t value = float_bits(samples[i]);
+        if ((series->frame_bits + encoded_bits(&series->encoder, value)) > FRAME_BITS){
+            err = program_frame(series);
+        }
+        if (err == ESP_OK){
+            encode(&series->encoder, series->frame, &series->frame_bits, value);
+            series->next_sample++;
+            series->stats.samples++;
+            series->stats.raw_bytes += static_cast<uint32_t>(sizeof(float));
+        }
+    }
+    xSemaphoreGive(series->mutex);
+    return err;
+}
+
+esp_err_t w25_SeriesFlush(w25_series_t *series){
+    esp_err_t err = ESP_OK;
+    (void)xSemaphoreTake(series->mutex, portMAX_DELAY);
+    if (series->encoder.count > 0U){
+        err = program_frame(series);
+    }
+    xSemaphoreGive(series->mutex);
+    return err;
+}
+
+void w25_SeriesRange(w25_series_t *series, uint32_t *first, uint32_t *end){
+    (void)xSemaphoreTake(series->mutex, portMAX_DELAY);
+    *first = oldest_sample(series);
+    *end = series->next_sample;
+    xSemaphoreGive(series->mutex);
+}
+
+esp_err_t w25_SeriesRead(w25_series_t *series, uint32_t first_sample, float *out, size_t count, size_t *read){
+    esp_err_t err = ESP_OK;
+    size_t delivered = 0;
+    uint32_t sample = first_sample;
+    uint16_t block = 0;
+    uint16_t page = 0;
+
+    (void)xSemaphoreTake(series->mutex, portMAX_DELAY);
+    const uint32_t pending_first = (series->encoder.count > 0U) ? series->frame_first : series->next_sample;
+    if ((first_sample < oldest_sample(series)) || (first_sample >= series->next_sample)){
+        err = ESP_ERR_NOT_FOUND;
+    }else if (first_sample < pending_first){
+        err = locate(series, first_sample, &block, &page);
+    }else{
+        //Straight into the pending frame
+    }
+
+    while ((err == ESP_OK) && (delivered < count) && (sample < pending_first)){
+        frame_index index = {};
+        bool valid = false;
+        err = read_index(series, block, page, &index, &valid);
+        if ((err == ESP_OK) && valid){
+            err = w25_ReadMemory(series->w25, 0, page_addr_of(series, block, page), series->scratch, (uint32_t{index.bits} + 7U) / 8U);
+        }
+        if ((err == ESP_OK) && (!valid || (index.crc != index_crc(&index, series->scratch)))){
+            err = ESP_ERR_INVALID_CRC;
+        }
+        if (err == ESP_OK){
+            delivered += decode_frame(series->scratch, index.first_sample, index.count, sample, &out[delivered], count - delivered);
+            sample = index.first_sample + index.count;
+            page++;
+            if (page == W25_PAGES_PER_BLOCK){
+                block = next_block(series, block);
+                page = 0;
+            }
+        }
+    }
+    if ((err == ESP_OK) && (delivered < count) && (series->encoder.count > 0U) && (sample < series->next_sample)){
+        delivered += decode_frame(series->frame, series->frame_first, series->encoder.count, sample, &out[delivered], count - delivered);
+    }
+    xSemaphoreGive(series->mutex);
+
+    *read = delivered;
+    return err;
+}
+
+void w25_SeriesGetStats(w25_series_t *series, w25_series_stats_t *stats){
+    (void)xSemaphoreTake(series->mutex, portMAX_DELAY);
+    *stats = series->stats;
+    xSemaphoreGive(series->mutex);
+}
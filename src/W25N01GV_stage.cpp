@@ -0,0 +1,66 @@
+#include <string.h>
+#include <time.h>
+#include "esp_err.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_log.h"
+#include "../include/W25N01GV_stage.h"
+
+namespace{
+    constexpr uint32_t STAGE_MAGIC = 0x57325354U;
+}
+
+static uint16_t capacity(const w25_rtc_stage_t *stage){
+    return static_cast<uint16_t>(W25_PAGE_SIZE / stage->record_size);
+}
+
+void w25_StageInit(w25_rtc_stage_t *stage, uint16_t record_size, uint16_t threshold, uint32_t deadline_s){
+    assert((record_size > 0U) && (record_size <= W25_PAGE_SIZE));
+    if ((stage->magic != STAGE_MAGIC) || (stage->record_size != record_size) || (stage->used > W25_PAGE_SIZE)){
+        stage->magic = STAGE_MAGIC; //Cold boot, RTC memory starts zeroed
+        stage->record_size = record_size;
+        stage->used = 0;
+    }
+    stage->threshold = ((threshold == 0U) || (threshold > capacity(stage))) ? capacity(stage) : threshold;
+    stage->deadline_s = deadline_s;
+}
+
+esp_err_t w25_StagePush(w25_rtc_stage_t *stage, const void *record){
+    esp_err_t err = ESP_OK;
+    if ((stage->used + stage->record_size) > W25_PAGE_SIZE){
+        err = ESP_ERR_NO_MEM;
+    }else{
+        if (stage->used == 0U){
+            stage->first_time = time(nullptr);
+        }
+        (void)memcpy(&stage->data[stage->used], record, stage->record_size);
+        stage->used = static_cast<uint16_t>(stage->used + stage->record_size);
+    }
+    return err;
+}
+
+uint16_t w25_StageCount(const w25_rtc_stage_t *stage){
+    return static_cast<uint16_t>(stage->used / stage->record_size);
+}
+
+bool w25_StageCommitDue(const w25_rtc_stage_t *stage){
+    bool due = (w25_StageCount(stage) >= stage->threshold);
+    if (!due && (stage->used > 0U) && (stage->deadline_s > 0U)){
+        due = (difftime(time(nullptr), stage->first_time) >= static_cast<double>(stage->deadline_s));
+    }
+    return due;
+}
+
+esp_err_t w25_StageCommit(w25_rtc_stage_t *stage, w25_log_t *log){
+    esp_err_t err = ESP_OK;
+
+    for (uint16_t committed = 0; (committed < stage->used) && (err == ESP_OK); committed = static_cast<uint16_t>(committed + stage->record_size)){
+        err = w25_LogAppend(log, &stage->data[committed]);
+    }
+    if (err == ESP_OK){
+        err = w25_LogFlush(log);
+    }
+    if (err == ESP_OK){ //Only once they are all programmed, the log's RAM page is lost on a deep sleep or a reset
+        stage->used = 0;
+    }
+    return err;
+}
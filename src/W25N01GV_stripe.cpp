@@ -0,0 +1,199 @@
+#include <string.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "../include/W25N01GV.h"
+#include "../include/W25N01GV_stripe.h"
+
+namespace{
+    constexpr uint32_t STRIPE_TASK_STACK = 3072U;
+
+    enum class stripe_op : uint8_t {
+        READ,
+        WRITE,
+        ERASE,
+        STOP
+    };
+
+    struct stripe_worker{
+        w25_stripe_t *stripe;
+        const winbond_t *w25;
+        size_t index;
+        TaskHandle_t task;
+        SemaphoreHandle_t start;
+        esp_err_t err;
+    };
+}
+
+struct w25_stripe{
+    stripe_worker workers[W25_STRIPE_MAX_CHIPS];
+    size_t count;
+    SemaphoreHandle_t done;  //Given by every worker once its share is over
+    SemaphoreHandle_t mutex; //One transfer at a time
+    //Transfer being run by the workers
+    stripe_op op;
+    uint32_t first;
+    size_t pages;
+    uint8_t *out_buffer;
+    const uint8_t *in_buffer;
+    uint16_t block;
+};
+
+//Runs the share of the transfer that falls on the worker's chip: every count-th page from the first one it holds
+static esp_err_t run_share(const w25_stripe_t *stripe, const stripe_worker *worker){
+    esp_err_t err = ESP_OK;
+    if (stripe->op == stripe_op::ERASE){
+        err = w25_BlockErase(worker->w25, static_cast<uint16_t>(stripe->block*W25_PAGES_PER_BLOCK), W25_ERASE_TIMEOUT_MS);
+    }else{
+        const size_t skip = (worker->index + stripe->count - (stripe->first % stripe->count)) % stripe->count;
+        for (size_t k = skip; (k < stripe->pages) && (err == ESP_OK); k += stripe->count){
+            const uint16_t page_addr = static_cast<uint16_t>((stripe->first + k) / stripe->count);
+            if (stripe->op == stripe_op::READ){
+                err = w25_ReadRange(worker->w25, 0, page_addr, &stripe->out_buffer[k*W25_PAGE_SIZE], W25_PAGE_SIZE);
+            }else{
+                err = w25_WriteRange(worker->w25, 0, page_addr, &stripe->in_buffer[k*W25_PAGE_SIZE], W25_PAGE_SIZE);
+            }
+        }
+    }
+    return err;
+}
+
+static void stripe_task(void *arg){
+    stripe_worker *worker = static_cast<stripe_worker *>(arg);
+    bool running = true;
+
+    while (running){
+        (void)xSemaphoreTake(worker->start, portMAX_DELAY);
+        if (worker->stripe->op == stripe_op::STOP){
+            running = false;
+        }else{
+            worker->err = run_share(worker->stripe, worker);
+        }
+        xSemaphoreGive(worker->stripe->done);
+    }
+    vTaskDelete(nullptr);
+}
+
+//Starts every worker on the transfer set in the stripe and waits for all of them
+static esp_err_t dispatch(w25_stripe_t *stripe){
+    esp_err_t err = ESP_OK;
+    size_t started = 0;
+    for (size_t i = 0; i < stripe->count; i++){
+        if (stripe->workers[i].task != nullptr){
+            stripe->workers[i].err = ESP_OK;
+            xSemaphoreGive(stripe->workers[i].start);
+            started++;
+        }
+    }
+    for (size_t i = 0; i < started; i++){
+        (void)xSemaphoreTake(stripe->done, portMAX_DELAY);
+    }
+    for (size_t i = 0; (i < stripe->count) && (err == ESP_OK); i++){
+        err = stripe->workers[i].err;
+    }
+    return err;
+}
+
+static void free_stripe(w25_stripe_t *stripe){
+    stripe->op = stripe_op::STOP;
+    (void)dispatch(stripe);
+    for (size_t i = 0; i < stripe->count; i++){
+        if (stripe->workers[i].start != nullptr){
+            vSemaphoreDelete(stripe->workers[i].start);
+        }
+    }
+    if (stripe->done != nullptr){
+        vSemaphoreDelete(stripe->done);
+    }
+    if (stripe->mutex != nullptr){
+        vSemaphoreDelete(stripe->mutex);
+    }
+    delete stripe;
+}
+
+esp_err_t w25_StripeCreate(const winbond_t *const *chips, size_t count, unsigned int priority, w25_stripe_t **out_stripe){
+    assert(out_stripe != nullptr);
+    esp_err_t err = ESP_OK;
+    *out_stripe = nullptr;
+
+    if ((count == size_t{0}) || (count > W25_STRIPE_MAX_CHIPS)){
+        err = ESP_ERR_INVALID_ARG;
+    }else{
+        w25_stripe_t *stripe = new w25_stripe_t{};
+        stripe->count = count;
+        stripe->done = xSemaphoreCreateCounting(W25_STRIPE_MAX_CHIPS, 0);
+        stripe->mutex = xSemaphoreCreateMutex();
+        if ((stripe->done == nullptr) || (stripe->mutex == nullptr)){
+            err = ESP_ERR_NO_MEM;
+        }
+
+        for (size_t i = 0; (i < count) && (err == ESP_OK); i++){
+            stripe_worker *worker = &stripe->workers[i];
+            worker->stripe = stripe;
+            worker->w25 = chips[i];
+            worker->index = i;
+            worker->start = xSemaphoreCreateBinary();
+            if ((worker->start == nullptr) ||
+                (xTaskCreate(stripe_task, "w25_stripe", STRIPE_TASK_STACK, worker, priority, &worker->task) != pdPASS)){
+                worker->task = nullptr;
+                err = ESP_ERR_NO_MEM;
+            }
+        }
+
+        if (err == ESP_OK){
+            *out_stripe = stripe;
+        }else{
+            free_stripe(stripe);
+        }
+    }
+    return err;
+}
+
+void w25_StripeDestroy(w25_stripe_t *stripe){
+    free_stripe(stripe);
+}
+
+uint32_t w25_StripeCapacity(const w25_stripe_t *stripe){
+    return W25_USABLE_PAGES*stripe->count;
+}
+
+esp_err_t w25_StripeWritePages(w25_stripe_t *stripe, uint32_t logical_page, const uint8_t *in_buffer, size_t pages){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if ((static_cast<uint64_t>(logical_page) + pages) <= w25_StripeCapacity(stripe)){
+        (void)xSemaphoreTake(stripe->mutex, portMAX_DELAY);
+        stripe->op = stripe_op::WRITE;
+        stripe->first = logical_page;
+        stripe->pages = pages;
+        stripe->in_buffer = in_buffer;
+        err = dispatch(stripe);
+        xSemaphoreGive(stripe->mutex);
+    }
+    return err;
+}
+
+esp_err_t w25_StripeReadPages(w25_stripe_t *stripe, uint32_t logical_page, uint8_t *out_buffer, size_t pages){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if ((static_cast<uint64_t>(logical_page) + pages) <= w25_StripeCapacity(stripe)){
+        (void)xSemaphoreTake(stripe->mutex, portMAX_DELAY);
+        stripe->op = stripe_op::READ;
+        stripe->first = logical_page;
+        stripe->pages = pages;
+        stripe->out_buffer = out_buffer;
+        err = dispatch(stripe);
+        xSemaphoreGive(stripe->mutex);
+    }
+    return err;
+}
+
+esp_err_t w25_StripeBlockErase(w25_stripe_t *stripe, uint16_t block){
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (block < (W25_USABLE_PAGES / W25_PAGES_PER_BLOCK)){
+        (void)xSemaphoreTake(stripe->mutex, portMAX_DELAY);
+        stripe->op = stripe_op::ERASE;
+        stripe->block = block;
+        err = dispatch(stripe);
+        xSemaphoreGive(stripe->mutex);
+    }
+    return err;
+}
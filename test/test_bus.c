@@ -1,10 +1,25 @@
 #include "unity.h"
 #include "W25N01GV.h"
+#include "W25N01GV_cache.h"
+#include "W25N01GV_ftl.h"
+#include "W25N01GV_bbm.h"
+#include "W25N01GV_fs.h"
+#include "W25N01GV_log.h"
+#include "W25N01GV_stage.h"
+#include "W25N01GV_stripe.h"
+#include "W25N01GV_sched.h"
+#include "W25N01GV_pool.h"
+#include "W25N01GV_metrics.h"
+#include "W25N01GV_series.h"
+#include "W25N01GV_kv.h"
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include <string.h>
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 
 #define SIZE 2048
 
@@ -261,4 +276,803 @@ TEST_CASE("Continuous writing, same block", "[]"){
 	TEST_ASSERT_EQUAL_UINT8_ARRAY(second_chunk, second_chunk_RECEIVED, 3);	
 
 
-}
\ No newline at end of file
+}
+
+TEST_CASE("WRITE/READ 1 PAGE ON QUAD BUS", "[]"){
+	uint8_t payload[512] = {0};
+	uint8_t receiver[512] = {0};
+	for (int i = 0; i < 512; i++){
+		payload[i] = (uint8_t)(i*7);
+	}
+
+	TEST_ASSERT_NOT_EQUAL(ESP_OK, w25_SetBusMode(w25, W25_BUS_QUAD)); //The bus is still allocated
+	TEST_ASSERT_EQUAL_INT(ESP_OK, vspi_w25_free_bus(w25));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SetBusMode(w25, W25_BUS_QUAD));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, vspi_w25_alloc_bus(w25));
+
+	esp_err_t err = w25_BlockErase(w25, 0x0000, 20U);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	err = w25_WriteMemory(w25, 0x0000, 0x0000, payload, 512);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	err = w25_ReadMemory(w25, 0x0000, 0x0000, receiver, 512);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(payload, receiver, 512);
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, vspi_w25_free_bus(w25));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SetBusMode(w25, W25_BUS_SINGLE));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, vspi_w25_alloc_bus(w25));
+}
+
+TEST_CASE("CONTINUOUS READ ACROSS PAGES", "[]"){
+	uint8_t first_page_tail[48] = {0};
+	uint8_t second_page_head[48] = {0};
+	uint8_t expected[96] = {0};
+	uint8_t receiver[96] = {0};
+	memset(first_page_tail, 0x5A, 48);
+	memset(second_page_head, 0xC3, 48);
+	memcpy(&expected[0], first_page_tail, 48);
+	memcpy(&expected[48], second_page_head, 48);
+
+	esp_err_t err = w25_BlockErase(w25, 0x0000, 20U);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	err = w25_WriteMemory(w25, 2000, 0x0000, first_page_tail, 48);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	err = w25_WriteMemory(w25, 0x0000, 0x0001, second_page_head, 48);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+
+	err = w25_ReadContinuous(w25, 2000, 0x0000, receiver, 96);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, receiver, 96);
+
+	//Buffer Read Mode must be back after the continuous read
+	TEST_ASSERT_TRUE(w25_evaluateStatusRegisterBit(w25_ReadStatusRegister(w25, CONFIG_REG), BUF));
+	err = w25_ReadMemory(w25, 0x0000, 0x0001, receiver, 48);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(second_page_head, receiver, 48);
+}
+
+TEST_CASE("READ FULL PAGE INTO DMA BUFFER", "[]"){
+	uint8_t *payload = heap_caps_malloc(SIZE, MALLOC_CAP_DMA);
+	uint8_t *receiver = heap_caps_malloc(SIZE, MALLOC_CAP_DMA);
+	TEST_ASSERT_NOT_NULL(payload);
+	TEST_ASSERT_NOT_NULL(receiver);
+	for (int i = 0; i < SIZE; i++){
+		payload[i] = (uint8_t)(i ^ (i >> 8));
+	}
+
+	esp_err_t err = w25_BlockErase(w25, 0x0000, 20U);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	err = w25_WriteMemory(w25, 0x0000, 0x0000, payload, SIZE);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	err = w25_ReadMemory(w25, 0x0000, 0x0000, receiver, SIZE); //Straight into the DMA capable buffer
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(payload, receiver, SIZE);
+
+	err = w25_ReadMemory(w25, 1, 0x0000, &receiver[1], 7); //Unaligned, goes through the internal buffer
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(&payload[1], &receiver[1], 7);
+
+	heap_caps_free(payload);
+	heap_caps_free(receiver);
+}
+
+static void async_page_done(esp_err_t err, uint16_t page_addr, void *arg){
+	(void)page_addr;
+	if (err == ESP_OK){
+		(*(int *)arg)++;
+	}
+}
+
+TEST_CASE("ASYNC PROGRAM/READ 4 PAGES", "[]"){
+	static uint8_t payload[4][256];
+	static uint8_t receiver[4][256];
+	int programmed = 0;
+	int read = 0;
+	for (int page = 0; page < 4; page++){
+		memset(payload[page], 0x10 + page, 256);
+	}
+
+	esp_err_t err = w25_BlockErase(w25, 0x0000, 20U);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_StartAsync(w25, 4, 5));
+
+	for (int page = 0; page < 4; page++){
+		err = w25_ProgramPageAsync(w25, 0x0000, page, payload[page], 256, async_page_done, &programmed);
+		TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	}
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_WaitAsync(w25, 1000));
+	TEST_ASSERT_EQUAL_INT(4, programmed);
+
+	for (int page = 0; page < 4; page++){
+		err = w25_ReadPageAsync(w25, 0x0000, page, receiver[page], 256, async_page_done, &read);
+		TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	}
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_WaitAsync(w25, 1000));
+	TEST_ASSERT_EQUAL_INT(4, read);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(payload, receiver, 4*256);
+
+	//Requests running past the end of the page aren't queued
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, w25_ProgramPageAsync(w25, 2000, 4, payload[0], 256, async_page_done, &programmed));
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, w25_ReadPageAsync(w25, 2000, 4, receiver[0], 256, async_page_done, &read));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_WaitAsync(w25, 1000));
+	TEST_ASSERT_EQUAL_INT(4, programmed);
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_StopAsync(w25));
+}
+
+TEST_CASE("PAGE READ DOESN'T WAIT A WHOLE TICK", "[]"){
+	uint8_t payload[16] = {0};
+	uint8_t receiver[16] = {0};
+	memset(payload, 0x3C, 16);
+
+	esp_err_t err = w25_BlockErase(w25, 0x0000, 20U);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	err = w25_WriteMemory(w25, 0x0000, 0x0000, payload, 16);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+
+	int64_t start = esp_timer_get_time();
+	err = w25_ReadMemory(w25, 0x0000, 0x0000, receiver, 16);
+	int64_t elapsed = esp_timer_get_time() - start;
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(payload, receiver, 16);
+	TEST_ASSERT_LESS_THAN(portTICK_PERIOD_MS*1000, elapsed); //tRD is 25us, polling used to sleep a tick
+}
+
+TEST_CASE("PAGE CACHE READ-THROUGH AND WRITE-BACK", "[cache]"){
+	uint8_t record[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+	uint8_t receiver[8] = {0};
+	uint8_t clean_memory[8] = {0};
+	memset(clean_memory, 0xFF, 8);
+	w25_cache_stats_t stats;
+
+	esp_err_t err = w25_BlockErase(w25, 0x0000, 20U);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+
+	w25_cache_t *cache = w25_CacheCreate(w25, 2, false);
+	TEST_ASSERT_NOT_NULL(cache);
+
+	err = w25_CacheWrite(cache, 100, 0x0000, record, 8);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	err = w25_CacheRead(cache, 100, 0x0000, receiver, 8); //Served from RAM, not programmed yet
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(record, receiver, 8);
+	err = w25_ReadMemory(w25, 100, 0x0000, receiver, 8);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(clean_memory, receiver, 8);
+
+	//Two other pages evict page 0, which is written back
+	err = w25_CacheRead(cache, 0, 0x0001, receiver, 8);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	err = w25_CacheRead(cache, 0, 0x0002, receiver, 8);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	err = w25_ReadMemory(w25, 100, 0x0000, receiver, 8);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(record, receiver, 8);
+
+	w25_CacheGetStats(cache, &stats);
+	TEST_ASSERT_EQUAL_UINT32(1, stats.hits);
+	TEST_ASSERT_EQUAL_UINT32(3, stats.misses);
+	TEST_ASSERT_EQUAL_UINT32(1, stats.evictions);
+	TEST_ASSERT_EQUAL_UINT32(1, stats.write_backs);
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_CacheDestroy(cache));
+}
+
+TEST_CASE("FTL OVERWRITES WITHOUT ERASING AND SURVIVES A REMOUNT", "[ftl]"){
+	w25_ftl_config_t config = W25_FTL_CONFIG_DEFAULT();
+	config.first_block = 900;
+	config.block_count = 8;
+	config.reserved_blocks = 4;
+	w25_ftl_t *ftl = NULL;
+	w25_ftl_stats_t stats;
+	uint8_t *page = heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA);
+	uint8_t *receiver = heap_caps_malloc(W25_PAGE_SIZE, MALLOC_CAP_DMA);
+	TEST_ASSERT_NOT_NULL(page);
+	TEST_ASSERT_NOT_NULL(receiver);
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_FtlMount(w25, &config, &ftl));
+	TEST_ASSERT_EQUAL_UINT16(4 * 61, w25_FtlCapacity(ftl));
+
+	//More writes than physical pages in the range, garbage collection has to run
+	for (uint16_t i = 0; i < 600; i++){
+		memset(page, (uint8_t)i, W25_PAGE_SIZE);
+		TEST_ASSERT_EQUAL_INT(ESP_OK, w25_FtlWrite(ftl, 0, i % 3, page, W25_PAGE_SIZE));
+	}
+	w25_FtlGetStats(ftl, &stats);
+	TEST_ASSERT_EQUAL_UINT32(600, stats.host_writes);
+	TEST_ASSERT_GREATER_THAN_UINT32(0, stats.gc_collections);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_FtlUnmount(ftl));
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_FtlMount(w25, &config, &ftl));
+	for (uint16_t lpn = 0; lpn < 3; lpn++){
+		memset(page, (uint8_t)(597 + lpn), W25_PAGE_SIZE);
+		TEST_ASSERT_EQUAL_INT(ESP_OK, w25_FtlRead(ftl, 0, lpn, receiver, W25_PAGE_SIZE));
+		TEST_ASSERT_EQUAL_HEX8_ARRAY(page, receiver, W25_PAGE_SIZE);
+	}
+	memset(page, 0xFF, W25_PAGE_SIZE);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_FtlRead(ftl, 0, 3, receiver, W25_PAGE_SIZE));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(page, receiver, W25_PAGE_SIZE);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_FtlUnmount(ftl));
+
+	heap_caps_free(page);
+	heap_caps_free(receiver);
+}
+
+TEST_CASE("BAD BLOCK MANAGER CACHES THE LUT", "[bbm]"){
+	w25_bbm_t *bbm = NULL;
+	w25_bbm_entry_t cached[W25_BBM_LUT_SIZE];
+	w25_bbm_entry_t chip[W25_BBM_LUT_SIZE];
+	w25_bbm_stats_t stats;
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_BbmInit(w25, W25_BBM_DEFAULT_SPARE_FIRST, W25_BBM_DEFAULT_SPARE_COUNT, &bbm));
+	w25_BbmGetLut(bbm, cached);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ReadBBMLut(w25, chip));
+	TEST_ASSERT_EQUAL_MEMORY(chip, cached, sizeof(chip));
+
+	//The replacement pool is never handed out
+	TEST_ASSERT_TRUE(w25_BbmIsBad(bbm, W25_BBM_DEFAULT_SPARE_FIRST));
+	TEST_ASSERT_EQUAL_UINT16(W25_BLOCK_COUNT, w25_BbmNextGoodBlock(bbm, W25_BBM_DEFAULT_SPARE_FIRST));
+
+	uint16_t block = w25_BbmNextGoodBlock(bbm, 0);
+	TEST_ASSERT_LESS_THAN_UINT16(W25_BBM_DEFAULT_SPARE_FIRST, block);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_BbmBlockErase(bbm, block * W25_PAGES_PER_BLOCK, 20U));
+
+	w25_BbmGetStats(bbm, &stats);
+	TEST_ASSERT_EQUAL_UINT32(0, stats.swapped);
+	TEST_ASSERT_LESS_OR_EQUAL_UINT32(W25_BBM_LUT_SIZE, stats.lut_free);
+	w25_BbmDeinit(bbm);
+}
+
+TEST_CASE("FATFS ON THE FTL THROUGH THE VFS", "[fs]"){
+	w25_ftl_config_t config = W25_FTL_CONFIG_DEFAULT();
+	config.first_block = 800;
+	config.block_count = 100;
+	config.reserved_blocks = 8;
+	const esp_vfs_fat_mount_config_t mount_config = {
+		.format_if_mount_failed = true,
+		.max_files = 2,
+		.allocation_unit_size = 0
+	};
+	const char text[] = "W25N01GV over FATFS";
+	char receiver[sizeof(text)] = {0};
+	w25_ftl_t *ftl = NULL;
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_FtlMount(w25, &config, &ftl));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_VfsFatMount(ftl, "/w25", &mount_config));
+
+	FILE *file = fopen("/w25/test.txt", "w");
+	TEST_ASSERT_NOT_NULL(file);
+	TEST_ASSERT_EQUAL_size_t(sizeof(text), fwrite(text, 1, sizeof(text), file));
+	TEST_ASSERT_EQUAL_INT(0, fclose(file));
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_VfsFatUnmount(ftl, "/w25"));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_VfsFatMount(ftl, "/w25", &mount_config));
+
+	file = fopen("/w25/test.txt", "r");
+	TEST_ASSERT_NOT_NULL(file);
+	TEST_ASSERT_EQUAL_size_t(sizeof(text), fread(receiver, 1, sizeof(receiver), file));
+	TEST_ASSERT_EQUAL_INT(0, fclose(file));
+	TEST_ASSERT_EQUAL_STRING(text, receiver);
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_VfsFatUnmount(ftl, "/w25"));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_FtlUnmount(ftl));
+}
+
+TEST_CASE("SCATTER-GATHER WRITE/READ ACROSS PAGES", "[batch]"){
+	uint8_t *data = heap_caps_malloc(3*SIZE, MALLOC_CAP_DMA);
+	uint8_t *receiver = heap_caps_malloc(3*SIZE, MALLOC_CAP_DMA);
+	TEST_ASSERT_NOT_NULL(data);
+	TEST_ASSERT_NOT_NULL(receiver);
+	for (size_t i = 0; i < (3*SIZE); i++){
+		data[i] = (uint8_t)(i ^ (i >> 8));
+	}
+
+	esp_err_t err = w25_BlockErase(w25, 0x0140, 20U);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+
+	//The first two segments share page 0x0140, the last one runs over 0x0141 and 0x0142
+	const w25_write_segment_t writes[3] = {
+		{0x0140, 0, data, 100},
+		{0x0140, 100, &data[100], SIZE - 100},
+		{0x0141, 0, &data[SIZE], 2*SIZE},
+	};
+	err = w25_WritePages(w25, writes, 3);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+
+	err = w25_ReadRange(w25, 10, 0x0140, &receiver[10], (3*SIZE) - 10);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(&data[10], &receiver[10], (3*SIZE) - 10);
+
+	err = w25_WriteRange(w25, 0, 1023*64, data, 1);
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, err);
+
+	heap_caps_free(receiver);
+	heap_caps_free(data);
+}
+
+TEST_CASE("APPEND RECORDS WITH PARTIAL PAGE PROGRAMS", "[append]"){
+	uint8_t record[16];
+	uint8_t receiver[4*16] = {0};
+	uint8_t expected[4*16];
+	w25_append_cursor_t cursor = {0x0180, 0, 0};
+
+	esp_err_t err = w25_BlockErase(w25, 0x0180, 20U);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+
+	for (uint8_t i = 0; i < W25_MAX_PARTIAL_PROGRAMS; i++){
+		memset(record, i, sizeof(record));
+		memcpy(&expected[i*16], record, sizeof(record));
+		err = w25_AppendData(w25, &cursor, record, sizeof(record));
+		TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	}
+	TEST_ASSERT_EQUAL_UINT16(0x0180, cursor.page_addr);
+	TEST_ASSERT_EQUAL_UINT16(4*16, cursor.column_addr);
+
+	//The page took every partial program allowed, the next record starts a new page
+	err = w25_AppendData(w25, &cursor, record, sizeof(record));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_UINT16(0x0181, cursor.page_addr);
+	TEST_ASSERT_EQUAL_UINT16(16, cursor.column_addr);
+
+	err = w25_ReadMemory(w25, 0, 0x0180, receiver, sizeof(receiver));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, receiver, sizeof(receiver));
+	err = w25_ReadMemory(w25, 0, 0x0181, receiver, 16);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(record, receiver, 16);
+}
+
+TEST_CASE("CIRCULAR LOG WRAPS AROUND AND RECOVERS ITS HEAD", "[log]"){
+	static w25_log_state_t rtc_state; //Stands for an RTC_DATA_ATTR variable
+	const w25_log_config_t config = {700, 3, 16, 1};
+	const uint32_t records = 4*63*(2048/16); //More than the 3 blocks can hold
+	uint8_t record[16] = {0};
+	w25_log_t *log = NULL;
+	w25_log_stats_t stats;
+	w25_log_reader_t reader;
+
+	memset(&rtc_state, 0, sizeof(rtc_state));
+	esp_err_t err = w25_LogOpen(w25, &config, &rtc_state, &log);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	for (uint32_t i = 0; i < records; i++){
+		memcpy(record, &i, sizeof(i));
+		err = w25_LogAppend(log, record);
+		TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	}
+	w25_LogGetStats(log, &stats);
+	TEST_ASSERT_GREATER_THAN_UINT32(0, stats.reclaimed_blocks);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_LogClose(log));
+
+	//Without the RTC state the head is found by scanning the flash
+	memset(&rtc_state, 0, sizeof(rtc_state));
+	err = w25_LogOpen(w25, &config, &rtc_state, &log);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, err);
+	w25_LogReaderInit(log, &reader);
+	uint32_t expected = UINT32_MAX;
+	uint32_t value = 0;
+	while (w25_LogRead(log, &reader, record) == ESP_OK){
+		memcpy(&value, record, sizeof(value));
+		if (expected != UINT32_MAX){
+			TEST_ASSERT_EQUAL_UINT32(expected, value);
+		}
+		expected = value + 1;
+	}
+	TEST_ASSERT_EQUAL_UINT32(records, expected); //The newest record is the last one read
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_LogClose(log));
+}
+
+TEST_CASE("RTC STAGE COMMITS A BATCH INTO THE LOG", "[stage]"){
+	static w25_rtc_stage_t stage; //Stands for an RTC_DATA_ATTR variable
+	const w25_log_config_t config = {710, 3, sizeof(uint32_t), 1};
+	w25_log_t *log = NULL;
+	w25_log_reader_t reader;
+	uint32_t value = 0;
+
+	memset(&stage, 0, sizeof(stage));
+	w25_StageInit(&stage, sizeof(uint32_t), 8, 0);
+	for (uint32_t i = 0; i < 7; i++){
+		TEST_ASSERT_EQUAL_INT(ESP_OK, w25_StagePush(&stage, &i));
+	}
+	TEST_ASSERT_FALSE(w25_StageCommitDue(&stage));
+
+	//A wake up keeps what was staged before
+	w25_StageInit(&stage, sizeof(uint32_t), 8, 0);
+	TEST_ASSERT_EQUAL_UINT16(7, w25_StageCount(&stage));
+	value = 7;
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_StagePush(&stage, &value));
+	TEST_ASSERT_TRUE(w25_StageCommitDue(&stage));
+
+	for (uint16_t block = 710; block < 713; block++){ //An empty log, so the batch is all it holds
+		TEST_ASSERT_EQUAL_INT(ESP_OK, w25_BlockErase(w25, block*W25_PAGES_PER_BLOCK, 20U));
+	}
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_LogOpen(w25, &config, NULL, &log));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_StageCommit(&stage, log));
+	TEST_ASSERT_EQUAL_UINT16(0, w25_StageCount(&stage));
+
+	w25_LogReaderInit(log, &reader);
+	for (uint32_t i = 0; i < 8; i++){
+		TEST_ASSERT_EQUAL_INT(ESP_OK, w25_LogRead(log, &reader, &value));
+		TEST_ASSERT_EQUAL_UINT32(i, value);
+	}
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_LogClose(log));
+}
+
+TEST_CASE("CONFIGURED INSTANCE REJECTS QUAD WITHOUT WP AND HOLD", "[init denit]"){
+	w25_config_t config = W25_CONFIG_DEFAULT();
+	config.host = HSPI_HOST;
+	config.mosi = GPIO_NUM_13;
+	config.miso = GPIO_NUM_12;
+	config.sclk = GPIO_NUM_14;
+	config.cs = GPIO_NUM_15;
+	config.hold = GPIO_NUM_NC;
+	config.wp = GPIO_NUM_NC;
+
+	winbond_t *second = w25_Create(&config);
+	TEST_ASSERT_NOT_NULL(second);
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, w25_SetBusMode(second, W25_BUS_QUAD));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SetBusMode(second, W25_BUS_DUAL));
+
+	//The second host is set up next to the one of the test memory
+	TEST_ASSERT_EQUAL_INT(ESP_OK, vspi_w25_alloc_bus(second));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, vspi_w25_free_bus(second));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, deinit_w25_struct(second));
+}
+
+TEST_CASE("STRIPE SPREADS PAGES OVER ITS CHIPS", "[stripe]"){
+	const winbond_t *chips[1] = {w25}; //A single memory on the test board, the stripe still runs on its worker
+	w25_stripe_t *stripe = NULL;
+	uint8_t *data = heap_caps_malloc(2*SIZE, MALLOC_CAP_DMA);
+	uint8_t *receiver = heap_caps_malloc(2*SIZE, MALLOC_CAP_DMA);
+	TEST_ASSERT_NOT_NULL(data);
+	TEST_ASSERT_NOT_NULL(receiver);
+	for (size_t i = 0; i < (2*SIZE); i++){
+		data[i] = (uint8_t)(i*7U);
+	}
+
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, w25_StripeCreate(chips, 0, 5, &stripe));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_StripeCreate(chips, 1, 5, &stripe));
+	TEST_ASSERT_EQUAL_UINT32(65472, w25_StripeCapacity(stripe));
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_StripeBlockErase(stripe, 720));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_StripeWritePages(stripe, 720*64, data, 2));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_StripeReadPages(stripe, 720*64, receiver, 2));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(data, receiver, 2*SIZE);
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, w25_StripeReadPages(stripe, 65471, receiver, 2));
+
+	w25_StripeDestroy(stripe);
+	heap_caps_free(receiver);
+	heap_caps_free(data);
+}
+
+typedef struct {
+	uint16_t page_addr;
+	uint8_t seed;
+	esp_err_t err;
+	bool match;
+	SemaphoreHandle_t done;
+} lock_worker_t;
+
+static void lock_worker(void *arg){
+	lock_worker_t *worker = (lock_worker_t *)arg;
+	uint8_t data[64];
+	uint8_t receiver[64];
+	worker->err = ESP_OK;
+	worker->match = true;
+	for (uint8_t round = 0; (round < 8U) && (worker->err == ESP_OK); round++){
+		for (size_t i = 0; i < sizeof(data); i++){
+			data[i] = (uint8_t)(worker->seed + round + i);
+		}
+		uint16_t page_addr = (uint16_t)(worker->page_addr + 2U*round); //The two workers take turns on the pages
+		worker->err = w25_WriteMemory(w25, 0, page_addr, data, sizeof(data));
+		if (worker->err == ESP_OK){
+			worker->err = w25_ReadMemory(w25, 0, page_addr, receiver, sizeof(receiver));
+		}
+		worker->match = worker->match && (memcmp(data, receiver, sizeof(data)) == 0);
+	}
+	xSemaphoreGive(worker->done);
+	vTaskDelete(NULL);
+}
+
+TEST_CASE("CONCURRENT TASKS KEEP THEIR OPERATIONS WHOLE", "[lock]"){
+	lock_worker_t workers[2] = {
+		{.page_addr = 730*64, .seed = 0x11},
+		{.page_addr = 730*64 + 1, .seed = 0x80},
+	};
+	SemaphoreHandle_t done = xSemaphoreCreateCounting(2, 0);
+	TEST_ASSERT_NOT_NULL(done);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_BlockErase(w25, 730*64, 20U));
+
+	for (size_t i = 0; i < 2; i++){
+		workers[i].done = done;
+		TEST_ASSERT_EQUAL_INT(pdPASS, xTaskCreate(lock_worker, "lock_worker", 3072, &workers[i], 5, NULL));
+	}
+	for (size_t i = 0; i < 2; i++){
+		TEST_ASSERT_EQUAL_INT(pdTRUE, xSemaphoreTake(done, pdMS_TO_TICKS(5000)));
+	}
+	for (size_t i = 0; i < 2; i++){
+		TEST_ASSERT_EQUAL_INT(ESP_OK, workers[i].err);
+		TEST_ASSERT_TRUE(workers[i].match);
+	}
+
+	//The holder nests its own calls, a load and a random load end up in the same program
+	uint8_t head[4] = {1, 2, 3, 4};
+	uint8_t tail[4] = {5, 6, 7, 8};
+	uint8_t receiver[8] = {0};
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_Lock(w25));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_LoadProgramData(w25, 0, head, sizeof(head)));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_RandomLoadProgramData(w25, 4, tail, sizeof(tail)));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ProgramExecute(w25, 730*64 + 20, 20U));
+	w25_Unlock(w25);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ReadMemory(w25, 0, 730*64 + 20, receiver, sizeof(receiver)));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(head, receiver, sizeof(head));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(tail, &receiver[4], sizeof(tail));
+
+	vSemaphoreDelete(done);
+}
+
+typedef struct {
+	w25_sched_t *sched;
+	uint16_t page_addr;
+	uint8_t receiver[16];
+	esp_err_t err;
+	SemaphoreHandle_t done;
+} sched_reader_t;
+
+static void sched_reader(void *arg){
+	sched_reader_t *reader = (sched_reader_t *)arg;
+	reader->err = w25_SchedRead(reader->sched, W25_IO_NORMAL, 0, reader->page_addr, reader->receiver, sizeof(reader->receiver));
+	xSemaphoreGive(reader->done);
+	vTaskDelete(NULL);
+}
+
+TEST_CASE("SCHEDULER KEEPS PAGE ORDER, MERGES READS AND COALESCES WRITES", "[sched]"){
+	w25_sched_t *sched = NULL;
+	w25_sched_stats_t stats;
+	uint8_t first[16];
+	uint8_t second[16];
+	uint8_t receiver[32];
+	sched_reader_t readers[2] = {
+		{.page_addr = 741*64},
+		{.page_addr = 741*64 + 1},
+	};
+	SemaphoreHandle_t done = xSemaphoreCreateCounting(2, 0);
+	TEST_ASSERT_NOT_NULL(done);
+	memset(first, 0x3C, sizeof(first));
+	memset(second, 0xA5, sizeof(second));
+
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, w25_SchedCreate(w25, 0, 5, &sched));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SchedCreate(w25, 8, 5, &sched));
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, w25_SchedWrite(sched, W25_IO_BACKGROUND, 2040, 740*64, first, sizeof(first)));
+
+	//The memory is held, so nothing is served until every request is queued: the writes wait behind the erase
+	//of their block, the second one is folded into the first, and the reads of adjacent pages are served together
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_Lock(w25));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SchedErase(sched, W25_IO_BACKGROUND, 740*64));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SchedWrite(sched, W25_IO_BACKGROUND, 0, 740*64, first, sizeof(first)));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SchedWrite(sched, W25_IO_BACKGROUND, 16, 740*64, second, sizeof(second)));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SchedWrite(sched, W25_IO_BACKGROUND, 0, 740*64 + 1, second, sizeof(second)));
+	for (size_t i = 0; i < 2; i++){
+		readers[i].sched = sched;
+		readers[i].done = done;
+		TEST_ASSERT_EQUAL_INT(pdPASS, xTaskCreate(sched_reader, "sched_reader", 3072, &readers[i], 5, NULL));
+	}
+	vTaskDelay(pdMS_TO_TICKS(10)); //Both reads are queued by then
+	w25_Unlock(w25);
+
+	//The urgent read can't overtake the writes of its page
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SchedRead(sched, W25_IO_URGENT, 0, 740*64, receiver, sizeof(receiver)));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(first, receiver, sizeof(first));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(second, &receiver[16], sizeof(second));
+	for (size_t i = 0; i < 2; i++){
+		TEST_ASSERT_EQUAL_INT(pdTRUE, xSemaphoreTake(done, pdMS_TO_TICKS(1000)));
+		TEST_ASSERT_EQUAL_INT(ESP_OK, readers[i].err);
+	}
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SchedSync(sched, 1000));
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SchedRead(sched, W25_IO_NORMAL, 0, 740*64 + 1, receiver, sizeof(second)));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(second, receiver, sizeof(second));
+
+	w25_SchedGetStats(sched, &stats);
+	TEST_ASSERT_EQUAL_UINT32(1, stats.coalesced_writes);
+	TEST_ASSERT_EQUAL_UINT32(1, stats.merged_reads);
+	TEST_ASSERT_EQUAL_UINT32(1, stats.latency[W25_IO_URGENT].requests);
+	TEST_ASSERT_EQUAL_UINT32(3, stats.latency[W25_IO_NORMAL].requests);
+	TEST_ASSERT_EQUAL_UINT32(3, stats.latency[W25_IO_BACKGROUND].requests); //The erase and two programs
+	TEST_ASSERT_LESS_THAN_UINT32(20000, stats.latency[W25_IO_URGENT].max_us); //Behind the erase (10ms max) and the writes only
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SchedDestroy(sched));
+	vSemaphoreDelete(done);
+}
+
+TEST_CASE("POOL HANDS OUT ERASED BLOCKS AND RECLAIMS THEM", "[pool]"){
+	w25_pool_config_t config = {.first_block = 750, .block_count = 4, .low_water = 2, .target = 0};
+	w25_pool_t *pool = NULL;
+	w25_pool_stats_t stats;
+	uint16_t block = 0;
+	uint8_t data[16];
+	uint8_t receiver[16];
+	memset(data, 0x5A, sizeof(data));
+
+	config.low_water = 5;
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, w25_PoolCreate(w25, &config, 1, &pool));
+	config.low_water = 2;
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_PoolCreate(w25, &config, 1, &pool));
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_PoolTake(pool, &block, 1000));
+	TEST_ASSERT_TRUE((block >= 750) && (block < 754));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ReadMemory(w25, 0, block*64, receiver, sizeof(receiver)));
+	for (size_t i = 0; i < sizeof(receiver); i++){
+		TEST_ASSERT_EQUAL_HEX8(0xFF, receiver[i]);
+	}
+	//Written without erasing first, then handed back dirty
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_WriteMemory(w25, 0, block*64, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, w25_PoolRelease(pool, 749));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_PoolRelease(pool, block));
+
+	//Draining the pool brings the released block back erased
+	for (size_t i = 0; i < 4; i++){
+		TEST_ASSERT_EQUAL_INT(ESP_OK, w25_PoolTake(pool, &block, 1000));
+	}
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ReadMemory(w25, 0, block*64, receiver, sizeof(receiver)));
+	for (size_t i = 0; i < sizeof(receiver); i++){
+		TEST_ASSERT_EQUAL_HEX8(0xFF, receiver[i]);
+	}
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_TIMEOUT, w25_PoolTake(pool, &block, 50));
+
+	w25_PoolGetStats(pool, &stats);
+	TEST_ASSERT_EQUAL_UINT32(5, stats.takes);
+	TEST_ASSERT_EQUAL_UINT32(5, stats.erases);
+	TEST_ASSERT_TRUE(stats.dry >= 1);
+	w25_PoolDestroy(pool);
+}
+
+TEST_CASE("METRICS ACCOUNT A PAGE READ AND DUMP AS JSON", "[metrics]"){
+	static w25_metrics_t metrics;
+	static char json[2048];
+	uint8_t receiver[16];
+
+#if W25_METRICS_ENABLED
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ResetMetrics(w25));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ReadMemory(w25, 0, 0, receiver, sizeof(receiver)));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_GetMetrics(w25, &metrics));
+	TEST_ASSERT_EQUAL_UINT32(1, metrics.opcodes[0x13]); //Page Data Read
+	TEST_ASSERT_EQUAL_UINT32(1, metrics.latency[W25_LAT_PAGE_READ].count);
+	TEST_ASSERT_TRUE(metrics.data_bytes >= sizeof(receiver));
+#else
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_SUPPORTED, w25_GetMetrics(w25, &metrics));
+	(void)receiver;
+	memset(&metrics, 0, sizeof(metrics));
+	metrics.opcodes[0x13] = 1;
+#endif
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_MetricsToJson(&metrics, json, sizeof(json)));
+	TEST_ASSERT_NOT_NULL(strstr(json, "\"0x13\":1"));
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, w25_MetricsToJson(&metrics, json, 16));
+}
+
+TEST_CASE("READ REPORTS THE ECC STATUS FROM THE BUSY POLL", "[ecc]"){
+	uint8_t data[32];
+	uint8_t receiver[32];
+	w25_ecc_status ecc = W25_ECC_MULTI_PAGE;
+	uint16_t failed_page = 0;
+	memset(data, 0xC3, sizeof(data));
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_BlockErase(w25, 760*64, 20));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_WriteMemory(w25, 0, 760*64, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ReadMemoryECC(w25, 0, 760*64, receiver, sizeof(receiver), &ecc));
+	TEST_ASSERT_EQUAL_INT(W25_ECC_CLEAN, ecc);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(data, receiver, sizeof(receiver));
+
+	ecc = W25_ECC_MULTI_PAGE;
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ReadContinuousECC(w25, 0, 760*64, receiver, sizeof(receiver), &ecc));
+	TEST_ASSERT_EQUAL_INT(W25_ECC_CLEAN, ecc);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(data, receiver, sizeof(receiver));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_LastECCFailure(w25, &failed_page, 20));
+}
+
+TEST_CASE("SPARE BYTES ARE PROGRAMMED WITH THE PAGE", "[spare]"){
+	uint8_t data[64];
+	uint8_t spare[W25_SPARE_SIZE];
+	uint8_t receiver[W25_SPARE_SIZE];
+	bool bad = true;
+	for (size_t i = 0; i < sizeof(spare); i++){
+		spare[i] = (uint8_t)(0xA0 + i);
+	}
+	memset(data, 0x3C, sizeof(data));
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_BlockErase(w25, 761*64, 20));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_WriteMemorySpare(w25, 0, 761*64, data, sizeof(data), spare, sizeof(spare)));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ReadSpare(w25, 761*64, receiver, sizeof(receiver)));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(spare, receiver, sizeof(receiver));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ReadMemory(w25, 0, 761*64, receiver, sizeof(receiver)));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(data, receiver, sizeof(receiver));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_IsBadBlock(w25, 761, &bad));
+	TEST_ASSERT_FALSE(bad);
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, w25_ReadSpare(w25, 761*64, receiver, W25_SPARE_SIZE + 1));
+}
+
+TEST_CASE("CLOCK CALIBRATION KEEPS A WORKING CLOCK", "[clock]"){
+	uint8_t data[32];
+	uint8_t receiver[32];
+	uint32_t clock_hz = 0;
+	memset(data, 0x96, sizeof(data));
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_CalibrateClock(w25, 80000000, &clock_hz));
+	TEST_ASSERT_TRUE((clock_hz >= 8000000) && (clock_hz <= 80000000));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_BlockErase(w25, 762*64, 20));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_WriteMemory(w25, 0, 762*64, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_ReadMemory(w25, 0, 762*64, receiver, sizeof(receiver)));
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(data, receiver, sizeof(receiver));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SetClock(w25, 8000000, 0)); //Back to the default for the next tests
+}
+
+TEST_CASE("SERIES COMPRESSES SAMPLES AND READS THEM BACK", "[series]"){
+	static float samples[2000];
+	static float receiver[2000];
+	const w25_series_config_t config = {770, 2};
+	w25_series_t *series = NULL;
+	w25_series_stats_t stats;
+	size_t read = 0;
+	uint32_t first = 0;
+	uint32_t end = 0;
+	for (size_t i = 0; i < 2000; i++){
+		samples[i] = 21.0f + (float)((int)((i / 7) % 300) - 150)*0.01f;
+	}
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_BlockErase(w25, 770*64, 20));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_BlockErase(w25, 771*64, 20));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SeriesOpen(w25, &config, &series));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SeriesAppend(series, samples, 2000));
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SeriesClose(series));
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SeriesOpen(w25, &config, &series));
+	w25_SeriesRange(series, &first, &end);
+	TEST_ASSERT_EQUAL_UINT32(0, first);
+	TEST_ASSERT_EQUAL_UINT32(2000, end);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SeriesRead(series, 500, receiver, 2000, &read));
+	TEST_ASSERT_EQUAL_UINT32(1500, read);
+	TEST_ASSERT_EQUAL_MEMORY(&samples[500], receiver, 1500*sizeof(float));
+	w25_SeriesGetStats(series, &stats);
+	TEST_ASSERT_EQUAL_UINT32(0, stats.frames); //Nothing appended since it was reopened
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_SeriesClose(series));
+}
+
+TEST_CASE("KV STORE KEEPS THE LAST VALUE OF EVERY KEY", "[kv]"){
+	const w25_kv_config_t config = {780, 3, 32};
+	static uint32_t value[50]; //200 bytes, value[0] being the version
+	w25_kv_t *kv = NULL;
+	w25_kv_stats_t stats;
+	char key[16];
+	size_t size = 0;
+	uint32_t reads = 0;
+
+	for (uint16_t block = 780; block < 783; block++){
+		TEST_ASSERT_EQUAL_INT(ESP_OK, w25_BlockErase(w25, block*64, 20));
+	}
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_KvOpen(w25, &config, &kv));
+	for (uint32_t i = 0; i < 2000; i++){ //About 3.5 blocks of entries, the oldest blocks get compacted
+		snprintf(key, sizeof(key), "counter%u", (unsigned int)(i % 16));
+		value[0] = i;
+		TEST_ASSERT_EQUAL_INT(ESP_OK, w25_KvPut(kv, key, value, sizeof(value)));
+		if ((i % 50) == 0){
+			TEST_ASSERT_EQUAL_INT(ESP_OK, w25_KvSync(kv));
+		}
+	}
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_KvDelete(kv, "counter0"));
+	w25_KvGetStats(kv, &stats);
+	TEST_ASSERT_GREATER_THAN_UINT32(0, stats.compactions);
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_KvClose(kv));
+
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_KvOpen(w25, &config, &kv));
+	w25_KvGetStats(kv, &stats);
+	reads = stats.entry_reads;
+	TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_FOUND, w25_KvGet(kv, "counter0", value, sizeof(value), &size));
+	for (uint32_t n = 1; n < 16; n++){
+		snprintf(key, sizeof(key), "counter%u", (unsigned int)n);
+		TEST_ASSERT_EQUAL_INT(ESP_OK, w25_KvGet(kv, key, value, sizeof(value), &size));
+		TEST_ASSERT_EQUAL_UINT32(sizeof(value), size);
+		TEST_ASSERT_EQUAL_UINT32(1984 + n, value[0]);
+	}
+	w25_KvGetStats(kv, &stats);
+	TEST_ASSERT_EQUAL_UINT32(15, stats.keys);
+	TEST_ASSERT_EQUAL_UINT32(reads + 15, stats.entry_reads); //One read per get
+	TEST_ASSERT_EQUAL_INT(ESP_OK, w25_KvClose(kv));
+}